@@ -48,7 +48,7 @@ public:
   tN2kCANMsg()
     : Ready(false),FreeMsg(true),SystemMessage(false), KnownMessage(false) 
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-      ,TPRequireCTS(false), TPMaxPackets(0) 
+      ,TPRequireCTS(false), TPMaxPackets(0), LargeMsg(0) 
 #endif
     {
 	  N2kMsg.Clear();
@@ -69,12 +69,15 @@ public:
   unsigned char TPRequireCTS; 
   /** \brief =0 not TP message. >0 number of packets can be received  */
   unsigned char TPMaxPackets; 
+  /** \brief Message from large message pool, if TP message is longer than
+   *         \ref tN2kMsg::MaxDataLen. Otherwise 0.*/
+  tN2kLargeMsg *LargeMsg;
 #endif
   /** \brief  Last received frame sequence number on fast 
    *          packets or multi packet  */
   unsigned char LastFrame; // 
   /** \brief  Length of copied bytes */
-  unsigned char CopiedLen;
+  uint16_t CopiedLen;
   
 public:
   /************************************************************************//**
@@ -87,9 +90,23 @@ public:
     FreeMsg=true; Ready=false; SystemMessage=false; 
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
     TPMaxPackets=0; TPRequireCTS=false; 
+    if ( LargeMsg!=0 ) { LargeMsg->Clear(); LargeMsg=0; } // Return to pool
 #endif
     N2kMsg.Clear(); N2kMsg.Source=0; 
   }  
+
+  /************************************************************************//**
+   * \brief Get received message
+   *
+   * \return Reference to large message, if message has been received to it.
+   *         Otherwise \ref N2kMsg
+   */
+  const tN2kMsg &GetN2kMsg() const {
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+    if ( LargeMsg!=0 ) return *LargeMsg;
+#endif
+    return N2kMsg;
+  }
 };
 
 #endif
@@ -0,0 +1,571 @@
+/*
+ * N2kFrameLog.cpp
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "N2kFrameLog.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define FileHeaderSize 16
+#define BlockHeaderSize 36
+#define SegmentHeaderSize 8
+#define IndexHeaderSize 16
+#define IndexEntrySize 32
+#define TrailerSize 16
+#define MaxEncodedRecordSize (1+2+N2kFrameLogRecordSize)
+#define TimeSyncLen 0x0f
+#define MaxTimeDelta 0x0fffffff
+#define TxFlag 0x80000000UL
+
+static const char FileMagic[8]={'N','2','K','F','L','O','G','1'};
+static const char BlockMagic[4]={'N','2','K','B'};
+static const char IndexMagic[4]={'N','2','K','I'};
+static const char TrailerMagic[4]={'N','2','K','T'};
+
+//*****************************************************************************
+static inline void SetLE16(unsigned char *p, uint16_t v) {
+  p[0]=v; p[1]=v>>8;
+}
+
+//*****************************************************************************
+static inline void SetLE32(unsigned char *p, uint32_t v) {
+  p[0]=v; p[1]=v>>8; p[2]=v>>16; p[3]=v>>24;
+}
+
+//*****************************************************************************
+static inline void SetLE64(unsigned char *p, uint64_t v) {
+  SetLE32(p,(uint32_t)v); SetLE32(p+4,(uint32_t)(v>>32));
+}
+
+//*****************************************************************************
+static inline uint16_t GetLE16(const unsigned char *p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1]<<8);
+}
+
+//*****************************************************************************
+static inline uint32_t GetLE32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+//*****************************************************************************
+static inline uint64_t GetLE64(const unsigned char *p) {
+  return (uint64_t)GetLE32(p) | ((uint64_t)GetLE32(p+4)<<32);
+}
+
+//*****************************************************************************
+static inline uint8_t CacheSlot(const unsigned char *Record) {
+  return (uint8_t)((GetLE32(Record+4)*0x9E3779B1UL) >> 27) & (N2kFrameLogCacheSlots-1);
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::IsFrameLog(const unsigned char *Buf, size_t Size) {
+  return Buf!=0 && Size>=FileHeaderSize && memcmp(Buf,FileMagic,sizeof(FileMagic))==0;
+}
+
+//*****************************************************************************
+unsigned long tN2kFrameLogReader::GetPGN(unsigned long id) {
+  unsigned char PF=(unsigned char)(id>>16);
+  unsigned long PGN=(((id>>24) & 1UL)<<16) | ((unsigned long)PF<<8);
+
+  if ( PF>=240 ) PGN|=(unsigned char)(id>>8);
+
+  return PGN;
+}
+
+//*****************************************************************************
+uint64_t tN2kFrameLogReader::PGNFilterBits(unsigned long PGN) {
+  uint32_t h=(uint32_t)PGN*0x9E3779B1UL;
+  return (1ULL<<(h>>26)) | (1ULL<<((h>>20) & 63));
+}
+
+//*****************************************************************************
+tN2kFrameLogWriter::tN2kFrameLogWriter(N2kStream *_Stream, uint16_t _BlockSize, uint16_t _MaxIndexEntries) {
+  Stream=_Stream;
+  Offset=0;
+  IsOpen=false;
+  Block=0;
+  BlockSize=(_BlockSize<4*MaxEncodedRecordSize?4*MaxEncodedRecordSize:_BlockSize);
+  BlockLen=0;
+  BlockRecords=0;
+  BlockFirstTime=0;
+  BlockLastTime=0;
+  BlockPGNFilter=0;
+  Index=0;
+  MaxIndexEntries=_MaxIndexEntries;
+  IndexEntries=0;
+  LastIndexOffset=0;
+  FrameCount=0;
+}
+
+//*****************************************************************************
+tN2kFrameLogWriter::~tN2kFrameLogWriter() {
+  delete[] Block;
+  delete[] Index;
+}
+
+//*****************************************************************************
+void tN2kFrameLogWriter::Write(const unsigned char *Buf, size_t Len) {
+  Stream->write(Buf,Len);
+  Offset+=Len;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogWriter::Open(uint64_t StartTime) {
+  if ( Stream==0 ) return false;
+  if ( IsOpen ) Close();
+
+  if ( Block==0 ) Block=new unsigned char[BlockSize];
+  if ( Index==0 && MaxIndexEntries>0 ) Index=new unsigned char[MaxIndexEntries*IndexEntrySize];
+
+  unsigned char Header[FileHeaderSize];
+  memcpy(Header,FileMagic,sizeof(FileMagic));
+  SetLE64(Header+8,StartTime);
+  Offset=0;
+  Write(Header,FileHeaderSize);
+
+  BlockLen=0;
+  BlockRecords=0;
+  IndexEntries=0;
+  LastIndexOffset=0;
+  FrameCount=0;
+  IsOpen=true;
+
+  return true;
+}
+
+//*****************************************************************************
+void tN2kFrameLogWriter::AddRecord(const unsigned char *Record) {
+  uint8_t Slot=CacheSlot(Record);
+  unsigned char *Ref=Cache[Slot];
+  uint16_t Mask=0;
+  uint16_t MaskPos;
+
+  Block[BlockLen++]=Slot;
+  MaskPos=BlockLen;
+  BlockLen+=2;
+  for (uint8_t i=0; i<N2kFrameLogRecordSize; i++) {
+    if ( Record[i]!=Ref[i] ) {
+      Mask|=(1<<i);
+      Block[BlockLen++]=Record[i];
+      Ref[i]=Record[i];
+    }
+  }
+  SetLE16(Block+MaskPos,Mask);
+  BlockRecords++;
+}
+
+//*****************************************************************************
+void tN2kFrameLogWriter::WriteFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool Tx, uint64_t FrameTime) {
+  unsigned char Record[N2kFrameLogRecordSize];
+
+  if ( !IsOpen ) return;
+  if ( len>8 ) len=8;
+
+  // Keep room for time sync and frame record
+  if ( BlockRecords>0 && ( BlockLen+2*MaxEncodedRecordSize>BlockSize || BlockRecords>=0xfffe ) ) Flush();
+
+  if ( BlockRecords==0 ) {
+    memset(Cache,0,sizeof(Cache));
+    BlockFirstTime=FrameTime;
+    BlockLastTime=FrameTime;
+    BlockPGNFilter=0;
+  }
+  if ( FrameTime<BlockLastTime ) FrameTime=BlockLastTime;
+
+  uint64_t Delta=FrameTime-BlockLastTime;
+  memset(Record,0,sizeof(Record));
+  if ( Delta>MaxTimeDelta ) {
+    SetLE32(Record,(uint32_t)TimeSyncLen<<28);
+    SetLE64(Record+8,FrameTime);
+    AddRecord(Record);
+    memset(Record,0,sizeof(Record));
+    Delta=0;
+  }
+
+  SetLE32(Record,(uint32_t)Delta | ((uint32_t)len<<28));
+  SetLE32(Record+4,(id & 0x1fffffff) | (Tx?TxFlag:0));
+  memcpy(Record+8,buf,len);
+  AddRecord(Record);
+
+  BlockLastTime=FrameTime;
+  BlockPGNFilter|=tN2kFrameLogReader::PGNFilterBits(tN2kFrameLogReader::GetPGN(id));
+  FrameCount++;
+}
+
+//*****************************************************************************
+void tN2kFrameLogWriter::Flush() {
+  if ( !IsOpen || BlockRecords==0 ) return;
+
+  unsigned char Header[BlockHeaderSize];
+  uint64_t BlockOffset=Offset;
+
+  memcpy(Header,BlockMagic,sizeof(BlockMagic));
+  SetLE32(Header+4,BlockLen);
+  SetLE16(Header+8,BlockRecords);
+  SetLE16(Header+10,0);
+  SetLE64(Header+12,BlockFirstTime);
+  SetLE64(Header+20,BlockLastTime);
+  SetLE64(Header+28,BlockPGNFilter);
+  Write(Header,BlockHeaderSize);
+  Write(Block,BlockLen);
+
+  if ( Index!=0 ) {
+    unsigned char *Entry=Index+IndexEntries*IndexEntrySize;
+    SetLE64(Entry,BlockOffset);
+    SetLE64(Entry+8,BlockFirstTime);
+    SetLE64(Entry+16,BlockLastTime);
+    SetLE64(Entry+24,BlockPGNFilter);
+    IndexEntries++;
+    if ( IndexEntries>=MaxIndexEntries ) WriteIndex();
+  }
+
+  BlockLen=0;
+  BlockRecords=0;
+}
+
+//*****************************************************************************
+void tN2kFrameLogWriter::WriteIndex() {
+  if ( IndexEntries==0 ) return;
+
+  unsigned char Header[SegmentHeaderSize+IndexHeaderSize];
+  uint64_t IndexOffset=Offset;
+
+  memcpy(Header,IndexMagic,sizeof(IndexMagic));
+  SetLE32(Header+4,IndexHeaderSize+IndexEntries*IndexEntrySize);
+  SetLE64(Header+8,LastIndexOffset);
+  SetLE32(Header+16,IndexEntries);
+  SetLE32(Header+20,0);
+  Write(Header,sizeof(Header));
+  Write(Index,IndexEntries*IndexEntrySize);
+
+  LastIndexOffset=IndexOffset;
+  IndexEntries=0;
+}
+
+//*****************************************************************************
+void tN2kFrameLogWriter::Close() {
+  if ( !IsOpen ) return;
+
+  Flush();
+  WriteIndex();
+
+  unsigned char Trailer[TrailerSize];
+  memcpy(Trailer,TrailerMagic,sizeof(TrailerMagic));
+  SetLE32(Trailer+4,0);
+  SetLE64(Trailer+8,LastIndexOffset);
+  Write(Trailer,TrailerSize);
+
+  IsOpen=false;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::tMemorySource::Read(uint64_t Offset, void *Buf, size_t Len) {
+  if ( Data==0 || Offset>Size || Len>Size-Offset ) return false;
+  memcpy(Buf,Data+Offset,Len);
+  return true;
+}
+
+//*****************************************************************************
+tN2kFrameLogReader::tN2kFrameLogReader() {
+  Source=0;
+  StartTime=0;
+  Blocks=0;
+  BlockCount=0;
+  BlockCapacity=0;
+  Payload=0;
+  PayloadCapacity=0;
+  PayloadLen=0;
+  PayloadPos=0;
+  PayloadRecords=0;
+  CurrentTime=0;
+  Seek();
+}
+
+//*****************************************************************************
+tN2kFrameLogReader::~tN2kFrameLogReader() {
+  Close();
+}
+
+//*****************************************************************************
+void tN2kFrameLogReader::Close() {
+  delete[] Blocks;
+  Blocks=0;
+  BlockCount=0;
+  BlockCapacity=0;
+  delete[] Payload;
+  Payload=0;
+  PayloadCapacity=0;
+  Source=0;
+  Seek();
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::AddBlock(const tBlockInfo &Info) {
+  if ( BlockCount>=BlockCapacity ) {
+    size_t NewCapacity=(BlockCapacity>0?BlockCapacity*2:64);
+    tBlockInfo *NewBlocks=new tBlockInfo[NewCapacity];
+    if ( NewBlocks==0 ) return false;
+    if ( BlockCount>0 ) memcpy(NewBlocks,Blocks,BlockCount*sizeof(tBlockInfo));
+    delete[] Blocks;
+    Blocks=NewBlocks;
+    BlockCapacity=NewCapacity;
+  }
+  Blocks[BlockCount++]=Info;
+  return true;
+}
+
+//*****************************************************************************
+static int CompareBlockOffset(const void *a, const void *b) {
+  uint64_t OffsetA=*(const uint64_t *)a;
+  uint64_t OffsetB=*(const uint64_t *)b;
+  return (OffsetA<OffsetB?-1:(OffsetA>OffsetB?1:0));
+}
+
+//*****************************************************************************
+// Walks index segments backwards from trailer.
+bool tN2kFrameLogReader::LoadIndex() {
+  uint64_t Size=Source->GetSize();
+  unsigned char Buf[SegmentHeaderSize+IndexHeaderSize];
+
+  if ( Size<FileHeaderSize+TrailerSize ) return false;
+  if ( !Source->Read(Size-TrailerSize,Buf,TrailerSize) || memcmp(Buf,TrailerMagic,sizeof(TrailerMagic))!=0 ) return false;
+
+  uint64_t IndexOffset=GetLE64(Buf+8);
+  if ( IndexOffset==0 ) return false;
+
+  for (size_t Segments=0; IndexOffset!=0; Segments++) {
+    if ( IndexOffset<FileHeaderSize || Segments>Size/IndexEntrySize ) return false; // Broken chain
+    if ( !Source->Read(IndexOffset,Buf,sizeof(Buf)) || memcmp(Buf,IndexMagic,sizeof(IndexMagic))!=0 ) return false;
+    uint64_t PrevOffset=GetLE64(Buf+8);
+    uint32_t Count=GetLE32(Buf+16);
+    for (uint32_t i=0; i<Count; i++) {
+      unsigned char Entry[IndexEntrySize];
+      if ( !Source->Read(IndexOffset+sizeof(Buf)+i*IndexEntrySize,Entry,IndexEntrySize) ) return false;
+      tBlockInfo Info;
+      Info.Offset=GetLE64(Entry);
+      Info.FirstTime=GetLE64(Entry+8);
+      Info.LastTime=GetLE64(Entry+16);
+      Info.PGNFilter=GetLE64(Entry+24);
+      if ( !AddBlock(Info) ) return false;
+    }
+    IndexOffset=PrevOffset;
+  }
+
+  qsort(Blocks,BlockCount,sizeof(tBlockInfo),CompareBlockOffset);
+  return true;
+}
+
+//*****************************************************************************
+// Builds index by jumping over block headers. Used for logs without trailer.
+bool tN2kFrameLogReader::ScanBlocks() {
+  uint64_t Size=Source->GetSize();
+  uint64_t Offset=FileHeaderSize;
+  unsigned char Header[BlockHeaderSize];
+
+  BlockCount=0;
+  while ( Offset+SegmentHeaderSize<=Size && Source->Read(Offset,Header,SegmentHeaderSize) ) {
+    uint32_t SegmentSize=GetLE32(Header+4);
+    if ( memcmp(Header,BlockMagic,sizeof(BlockMagic))==0 ) {
+      if ( Offset+BlockHeaderSize+SegmentSize>Size ) break; // Incomplete block
+      if ( !Source->Read(Offset,Header,BlockHeaderSize) ) break;
+      tBlockInfo Info;
+      Info.Offset=Offset;
+      Info.FirstTime=GetLE64(Header+12);
+      Info.LastTime=GetLE64(Header+20);
+      Info.PGNFilter=GetLE64(Header+28);
+      if ( !AddBlock(Info) ) return false;
+      Offset+=BlockHeaderSize+SegmentSize;
+    } else if ( memcmp(Header,IndexMagic,sizeof(IndexMagic))==0 ) {
+      Offset+=SegmentHeaderSize+SegmentSize;
+    } else {
+      break;
+    }
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::Open(tSource *_Source) {
+  unsigned char Header[FileHeaderSize];
+
+  Close();
+  if ( _Source==0 ) return false;
+  if ( !_Source->Read(0,Header,FileHeaderSize) || memcmp(Header,FileMagic,sizeof(FileMagic))!=0 ) return false;
+
+  Source=_Source;
+  StartTime=GetLE64(Header+8);
+  if ( !LoadIndex() && !ScanBlocks() ) {
+    Close();
+    return false;
+  }
+  Seek();
+
+  return true;
+}
+
+//*****************************************************************************
+void tN2kFrameLogReader::Seek(uint64_t _FromTime, uint64_t _ToTime, unsigned long PGN) {
+  FromTime=_FromTime;
+  ToTime=_ToTime;
+  FilterPGN=PGN;
+  BlockLoaded=false;
+
+  // First block, which may contain FromTime
+  size_t Low=0, High=BlockCount;
+  while ( Low<High ) {
+    size_t Mid=(Low+High)/2;
+    if ( Blocks[Mid].LastTime<FromTime ) { Low=Mid+1; } else { High=Mid; }
+  }
+  NextBlock=Low;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::LoadBlock(size_t iBlock) {
+  unsigned char Header[BlockHeaderSize];
+
+  if ( !Source->Read(Blocks[iBlock].Offset,Header,BlockHeaderSize) || memcmp(Header,BlockMagic,sizeof(BlockMagic))!=0 ) return false;
+
+  uint32_t Len=GetLE32(Header+4);
+  if ( Len>PayloadCapacity ) {
+    delete[] Payload;
+    Payload=new unsigned char[Len];
+    PayloadCapacity=( Payload!=0 ? Len : 0 );
+    if ( Payload==0 ) return false;
+  }
+  if ( !Source->Read(Blocks[iBlock].Offset+BlockHeaderSize,Payload,Len) ) return false;
+
+  PayloadLen=Len;
+  PayloadPos=0;
+  PayloadRecords=GetLE16(Header+8);
+  CurrentTime=GetLE64(Header+12);
+  memset(Cache,0,sizeof(Cache));
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::DecodeRecord(tRecord &Record) {
+  while ( PayloadRecords>0 && PayloadPos+3<=PayloadLen ) {
+    unsigned char *Rec=Cache[Payload[PayloadPos++] & (N2kFrameLogCacheSlots-1)];
+    uint16_t Mask=GetLE16(Payload+PayloadPos);
+    PayloadPos+=2;
+    for (uint8_t i=0; i<N2kFrameLogRecordSize; i++) {
+      if ( (Mask & (1<<i))==0 ) continue;
+      if ( PayloadPos>=PayloadLen ) return false; // Corrupted block
+      Rec[i]=Payload[PayloadPos++];
+    }
+    PayloadRecords--;
+
+    uint32_t TimeLen=GetLE32(Rec);
+    unsigned char len=TimeLen>>28;
+    if ( len==TimeSyncLen ) {
+      CurrentTime=GetLE64(Rec+8);
+      continue;
+    }
+    if ( len>8 ) continue;
+
+    CurrentTime+=TimeLen & MaxTimeDelta;
+    uint32_t id=GetLE32(Rec+4);
+    Record.Time=CurrentTime;
+    Record.id=id & 0x1fffffff;
+    Record.Tx=(id & TxFlag)!=0;
+    Record.len=len;
+    memcpy(Record.buf,Rec+8,8);
+    return true;
+  }
+
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogReader::ReadNext(tRecord &Record) {
+  uint64_t FilterBits=( FilterPGN!=0 ? PGNFilterBits(FilterPGN) : 0 );
+
+  if ( Source==0 ) return false;
+
+  while ( true ) {
+    if ( !BlockLoaded ) {
+      while ( NextBlock<BlockCount && Blocks[NextBlock].FirstTime<=ToTime &&
+              (Blocks[NextBlock].PGNFilter & FilterBits)!=FilterBits ) NextBlock++;
+      if ( NextBlock>=BlockCount || Blocks[NextBlock].FirstTime>ToTime ) return false;
+      BlockLoaded=LoadBlock(NextBlock);
+      NextBlock++;
+      if ( !BlockLoaded ) continue;
+    }
+
+    if ( !DecodeRecord(Record) ) {
+      BlockLoaded=false;
+      continue;
+    }
+    if ( Record.Time<FromTime ) continue;
+    if ( Record.Time>ToTime ) return false;
+    if ( FilterPGN!=0 && GetPGN(Record.id)!=FilterPGN ) continue;
+
+    return true;
+  }
+}
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//*****************************************************************************
+bool tN2kFrameLogFile::Open(const char *FileName) {
+  struct stat FileStat;
+
+  Close();
+  FileHandle=open(FileName,O_RDONLY);
+  if ( FileHandle<0 ) return false;
+  if ( fstat(FileHandle,&FileStat)!=0 ) {
+    Close();
+    return false;
+  }
+  Size=FileStat.st_size;
+
+  return true;
+}
+
+//*****************************************************************************
+void tN2kFrameLogFile::Close() {
+  if ( FileHandle>=0 ) close(FileHandle);
+  FileHandle=-1;
+  Size=0;
+}
+
+//*****************************************************************************
+bool tN2kFrameLogFile::Read(uint64_t Offset, void *Buf, size_t Len) {
+  unsigned char *p=(unsigned char *)Buf;
+
+  if ( FileHandle<0 || Offset>Size || Len>Size-Offset ) return false;
+  while ( Len>0 ) {
+    ssize_t Read=pread(FileHandle,p,Len,Offset);
+    if ( Read<=0 ) return false;
+    p+=Read;
+    Offset+=Read;
+    Len-=Read;
+  }
+
+  return true;
+}
+#endif
@@ -0,0 +1,328 @@
+/*
+ * N2kFrameLog.h
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  N2kFrameLog.h
+ * \brief Compact binary frame log with block index
+ *
+ * Frame log stores raw CAN frames as 16 byte records in compressed blocks.
+ * It is designed for black box recording on device and for fast random
+ * access with host tools.
+ *
+ * ### Format
+ * All values are little endian.
+ *
+ * File header (16 bytes): magic "N2KFLOG1", log start time in us (8).
+ *
+ * Data block: 'N2KB', payload size (4), record count (2), reserved (2),
+ * first record time in us (8), last record time in us (8), PGN filter (8)
+ * and compressed payload. PGN filter is 64 bit bloom filter of PGNs in
+ * block, so reader can skip blocks without decompressing them.
+ *
+ * Records are same as on raw frame log (see \ref tN2kLogReplay::lf_RawFrames).
+ * Bits 0-27 of first word is time from previous record in block, bits 28-31
+ * frame length and length 0xf is time sync record. Second word is CAN id,
+ * where bit 31 marks sent frame. 8 bytes data follows. First record
+ * time is block first time.
+ *
+ * Record is compressed against previous record with same cache slot in
+ * block: slot (1), mask of changed bytes (2) and changed bytes. Slot cache
+ * will be cleared on each block, so blocks can be decoded independently.
+ *
+ * Index segment: 'N2KI', payload size (4), previous index segment offset (8),
+ * entry count (4), reserved (4) and entries: block offset (8), first time (8),
+ * last time (8), PGN filter (8). Writer writes index segment, when its
+ * bounded index buffer is full and on close.
+ *
+ * Trailer (16 bytes): 'N2KT', reserved (4), last index segment offset (8).
+ * If trailer is missing e.g. due to power loss, reader builds index by
+ * jumping over block headers.
+ *
+ * ### Recording
+ *
+ * \code
+ *  tN2kFrameLogWriter FrameLog(&LogFile);
+ *
+ *  FrameLog.Open();
+ *  NMEA2000.SetFrameMonitor(&FrameLog);
+ *  ...
+ *  FrameLog.Close();
+ * \endcode
+ */
+
+#ifndef _N2K_FRAME_LOG_H_
+#define _N2K_FRAME_LOG_H_
+
+#include "NMEA2000.h"
+#include "N2kStream.h"
+
+/** \brief Size of frame record */
+#define N2kFrameLogRecordSize 16
+/** \brief Number of compression cache slots */
+#define N2kFrameLogCacheSlots 32
+
+/************************************************************************//**
+ * \class tN2kFrameLogWriter
+ * \brief Append only frame log writer with bounded memory
+ * \ingroup group_coreSupplementary
+ *
+ * Writer uses BlockSize bytes for block buffer, 512 bytes for compression
+ * cache and 32 bytes for each index entry.
+ */
+class tN2kFrameLogWriter : public tNMEA2000::tFrameMonitor {
+protected:
+  N2kStream *Stream;
+  uint64_t Offset;
+  bool IsOpen;
+
+  unsigned char *Block;
+  uint16_t BlockSize;
+  uint16_t BlockLen;
+  uint16_t BlockRecords;
+  uint64_t BlockFirstTime;
+  uint64_t BlockLastTime;
+  uint64_t BlockPGNFilter;
+  unsigned char Cache[N2kFrameLogCacheSlots][N2kFrameLogRecordSize];
+
+  unsigned char *Index;
+  uint16_t MaxIndexEntries;
+  uint16_t IndexEntries;
+  uint64_t LastIndexOffset;
+
+  uint32_t FrameCount;
+
+protected:
+  void Write(const unsigned char *Buf, size_t Len);
+  void AddRecord(const unsigned char *Record);
+  void WriteIndex();
+
+public:
+  /*********************************************************************//**
+   * \brief Constructor for the writer
+   *
+   * \param _Stream           Stream log will be written to
+   * \param _BlockSize        Maximum compressed block payload size
+   * \param _MaxIndexEntries  Number of index entries buffered before index
+   *                          segment will be written
+   */
+  tN2kFrameLogWriter(N2kStream *_Stream=0, uint16_t _BlockSize=1024, uint16_t _MaxIndexEntries=32);
+  virtual ~tN2kFrameLogWriter();
+
+  /** \brief Set stream log will be written to. Must be called before Open. */
+  void SetStream(N2kStream *_Stream) { if ( !IsOpen ) Stream=_Stream; }
+
+  /*********************************************************************//**
+   * \brief Start new log and write file header
+   *
+   * \param StartTime   Log start time in us. Use e.g., UTC time, if it
+   *                    is available. Record times are N2kMicros64() times.
+   * \retval true       Log started
+   */
+  bool Open(uint64_t StartTime=0);
+
+  /*********************************************************************//**
+   * \brief Write current block to stream
+   *
+   * Call this periodically, if you want to limit data lost on power loss.
+   */
+  void Flush();
+
+  /*********************************************************************//**
+   * \brief Flush, write index and trailer.
+   */
+  void Close();
+
+  /*********************************************************************//**
+   * \brief Add frame to log
+   *
+   * \param id        ID of the CAN frame
+   * \param len       length of payload
+   * \param buf       buffer with the payload
+   * \param Tx        true for sent frame
+   * \param FrameTime Frame time in us. Times should be increasing.
+   */
+  void WriteFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool Tx, uint64_t FrameTime);
+
+  /** \brief Frame monitor interface for tNMEA2000::SetFrameMonitor */
+  void HandleFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool Tx, uint64_t FrameTime) {
+    WriteFrame(id,len,buf,Tx,FrameTime);
+  }
+
+  /** \brief Number of frames written */
+  uint32_t GetFrameCount() const { return FrameCount; }
+  /** \brief Number of bytes written to stream */
+  uint64_t GetSize() const { return Offset; }
+};
+
+/************************************************************************//**
+ * \class tN2kFrameLogReader
+ * \brief Frame log reader with time and PGN seek
+ * \ingroup group_coreSupplementary
+ */
+class tN2kFrameLogReader {
+public:
+  /** \brief Random access data source for reader */
+  class tSource {
+    public:
+      virtual ~tSource() {}
+      /** \brief Read Len bytes from Offset. Returns false, if not available. */
+      virtual bool Read(uint64_t Offset, void *Buf, size_t Len)=0;
+      /** \brief Size of data */
+      virtual uint64_t GetSize()=0;
+  };
+
+  /** \brief Source for log in memory */
+  class tMemorySource : public tSource {
+    protected:
+      const unsigned char *Data;
+      size_t Size;
+    public:
+      tMemorySource(const void *_Data=0, size_t _Size=0) : Data((const unsigned char *)_Data), Size(_Size) {}
+      void Set(const void *_Data, size_t _Size) { Data=(const unsigned char *)_Data; Size=_Size; }
+      bool Read(uint64_t Offset, void *Buf, size_t Len);
+      uint64_t GetSize() { return Size; }
+  };
+
+  /** \brief Decoded frame record */
+  struct tRecord {
+    /** \brief Frame time in us */
+    uint64_t Time;
+    unsigned long id;
+    unsigned char len;
+    unsigned char buf[8];
+    /** \brief Frame has been sent by logging device */
+    bool Tx;
+  };
+
+protected:
+  struct tBlockInfo {
+    uint64_t Offset;
+    uint64_t FirstTime;
+    uint64_t LastTime;
+    uint64_t PGNFilter;
+  };
+
+  tSource *Source;
+  uint64_t StartTime;
+
+  tBlockInfo *Blocks;
+  size_t BlockCount;
+  size_t BlockCapacity;
+
+  unsigned char *Payload;
+  size_t PayloadCapacity;
+  size_t PayloadLen;
+  size_t PayloadPos;
+  uint16_t PayloadRecords;
+  unsigned char Cache[N2kFrameLogCacheSlots][N2kFrameLogRecordSize];
+  uint64_t CurrentTime;
+
+  size_t NextBlock;
+  bool BlockLoaded;
+  uint64_t FromTime;
+  uint64_t ToTime;
+  unsigned long FilterPGN;
+
+protected:
+  bool AddBlock(const tBlockInfo &Info);
+  bool LoadIndex();
+  bool ScanBlocks();
+  bool LoadBlock(size_t iBlock);
+  bool DecodeRecord(tRecord &Record);
+
+public:
+  tN2kFrameLogReader();
+  ~tN2kFrameLogReader();
+
+  /*********************************************************************//**
+   * \brief Open log and load block index
+   *
+   * \param _Source   Data source. Must be valid until Close.
+   * \retval true     Log opened
+   * \retval false    Not a frame log
+   */
+  bool Open(tSource *_Source);
+  /** \brief Release index and buffers */
+  void Close();
+
+  /** \brief Log start time from file header */
+  uint64_t GetStartTime() const { return StartTime; }
+  /** \brief Number of data blocks on log */
+  size_t GetBlockCount() const { return BlockCount; }
+  /** \brief Time of first frame on log */
+  uint64_t GetFirstTime() const { return BlockCount>0?Blocks[0].FirstTime:0; }
+  /** \brief Time of last frame on log */
+  uint64_t GetLastTime() const { return BlockCount>0?Blocks[BlockCount-1].LastTime:0; }
+
+  /*********************************************************************//**
+   * \brief Seek to time range and set PGN filter
+   *
+   * Reader finds first block by binary search on block index and skips
+   * blocks, which PGN filter does not match PGN.
+   *
+   * \param _FromTime First frame time to read
+   * \param _ToTime   Last frame time to read
+   * \param PGN       PGN to read or 0 for all
+   */
+  void Seek(uint64_t _FromTime=0, uint64_t _ToTime=0xffffffffffffffffULL, unsigned long PGN=0);
+
+  /*********************************************************************//**
+   * \brief Read next frame matching seek range and PGN filter
+   *
+   * \param Record    Decoded frame
+   * \retval true     Frame read
+   * \retval false    No more frames
+   */
+  bool ReadNext(tRecord &Record);
+
+  /** \brief Check, does data start with frame log file header */
+  static bool IsFrameLog(const unsigned char *Buf, size_t Size);
+  /** \brief PGN of CAN id */
+  static unsigned long GetPGN(unsigned long id);
+  /** \brief Bloom filter bits for PGN */
+  static uint64_t PGNFilterBits(unsigned long PGN);
+};
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+/************************************************************************//**
+ * \class tN2kFrameLogFile
+ * \brief File source for tN2kFrameLogReader on host
+ * \ingroup group_coreSupplementary
+ */
+class tN2kFrameLogFile : public tN2kFrameLogReader::tSource {
+protected:
+  int FileHandle;
+  uint64_t Size;
+public:
+  tN2kFrameLogFile() : FileHandle(-1), Size(0) {}
+  ~tN2kFrameLogFile() { Close(); }
+  /** \brief Open file for reading */
+  bool Open(const char *FileName);
+  /** \brief Close file */
+  void Close();
+  bool Read(uint64_t Offset, void *Buf, size_t Len);
+  uint64_t GetSize() { return Size; }
+};
+#endif
+
+#endif
@@ -141,8 +141,35 @@ bool tN2kGroupFunctionHandler::HandleRequest(const tN2kMsg &N2kMsg,
                                uint8_t  NumberOfParameterPairs,
                                int iDev) {
 
+    unsigned long PGNForGroupFunction=GetPGNForGroupFunction(N2kMsg);
+
+    // Library managed periodic message supports interval and offset changes.
+    if ( pNMEA2000->IsPeriodicMsg(PGNForGroupFunction,iDev) && NumberOfParameterPairs==0 ) {
+      // Offset 0xfffe=Restore default is valid for library managed messages, so check it as no change.
+      tN2kGroupFunctionTransmissionOrPriorityErrorCode pec=GetRequestGroupFunctionTransmissionOrPriorityErrorCode(TransmissionInterval,
+                                                               (TransmissionIntervalOffset==0xfffe?0xffff:TransmissionIntervalOffset),
+                                                               true,N2k_MAX_TRANSMISSION_INTERVAL,50,true,N2k_MAX_TRANSMISSION_INTERVAL_OFFSET);
+      if ( pec==N2kgfTPec_Acknowledge ) {
+        uint32_t Offset;
+        switch (TransmissionIntervalOffset) {
+          case 0xffff: Offset=0xffffffff; break; // No change
+          case 0xfffe: Offset=0xfffffffe; break; // Restore default
+          default: Offset=(uint32_t)TransmissionIntervalOffset*10; // Offset comes in 10 ms, convert to ms.
+        }
+        uint32_t Period;
+        pNMEA2000->SetPeriodicMsgInterval(PGNForGroupFunction,TransmissionInterval,Offset,iDev);
+        // Send new state immediately, unless message has been turned off.
+        if ( pNMEA2000->GetPeriodicMsgInterval(PGNForGroupFunction,Period,Offset,iDev) && Period!=0 ) {
+          pNMEA2000->SendPeriodicMsg(PGNForGroupFunction,iDev);
+        }
+      } else if ( !tNMEA2000::IsBroadcast(N2kMsg.Destination) ) {
+        SendAcknowledge(pNMEA2000,N2kMsg.Source,iDev,PGNForGroupFunction,N2kgfPGNec_Acknowledge,pec);
+      }
+      return true;
+    }
+
     // As default we respond with not supported.
-    bool IsTxPGN=pNMEA2000->IsTxPGN(GetPGNForGroupFunction(N2kMsg),iDev);
+    bool IsTxPGN=pNMEA2000->IsTxPGN(PGNForGroupFunction,iDev);
     tN2kGroupFunctionTransmissionOrPriorityErrorCode TORec=GetRequestGroupFunctionTransmissionOrPriorityErrorCode(TransmissionInterval,TransmissionIntervalOffset);
     tN2kGroupFunctionPGNErrorCode PGNec=(IsTxPGN?N2kgfPGNec_PGNTemporarilyNotAvailable:N2kgfPGNec_PGNNotSupported);
     tN2kGroupFunctionParameterErrorCode PARec=N2kgfpec_Acknowledge;
@@ -157,7 +184,7 @@ bool tN2kGroupFunctionHandler::HandleRequest(const tN2kMsg &N2kMsg,
     }
 
     if ( !tNMEA2000::IsBroadcast(N2kMsg.Destination) ) {
-      SendAcknowledge(pNMEA2000,N2kMsg.Source,iDev,GetPGNForGroupFunction(N2kMsg),
+      SendAcknowledge(pNMEA2000,N2kMsg.Source,iDev,PGNForGroupFunction,
                       PGNec,
                       TORec,
                       NumberOfParameterPairs, PARec);
@@ -476,4 +503,253 @@ void tN2kGroupFunctionHandler::SendAcknowledge(tNMEA2000 *pNMEA2000, unsigned ch
     pNMEA2000->SendMsg(N2kRMsg,iDev);
 }
 
+
+//*****************************************************************************
+tN2kGroupFunctionFieldHandler::tN2kGroupFunctionFieldHandler(tNMEA2000 *_pNMEA2000, unsigned long _PGN,
+                                                             const tN2kGroupFunctionField *_Fields, uint8_t _FieldCount)
+  : tN2kGroupFunctionHandler(_pNMEA2000,_PGN) {
+  Fields=_Fields;
+  FieldCount=_FieldCount;
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::FindField(uint8_t FieldNumber, tN2kGroupFunctionField &Field) const {
+  for (uint8_t i=0; i<FieldCount; i++) {
+    if ( pgm_read_byte(&Fields[i].Field)==FieldNumber ) {
+      Field.Field=FieldNumber;
+      Field.BitOffset=pgm_read_word(&Fields[i].BitOffset);
+      Field.Bits=pgm_read_byte(&Fields[i].Bits);
+      Field.Flags=pgm_read_byte(&Fields[i].Flags);
+      return ( Field.Bits>0 && Field.Bits<=32 );
+    }
+  }
+
+  return false;
+}
+
+//*****************************************************************************
+static uint32_t N2kFieldMask(uint8_t Bits) {
+  return ( Bits>=32 ? 0xffffffffUL : ((uint32_t)1<<Bits)-1 );
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::GetFieldValue(const tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, uint32_t &Value) {
+  int End=(Field.BitOffset+Field.Bits+7)>>3;
+  if ( End>N2kMsg.DataLen ) return false;
+
+  uint64_t Raw=0;
+  for (int i=End-1; i>=(Field.BitOffset>>3); i--) Raw=(Raw<<8) | N2kMsg.Data[i];
+  Value=(uint32_t)(Raw>>(Field.BitOffset & 7)) & N2kFieldMask(Field.Bits);
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::SetFieldValue(tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, uint32_t Value) {
+  int Start=Field.BitOffset>>3;
+  int End=(Field.BitOffset+Field.Bits+7)>>3;
+  uint32_t Mask=N2kFieldMask(Field.Bits);
+  if ( End>N2kMsg.DataLen || (Value & ~Mask)!=0 ) return false;
+
+  uint64_t Raw=0;
+  uint8_t Shift=Field.BitOffset & 7;
+  for (int i=End-1; i>=Start; i--) Raw=(Raw<<8) | N2kMsg.Data[i];
+  Raw=(Raw & ~((uint64_t)Mask<<Shift)) | ((uint64_t)Value<<Shift);
+  for (int i=Start; i<End; i++, Raw>>=8) N2kMsg.Data[i]=Raw & 0xff;
+
+  return true;
+}
+
+//*****************************************************************************
+uint32_t tN2kGroupFunctionFieldHandler::GetPairValue(const tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, int &Index) {
+  uint32_t Value=0;
+  for (uint8_t i=0; i<(Field.Bits+7)/8; i++) Value|=(uint32_t)N2kMsg.GetByte(Index)<<(8*i);
+  return Value;
+}
+
+//*****************************************************************************
+void tN2kGroupFunctionFieldHandler::AddPairValue(tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, uint32_t Value) {
+  for (uint8_t i=0; i<(Field.Bits+7)/8; i++, Value>>=8) N2kMsg.AddByte(Value & 0xff);
+}
+
+//*****************************************************************************
+// Index will be set to -1, if pairs could not be parsed to the end.
+bool tN2kGroupFunctionFieldHandler::MatchSelectionPairs(const tN2kMsg &N2kMsg, const tN2kMsg &Current, uint8_t NumberOfSelectionPairs,
+                                                        int &Index, tN2kMsg &Ack) const {
+  bool Match=true;
+  tN2kGroupFunctionField Field;
+  uint32_t Value;
+
+  for (uint8_t i=0; i<NumberOfSelectionPairs; i++) {
+    tN2kGroupFunctionParameterErrorCode PARec=N2kgfpec_Acknowledge;
+    if ( Index<0 ) {
+      PARec=N2kgfpec_TemporarilyUnableToComply;
+    } else if ( Index>=N2kMsg.DataLen || !FindField(N2kMsg.GetByte(Index),Field) ) {
+      PARec=N2kgfpec_InvalidRequestOrCommandParameterField;
+      Index=-1; // Can not know value length, so rest can not be parsed
+    } else {
+      uint32_t Selection=GetPairValue(N2kMsg,Field,Index);
+      if ( !GetFieldValue(Current,Field,Value) ) {
+        PARec=N2kgfpec_TemporarilyUnableToComply;
+      } else if ( Value!=Selection ) {
+        PARec=N2kgfpec_RequestOrCommandParameterOutOfRange;
+      }
+    }
+    if ( PARec!=N2kgfpec_Acknowledge ) Match=false;
+    AddAcknowledgeParameter(Ack,i,PARec);
+  }
+
+  return Match;
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::CheckParameterPairs(const tN2kMsg &N2kMsg, const tN2kMsg &Current,
+                                                        uint8_t NumberOfSelectionPairs, uint8_t NumberOfParameterPairs,
+                                                        int Index, tN2kMsg &Ack, tN2kMsg *Changed) const {
+  bool OK=true;
+  tN2kGroupFunctionField Field;
+  uint32_t Value;
+
+  for (uint8_t i=0; i<NumberOfParameterPairs; i++) {
+    tN2kGroupFunctionParameterErrorCode PARec=N2kgfpec_Acknowledge;
+    if ( Index<0 ) {
+      PARec=N2kgfpec_TemporarilyUnableToComply;
+    } else if ( Index>=N2kMsg.DataLen || !FindField(N2kMsg.GetByte(Index),Field) ) {
+      PARec=N2kgfpec_InvalidRequestOrCommandParameterField;
+      if ( Changed!=0 ) Index=-1; // Unknown value length
+    } else if ( Changed==0 ) {
+      if ( !GetFieldValue(Current,Field,Value) ) PARec=N2kgfpec_TemporarilyUnableToComply;
+    } else {
+      Value=GetPairValue(N2kMsg,Field,Index);
+      if ( (Field.Flags & N2kgff_Writable)==0 ) {
+        PARec=N2kgfpec_ReadOrWriteIsNotSupported;
+      } else if ( Value & ~N2kFieldMask(Field.Bits) ) {
+        PARec=N2kgfpec_RequestOrCommandParameterOutOfRange;
+      } else if ( !SetFieldValue(*Changed,Field,Value) ) {
+        PARec=N2kgfpec_TemporarilyUnableToComply;
+      }
+    }
+    if ( PARec!=N2kgfpec_Acknowledge ) OK=false;
+    AddAcknowledgeParameter(Ack,NumberOfSelectionPairs+i,PARec);
+  }
+
+  return OK;
+}
+
+//*****************************************************************************
+void tN2kGroupFunctionFieldHandler::AddReplyPairs(const tN2kMsg &N2kMsg, const tN2kMsg &Current, uint8_t NumberOfParameterPairs,
+                                                  int Index, bool HasValues, tN2kMsg &Reply) const {
+  tN2kGroupFunctionField Field;
+  uint32_t Value;
+
+  for (uint8_t i=0; i<NumberOfParameterPairs; i++) {
+    if ( !FindField(N2kMsg.GetByte(Index),Field) ) return; // Already checked
+    if ( HasValues ) GetPairValue(N2kMsg,Field,Index);
+    GetFieldValue(Current,Field,Value);
+    Reply.AddByte(Field.Field);
+    AddPairValue(Reply,Field,Value);
+  }
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::GetFieldMsg(tN2kMsg &/*N2kMsg*/, int /*iDev*/) {
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::SetFieldMsg(const tN2kMsg &/*N2kMsg*/, int /*iDev*/) {
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::HandleReadFields(const tN2kMsg &N2kMsg,
+                                  uint16_t ManufacturerCode,
+                                  uint8_t IndustryGroup,
+                                  uint8_t UniqueID,
+                                  uint8_t NumberOfSelectionPairs,
+                                  uint8_t NumberOfParameterPairs,
+                                  int iDev) {
+  tN2kMsg Current;
+  tN2kMsg N2kRMsg;
+  int Index;
+
+    if ( !GetFieldMsg(Current,iDev) ) {
+      SendAcknowledge(pNMEA2000,N2kMsg.Source,iDev,PGN,
+                      N2kgfPGNec_PGNTemporarilyNotAvailable,
+                      N2kgfTPec_Acknowledge,
+                      NumberOfSelectionPairs+NumberOfParameterPairs, N2kgfpec_TemporarilyUnableToComply);
+      return true;
+    }
+
+    SetStartAcknowledge(N2kRMsg,N2kMsg.Source,PGN,
+                        N2kgfPGNec_Acknowledge,
+                        N2kgfTPec_Acknowledge,
+                        NumberOfSelectionPairs+NumberOfParameterPairs);
+    StartParseReadOrWriteParameters(N2kMsg,Proprietary,Index);
+    int SelectionStart=Index;
+    bool OK=MatchSelectionPairs(N2kMsg,Current,NumberOfSelectionPairs,Index,N2kRMsg);
+    OK=CheckParameterPairs(N2kMsg,Current,NumberOfSelectionPairs,NumberOfParameterPairs,Index,N2kRMsg,0) && OK;
+
+    if ( OK ) {
+      SetStartReadReply(N2kRMsg,N2kMsg.Source,PGN,ManufacturerCode,IndustryGroup,UniqueID,
+                        NumberOfSelectionPairs,NumberOfParameterPairs,Proprietary);
+      for (int i=SelectionStart; i<Index; i++) N2kRMsg.AddByte(N2kMsg.Data[i]);
+      AddReplyPairs(N2kMsg,Current,NumberOfParameterPairs,Index,false,N2kRMsg);
+    }
+    pNMEA2000->SendMsg(N2kRMsg,iDev);
+
+    return true;
+}
+
+//*****************************************************************************
+bool tN2kGroupFunctionFieldHandler::HandleWriteFields(const tN2kMsg &N2kMsg,
+                                  uint16_t ManufacturerCode,
+                                  uint8_t IndustryGroup,
+                                  uint8_t UniqueID,
+                                  uint8_t NumberOfSelectionPairs,
+                                  uint8_t NumberOfParameterPairs,
+                                  int iDev) {
+  tN2kMsg Current;
+  tN2kMsg Changed;
+  tN2kMsg N2kRMsg;
+  int Index;
+
+    if ( !GetFieldMsg(Current,iDev) ) {
+      SendAcknowledge(pNMEA2000,N2kMsg.Source,iDev,PGN,
+                      N2kgfPGNec_PGNTemporarilyNotAvailable,
+                      N2kgfTPec_Acknowledge,
+                      NumberOfSelectionPairs+NumberOfParameterPairs, N2kgfpec_TemporarilyUnableToComply);
+      return true;
+    }
+
+    SetStartAcknowledge(N2kRMsg,N2kMsg.Source,PGN,
+                        N2kgfPGNec_Acknowledge,
+                        N2kgfTPec_Acknowledge,
+                        NumberOfSelectionPairs+NumberOfParameterPairs);
+    StartParseReadOrWriteParameters(N2kMsg,Proprietary,Index);
+    int SelectionStart=Index;
+    bool OK=MatchSelectionPairs(N2kMsg,Current,NumberOfSelectionPairs,Index,N2kRMsg);
+    Changed=Current;
+    OK=CheckParameterPairs(N2kMsg,Current,NumberOfSelectionPairs,NumberOfParameterPairs,Index,N2kRMsg,&Changed) && OK;
+
+    // Fields will be written all or none.
+    if ( OK && (!SetFieldMsg(Changed,iDev) || !GetFieldMsg(Current,iDev)) ) {
+      SendAcknowledge(pNMEA2000,N2kMsg.Source,iDev,PGN,
+                      N2kgfPGNec_Acknowledge,
+                      N2kgfTPec_Acknowledge,
+                      NumberOfSelectionPairs+NumberOfParameterPairs, N2kgfpec_TemporarilyUnableToComply);
+      return true;
+    }
+
+    if ( OK ) {
+      SetStartWriteReply(N2kRMsg,N2kMsg.Source,PGN,ManufacturerCode,IndustryGroup,UniqueID,
+                         NumberOfSelectionPairs,NumberOfParameterPairs,Proprietary);
+      for (int i=SelectionStart; i<Index; i++) N2kRMsg.AddByte(N2kMsg.Data[i]);
+      AddReplyPairs(N2kMsg,Current,NumberOfParameterPairs,Index,true,N2kRMsg);
+    }
+    pNMEA2000->SendMsg(N2kRMsg,iDev);
+
+    return true;
+}
+
 #endif
@@ -887,6 +887,229 @@ class tN2kGroupFunctionHandler {
 
 };
 
+/************************************************************************//**
+ * \enum  tN2kGroupFunctionFieldFlags
+ * \brief Flags for \ref tN2kGroupFunctionField
+ */
+enum tN2kGroupFunctionFieldFlags {
+                            /** Field can be only read */
+                            N2kgff_ReadOnly=0,
+                            /** Field can be changed with write fields group function */
+                            N2kgff_Writable=1
+                          };
+
+/************************************************************************//**
+ * \struct tN2kGroupFunctionField
+ * \brief  Field map entry for \ref tN2kGroupFunctionFieldHandler
+ *
+ * Entry tells where field is located on PGN data as it has been built with
+ * PGN SetN2k... function. Table can be defined as PROGMEM. E.g., for
+ * PGN 127245 rudder:
+ * \code
+ * const tN2kGroupFunctionField RudderFields[] PROGMEM={
+ *   { 1,0,8,N2kgff_ReadOnly },   // Instance
+ *   { 2,8,3,N2kgff_Writable },   // Direction order
+ *   { 4,16,16,N2kgff_Writable }, // Angle order
+ *   { 5,32,16,N2kgff_ReadOnly }  // Position
+ * };
+ * \endcode
+ */
+struct tN2kGroupFunctionField {
+  /** \brief Field number as on PGN definition, first field is 1 */
+  uint8_t Field;
+  /** \brief Bit offset of field on PGN data */
+  uint16_t BitOffset;
+  /** \brief Field width in bits, 1-32. Value will be sent on group function as (Bits+7)/8 bytes. */
+  uint8_t Bits;
+  /** \brief Field flags, see \ref tN2kGroupFunctionFieldFlags */
+  uint8_t Flags;
+};
+
+/************************************************************************//**
+ * \class   tN2kGroupFunctionFieldHandler
+ * \brief   Group function handler with read and write fields support by field map
+ * \ingroup group_coreSupplementary
+ *
+ * Handler answers read fields and write fields group functions for a PGN by
+ * using field map and message built with PGN normal SetN2k... function. So
+ * application does not need to parse selection and parameter pairs.
+ *
+ * For read fields handler calls \ref GetFieldMsg once, checks selection
+ * pairs against it and builds reply with all requested fields. For write
+ * fields handler also sets written fields to copy of that message and
+ * gives it to \ref SetFieldMsg, which should apply new values e.g., with
+ * PGN ParseN2k... function. Reply will be built from message returned by
+ * \ref GetFieldMsg after write, so it contains values actually taken in use.
+ *
+ * Only fields with fixed position can be on map. Inherit handler, override
+ * \ref GetFieldMsg and for writable fields \ref SetFieldMsg and register
+ * it with tNMEA2000::AddGroupFunctionHandler().
+ */
+class tN2kGroupFunctionFieldHandler : public tN2kGroupFunctionHandler {
+  protected:
+    /** \brief Field map */
+    const tN2kGroupFunctionField *Fields;
+    /** \brief Number of entries on field map */
+    uint8_t FieldCount;
+
+    /**********************************************************************//**
+     * \brief Find field from field map
+     *
+     * \param FieldNumber  Field number
+     * \param Field        Copy of found field map entry
+     * \retval true  Field found
+     * \retval false Field is not on map
+     */
+    bool FindField(uint8_t FieldNumber, tN2kGroupFunctionField &Field) const;
+
+    /**********************************************************************//**
+     * \brief Get field value from PGN data
+     *
+     * \param N2kMsg  PGN message
+     * \param Field   Field map entry
+     * \param Value   Field value
+     * \retval true  Value read
+     * \retval false Field is outside of message data
+     */
+    static bool GetFieldValue(const tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, uint32_t &Value);
+
+    /**********************************************************************//**
+     * \brief Set field value to PGN data
+     *
+     * \param N2kMsg  PGN message
+     * \param Field   Field map entry
+     * \param Value   Field value
+     * \retval true  Value set
+     * \retval false Field is outside of message data or value does not fit to field
+     */
+    static bool SetFieldValue(tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, uint32_t Value);
+
+    /**********************************************************************//**
+     * \brief Read field value from group function message
+     *
+     * \param N2kMsg  Group function message
+     * \param Field   Field map entry
+     * \param Index   Position on group function message, will be moved after value
+     * \return Field value
+     */
+    static uint32_t GetPairValue(const tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, int &Index);
+
+    /**********************************************************************//**
+     * \brief Add field value to group function message
+     *
+     * \param N2kMsg  Group function message
+     * \param Field   Field map entry
+     * \param Value   Field value
+     */
+    static void AddPairValue(tN2kMsg &N2kMsg, const tN2kGroupFunctionField &Field, uint32_t Value);
+
+    /**********************************************************************//**
+     * \brief Check selection pairs against current PGN message
+     *
+     * All pairs will be checked and error code set for each to acknowledge
+     * message. After unknown field rest of pairs can not be parsed and
+     * they get error code N2kgfpec_TemporarilyUnableToComply.
+     *
+     * \param N2kMsg                 Read or write fields group function message
+     * \param Current                Current PGN message
+     * \param NumberOfSelectionPairs Number of selection pairs
+     * \param Index                  Start of selection pairs, will be moved after them
+     * \param Ack                    Acknowledge message, which gets error code for each pair
+     * \retval true  All selection pairs match
+     * \retval false Some pair did not match or could not be parsed
+     */
+    bool MatchSelectionPairs(const tN2kMsg &N2kMsg, const tN2kMsg &Current, uint8_t NumberOfSelectionPairs,
+                             int &Index, tN2kMsg &Ack) const;
+
+    /**********************************************************************//**
+     * \brief Check parameter pairs
+     *
+     * Error code for each pair will be set to acknowledge message after
+     * selection pairs. For write fields values will be also checked and
+     * set to Changed.
+     *
+     * \param N2kMsg                 Read or write fields group function message
+     * \param Current                Current PGN message
+     * \param NumberOfSelectionPairs Number of selection pairs
+     * \param NumberOfParameterPairs Number of parameter pairs
+     * \param Index                  Start of parameter pairs or -1, if selection
+     *                               pairs could not be parsed
+     * \param Ack                    Acknowledge message
+     * \param Changed                Message for written values or 0 for read fields
+     * \retval true  All pairs are valid
+     * \retval false Some pair is invalid
+     */
+    bool CheckParameterPairs(const tN2kMsg &N2kMsg, const tN2kMsg &Current,
+                             uint8_t NumberOfSelectionPairs, uint8_t NumberOfParameterPairs,
+                             int Index, tN2kMsg &Ack, tN2kMsg *Changed) const;
+
+    /**********************************************************************//**
+     * \brief Add requested parameter fields with values to reply
+     *
+     * \param N2kMsg                 Read or write fields group function message
+     * \param Current                Current PGN message
+     * \param NumberOfParameterPairs Number of parameter pairs
+     * \param Index                  Start of parameter pairs
+     * \param HasValues              Parameter pairs contains values (write fields)
+     * \param Reply                  Reply message
+     */
+    void AddReplyPairs(const tN2kMsg &N2kMsg, const tN2kMsg &Current, uint8_t NumberOfParameterPairs,
+                       int Index, bool HasValues, tN2kMsg &Reply) const;
+
+    /**********************************************************************//**
+     * \brief Get current PGN content
+     *
+     * Build message with PGN SetN2k... function. Default does nothing.
+     *
+     * \param N2kMsg  Message to be filled
+     * \param iDev    Index off the device in \ref tNMEA2000::Devices
+     * \retval true  Message is available
+     * \retval false PGN temporarily not available
+     */
+    virtual bool GetFieldMsg(tN2kMsg &N2kMsg, int iDev);
+
+    /**********************************************************************//**
+     * \brief Apply written PGN content
+     *
+     * Message contains current content with written fields changed. Parse
+     * it e.g., with PGN ParseN2k... function. Default refuses write.
+     *
+     * \param N2kMsg  Message with written fields
+     * \param iDev    Index off the device in \ref tNMEA2000::Devices
+     * \retval true  New values were taken in use
+     * \retval false Values could not be used
+     */
+    virtual bool SetFieldMsg(const tN2kMsg &N2kMsg, int iDev);
+
+    virtual bool HandleReadFields(const tN2kMsg &N2kMsg,
+                                  uint16_t ManufacturerCode,
+                                  uint8_t IndustryGroup,
+                                  uint8_t UniqueID,
+                                  uint8_t NumberOfSelectionPairs,
+                                  uint8_t NumberOfParameterPairs,
+                                  int iDev);
+
+    virtual bool HandleWriteFields(const tN2kMsg &N2kMsg,
+                                  uint16_t ManufacturerCode,
+                                  uint8_t IndustryGroup,
+                                  uint8_t UniqueID,
+                                  uint8_t NumberOfSelectionPairs,
+                                  uint8_t NumberOfParameterPairs,
+                                  int iDev);
+
+  public:
+    /**********************************************************************//**
+     * \brief Constructor for the class
+     *
+     * \param _pNMEA2000   Pointer to the NMEA2000 object
+     * \param _PGN         PGN handled
+     * \param _Fields      Field map. Map must exist as long as handler.
+     * \param _FieldCount  Number of entries on field map
+     */
+    tN2kGroupFunctionFieldHandler(tNMEA2000 *_pNMEA2000, unsigned long _PGN,
+                                  const tN2kGroupFunctionField *_Fields, uint8_t _FieldCount);
+};
+
 #endif
 
 #endif
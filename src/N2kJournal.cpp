@@ -0,0 +1,364 @@
+/*
+ * N2kJournal.cpp
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "N2kJournal.h"
+#include <string.h>
+
+// Values are compared and checksummed in chunks to keep stack usage small.
+#define N2kJournalChunkSize 16
+
+//*****************************************************************************
+tN2kJournal::tN2kJournal(tN2kJournalStorage *_Storage, uint8_t _MaxEntries) {
+  Storage=_Storage;
+  MaxEntries=_MaxEntries;
+  Entries=( MaxEntries>0 ? new tEntry[MaxEntries] : 0 );
+  EntryCount=0;
+  Area=0;
+  Generation=0;
+  Start=N2kJournalAreaHeaderSize;
+  End=Start;
+  WriteCount=0;
+  CompactCount=0;
+}
+
+//*****************************************************************************
+tN2kJournal::~tN2kJournal() {
+  if ( Entries!=0 ) delete[] Entries;
+}
+
+//*****************************************************************************
+uint8_t tN2kJournal::CRC8(uint8_t CRC, const unsigned char *Buf, size_t Len) {
+  for (size_t i=0; i<Len; i++) {
+    CRC^=Buf[i];
+    for (uint8_t b=0; b<8; b++) {
+      CRC=( (CRC & 0x80)!=0 ? (uint8_t)((CRC<<1)^0x07) : (uint8_t)(CRC<<1) );
+    }
+  }
+
+  return CRC;
+}
+
+//*****************************************************************************
+uint32_t tN2kJournal::GetAreaLimit(uint8_t _Area) {
+  uint32_t Limit=GetAreaStart(_Area)+GetAreaSize();
+  uint32_t Size=Storage->GetSize();
+
+  return ( Size<Limit ? Size : Limit );
+}
+
+//*****************************************************************************
+bool tN2kJournal::ReadAreaHeader(uint8_t _Area, uint32_t &_Generation) {
+  unsigned char Header[N2kJournalAreaHeaderSize];
+  uint32_t AreaStart=GetAreaStart(_Area);
+
+  if ( AreaStart+N2kJournalAreaHeaderSize>GetAreaLimit(_Area) ) return false;
+  if ( !Storage->Read(AreaStart,Header,N2kJournalAreaHeaderSize) ) return false;
+  if ( Header[0]!=N2kJournalAreaMarker || CRC8(0,Header,N2kJournalAreaHeaderSize-1)!=Header[N2kJournalAreaHeaderSize-1] ) return false;
+  _Generation=(uint32_t)Header[1] | (uint32_t)Header[2]<<8 | (uint32_t)Header[3]<<16 | (uint32_t)Header[4]<<24;
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournal::WriteAreaHeader(uint8_t _Area, uint32_t _Generation) {
+  unsigned char Header[N2kJournalAreaHeaderSize]={ N2kJournalAreaMarker,
+                                                   (unsigned char)_Generation, (unsigned char)(_Generation>>8),
+                                                   (unsigned char)(_Generation>>16), (unsigned char)(_Generation>>24), 0 };
+
+  Header[N2kJournalAreaHeaderSize-1]=CRC8(0,Header,N2kJournalAreaHeaderSize-1);
+  return Storage->Write(GetAreaStart(_Area),Header,N2kJournalAreaHeaderSize);
+}
+
+//*****************************************************************************
+tN2kJournal::tEntry *tN2kJournal::FindEntry(uint8_t Key) {
+  for (uint8_t i=0; i<EntryCount; i++) {
+    if ( Entries[i].Key==Key ) return &Entries[i];
+  }
+
+  return 0;
+}
+
+//*****************************************************************************
+bool tN2kJournal::IsSame(const tEntry &Entry, const unsigned char *Value, uint8_t Len) {
+  unsigned char Buf[N2kJournalChunkSize];
+
+  if ( Entry.Len!=Len ) return false;
+  for (uint8_t Pos=0; Pos<Len; ) {
+    uint8_t ChunkLen=( Len-Pos>N2kJournalChunkSize ? N2kJournalChunkSize : Len-Pos );
+    if ( !Storage->Read(Entry.Offset+Pos,Buf,ChunkLen) ) return false;
+    if ( memcmp(Buf,Value+Pos,ChunkLen)!=0 ) return false;
+    Pos+=ChunkLen;
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournal::Append(uint8_t Key, const unsigned char *Value, uint8_t Len) {
+  unsigned char Header[3]={ N2kJournalMarker, Key, Len };
+  uint8_t CRC=CRC8(CRC8(0,Header+1,2),Value,Len);
+
+  if ( End+Len+N2kJournalRecordOverhead>GetAreaStart(Area)+GetAreaSize() ) return false;
+  if ( !Storage->Write(End,Header,3) ||
+       ( Len>0 && !Storage->Write(End+3,Value,Len) ) ||
+       !Storage->Write(End+3+Len,&CRC,1) ) return false;
+
+  tEntry *Entry=FindEntry(Key);
+  if ( Entry==0 ) Entry=&Entries[EntryCount++];
+  Entry->Key=Key;
+  Entry->Len=Len;
+  Entry->Offset=End+3;
+  End+=Len+N2kJournalRecordOverhead;
+  WriteCount++;
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournal::CopyRecord(const tEntry &Entry, uint32_t To) {
+  unsigned char Buf[N2kJournalChunkSize];
+  unsigned char Header[3]={ N2kJournalMarker, Entry.Key, Entry.Len };
+  uint8_t CRC=CRC8(0,Header+1,2);
+
+  if ( !Storage->Write(To,Header,3) ) return false;
+  for (uint8_t Pos=0; Pos<Entry.Len; ) {
+    uint8_t ChunkLen=( Entry.Len-Pos>N2kJournalChunkSize ? N2kJournalChunkSize : Entry.Len-Pos );
+    if ( !Storage->Read(Entry.Offset+Pos,Buf,ChunkLen) ||
+         !Storage->Write(To+3+Pos,Buf,ChunkLen) ) return false;
+    CRC=CRC8(CRC,Buf,ChunkLen);
+    Pos+=ChunkLen;
+  }
+
+  return Storage->Write(To+3+Entry.Len,&CRC,1);
+}
+
+//*****************************************************************************
+bool tN2kJournal::Scan() {
+  unsigned char Buf[N2kJournalChunkSize];
+  uint32_t Limit=GetAreaLimit(Area);
+
+  EntryCount=0;
+  Start=GetAreaStart(Area)+N2kJournalAreaHeaderSize;
+  End=Start;
+  while ( End+N2kJournalRecordOverhead<=Limit ) {
+    if ( !Storage->Read(End,Buf,3) ) return false;
+    if ( Buf[0]!=N2kJournalMarker ) break;
+    uint8_t Key=Buf[1];
+    uint8_t Len=Buf[2];
+    if ( End+Len+N2kJournalRecordOverhead>Limit ) break;
+
+    uint8_t CRC=CRC8(0,Buf+1,2);
+    for (uint8_t Pos=0; Pos<Len; ) {
+      uint8_t ChunkLen=( Len-Pos>N2kJournalChunkSize ? N2kJournalChunkSize : Len-Pos );
+      if ( !Storage->Read(End+3+Pos,Buf,ChunkLen) ) return false;
+      CRC=CRC8(CRC,Buf,ChunkLen);
+      Pos+=ChunkLen;
+    }
+    if ( !Storage->Read(End+3+Len,Buf,1) ) return false;
+    if ( Buf[0]!=CRC ) break;
+
+    tEntry *Entry=FindEntry(Key);
+    if ( Entry==0 ) {
+      if ( EntryCount>=MaxEntries ) return false; // Compaction would lose keys, which do not fit to index.
+      Entry=&Entries[EntryCount++];
+    }
+    Entry->Key=Key;
+    Entry->Len=Len;
+    Entry->Offset=End+3;
+    End+=Len+N2kJournalRecordOverhead;
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournal::Open() {
+  unsigned char Next;
+  uint32_t Generations[2];
+  bool Valid[2];
+
+  Generation=0;
+  if ( Storage==0 || Entries==0 || GetAreaSize()<=N2kJournalAreaHeaderSize+N2kJournalRecordOverhead ) return false;
+
+  for (uint8_t i=0; i<2; i++) Valid[i]=ReadAreaHeader(i,Generations[i]);
+  if ( !Valid[0] && !Valid[1] ) { // Empty storage, start new journal on first area
+    if ( !Storage->Erase(GetAreaStart(0),GetAreaSize()) || !WriteAreaHeader(0,1) ) return false;
+    Area=0;
+    Generations[0]=1;
+  } else {
+    Area=( Valid[1] && (!Valid[0] || Generations[1]>Generations[0]) ? 1 : 0 );
+  }
+  Generation=Generations[Area];
+  if ( !Scan() ) {
+    Generation=0;
+    return false;
+  }
+  // Broken record after valid data. Copy valid data to other area, so that
+  // new records will be readable on next open.
+  if ( End<GetAreaLimit(Area) && Storage->Read(End,&Next,1) && Next!=0xff ) return Compact();
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournal::Write(uint8_t Key, const void *Value, uint8_t Len) {
+  if ( Storage==0 || Entries==0 || Generation==0 ) return false;
+
+  tEntry *Entry=FindEntry(Key);
+  if ( Entry!=0 && IsSame(*Entry,(const unsigned char *)Value,Len) ) return true;
+  if ( Entry==0 && EntryCount>=MaxEntries ) return false;
+  if ( End+Len+N2kJournalRecordOverhead>GetAreaStart(Area)+GetAreaSize() ) {
+    if ( !Compact() ) return false;
+  }
+
+  return Append(Key,(const unsigned char *)Value,Len);
+}
+
+//*****************************************************************************
+bool tN2kJournal::Read(uint8_t Key, void *Value, uint8_t &Len) {
+  tEntry *Entry=FindEntry(Key);
+
+  if ( Entry==0 || Entry->Len>Len ) return false;
+  if ( Entry->Len>0 && !Storage->Read(Entry->Offset,Value,Entry->Len) ) return false;
+  Len=Entry->Len;
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournal::Compact() {
+  if ( Storage==0 || Entries==0 || Generation==0 ) return false;
+
+  uint8_t NewArea=Area^1;
+  uint32_t NewStart=GetAreaStart(NewArea)+N2kJournalAreaHeaderSize;
+  uint32_t Limit=GetAreaStart(NewArea)+GetAreaSize();
+  uint32_t Pos=NewStart;
+
+  // Current area stays valid until new area header has been written.
+  if ( !Storage->Erase(GetAreaStart(NewArea),GetAreaSize()) ) return false;
+  for (uint8_t i=0; i<EntryCount; i++) {
+    if ( Pos+Entries[i].Len+N2kJournalRecordOverhead>Limit || !CopyRecord(Entries[i],Pos) ) return false;
+    Pos+=Entries[i].Len+N2kJournalRecordOverhead;
+  }
+  if ( !WriteAreaHeader(NewArea,Generation+1) ) return false;
+
+  Pos=NewStart;
+  for (uint8_t i=0; i<EntryCount; i++) {
+    Entries[i].Offset=Pos+3;
+    Pos+=Entries[i].Len+N2kJournalRecordOverhead;
+  }
+  Area=NewArea;
+  Generation++;
+  Start=NewStart;
+  End=Pos;
+  CompactCount++;
+
+  return true;
+}
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//*****************************************************************************
+bool tN2kJournalFile::Open(const char *FileName, uint32_t _Capacity) {
+  struct stat FileStat;
+
+  Close();
+  FileHandle=open(FileName,O_RDWR | O_CREAT,0644);
+  if ( FileHandle<0 ) return false;
+  if ( fstat(FileHandle,&FileStat)!=0 ) {
+    Close();
+    return false;
+  }
+  Size=FileStat.st_size;
+  Capacity=_Capacity;
+
+  return true;
+}
+
+//*****************************************************************************
+void tN2kJournalFile::Close() {
+  if ( FileHandle>=0 ) close(FileHandle);
+  FileHandle=-1;
+  Size=0;
+}
+
+//*****************************************************************************
+bool tN2kJournalFile::Read(uint32_t Offset, void *Buf, size_t Len) {
+  unsigned char *p=(unsigned char *)Buf;
+
+  if ( FileHandle<0 || Offset>Size || Len>Size-Offset ) return false;
+  while ( Len>0 ) {
+    ssize_t Read=pread(FileHandle,p,Len,Offset);
+    if ( Read<=0 ) return false;
+    p+=Read;
+    Offset+=Read;
+    Len-=Read;
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kJournalFile::Write(uint32_t Offset, const void *Buf, size_t Len) {
+  const unsigned char *p=(const unsigned char *)Buf;
+
+  if ( FileHandle<0 || Offset>Capacity || Len>Capacity-Offset ) return false;
+  while ( Len>0 ) {
+    ssize_t Written=pwrite(FileHandle,p,Len,Offset);
+    if ( Written<=0 ) return false;
+    p+=Written;
+    Offset+=Written;
+    Len-=Written;
+  }
+  if ( Offset>Size ) Size=Offset;
+
+  return fdatasync(FileHandle)==0;
+}
+
+//*****************************************************************************
+bool tN2kJournalFile::Erase(uint32_t Offset, uint32_t Len) {
+  unsigned char Buf[N2kJournalChunkSize];
+
+  if ( FileHandle<0 ) return false;
+  if ( Offset>=Size ) return true;
+  if ( Len>=Size-Offset ) { // Erase to end of file
+    if ( ftruncate(FileHandle,Offset)!=0 ) return false;
+    Size=Offset;
+    return fdatasync(FileHandle)==0;
+  }
+
+  memset(Buf,0xff,sizeof(Buf));
+  while ( Len>0 ) {
+    size_t ChunkLen=( Len>sizeof(Buf) ? sizeof(Buf) : Len );
+    ssize_t Written=pwrite(FileHandle,Buf,ChunkLen,Offset);
+    if ( Written<=0 ) return false;
+    Offset+=Written;
+    Len-=Written;
+  }
+
+  return fdatasync(FileHandle)==0;
+}
+#endif
@@ -0,0 +1,230 @@
+/*
+ * N2kJournal.h
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  N2kJournal.h
+ * \brief Append only key/value journal for persistent device settings
+ *
+ * Journal stores small values by one byte key. Changed value will be
+ * appended as new record, so single change writes only few bytes and
+ * storage needs to be erased only, when it is full. Journal keeps index of
+ * latest record for each key in RAM.
+ *
+ * tNMEA2000 can use journal to save and restore device settings, which
+ * may be changed from bus. See \ref tNMEA2000::SetJournal.
+ *
+ * ### Format
+ * Storage is divided to two equal areas. Only one area is active at time.
+ * Area starts with header: marker 0x5a, generation (4) and CRC-8 (1) over
+ * marker and generation. Area with valid header and highest generation
+ * is active.
+ *
+ * Record: marker 0xa5, key (1), value length (1), value and CRC-8 (1)
+ * over key, length and value.
+ *
+ * On open journal reads records until first invalid record. If storage
+ * after last valid record is not empty (0xff or end of storage), e.g.
+ * due to power loss during write, journal will be compacted, so that
+ * new records will not be written after broken data.
+ *
+ * Compaction copies latest records to other area and writes area header
+ * with next generation last. Old area will be erased only on next
+ * compaction, so power loss during compaction never loses stored values.
+ */
+
+#ifndef _N2K_JOURNAL_H_
+#define _N2K_JOURNAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** \brief Record marker */
+#define N2kJournalMarker 0xa5
+/** \brief Record size without value */
+#define N2kJournalRecordOverhead 4
+/** \brief Area header marker */
+#define N2kJournalAreaMarker 0x5a
+/** \brief Area header size */
+#define N2kJournalAreaHeaderSize 6
+
+/************************************************************************//**
+ * \class tN2kJournalStorage
+ * \brief Storage interface for tN2kJournal
+ * \ingroup group_coreSupplementary
+ *
+ * Storage can be e.g., file, EEPROM or flash sectors. For flash, erased
+ * area must read as 0xff and Write will be called only for erased area.
+ * Journal uses capacity as two equal areas, which will be erased
+ * separately, so for flash half of capacity should be sector aligned.
+ */
+class tN2kJournalStorage {
+public:
+  virtual ~tN2kJournalStorage() {}
+  /** \brief Number of readable bytes. For fixed size storage same as capacity. */
+  virtual uint32_t GetSize()=0;
+  /** \brief Maximum number of bytes storage can hold */
+  virtual uint32_t GetCapacity()=0;
+  /** \brief Read Len bytes from Offset. Returns false, if not available. */
+  virtual bool Read(uint32_t Offset, void *Buf, size_t Len)=0;
+  /** \brief Write Len bytes to Offset. Returns false on failure. */
+  virtual bool Write(uint32_t Offset, const void *Buf, size_t Len)=0;
+  /** \brief Erase Len bytes from Offset. Erased bytes read as 0xff or are not available. */
+  virtual bool Erase(uint32_t Offset, uint32_t Len)=0;
+};
+
+/************************************************************************//**
+ * \class tN2kJournal
+ * \brief Append only key/value journal
+ * \ingroup group_coreSupplementary
+ */
+class tN2kJournal {
+protected:
+  struct tEntry {
+    uint32_t Offset;
+    uint8_t Key;
+    uint8_t Len;
+  };
+
+  tN2kJournalStorage *Storage;
+  tEntry *Entries;
+  uint8_t EntryCount;
+  uint8_t MaxEntries;
+  /** \brief Active area 0 or 1 */
+  uint8_t Area;
+  /** \brief Generation of active area. 0 before open. */
+  uint32_t Generation;
+  /** \brief Offset for first record on active area */
+  uint32_t Start;
+  /** \brief Offset for next record */
+  uint32_t End;
+  uint32_t WriteCount;
+  uint32_t CompactCount;
+
+protected:
+  static uint8_t CRC8(uint8_t CRC, const unsigned char *Buf, size_t Len);
+  tEntry *FindEntry(uint8_t Key);
+  bool IsSame(const tEntry &Entry, const unsigned char *Value, uint8_t Len);
+  bool Append(uint8_t Key, const unsigned char *Value, uint8_t Len);
+  /** \brief Copy record for entry to other area through small buffer */
+  bool CopyRecord(const tEntry &Entry, uint32_t To);
+  bool Scan();
+  uint32_t GetAreaSize() { return Storage->GetCapacity()/2; }
+  uint32_t GetAreaStart(uint8_t _Area) { return _Area*GetAreaSize(); }
+  /** \brief End of readable data on area */
+  uint32_t GetAreaLimit(uint8_t _Area);
+  bool ReadAreaHeader(uint8_t _Area, uint32_t &_Generation);
+  bool WriteAreaHeader(uint8_t _Area, uint32_t _Generation);
+
+public:
+  /*********************************************************************//**
+   * \brief Construct journal
+   *
+   * \param _Storage    Storage. Must be valid as long as journal is used.
+   * \param _MaxEntries Max number of different keys
+   */
+  tN2kJournal(tN2kJournalStorage *_Storage, uint8_t _MaxEntries=32);
+  ~tN2kJournal();
+
+  /*********************************************************************//**
+   * \brief Read records from storage and build index
+   *
+   * \retval true     Journal ready
+   * \retval false    Storage could not be read or compacted, or it
+   *                  contains more keys than journal can index. In this
+   *                  case journal can not be used, since compaction would
+   *                  lose keys.
+   */
+  bool Open();
+
+  /*********************************************************************//**
+   * \brief Write value, if it differs from stored value
+   *
+   * If storage is full, journal will be compacted first.
+   *
+   * \param Key       Value key
+   * \param Value     Value data
+   * \param Len       Value length
+   * \retval true     Value stored or it was already same
+   * \retval false    Journal not open, no space or write failed
+   */
+  bool Write(uint8_t Key, const void *Value, uint8_t Len);
+
+  /*********************************************************************//**
+   * \brief Read latest value for key
+   *
+   * \param Key       Value key
+   * \param Value     Buffer for value
+   * \param Len       In buffer size, out value length
+   * \retval true     Value read
+   * \retval false    Key not found or value does not fit to buffer
+   */
+  bool Read(uint8_t Key, void *Value, uint8_t &Len);
+
+  /** \brief Check has journal value for key */
+  bool Contains(uint8_t Key) { return FindEntry(Key)!=0; }
+
+  /*********************************************************************//**
+   * \brief Rewrite only latest value for each key
+   *
+   * Live values will be copied to other area. If copy fails or power will
+   * be lost during copy, current area stays valid.
+   */
+  bool Compact();
+
+  /** \brief Used bytes on active area without area header */
+  uint32_t GetSize() const { return End-Start; }
+  /** \brief Number of different keys */
+  uint8_t GetCount() const { return EntryCount; }
+  /** \brief Number of records written since construction */
+  uint32_t GetWriteCount() const { return WriteCount; }
+  /** \brief Number of compactions since construction */
+  uint32_t GetCompactCount() const { return CompactCount; }
+};
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+/************************************************************************//**
+ * \class tN2kJournalFile
+ * \brief File storage for tN2kJournal on host
+ * \ingroup group_coreSupplementary
+ */
+class tN2kJournalFile : public tN2kJournalStorage {
+protected:
+  int FileHandle;
+  uint32_t Size;
+  uint32_t Capacity;
+public:
+  tN2kJournalFile() : FileHandle(-1), Size(0), Capacity(0) {}
+  ~tN2kJournalFile() { Close(); }
+  /** \brief Open or create file. Journal uses half of capacity before compaction. */
+  bool Open(const char *FileName, uint32_t _Capacity=4096);
+  /** \brief Close file */
+  void Close();
+  uint32_t GetSize() { return Size; }
+  uint32_t GetCapacity() { return Capacity; }
+  bool Read(uint32_t Offset, void *Buf, size_t Len);
+  bool Write(uint32_t Offset, const void *Buf, size_t Len);
+  bool Erase(uint32_t Offset, uint32_t Len);
+};
+#endif
+
+#endif
@@ -0,0 +1,518 @@
+/*
+ * N2kLogReplay.cpp
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "N2kLogReplay.h"
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+
+#include "Seasmart.h"
+#include "N2kTimer.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define Escape 0x10
+#define StartOfText 0x02
+#define EndOfText 0x03
+#define MsgTypeN2kData 0x93
+#define MsgTypeN2kRequest 0x94
+
+#define MaxActisenseMsgLen 300
+#define MaxSeasmartLineLen 512
+#define DetectFormatBytes 4096
+#define RawTimeSyncLen 0x0f
+
+const char tN2kLogReplay::RawFramesMagic[8]={'N','2','K','F','R','A','W','1'};
+
+//*****************************************************************************
+static inline uint32_t GetLE32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+//*****************************************************************************
+static inline uint64_t GetLE64(const unsigned char *p) {
+  return (uint64_t)GetLE32(p) | ((uint64_t)GetLE32(p+4)<<32);
+}
+
+//*****************************************************************************
+static inline int HexValue(char c) {
+  if ( c>='0' && c<='9' ) return c-'0';
+  if ( c>='A' && c<='F' ) return c-'A'+10;
+  if ( c>='a' && c<='f' ) return c-'a'+10;
+  return -1;
+}
+
+//*****************************************************************************
+static inline bool IsSpace(char c) { return c==' ' || c=='\t'; }
+
+//*****************************************************************************
+static const char *FindText(const char *p, const char *e, const char *Text) {
+  size_t Len=strlen(Text);
+  for (; p+Len<=e; p++) {
+    if ( *p==*Text && memcmp(p,Text,Len)==0 ) return p;
+  }
+  return 0;
+}
+
+//*****************************************************************************
+// Parses one candump line. Supported formats:
+//  (1436509052.249713) can0 09F80104#0D0A1B2C3D4E5F60
+//    can0  09F80104   [8]  0D 0A 1B 2C 3D 4E 5F 60
+//  (1436509052.249713)  can0  09F80104   [8]  0D 0A 1B 2C 3D 4E 5F 60
+// Returns 1 for extended data frame, 0 for line to be skipped and -1 for error.
+static int ParseCandumpLine(const char *p, const char *e, tN2kLogReplay::tRecord &Record) {
+  int Digit;
+
+  while ( p<e && IsSpace(*p) ) p++;
+  if ( p==e ) return 0; // Empty line
+
+  Record.Time=0;
+  if ( *p=='(' ) {
+    uint64_t Seconds=0;
+    uint32_t Micros=0;
+    int MicroDigits=0;
+    for (p++; p<e && (Digit=HexValue(*p))>=0 && Digit<10; p++) Seconds=Seconds*10+Digit;
+    if ( p<e && *p=='.' ) {
+      for (p++; p<e && (Digit=HexValue(*p))>=0 && Digit<10; p++) {
+        if ( MicroDigits<6 ) { Micros=Micros*10+Digit; MicroDigits++; }
+      }
+    }
+    if ( p==e || *p!=')' ) return -1;
+    p++;
+    for (; MicroDigits<6; MicroDigits++) Micros*=10;
+    Record.Time=Seconds*1000000+Micros;
+    while ( p<e && IsSpace(*p) ) p++;
+  }
+
+  // Interface name
+  if ( p==e ) return -1;
+  while ( p<e && !IsSpace(*p) ) p++;
+  while ( p<e && IsSpace(*p) ) p++;
+
+  unsigned long id=0;
+  int IdDigits=0;
+  for (; p<e && (Digit=HexValue(*p))>=0; p++, IdDigits++) id=(id<<4) | Digit;
+  if ( IdDigits==0 ) return -1;
+  if ( IdDigits!=8 ) return 0; // Not extended frame, so not NMEA2000
+
+  unsigned char len=0;
+  if ( p<e && *p=='#' ) {
+    p++;
+    if ( p<e && *p=='R' ) return 0; // Remote frame
+    while ( p+1<e && HexValue(p[0])>=0 && HexValue(p[1])>=0 ) {
+      if ( len>=8 ) return -1;
+      Record.buf[len++]=(HexValue(p[0])<<4) | HexValue(p[1]);
+      p+=2;
+      if ( p<e && *p=='.' ) p++;
+    }
+  } else {
+    while ( p<e && IsSpace(*p) ) p++;
+    if ( p+3>e || p[0]!='[' || p[2]!=']' || p[1]<'0' || p[1]>'8' ) return -1;
+    unsigned char DLC=p[1]-'0';
+    p+=3;
+    for (; len<DLC; len++) {
+      while ( p<e && IsSpace(*p) ) p++;
+      if ( p+1>=e || HexValue(p[0])<0 || HexValue(p[1])<0 ) return -1;
+      Record.buf[len]=(HexValue(p[0])<<4) | HexValue(p[1]);
+      p+=2;
+    }
+  }
+
+  Record.Type=tN2kLogReplay::rt_Frame;
+  Record.id=id & 0x1fffffff;
+  Record.len=len;
+
+  return 1;
+}
+
+//*****************************************************************************
+tN2kLogReplay::tN2kLogReplay() {
+  Data=0;
+  DataSize=0;
+  Pos=0;
+  Format=lf_Unknown;
+  FileHandle=-1;
+  RawTime=0;
+  DefaultSource=65;
+  TimeScale=0;
+  Rewind();
+}
+
+//*****************************************************************************
+tN2kLogReplay::~tN2kLogReplay() {
+  Close();
+}
+
+//*****************************************************************************
+tN2kLogReplay::tLogFormat tN2kLogReplay::DetectFormat(const unsigned char *Buf, size_t Size) {
+  if ( Buf==0 || Size==0 ) return lf_Unknown;
+
+  if ( Size>=RawFramesRecordSize && memcmp(Buf,RawFramesMagic,sizeof(RawFramesMagic))==0 ) return lf_RawFrames;
+  if ( tN2kFrameLogReader::IsFrameLog(Buf,Size) ) return lf_FrameLog;
+
+  if ( Size>DetectFormatBytes ) Size=DetectFormatBytes;
+  for (size_t i=0; i+2<Size; i++) {
+    if ( Buf[i]==Escape && Buf[i+1]==StartOfText && (Buf[i+2]==MsgTypeN2kData || Buf[i+2]==MsgTypeN2kRequest) ) return lf_Actisense;
+  }
+
+  const char *p=(const char *)Buf;
+  const char *e=p+Size;
+  if ( FindText(p,e,"$PCDIN,")!=0 ) return lf_Seasmart;
+
+  // Candump, if first non empty line can be parsed
+  tRecord Record;
+  while ( p<e ) {
+    const char *LineEnd=(const char *)memchr(p,'\n',e-p);
+    if ( LineEnd==0 ) LineEnd=e;
+    const char *Check=LineEnd;
+    if ( Check>p && Check[-1]=='\r' ) Check--;
+    int Result=ParseCandumpLine(p,Check,Record);
+    if ( Result>0 ) return lf_Candump;
+    if ( Result<0 ) break;
+    p=LineEnd+1;
+  }
+
+  return lf_Unknown;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::OpenBuffer(const void *Buf, size_t Size, tLogFormat _Format) {
+  Close();
+  Data=(const unsigned char *)Buf;
+  DataSize=(Data!=0?Size:0);
+  Format=( _Format!=lf_Unknown ? _Format : DetectFormat(Data,DataSize) );
+  Rewind();
+
+  return Format!=lf_Unknown;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::Open(const char *FileName, tLogFormat _Format) {
+  struct stat FileStat;
+
+  Close();
+  if ( FileName==0 ) return false;
+
+  int Handle=open(FileName,O_RDONLY);
+  if ( Handle<0 ) return false;
+  if ( fstat(Handle,&FileStat)!=0 || FileStat.st_size==0 ) {
+    close(Handle);
+    return false;
+  }
+
+  void *Map=mmap(0,FileStat.st_size,PROT_READ,MAP_PRIVATE,Handle,0);
+  if ( Map==MAP_FAILED ) {
+    close(Handle);
+    return false;
+  }
+  madvise(Map,FileStat.st_size,MADV_SEQUENTIAL);
+
+  bool Result=OpenBuffer(Map,FileStat.st_size,_Format);
+  FileHandle=Handle;
+
+  return Result;
+}
+
+//*****************************************************************************
+void tN2kLogReplay::Close() {
+  if ( FileHandle>=0 ) {
+    munmap((void *)Data,DataSize);
+    close(FileHandle);
+    FileHandle=-1;
+  }
+  Data=0;
+  DataSize=0;
+  Format=lf_Unknown;
+  Rewind();
+}
+
+//*****************************************************************************
+void tN2kLogReplay::Rewind() {
+  Pos=0;
+  RawTime=0;
+  if ( Format==lf_RawFrames && DataSize>=RawFramesRecordSize ) {
+    RawTime=GetLE64(Data+sizeof(RawFramesMagic));
+    Pos=RawFramesRecordSize;
+  }
+  FrameLog.Close();
+  if ( Format==lf_FrameLog ) {
+    FrameLogSource.Set(Data,DataSize);
+    if ( !FrameLog.Open(&FrameLogSource) ) Pos=DataSize; // Nothing readable
+  }
+  ReplayStarted=false;
+  HasPending=false;
+  RecordCount=0;
+  ErrorCount=0;
+}
+
+//*****************************************************************************
+// Actisense Format:
+// <10><02><93><length (1)><priority (1)><PGN (3)><destination (1)><source (1)><time (4)><len (1)><data (len)><CRC (1)><10><03>
+// or
+// <10><02><94><length (1)><priority (1)><PGN (3)><destination (1)><len (1)><data (len)><CRC (1)><10><03>
+bool tN2kLogReplay::ReadActisense(tRecord &Record) {
+  unsigned char MsgBuf[MaxActisenseMsgLen];
+  const unsigned char *End=Data+DataSize;
+
+  while ( Pos<DataSize ) {
+    const unsigned char *p=(const unsigned char *)memchr(Data+Pos,Escape,DataSize-Pos);
+    if ( p==0 || p+1>=End ) break;
+    if ( p[1]!=StartOfText ) {
+      Pos=p-Data+1;
+      continue;
+    }
+
+    // Unescape message to buffer
+    int MsgLen=0;
+    bool Complete=false;
+    bool Valid=true;
+    for (p+=2; p<End && !Complete && Valid; ) {
+      if ( *p!=Escape ) {
+        if ( MsgLen<MaxActisenseMsgLen ) { MsgBuf[MsgLen++]=*p++; } else { Valid=false; }
+        continue;
+      }
+      if ( p+1>=End ) { p=End; break; }
+      switch ( p[1] ) {
+        case Escape:
+          if ( MsgLen<MaxActisenseMsgLen ) { MsgBuf[MsgLen++]=Escape; p+=2; } else { Valid=false; }
+          break;
+        case EndOfText:
+          p+=2;
+          Complete=true;
+          break;
+        default: // Start of next message or error. Continue from escape.
+          Valid=false;
+      }
+    }
+    Pos=p-Data;
+    if ( !Complete ) {
+      if ( Pos<DataSize ) ErrorCount++;
+      continue;
+    }
+    if ( MsgLen<2 ) { // Too short to have even type and length
+      ErrorCount++;
+      continue;
+    }
+    if ( MsgBuf[0]!=MsgTypeN2kData && MsgBuf[0]!=MsgTypeN2kRequest ) continue; // Other Actisense messages
+
+    uint8_t ByteSum=0;
+    for (int i=0; i<MsgLen; i++) ByteSum+=MsgBuf[i];
+    if ( MsgBuf[1]+3!=MsgLen || ByteSum!=0 ) {
+      ErrorCount++;
+      continue;
+    }
+
+    tN2kMsg &N2kMsg=Record.Msg;
+    int i=2;
+    N2kMsg.Clear();
+    N2kMsg.Priority=MsgBuf[i++];
+    N2kMsg.PGN=GetBuf3ByteUInt(i,MsgBuf);
+    N2kMsg.Destination=MsgBuf[i++];
+    if ( MsgBuf[0]==MsgTypeN2kData ) {
+      N2kMsg.Source=MsgBuf[i++];
+      N2kMsg.MsgTime=GetBuf4ByteUInt(i,MsgBuf);
+      Record.Time=(uint64_t)N2kMsg.MsgTime*1000;
+    } else {
+      N2kMsg.Source=DefaultSource;
+      Record.Time=0;
+    }
+    N2kMsg.DataLen=MsgBuf[i++];
+    if ( N2kMsg.DataLen>tN2kMsg::MaxDataLen || i+N2kMsg.DataLen!=MsgLen-1 ) {
+      N2kMsg.Clear();
+      ErrorCount++;
+      continue;
+    }
+    memcpy(N2kMsg.Data,MsgBuf+i,N2kMsg.DataLen);
+    Record.Type=rt_Msg;
+
+    return true;
+  }
+
+  Pos=DataSize;
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::ReadSeasmart(tRecord &Record) {
+  char Line[MaxSeasmartLineLen];
+
+  while ( Pos<DataSize ) {
+    const char *p=(const char *)Data+Pos;
+    const char *e=(const char *)Data+DataSize;
+    const char *LineEnd=(const char *)memchr(p,'\n',e-p);
+    if ( LineEnd==0 ) LineEnd=e;
+    Pos=LineEnd-(const char *)Data+1;
+    if ( LineEnd>p && LineEnd[-1]=='\r' ) LineEnd--;
+
+    const char *Start=FindText(p,LineEnd,"$PCDIN,");
+    if ( Start==0 ) continue; // Other sentences will be skipped
+
+    size_t Len=LineEnd-Start;
+    if ( Len>=MaxSeasmartLineLen ) {
+      ErrorCount++;
+      continue;
+    }
+    memcpy(Line,Start,Len);
+    Line[Len]=0;
+
+    uint32_t TimeStamp;
+    if ( !SeasmartToN2k(Line,TimeStamp,Record.Msg) ) {
+      ErrorCount++;
+      continue;
+    }
+    Record.Msg.MsgTime=TimeStamp;
+    Record.Time=(uint64_t)TimeStamp*1000;
+    Record.Type=rt_Msg;
+
+    return true;
+  }
+
+  Pos=DataSize;
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::ReadCandump(tRecord &Record) {
+  while ( Pos<DataSize ) {
+    const char *p=(const char *)Data+Pos;
+    const char *e=(const char *)Data+DataSize;
+    const char *LineEnd=(const char *)memchr(p,'\n',e-p);
+    if ( LineEnd==0 ) LineEnd=e;
+    Pos=LineEnd-(const char *)Data+1;
+    if ( LineEnd>p && LineEnd[-1]=='\r' ) LineEnd--;
+
+    int Result=ParseCandumpLine(p,LineEnd,Record);
+    if ( Result>0 ) return true;
+    if ( Result<0 ) ErrorCount++;
+  }
+
+  Pos=DataSize;
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::ReadRawFrame(tRecord &Record) {
+  while ( Pos+RawFramesRecordSize<=DataSize ) {
+    const unsigned char *p=Data+Pos;
+    Pos+=RawFramesRecordSize;
+
+    uint32_t TimeLen=GetLE32(p);
+    unsigned char len=TimeLen>>28;
+    if ( len==RawTimeSyncLen ) {
+      RawTime=GetLE64(p+8);
+      continue;
+    }
+    RawTime+=TimeLen & 0x0fffffff;
+    if ( len>8 ) {
+      ErrorCount++;
+      continue;
+    }
+
+    Record.Type=rt_Frame;
+    Record.Time=RawTime;
+    Record.id=GetLE32(p+4) & 0x1fffffff;
+    Record.len=len;
+    memcpy(Record.buf,p+8,8);
+
+    return true;
+  }
+
+  Pos=DataSize;
+  return false;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::ReadFrameLog(tRecord &Record) {
+  tN2kFrameLogReader::tRecord Frame;
+
+  if ( !FrameLog.ReadNext(Frame) ) {
+    Pos=DataSize;
+    return false;
+  }
+
+  Record.Type=rt_Frame;
+  Record.Time=Frame.Time;
+  Record.id=Frame.id;
+  Record.len=Frame.len;
+  memcpy(Record.buf,Frame.buf,8);
+
+  return true;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::ReadNext(tRecord &Record) {
+  bool Result=false;
+
+  switch ( Format ) {
+    case lf_Actisense: Result=ReadActisense(Record); break;
+    case lf_Seasmart: Result=ReadSeasmart(Record); break;
+    case lf_Candump: Result=ReadCandump(Record); break;
+    case lf_RawFrames: Result=ReadRawFrame(Record); break;
+    case lf_FrameLog: Result=ReadFrameLog(Record); break;
+    default: Pos=DataSize;
+  }
+
+  if ( Result ) RecordCount++;
+
+  return Result;
+}
+
+//*****************************************************************************
+bool tN2kLogReplay::Inject(tNMEA2000 &NMEA2000, tRecord &Record) {
+  if ( Record.Type==rt_Frame ) return NMEA2000.InjectFrame(Record.id,Record.len,Record.buf);
+
+  NMEA2000.InjectMsg(Record.Msg);
+  return true;
+}
+
+//*****************************************************************************
+size_t tN2kLogReplay::Replay(tNMEA2000 &NMEA2000, size_t MaxRecords) {
+  size_t Count=0;
+
+  while ( MaxRecords==0 || Count<MaxRecords ) {
+    if ( !HasPending ) {
+      if ( !ReadNext(Pending) ) break;
+      HasPending=true;
+    }
+
+    if ( TimeScale>0 && Pending.Time!=0 ) {
+      uint64_t Now=N2kMicros64();
+      if ( !ReplayStarted ) {
+        ReplayStarted=true;
+        ReplayStartTime=Now;
+        LogStartTime=Pending.Time;
+      }
+      if ( Pending.Time>LogStartTime && ReplayStartTime+(uint64_t)((Pending.Time-LogStartTime)/TimeScale)>Now ) break;
+    }
+
+    if ( !Inject(NMEA2000,Pending) ) break; // Object not open yet
+    HasPending=false;
+    Count++;
+  }
+
+  return Count;
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * N2kLogReplay.h
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  N2kLogReplay.h
+ * \brief Replay engine for recorded bus logs
+ *
+ * tN2kLogReplay memory maps log file, detects its format and decodes
+ * records directly from mapped memory. Decoded records can be read with
+ * \ref tN2kLogReplay::ReadNext or injected to tNMEA2000 object with
+ * \ref tN2kLogReplay::Replay.
+ *
+ * Supported formats:
+ *  - Actisense binary (DLE STX 0x93/0x94 ... DLE ETX). Gives messages.
+ *  - Seasmart $PCDIN sentences. Gives messages.
+ *  - candump text output, both log (-l) and default screen format with
+ *    or without absolute time. Gives frames.
+ *  - raw frame log. Gives frames. See \ref tN2kLogReplay::lf_RawFrames.
+ *  - block frame log written by tN2kFrameLogWriter. Gives frames.
+ *
+ * \code
+ *  tN2kLogReplay Replay;
+ *
+ *  if ( Replay.Open("bus.log") ) {
+ *    Replay.SetTimeScale(0); // As fast as possible
+ *    while ( !Replay.IsEnd() ) Replay.Replay(NMEA2000,1000);
+ *  }
+ * \endcode
+ *
+ * Module is available only on Linux hosts.
+ */
+
+#ifndef _N2K_LOG_REPLAY_H_
+#define _N2K_LOG_REPLAY_H_
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+
+#include "NMEA2000.h"
+#include "N2kMsg.h"
+#include "N2kFrameLog.h"
+
+/************************************************************************//**
+ * \class tN2kLogReplay
+ * \brief Memory mapped log file reader and replay engine
+ * \ingroup group_coreSupplementary
+ */
+class tN2kLogReplay {
+public:
+  /** \brief Log file formats */
+  enum tLogFormat {
+    lf_Unknown=0,
+    /** \brief Actisense binary format */
+    lf_Actisense,
+    /** \brief Seasmart $PCDIN sentences */
+    lf_Seasmart,
+    /** \brief candump text output */
+    lf_Candump,
+    /** \brief Raw frame log
+     *
+     * Log starts with 16 byte header: 8 byte magic "N2KFRAW1" and 8 byte
+     * little endian log start time in us. Header is followed by 16 byte
+     * records:
+     *  - 4 bytes: bits 0-27 time in us from previous record, bits 28-31
+     *    frame length. Length 0xf means time sync record, which has absolute
+     *    time in us as 8 byte little endian value on data.
+     *  - 4 bytes: CAN id
+     *  - 8 bytes: frame data
+     */
+    lf_RawFrames,
+    /** \brief Block frame log. See N2kFrameLog.h */
+    lf_FrameLog
+  };
+
+  /** \brief Type of decoded record */
+  enum tRecordType {
+    rt_Frame,
+    rt_Msg
+  };
+
+  /** \brief Decoded log record */
+  struct tRecord {
+    tRecordType Type;
+    /** \brief Record time in us from log or 0, if log does not have time */
+    uint64_t Time;
+    /** \brief CAN id for frame records */
+    unsigned long id;
+    /** \brief Frame length for frame records */
+    unsigned char len;
+    /** \brief Frame data for frame records */
+    unsigned char buf[8];
+    /** \brief Message for message records */
+    tN2kMsg Msg;
+  };
+
+  /** \brief Magic of raw frame log header */
+  static const char RawFramesMagic[8];
+  /** \brief Size of raw frame log header and record */
+  static const size_t RawFramesRecordSize=16;
+
+protected:
+  const unsigned char *Data;
+  size_t DataSize;
+  size_t Pos;
+  tLogFormat Format;
+  int FileHandle;
+
+  uint64_t RawTime;
+  unsigned char DefaultSource;
+  tN2kFrameLogReader::tMemorySource FrameLogSource;
+  tN2kFrameLogReader FrameLog;
+
+  double TimeScale;
+  bool ReplayStarted;
+  uint64_t ReplayStartTime;
+  uint64_t LogStartTime;
+  bool HasPending;
+  tRecord Pending;
+
+  uint32_t RecordCount;
+  uint32_t ErrorCount;
+
+protected:
+  bool ReadActisense(tRecord &Record);
+  bool ReadSeasmart(tRecord &Record);
+  bool ReadCandump(tRecord &Record);
+  bool ReadRawFrame(tRecord &Record);
+  bool ReadFrameLog(tRecord &Record);
+  bool Inject(tNMEA2000 &NMEA2000, tRecord &Record);
+
+public:
+  tN2kLogReplay();
+  ~tN2kLogReplay();
+
+  /*********************************************************************//**
+   * \brief Open and memory map log file
+   *
+   * \param FileName  Log file name
+   * \param _Format   Log format. With lf_Unknown format will be detected
+   *                  from file content.
+   *
+   * \retval true     File opened and format is known
+   * \retval false    File could not be opened or format is unknown
+   */
+  bool Open(const char *FileName, tLogFormat _Format=lf_Unknown);
+
+  /*********************************************************************//**
+   * \brief Use log from memory buffer
+   *
+   * Buffer must be valid until \ref Close has been called.
+   *
+   * \param Buf       Log data
+   * \param Size      Log data size
+   * \param _Format   Log format. With lf_Unknown format will be detected.
+   *
+   * \retval true     Format is known
+   */
+  bool OpenBuffer(const void *Buf, size_t Size, tLogFormat _Format=lf_Unknown);
+
+  /*********************************************************************//**
+   * \brief Unmap and close log file
+   */
+  void Close();
+
+  /*********************************************************************//**
+   * \brief Start reading log from beginning
+   */
+  void Rewind();
+
+  /*********************************************************************//**
+   * \brief Detect log format from log start
+   *
+   * \param Buf   Log data
+   * \param Size  Log data size
+   * \return Detected format
+   */
+  static tLogFormat DetectFormat(const unsigned char *Buf, size_t Size);
+
+  /** \brief Format of opened log */
+  tLogFormat GetFormat() const { return Format; }
+  /** \brief Source used for Actisense 0x94 messages, which do not have source */
+  void SetDefaultSource(unsigned char Source) { DefaultSource=Source; }
+
+  /*********************************************************************//**
+   * \brief Read next record from log
+   *
+   * Invalid records will be skipped and counted to \ref GetErrorCount.
+   *
+   * \param Record    Decoded record
+   * \retval true     Record read
+   * \retval false    End of log
+   */
+  bool ReadNext(tRecord &Record);
+
+  /** \brief Check has all records been read or replayed */
+  bool IsEnd() const { return !HasPending && Pos>=DataSize; }
+
+  /*********************************************************************//**
+   * \brief Set replay time scale
+   *
+   * \param Scale   0 replays as fast as possible. 1 replays on original
+   *                speed, 2 twice original speed etc.
+   */
+  void SetTimeScale(double Scale) { TimeScale=(Scale>0?Scale:0); }
+
+  /*********************************************************************//**
+   * \brief Inject log records to tNMEA2000 object
+   *
+   * Frame records will be injected with \ref tNMEA2000::InjectFrame and
+   * message records with \ref tNMEA2000::InjectMsg. Function does not
+   * block. With time scale it injects only records, which are due
+   * according to their log time, so it should be called periodically
+   * like tNMEA2000::ParseMessages.
+   *
+   * \param NMEA2000    Object to inject records to
+   * \param MaxRecords  Maximum number of records to inject. 0 for no limit.
+   * \return Number of records injected
+   */
+  size_t Replay(tNMEA2000 &NMEA2000, size_t MaxRecords=0);
+
+  /** \brief Number of records read */
+  uint32_t GetRecordCount() const { return RecordCount; }
+  /** \brief Number of invalid records skipped */
+  uint32_t GetErrorCount() const { return ErrorCount; }
+};
+
+#endif
+
+#endif
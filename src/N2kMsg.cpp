@@ -95,8 +95,26 @@ void tN2kMsg::Clear() {
   PGN=0;
   DataLen=0;
   MsgTime=0;
+#if defined(N2K_FRAME_TIMESTAMP)
+  FirstFrameTime=0;
+  LastFrameTime=0;
+#endif
+}
+
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+//*****************************************************************************
+void tN2kLargeMsg::UpdateData() {
+  DataLen=(LargeDataLen<MaxDataLen?LargeDataLen:MaxDataLen);
+  if ( LargeData!=0 ) memcpy(Data,LargeData,DataLen);
 }
 
+//*****************************************************************************
+void tN2kLargeMsg::Clear() {
+  tN2kMsg::Clear();
+  LargeDataLen=0;
+}
+#endif
+
 //*****************************************************************************
 void tN2kMsg::AddFloat(float v, float UndefVal) {
   if (v!=UndefVal) {
@@ -893,7 +911,7 @@ void AddByteEscapedToBuf(unsigned char byteToAdd, uint8_t &idx, unsigned char *b
 // <10><02><93><length (1)><priority (1)><PGN (3)><destination (1)><source (1)><time (4)><len (1)><data (len)><CRC (1)><10><03>
 void tN2kMsg::SendInActisenseFormat(N2kStream *port) const {
   unsigned long _PGN=PGN;
-  unsigned long _MsgTime=MsgTime;
+  unsigned long _MsgTime=GetMsgTime();
   uint8_t msgIdx=0;
   int byteSum = 0;
   uint8_t CheckSum;
@@ -725,6 +725,14 @@ public:
   unsigned char Data[MaxDataLen];
   /** \brief timestamp (ms since start [max 49days]) of the NMEA2000 message*/
   unsigned long MsgTime;
+#if defined(N2K_FRAME_TIMESTAMP)
+  /** \brief Receive time of the first frame of the message in microseconds
+   * (N2kMicros64() time or driver timestamp). 0 if unknown.*/
+  uint64_t FirstFrameTime;
+  /** \brief Receive time of the last frame of the message in microseconds.
+   * Same as \ref FirstFrameTime for single frame messages.*/
+  uint64_t LastFrameTime;
+#endif
 protected:
   /** \brief Fills the whole data buffer with 0xff*/
   void ResetData();
@@ -748,6 +756,18 @@ public:
    */
   bool IsTPMessage() const { return TPMessage; }
 
+  /************************************************************************//**
+   * \brief Determine if the message is \ref tN2kLargeMsg
+   * 
+   * Large messages carry more than \ref MaxDataLen bytes. For them \ref Data
+   * contains only beginning of the message and full data can be read from
+   * \ref tN2kLargeMsg::LargeData.
+   * 
+   * \return true   Message is a tN2kLargeMsg
+   * \return false  Message is a normal message
+   */
+  virtual bool IsLargeMsg() const { return false; }
+
 #endif
 public:
   /************************************************************************//**
@@ -809,6 +829,21 @@ public:
    */
   bool IsValid() const { return (PGN!=0 && DataLen>0); }
 
+  /************************************************************************//**
+   * \brief Get message time in milliseconds
+   * 
+   * If frame timestamps are available, returns receive time of the first
+   * frame. Otherwise \ref MsgTime.
+   * 
+   * \return unsigned long  Message time in milliseconds
+   */
+  unsigned long GetMsgTime() const {
+#if defined(N2K_FRAME_TIMESTAMP)
+    if ( FirstFrameTime!=0 ) return FirstFrameTime/1000;
+#endif
+    return MsgTime;
+  }
+
   /************************************************************************//**
    * \brief Get the Remaining Data Length 
    * 
@@ -1337,6 +1372,73 @@ public:
   void SendInActisenseFormat(N2kStream *port) const;
 };
 
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+/************************************************************************//**
+ * \class tN2kLargeMsg
+ * \brief Message received with ISO Transport Protocol longer than 
+ *        \ref tN2kMsg::MaxDataLen
+ * 
+ * ISO Transport Protocol allows messages up to 1785 bytes. To keep normal
+ * messages small, longer messages will be received to tN2kLargeMsg, which 
+ * data buffer is reserved from pool by tNMEA2000. Pool is disabled as default
+ * and must be enabled with tNMEA2000::SetN2kLargeMsgBufSize.
+ * 
+ * For compatibility message \ref Data contains first \ref tN2kMsg::MaxDataLen
+ * bytes of the message and \ref DataLen is limited to that. Message handlers
+ * should check \ref tN2kMsg::IsLargeMsg and read full data from 
+ * \ref LargeData. Use GetBuf... functions for parsing.
+ * 
+ * \code {.cpp}
+ * void HandleNMEA2000Msg(const tN2kMsg &N2kMsg) {
+ *   if ( N2kMsg.IsLargeMsg() ) {
+ *     const tN2kLargeMsg &LargeMsg=(const tN2kLargeMsg &)N2kMsg;
+ *     // E.g. PGN 126464 list
+ *     for (int Index=1; Index+3<=LargeMsg.LargeDataLen; ) {
+ *       uint32_t PGN=GetBuf3ByteUInt(Index,LargeMsg.LargeData);
+ *       ...
+ *     }
+ *   }
+ * }
+ * \endcode
+ */
+class tN2kLargeMsg : public tN2kMsg {
+public:
+  /** \brief Maximum number of bytes on ISO Transport Protocol message*/
+  static const int MaxLargeDataLen=1785;
+  /** \brief Pointer to data buffer of \ref MaxLargeDataLen bytes*/
+  unsigned char *LargeData;
+  /** \brief Number of bytes on \ref LargeData*/
+  int LargeDataLen;
+
+public:
+  tN2kLargeMsg() : tN2kMsg(), LargeData(0), LargeDataLen(0) {}
+
+  /************************************************************************//**
+   * \brief Initialize large message for reception
+   * 
+   * \param _Priority      Priority of the Message [0 .. 7]
+   * \param _PGN           Parameter Group Number [decimal]
+   * \param _Source        Source address of the sender
+   * \param _Destination   Destination address
+   * \param _LargeDataLen  Length of the message data
+   */
+  void Init(unsigned char _Priority, unsigned long _PGN, unsigned char _Source, unsigned char _Destination, int _LargeDataLen) {
+    tN2kMsg::Init(_Priority,_PGN,_Source,_Destination);
+    SetIsTPMessage();
+    LargeDataLen=(_LargeDataLen<=MaxLargeDataLen?_LargeDataLen:MaxLargeDataLen);
+  }
+
+  /************************************************************************//**
+   * \brief Copies beginning of \ref LargeData to \ref Data, so that
+   *        message can be handled also as normal message.
+   */
+  void UpdateData();
+
+  virtual void Clear();
+  virtual bool IsLargeMsg() const { return true; }
+};
+#endif
+
 /************************************************************************//**
  * \brief Print out a buffer (byte array)
  * 
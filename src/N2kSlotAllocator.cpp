@@ -0,0 +1,157 @@
+/*
+ * N2kSlotAllocator.cpp
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "N2kSlotAllocator.h"
+#include <string.h>
+
+//*****************************************************************************
+tN2kSlotAllocator::tN2kSlotAllocator(uint16_t _SlotTime, uint16_t _SlotCount) {
+  SlotTime=( _SlotTime>0 ? _SlotTime : 1 );
+  SlotCount=( _SlotCount>0 ? _SlotCount : 1 );
+  Reserved=new uint16_t[SlotCount];
+  Measured=new uint16_t[SlotCount];
+  Predicted=new uint16_t[SlotCount];
+  memset(Reserved,0,SlotCount*sizeof(uint16_t));
+  memset(Measured,0,SlotCount*sizeof(uint16_t));
+  memset(Predicted,0,SlotCount*sizeof(uint16_t));
+  Window=0;
+}
+
+//*****************************************************************************
+tN2kSlotAllocator::~tN2kSlotAllocator() {
+  delete[] Reserved;
+  delete[] Measured;
+  delete[] Predicted;
+}
+
+//*****************************************************************************
+void tN2kSlotAllocator::ClearReserved() {
+  memset(Reserved,0,SlotCount*sizeof(uint16_t));
+}
+
+//*****************************************************************************
+void tN2kSlotAllocator::GetSlotUsage(uint32_t Period, uint16_t &Count, uint16_t &Step) const {
+  uint32_t PeriodSlots=Period/SlotTime;
+
+  if ( PeriodSlots==0 ) PeriodSlots=1;
+  if ( PeriodSlots>=SlotCount ) { // Once per window or less
+    Count=1;
+    Step=SlotCount;
+  } else {
+    Step=PeriodSlots;
+    Count=(SlotCount+Step-1)/Step;
+  }
+}
+
+//*****************************************************************************
+void tN2kSlotAllocator::Reserve(uint32_t Period, uint32_t Offset, uint8_t Frames) {
+  uint16_t Count, Step;
+
+  if ( Period==0 ) return;
+  GetSlotUsage(Period,Count,Step);
+  uint16_t First=SlotIndex(Offset);
+  for (uint16_t i=0; i<Count; i++) {
+    uint16_t &Load=Reserved[(First+(uint32_t)i*Step)%SlotCount];
+    Load=( (uint32_t)Load+Frames<0xffff ? Load+Frames : 0xffff );
+  }
+}
+
+//*****************************************************************************
+uint32_t tN2kSlotAllocator::Allocate(uint32_t Period, uint8_t Frames, uint32_t MinOffset) {
+  uint16_t Count, Step;
+  uint16_t BestPhase=0;
+  uint32_t BestPeak=0xffffffff;
+  uint32_t BestSum=0xffffffff;
+
+  if ( Period==0 ) return MinOffset;
+  GetSlotUsage(Period,Count,Step);
+  uint16_t First=SlotIndex(MinOffset);
+  // Try phases within period or window. Step is never longer than period.
+  for (uint16_t Phase=0; Phase<Step; Phase++) {
+    uint32_t Peak=0;
+    uint32_t Sum=0;
+    for (uint16_t i=0; i<Count; i++) {
+      uint32_t Load=GetLoad((First+Phase+(uint32_t)i*Step)%SlotCount);
+      if ( Load>Peak ) Peak=Load;
+      Sum+=Load;
+    }
+    if ( Peak<BestPeak || (Peak==BestPeak && Sum<BestSum) ) {
+      BestPeak=Peak;
+      BestSum=Sum;
+      BestPhase=Phase;
+    }
+  }
+
+  uint32_t Offset=MinOffset+(uint32_t)BestPhase*SlotTime;
+  Reserve(Period,Offset,Frames);
+
+  return Offset;
+}
+
+//*****************************************************************************
+uint32_t tN2kSlotAllocator::GetDelay(uint64_t Time, uint32_t MinDelay, uint32_t Span, uint8_t Frames) {
+  uint32_t Slots=Span/SlotTime+1;
+  uint32_t BestDelay=MinDelay;
+  uint32_t BestLoad=0xffffffff;
+
+  if ( Slots>SlotCount ) Slots=SlotCount;
+  for (uint32_t i=0; i<Slots; i++) {
+    uint32_t Delay=MinDelay+i*SlotTime;
+    uint32_t Load=GetLoad(SlotIndex(Time+Delay));
+    if ( Load<BestLoad ) {
+      BestLoad=Load;
+      BestDelay=Delay;
+    }
+  }
+
+  uint16_t &Load=Predicted[SlotIndex(Time+BestDelay)];
+  Load=( (uint32_t)Load+Frames<0xffff ? Load+Frames : 0xffff );
+
+  return BestDelay;
+}
+
+//*****************************************************************************
+void tN2kSlotAllocator::UpdateWindow(uint64_t Time) {
+  uint64_t NewWindow=Time/SlotTime/SlotCount;
+
+  // Previous window measurement predicts next one. If windows have been
+  // skipped, there were no frames.
+  if ( NewWindow==Window+1 ) {
+    memcpy(Predicted,Measured,SlotCount*sizeof(uint16_t));
+  } else {
+    memset(Predicted,0,SlotCount*sizeof(uint16_t));
+  }
+  memset(Measured,0,SlotCount*sizeof(uint16_t));
+  Window=NewWindow;
+}
+
+//*****************************************************************************
+uint16_t tN2kSlotAllocator::GetPeakReserved() const {
+  uint16_t Peak=0;
+
+  for (uint16_t i=0; i<SlotCount; i++) {
+    if ( Reserved[i]>Peak ) Peak=Reserved[i];
+  }
+
+  return Peak;
+}
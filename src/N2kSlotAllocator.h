@@ -0,0 +1,142 @@
+/*
+ * N2kSlotAllocator.h
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  N2kSlotAllocator.h
+ * \brief Send time slot allocator for periodic transmissions
+ *
+ * Allocator divides time window (default 100 slots of 10 ms) to slots and
+ * keeps count of frames on each slot. Load of slot is sum of frames
+ * reserved for own periodic transmissions and frames received from bus
+ * during previous window. New periodic transmission will get offset,
+ * which minimizes highest load on slots it will use.
+ *
+ * All times are relative to \ref tN2kSyncScheduler sync offset, so
+ * allocated offsets can be used directly for tN2kSyncScheduler.
+ *
+ * See \ref tNMEA2000::SetSlotAllocator.
+ */
+
+#ifndef _N2K_SLOT_ALLOCATOR_H_
+#define _N2K_SLOT_ALLOCATOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/************************************************************************//**
+ * \class tN2kSlotAllocator
+ * \brief Send time slot allocator
+ * \ingroup group_coreSupplementary
+ */
+class tN2kSlotAllocator {
+protected:
+  uint16_t SlotTime;
+  uint16_t SlotCount;
+  /** \brief Frames reserved for own periodic transmissions */
+  uint16_t *Reserved;
+  /** \brief Frames received on current window */
+  uint16_t *Measured;
+  /** \brief Frames received on previous window and planned single transmissions */
+  uint16_t *Predicted;
+  /** \brief Number of current measurement window */
+  uint64_t Window;
+
+protected:
+  uint16_t SlotIndex(uint64_t Time) const { return (Time/SlotTime)%SlotCount; }
+  uint32_t GetLoad(uint16_t Slot) const { return (uint32_t)Reserved[Slot]+Predicted[Slot]; }
+  /** \brief Number of slots transmission with period uses and slot step between them */
+  void GetSlotUsage(uint32_t Period, uint16_t &Count, uint16_t &Step) const;
+  void UpdateWindow(uint64_t Time);
+
+public:
+  /*********************************************************************//**
+   * \brief Construct allocator
+   *
+   * \param _SlotTime   Slot length in ms
+   * \param _SlotCount  Number of slots in window
+   */
+  tN2kSlotAllocator(uint16_t _SlotTime=10, uint16_t _SlotCount=100);
+  ~tN2kSlotAllocator();
+
+  /** \brief Clear all reservations */
+  void ClearReserved();
+
+  /*********************************************************************//**
+   * \brief Reserve slots for periodic transmission with known offset
+   *
+   * \param Period    Period in ms
+   * \param Offset    Offset in ms
+   * \param Frames    Number of frames sent on each period
+   */
+  void Reserve(uint32_t Period, uint32_t Offset, uint8_t Frames);
+
+  /*********************************************************************//**
+   * \brief Allocate and reserve offset for periodic transmission
+   *
+   * Allocator tries all offsets within period or window, whichever is
+   * shorter, in slot steps and selects one with lowest highest load on
+   * used slots.
+   *
+   * \param Period      Period in ms
+   * \param Frames      Number of frames sent on each period
+   * \param MinOffset   Offset will be MinOffset + selected phase
+   * \return Offset in ms
+   */
+  uint32_t Allocate(uint32_t Period, uint8_t Frames, uint32_t MinOffset=0);
+
+  /*********************************************************************//**
+   * \brief Get delay for single transmission to least loaded slot
+   *
+   * Selected slot will be marked loaded, so that several transmissions
+   * planned at same time will be spread.
+   *
+   * \param Time      Current time in ms relative to sync offset
+   * \param MinDelay  Min delay in ms
+   * \param Span      Delay will be MinDelay - MinDelay+Span
+   * \param Frames    Number of frames to be sent
+   * \return Delay in ms
+   */
+  uint32_t GetDelay(uint64_t Time, uint32_t MinDelay, uint32_t Span, uint8_t Frames);
+
+  /*********************************************************************//**
+   * \brief Measure frame received from bus
+   *
+   * \param Time      Receive time in ms relative to sync offset
+   */
+  void AddFrame(uint64_t Time) {
+    if ( Time/SlotTime/SlotCount!=Window ) UpdateWindow(Time);
+    uint16_t &Count=Measured[SlotIndex(Time)];
+    if ( Count<0xffff ) Count++;
+  }
+
+  /** \brief Slot length in ms */
+  uint16_t GetSlotTime() const { return SlotTime; }
+  /** \brief Number of slots in window */
+  uint16_t GetSlotCount() const { return SlotCount; }
+  /** \brief Frames reserved on slot */
+  uint16_t GetReserved(uint16_t Slot) const { return Slot<SlotCount?Reserved[Slot]:0; }
+  /** \brief Highest reserved frame count on any slot */
+  uint16_t GetPeakReserved() const;
+};
+
+#endif
@@ -30,22 +30,44 @@ uint64_t tN2kSyncScheduler::SyncOffset=0;
   // N2kMillis64() and N2kMillis() as inline on header
 #elif defined(__linux__) || defined(__linux) || defined(linux)
   #include <time.h>
+  static uint64_t (*N2kClockSource)()=0;
+
+  void N2kSetClockSource(uint64_t (*ClockSource)()) { N2kClockSource=ClockSource; }
   uint64_t N2kMillis64() {
     struct timespec ticker;
 
+    if ( N2kClockSource!=0 ) return N2kClockSource()/1000;
     clock_gettime(CLOCK_MONOTONIC, &ticker);
     return (((uint64_t)ticker.tv_sec * 1000) + (ticker.tv_nsec / 1000000));
   }
   uint32_t N2kMillis() { return N2kMillis64(); }
+  uint64_t N2kMicros64() {
+    struct timespec ticker;
+
+    if ( N2kClockSource!=0 ) return N2kClockSource();
+    clock_gettime(CLOCK_MONOTONIC, &ticker);
+    return (((uint64_t)ticker.tv_sec * 1000000) + (ticker.tv_nsec / 1000));
+  }
 #elif defined(_WIN32)
   #include <time.h>
+  static uint64_t (*N2kClockSource)()=0;
+
+  void N2kSetClockSource(uint64_t (*ClockSource)()) { N2kClockSource=ClockSource; }
   uint64_t N2kMillis64() {
     struct timespec ticker;
 
+    if ( N2kClockSource!=0 ) return N2kClockSource()/1000;
     clock_gettime(CLOCK_MONOTONIC, &ticker);
     return (((uint64_t)ticker.tv_sec * 1000) + (ticker.tv_nsec / 1000000));
   }
   uint32_t N2kMillis() { return N2kMillis64(); }
+  uint64_t N2kMicros64() {
+    struct timespec ticker;
+
+    if ( N2kClockSource!=0 ) return N2kClockSource();
+    clock_gettime(CLOCK_MONOTONIC, &ticker);
+    return (((uint64_t)ticker.tv_sec * 1000000) + (ticker.tv_nsec / 1000));
+  }
 #else 
   #if defined(ARDUINO)
     // N2kMillis() as inline on header
@@ -65,6 +87,20 @@ uint64_t tN2kSyncScheduler::SyncOffset=0;
     LastRead=Now;
     return ((uint64_t)RollCount)<<32 | Now;
   }
+
+  #if defined(ARDUINO)
+  // micros() rolls over in about 71 minutes, so this must be called within that time.
+  uint64_t N2kMicros64() {
+    static uint32_t RollCount=0;
+    static uint32_t LastRead=0;
+    uint32_t Now=micros();
+    if ( LastRead>Now ) RollCount++;
+    LastRead=Now;
+    return ((uint64_t)RollCount)<<32 | Now;
+  }
+  #else
+  uint64_t N2kMicros64() { return N2kMillis64()*1000; }
+  #endif
 #endif
 
 #if !defined(N2kUse64bitSchedulerTime)
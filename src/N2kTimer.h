@@ -71,13 +71,35 @@
     return esp_timer_get_time()/1000ULL;
   }
   inline uint32_t N2kMillis() { return N2kMillis64(); }
+  inline uint64_t N2kMicros64() { return esp_timer_get_time(); }
 #elif defined(ARDUINO)
   #include <Arduino.h>
   uint64_t N2kMillis64();
   inline uint32_t N2kMillis() { return millis(); }
+  uint64_t N2kMicros64();
 #else
   uint64_t N2kMillis64();
   uint32_t N2kMillis();
+  /************************************************************************//**
+   * \brief 64 bit microsecond timer
+   *
+   * Time base is same as with N2kMillis64(). On platforms without 
+   * microsecond timer resolution is milliseconds.
+   */
+  uint64_t N2kMicros64();
+  #if defined(__linux__) || defined(__linux) || defined(linux) || defined(_WIN32)
+  /************************************************************************//**
+   * \brief Replace system clock with own clock source
+   *
+   * Host simulations and tests can use this to drive library timing with
+   * simulated time. After setting, N2kMillis64(), N2kMillis() and
+   * N2kMicros64() return time from ClockSource.
+   *
+   * \param ClockSource  Function returning time in microseconds. Set 0 to
+   *                     restore system clock.
+   */
+  void N2kSetClockSource(uint64_t (*ClockSource)());
+  #endif
 #endif
 
 #define N2kScheduler64Disabled 0xffffffffffffffffULL
@@ -257,6 +279,12 @@ public:
    *
    */
   static void SetSyncOffset() { SyncOffset=N2kMillis64(); }
+  /************************************************************************//**
+   * \brief Get the SyncOffset of the scheduler
+   *
+   * \return uint64_t N2kMillis64() time offsets are relative to
+   */
+  static uint64_t GetSyncOffset() { return SyncOffset; }
 };
 
 #if defined(ARDUINO_ARCH_ESP32) || defined(ESP_PLATFORM) || defined(__linux__) || defined(__linux) || defined(linux)
@@ -337,6 +365,26 @@ public:
     #endif
   }
 
+  /************************************************************************//**
+   * \brief Get timestamp of next event as N2kMillis64() time
+   *
+   * This can be used for comparing schedulers with tN2kSyncScheduler or
+   * finding next event from set of schedulers.
+   * 
+   * \param Now64   Current time as N2kMillis64()
+   * \return uint64_t  Next event time. For disabled scheduler 
+   *                   N2kScheduler64Disabled
+   */
+  uint64_t GetNextTime64(uint64_t Now64) const {
+    if ( IsDisabled() ) return N2kScheduler64Disabled;
+    #if defined(N2kUse64bitSchedulerTime)
+    (void)Now64;
+    return NextTime;
+    #else
+    return Now64+(int32_t)(NextTime-(uint32_t)Now64);
+    #endif
+  }
+
   /************************************************************************//**
    * \brief Set Timestamp for next event relative to now
    *
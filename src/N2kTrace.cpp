@@ -0,0 +1,103 @@
+/*
+ * N2kTrace.cpp
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "N2kTrace.h"
+
+#if defined(N2K_TRACE)
+#include <stdio.h>
+
+N2K_TRACE_THREAD_LOCAL tN2kTraceRing *tN2kTraceRing::CurrentRing=0;
+tN2kTraceRing *tN2kTraceRing::FirstRing=0;
+
+static uint32_t N2kTraceRingCount=0;
+
+struct tN2kTraceEventInfo {
+  const char *Name;
+  const char *Arg1;
+  const char *Arg2;
+};
+
+static const tN2kTraceEventInfo N2kTraceEvents[N2kte_Max]={
+  { "Unknown", "arg1", "arg2" },
+  { "FrameReceived", "id", "len" },
+  { "SlotAllocated", "pgn", "slot" },
+  { "MsgComplete", "pgn", "source" },
+  { "Handlers", "pgn", "source" },
+  { "Handlers", "pgn", "source" },
+  { "FrameQueued", "id", "len" },
+  { "FrameSent", "id", "len" }
+};
+
+//*****************************************************************************
+tN2kTraceRing *tN2kTraceRing::NewRing() {
+  tN2kTraceRing *Ring=new tN2kTraceRing;
+
+  Ring->Head=0;
+  Ring->ThreadId=__atomic_add_fetch(&N2kTraceRingCount,1,__ATOMIC_RELAXED);
+  Ring->Next=__atomic_load_n(&FirstRing,__ATOMIC_RELAXED);
+  while ( !__atomic_compare_exchange_n(&FirstRing,&Ring->Next,Ring,true,__ATOMIC_RELEASE,__ATOMIC_RELAXED) );
+  CurrentRing=Ring;
+
+  return Ring;
+}
+
+//*****************************************************************************
+void N2kTraceClear() {
+  for (tN2kTraceRing *Ring=tN2kTraceRing::First(); Ring!=0; Ring=Ring->Next) {
+    __atomic_store_n(&Ring->Head,0,__ATOMIC_RELEASE);
+  }
+}
+
+//*****************************************************************************
+size_t N2kTraceExportJSON(N2kStream *Stream) {
+  char Line[200];
+  size_t Count=0;
+
+  if ( Stream==0 ) return 0;
+
+  Stream->print("{\"traceEvents\":[");
+  for (tN2kTraceRing *Ring=tN2kTraceRing::First(); Ring!=0; Ring=Ring->Next) {
+    uint32_t Head=__atomic_load_n(&Ring->Head,__ATOMIC_ACQUIRE);
+    uint32_t Start=( Head>N2K_TRACE_RING_SIZE ? Head-N2K_TRACE_RING_SIZE : 0 );
+
+    for (uint32_t i=Start; i!=Head; i++) {
+      const tN2kTraceRecord &Record=Ring->Records[i & (N2K_TRACE_RING_SIZE-1)];
+      uint8_t Event=( Record.Event<N2kte_Max ? Record.Event : 0 );
+      const tN2kTraceEventInfo &Info=N2kTraceEvents[Event];
+      const char *Phase=( Event==N2kte_HandlerStart ? "B" : ( Event==N2kte_HandlerEnd ? "E" : "i" ) );
+
+      snprintf(Line,sizeof(Line),
+               "%s\n{\"name\":\"%s\",\"ph\":\"%s\",%s\"ts\":%llu,\"pid\":1,\"tid\":%lu,\"args\":{\"%s\":%lu,\"%s\":%lu}}",
+               Count>0?",":"",Info.Name,Phase,(Phase[0]=='i'?"\"s\":\"t\",":""),
+               (unsigned long long)Record.Time,(unsigned long)Ring->ThreadId,
+               Info.Arg1,(unsigned long)Record.Arg1,Info.Arg2,(unsigned long)Record.Arg2);
+      Stream->print(Line);
+      Count++;
+    }
+  }
+  Stream->print("\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  return Count;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * N2kTrace.h
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  N2kTrace.h
+ * \brief Structured trace probes for library hot path
+ *
+ * Probes record event, N2kMicros64() timestamp and two 32 bit arguments to
+ * a trace ring. Each thread has its own ring, so recording does not need
+ * locks. When ring is full, oldest records will be overwritten.
+ *
+ * Thread local rings are used on Linux, Windows and ESP32 (FreeRTOS tasks).
+ * On other targets there is single ring shared by all callers, so probes
+ * must be called only from one thread or task there. Other targets, which
+ * toolchain supports thread local storage, can enable it by defining
+ * N2K_TRACE_THREAD_LOCAL e.g., as thread_local for library build.
+ *
+ * Probes are compiled in only, when N2K_TRACE has been defined for whole
+ * library build. Otherwise \ref N2kTrace expands to nothing. Ring size can
+ * be changed with N2K_TRACE_RING_SIZE, which must be power of two.
+ *
+ * Recorded trace can be written in Chrome trace event JSON format with
+ * \ref N2kTraceExportJSON. Output can be opened with chrome://tracing or
+ * https://ui.perfetto.dev
+ */
+
+#ifndef _N2K_TRACE_H_
+#define _N2K_TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** \brief Trace probe events */
+enum tN2kTraceEvent {
+  /** \brief Frame received. Arguments CAN id, length */
+  N2kte_FrameReceived=1,
+  /** \brief Message slot allocated for first frame. Arguments PGN, slot index */
+  N2kte_SlotAllocated,
+  /** \brief Message complete. Arguments PGN, source */
+  N2kte_MsgComplete,
+  /** \brief Message handlers started. Arguments PGN, source */
+  N2kte_HandlerStart,
+  /** \brief Message handlers done. Arguments PGN, source */
+  N2kte_HandlerEnd,
+  /** \brief Frame queued to library send buffer. Arguments CAN id, length */
+  N2kte_FrameQueued,
+  /** \brief Frame given to driver. Arguments CAN id, length */
+  N2kte_FrameSent,
+  N2kte_Max
+};
+
+#if defined(N2K_TRACE)
+
+#include "N2kTimer.h"
+#include "N2kStream.h"
+
+#ifndef N2K_TRACE_RING_SIZE
+#define N2K_TRACE_RING_SIZE 1024
+#endif
+
+#ifndef N2K_TRACE_THREAD_LOCAL
+#if defined(__linux__) || defined(__linux) || defined(linux) || defined(_WIN32) || defined(ARDUINO_ARCH_ESP32) || defined(ESP_PLATFORM)
+#define N2K_TRACE_THREAD_LOCAL thread_local
+#else
+// No thread local storage assumed. Ring is shared, so trace only from single thread.
+#define N2K_TRACE_THREAD_LOCAL
+#endif
+#endif
+
+/************************************************************************//**
+ * \struct tN2kTraceRecord
+ * \brief One recorded probe
+ */
+struct tN2kTraceRecord {
+  uint64_t Time;
+  uint32_t Arg1;
+  uint32_t Arg2;
+  uint8_t Event;
+};
+
+/************************************************************************//**
+ * \class tN2kTraceRing
+ * \brief Single producer trace ring
+ *
+ * Ring will be created for thread on its first probe and it is never
+ * freed, so trace of finished threads can be still exported.
+ */
+class tN2kTraceRing {
+protected:
+  static N2K_TRACE_THREAD_LOCAL tN2kTraceRing *CurrentRing;
+  static tN2kTraceRing *FirstRing;
+
+  static tN2kTraceRing *NewRing();
+
+public:
+  tN2kTraceRecord Records[N2K_TRACE_RING_SIZE];
+  /** \brief Total number of records written. Written only by owner thread. */
+  uint32_t Head;
+  /** \brief Ring number used as thread id on export */
+  uint32_t ThreadId;
+  tN2kTraceRing *Next;
+
+  void Add(uint8_t Event, uint32_t Arg1, uint32_t Arg2) {
+    tN2kTraceRecord &Record=Records[Head & (N2K_TRACE_RING_SIZE-1)];
+    Record.Time=N2kMicros64();
+    Record.Arg1=Arg1;
+    Record.Arg2=Arg2;
+    Record.Event=Event;
+    __atomic_store_n(&Head,Head+1,__ATOMIC_RELEASE);
+  }
+
+  /** \brief Ring for calling thread */
+  static tN2kTraceRing *Current() { return CurrentRing!=0?CurrentRing:NewRing(); }
+  /** \brief First ring on list of all rings */
+  static tN2kTraceRing *First() { return __atomic_load_n(&FirstRing,__ATOMIC_ACQUIRE); }
+};
+
+/** \brief Trace probe. Use \ref N2kTrace macro instead. */
+inline void N2kTraceRecord(uint8_t Event, uint32_t Arg1, uint32_t Arg2) {
+  tN2kTraceRing::Current()->Add(Event,Arg1,Arg2);
+}
+
+#define N2kTrace(Event,Arg1,Arg2) N2kTraceRecord(Event,(uint32_t)(Arg1),(uint32_t)(Arg2))
+
+/************************************************************************//**
+ * \brief Clear all trace rings
+ *
+ * Should be called only, when no other thread is recording.
+ */
+void N2kTraceClear();
+
+/************************************************************************//**
+ * \brief Write recorded trace in Chrome trace event JSON format
+ *
+ * Handler start and end will be written as duration events and all others
+ * as instant events. Each ring will be written as own thread.
+ *
+ * \param Stream  Stream to write to
+ * \return Number of events written
+ */
+size_t N2kTraceExportJSON(N2kStream *Stream);
+
+#else
+#define N2kTrace(Event,Arg1,Arg2)
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * N2kTxPacer.cpp
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "N2kTxPacer.h"
+#include <string.h>
+
+//*****************************************************************************
+tN2kTxPacer::tN2kTxPacer(uint8_t _TargetLoad, uint16_t _MaxFrames, uint32_t _BitRate) {
+  BitRate=( _BitRate>0 ? _BitRate : 250000 );
+  BypassPriority=3;
+  SetPacing(_TargetLoad);
+  WindowStart=0;
+  WindowBits=0;
+  WindowPacedBits=0;
+  BusLoad=0;
+  OtherLoad=0;
+  Tokens=BurstBits;
+  LastFill=0;
+  MaxFrames=_MaxFrames;
+  Frames=( MaxFrames>0 ? new tFrame[MaxFrames] : 0 );
+  FrameRead=0;
+  FrameCount=0;
+  PeakFrameCount=0;
+  DeferredCount=0;
+}
+
+//*****************************************************************************
+tN2kTxPacer::~tN2kTxPacer() {
+  if ( Frames!=0 ) delete[] Frames;
+}
+
+//*****************************************************************************
+void tN2kTxPacer::SetPacing(uint8_t _TargetLoad, uint8_t _MinLoad, uint8_t _BurstFrames) {
+  TargetLoad=( _TargetLoad<=100 ? _TargetLoad : 100 );
+  MinLoad=( _MinLoad<=TargetLoad ? _MinLoad : TargetLoad );
+  if ( MinLoad<1 ) MinLoad=1; // Deferred frames must not stall and time out peer transport
+  BurstBits=(uint32_t)( _BurstFrames>0 ? _BurstFrames : 1 )*FrameBits(8);
+}
+
+//*****************************************************************************
+void tN2kTxPacer::UpdateWindow(uint64_t Time) {
+  uint32_t WindowCapacity=BitRate/(1000/N2kTxPacerWindowTime);
+
+  // If windows have been skipped, bus has been idle.
+  if ( Time>=WindowStart+2*N2kTxPacerWindowTime ) {
+    WindowBits=0;
+    WindowPacedBits=0;
+  }
+  uint32_t Load=(uint32_t)((uint64_t)WindowBits*100/WindowCapacity);
+  BusLoad=( Load<100 ? Load : 100 );
+  Load=(uint32_t)((uint64_t)(WindowBits>WindowPacedBits ? WindowBits-WindowPacedBits : 0)*100/WindowCapacity);
+  OtherLoad=( Load<100 ? Load : 100 );
+  WindowBits=0;
+  WindowPacedBits=0;
+  WindowStart=Time-Time%N2kTxPacerWindowTime;
+}
+
+//*****************************************************************************
+uint32_t tN2kTxPacer::GetFillRate() const {
+  uint8_t Share=( TargetLoad>OtherLoad ? TargetLoad-OtherLoad : 0 );
+
+  if ( Share<MinLoad ) Share=MinLoad;
+
+  uint32_t Rate=(uint32_t)((uint64_t)BitRate*Share/100000);
+
+  return ( Rate>0 ? Rate : 1 );
+}
+
+//*****************************************************************************
+void tN2kTxPacer::Fill(uint64_t Time) {
+  if ( Time<=LastFill ) return;
+  uint64_t Bits=(Time-LastFill)*GetFillRate()+Tokens;
+  Tokens=( Bits<BurstBits ? (uint32_t)Bits : BurstBits );
+  LastFill=Time;
+}
+
+//*****************************************************************************
+bool tN2kTxPacer::CanTake(uint64_t Time, unsigned char len) {
+  if ( Time>=WindowStart+N2kTxPacerWindowTime ) UpdateWindow(Time);
+  Fill(Time);
+
+  return Tokens>=FrameBits(len);
+}
+
+//*****************************************************************************
+bool tN2kTxPacer::Take(uint64_t Time, unsigned char len) {
+  uint16_t Bits=FrameBits(len);
+
+  if ( !CanTake(Time,len) ) return false;
+  Tokens-=Bits;
+  WindowPacedBits+=Bits;
+
+  return true;
+}
+
+//*****************************************************************************
+uint64_t tN2kTxPacer::GetNextSendTime(uint64_t Time) const {
+  if ( FrameCount==0 ) return Time;
+
+  uint16_t Bits=FrameBits(Frames[FrameRead].len);
+  uint32_t Rate=GetFillRate();
+  uint64_t Available=Tokens+( Time>LastFill ? (Time-LastFill)*Rate : 0 );
+
+  if ( Available>=Bits ) return Time;
+
+  return Time+(Bits-Available+Rate-1)/Rate;
+}
+
+//*****************************************************************************
+bool tN2kTxPacer::Defer(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent) {
+  if ( FrameCount>=MaxFrames ) return false;
+
+  tFrame &Frame=Frames[(FrameRead+FrameCount)%MaxFrames];
+  Frame.id=id;
+  Frame.len=( len<=8 ? len : 8 );
+  memcpy(Frame.buf,buf,Frame.len);
+  Frame.wait_sent=wait_sent;
+  FrameCount++;
+  if ( FrameCount>PeakFrameCount ) PeakFrameCount=FrameCount;
+  DeferredCount++;
+
+  return true;
+}
+
+//*****************************************************************************
+void tN2kTxPacer::RemoveDeferred() {
+  if ( FrameCount==0 ) return;
+  FrameRead=(FrameRead+1)%MaxFrames;
+  FrameCount--;
+}
@@ -0,0 +1,211 @@
+/*
+ * N2kTxPacer.h
+ *
+ * Copyright (c) 2015-2024 Timo Lappalainen, Kave Oy, www.kave.fi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  N2kTxPacer.h
+ * \brief Transmit pacing for low priority bulk traffic
+ *
+ * Pacer measures bus load from frames received and sent by library and
+ * limits rate of low priority bulk frames (fast packet frames and ISO TP
+ * data transfer) with token bucket. Bucket will be filled with share of
+ * bus bandwidth, which is left to target load from other traffic, so
+ * bulk transfers slow down when bus is busy. Frames, which can not be
+ * sent immediately, will be deferred to pacer queue and sent later in
+ * original order from \ref tNMEA2000::ParseMessages.
+ *
+ * Traffic with priority \ref tN2kTxPacer::GetBypassPriority or higher
+ * (lower value) and single frame messages will never be paced.
+ *
+ * Bit counts are nominal extended frame bit counts without stuffing, so
+ * target load should leave some headroom.
+ *
+ * See \ref tNMEA2000::SetTxPacer.
+ */
+
+#ifndef _N2K_TX_PACER_H_
+#define _N2K_TX_PACER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** \brief Bus load measurement window in ms */
+#define N2kTxPacerWindowTime 100
+
+/************************************************************************//**
+ * \class tN2kTxPacer
+ * \brief Token bucket pacer for low priority bulk frames
+ * \ingroup group_coreSupplementary
+ */
+class tN2kTxPacer {
+public:
+  /** \brief Deferred frame */
+  struct tFrame {
+    unsigned long id;
+    unsigned char len;
+    unsigned char buf[8];
+    bool wait_sent;
+  };
+
+protected:
+  uint32_t BitRate;
+  uint8_t TargetLoad;
+  uint8_t MinLoad;
+  uint8_t BypassPriority;
+  uint32_t BurstBits;
+
+  /** \brief Start of current measurement window in ms */
+  uint64_t WindowStart;
+  /** \brief All bits on current window */
+  uint32_t WindowBits;
+  /** \brief Paced bits sent on current window */
+  uint32_t WindowPacedBits;
+  /** \brief Bus load on previous window in % */
+  uint8_t BusLoad;
+  /** \brief Bus load without paced frames on previous window in % */
+  uint8_t OtherLoad;
+
+  /** \brief Available bits in bucket */
+  uint32_t Tokens;
+  /** \brief Time of last bucket fill in ms */
+  uint64_t LastFill;
+
+  tFrame *Frames;
+  uint16_t MaxFrames;
+  uint16_t FrameRead;
+  uint16_t FrameCount;
+  uint16_t PeakFrameCount;
+  uint32_t DeferredCount;
+
+protected:
+  void UpdateWindow(uint64_t Time);
+  void Fill(uint64_t Time);
+  /** \brief Bucket fill rate in bits/ms. Always at least 1. */
+  uint32_t GetFillRate() const;
+
+public:
+  /*********************************************************************//**
+   * \brief Construct pacer
+   *
+   * \param _TargetLoad   Target bus load in %
+   * \param _MaxFrames    Size of deferred frame queue
+   * \param _BitRate      Bus bit rate
+   */
+  tN2kTxPacer(uint8_t _TargetLoad=60, uint16_t _MaxFrames=40, uint32_t _BitRate=250000);
+  ~tN2kTxPacer();
+
+  /*********************************************************************//**
+   * \brief Set pacing parameters
+   *
+   * \param _TargetLoad   Target bus load in %. Bulk frames will be sent
+   *                      with bandwidth left from other traffic.
+   * \param _MinLoad      Bulk frames will always get at least this share
+   *                      of bandwidth in %, so transfers will not stall.
+   *                      Values below 1 % will be raised to 1 %.
+   * \param _BurstFrames  Number of 8 byte frames, which can be sent back
+   *                      to back after idle time.
+   */
+  void SetPacing(uint8_t _TargetLoad, uint8_t _MinLoad=5, uint8_t _BurstFrames=4);
+
+  /*********************************************************************//**
+   * \brief Set lowest priority value, which will not be paced
+   *
+   * Default is 3, so priorities 0-3 bypass pacing.
+   */
+  void SetBypassPriority(uint8_t _BypassPriority) { BypassPriority=_BypassPriority; }
+  uint8_t GetBypassPriority() const { return BypassPriority; }
+
+  /** \brief Nominal bit count of extended frame without stuffing */
+  static uint16_t FrameBits(unsigned char len) { return 67+8*(len>8?8:len); }
+
+  /*********************************************************************//**
+   * \brief Measure frame on bus
+   *
+   * Call for all frames received or sent.
+   *
+   * \param Time    Time in ms
+   * \param len     Frame data length
+   */
+  void AddFrame(uint64_t Time, unsigned char len) {
+    if ( Time>=WindowStart+N2kTxPacerWindowTime ) UpdateWindow(Time);
+    WindowBits+=FrameBits(len);
+  }
+
+  /*********************************************************************//**
+   * \brief Check, are there tokens for paced frame
+   *
+   * Tokens will not be taken, so use this before sending and call
+   * \ref Take after frame has been sent.
+   *
+   * \param Time    Time in ms
+   * \param len     Frame data length
+   * \retval true   Frame can be sent now
+   * \retval false  Not enough tokens
+   */
+  bool CanTake(uint64_t Time, unsigned char len);
+
+  /*********************************************************************//**
+   * \brief Take tokens for paced frame
+   *
+   * \param Time    Time in ms
+   * \param len     Frame data length
+   * \retval true   Frame can be sent now
+   * \retval false  Not enough tokens
+   */
+  bool Take(uint64_t Time, unsigned char len);
+
+  /*********************************************************************//**
+   * \brief Get time, when first deferred frame can be sent
+   *
+   * \param Time    Current time in ms
+   * \return Time in ms. Time, if there are no deferred frames.
+   */
+  uint64_t GetNextSendTime(uint64_t Time) const;
+
+  /*********************************************************************//**
+   * \brief Add frame to end of deferred queue
+   *
+   * \retval true   Frame has been queued
+   * \retval false  Queue is full
+   */
+  bool Defer(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent);
+  /** \brief First deferred frame or 0 */
+  const tFrame *GetDeferred() const { return FrameCount>0 ? &Frames[FrameRead] : 0; }
+  /** \brief Remove first deferred frame */
+  void RemoveDeferred();
+  bool HasDeferred() const { return FrameCount>0; }
+  /** \brief Remove all deferred frames */
+  void ClearDeferred() { FrameCount=0; }
+
+  /** \brief Bus load on last measurement window in % */
+  uint8_t GetBusLoad() const { return BusLoad; }
+  /** \brief Number of frames, which can still be deferred */
+  uint16_t GetFreeFrames() const { return MaxFrames-FrameCount; }
+  /** \brief Number of frames waiting on queue */
+  uint16_t GetDeferredFrames() const { return FrameCount; }
+  /** \brief Highest number of frames on queue */
+  uint16_t GetPeakDeferredFrames() const { return PeakFrameCount; }
+  /** \brief Total number of deferred frames */
+  uint32_t GetDeferredCount() const { return DeferredCount; }
+};
+
+#endif
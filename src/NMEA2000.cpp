@@ -23,6 +23,7 @@ OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "NMEA2000.h"
 #include "N2kDef.h"
+#include "N2kTrace.h"
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
 #include "N2kGroupFunctionDefaultHandlers.h"
 #endif
@@ -38,6 +39,7 @@ OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // #define NMEA2000_MSG_TX_DEBUG
 // #define NMEA2000_MSG_RX_DEBUG  // This one spams the console with every parsed message
 // #define NMEA2000_BUF_DEBUG
+// Define N2K_TRACE for whole library build to record structured trace probes. See N2kTrace.h
 // #define NMEA2000_DEBUG
 
 #if defined(NMEA2000_FRAME_ERROR_DEBUG)
@@ -125,6 +127,10 @@ void N2kPrintFreeMemory(const char *Source) {
 
 /** \brief Max frames, which can be received at time */
 #define TP_MAX_FRAMES 5
+/** \brief Interval between broadcast data packets in ms */
+#define TP_DTInterval 50
+/** \brief Timeout for receiver response (CTS or End of Message Acknowledgement) in ms */
+#define TP_ResponseTimeout 100
 /** \brief Multi packet connection management, TP.CM */
 #define TP_CM 60416L
 /** \brief Multi packet data transfer */
@@ -166,7 +172,8 @@ void N2kPrintFreeMemory(const char *Source) {
  * - 126996L Product information, pri=6, period=NA
  * - 126998L Configuration information, pri=6, period=NA
  * 
- * This list is terminated by 0.
+ * This list is terminated by 0. List must be kept sorted, since it will
+ * be used as PGN table for devices without own list.
  *
  */
 const unsigned long DefTransmitMessages[] PROGMEM = {
@@ -200,7 +207,8 @@ const unsigned long DefTransmitMessages[] PROGMEM = {
  * - 65240L Commanded Address
  * - 126208L NMEA Request/Command/Acknowledge group function
  * 
- * This list is terminated by 0.
+ * This list is terminated by 0. List must be kept sorted, since it will
+ * be used as PGN table for devices without own list.
  *
  */
 const unsigned long DefReceiveMessages[] PROGMEM = {
@@ -701,6 +709,11 @@ tNMEA2000::tNMEA2000() {
 
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
   pGroupFunctionHandlers=0;
+  GroupFunctionHandlerIndex=0;
+  GroupFunctionHandlerIndexSize=0;
+  GroupFunctionHandlerCount=0;
+  GroupFunctionPGNHandlerCount=0;
+  GroupFunctionHandlerIndexValid=false;
 #endif
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
   InstallationDescriptionChanged=false;
@@ -708,9 +721,14 @@ tNMEA2000::tNMEA2000() {
   ForwardStream=0;
 
   for (int i=0; i<N2kMessageGroups; i++) {SingleFrameMessages[i]=0; FastPacketMessages[i]=0;}
+  InvalidateCANIdCache();
 
   N2kCANMsgBuf=0;
   MaxN2kCANMsgs=0;
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+  LargeMsgBuf=0;
+  MaxLargeMsgs=0;
+#endif
 
   MaxCANSendFrames=40;
   MaxCANReceiveFrames=0; // Use driver default
@@ -719,10 +737,54 @@ tNMEA2000::tNMEA2000() {
   OnOpen=0;
   MsgHandler=0;
   MsgHandlers=0;
+  FrameMonitor=0;
   ISORqstHandler=0;
+  ISORequestCoalesceTime=N2K_ISO_REQUEST_COALESCE_TIME;
+#if !defined(N2K_NO_JOURNAL)
+  Journal=0;
+  JournalPending=0;
+#endif
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+  SlotAllocator=0;
+  SendingReservedMsg=false;
+#endif
+#if !defined(N2K_NO_TX_PACER)
+  TxPacer=0;
+#endif
+  memset(&Stats,0,sizeof(Stats));
+  PGNStats=0;
+  MaxPGNStats=0;
+  PGNStatsCount=0;
+  StatsStream=0;
+  StatsDumpPeriod=0;
+  HandlerTiming=false;
+  HandlerBudget=0;
+  SlowHandlerCallback=0;
+  memset(&MsgHandlerStats,0,sizeof(MsgHandlerStats));
+  Subscriptions=0;
+  SubscriptionCount=0;
+  SubscriptionCapacity=0;
+  CANFilters=0;
+  CANFilterCount=0;
+  CANFilterCapacity=0;
+  ForwardRules=0;
+  ForwardRuleCount=0;
+  ForwardRuleCapacity=0;
+  ForwardStates=0;
+  ForwardStateCount=0;
+  ForwardStateCapacity=0;
+  PeriodicMsgs=0;
+  PeriodicMsgCount=0;
+  PeriodicMsgCapacity=0;
+  PeriodicMsgQueue=0;
+  PeriodicMsgQueueCount=0;
 
   OpenScheduler.FromNow(0);
   OpenState=os_None;
+  NextProtocolEventTime=0;
+#if defined(N2K_FRAME_TIMESTAMP)
+  RxFrameTime=0;
+#endif
   AddressChanged=false;
   DeviceInformationChanged=false;
   dbMode=dm_None;
@@ -738,6 +800,11 @@ tNMEA2000::tNMEA2000() {
                                      DefInstallationDescription2);
   Devices=0;
   DeviceCount=1;
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+  MaxTPSessions=1;
+#endif
+  SourceDeviceIndex=0;
+  ClearClaimedAddresses();
 }
 
 //*****************************************************************************
@@ -752,6 +819,8 @@ void tNMEA2000::InitDevices() {
     N2kDbgln("Init devices");
     Devices=new tInternalDevice[DeviceCount];
     MaxCANSendFrames*=DeviceCount; // We need bigger buffer for sending all information
+    // For single device simple compare is faster than lookup and saves memory.
+    if ( DeviceCount>1 ) SourceDeviceIndex=new uint8_t[256];
 //    for (int i=0; i<DeviceCount; i++) Devices[i].tDevice();
     // We set default device information here.
     Devices[0].LocalProductInformation=0;
@@ -768,7 +837,12 @@ void tNMEA2000::InitDevices() {
         Devices[i].LocalProductInformation=0;
         Devices[i].ProductInformation=0;
       }
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+      Devices[i].TPSessions=new tTPSession[MaxTPSessions];
+      Devices[i].MaxTPSessions=MaxTPSessions;
+#endif
     }
+    UpdateSourceDeviceIndex();
   }
 }
 
@@ -779,6 +853,9 @@ void tNMEA2000::SetProductInformation(const tProductInformation *_ProductInforma
   Devices[iDev].ProductInformation=_ProductInformation;
   if (Devices[iDev].ProductInformation==0) Devices[iDev].ProductInformation=Devices[iDev].LocalProductInformation;
   if (Devices[iDev].ProductInformation==0) Devices[iDev].ProductInformation=&DefProductInformation;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  InvalidateProductInformationCache();
+#endif
 }
 
 //*****************************************************************************
@@ -798,6 +875,9 @@ void tNMEA2000::SetProductInformation(const char *_ModelSerialCode,
   }
   Devices[iDev].ProductInformation=Devices[iDev].LocalProductInformation;
   Devices[iDev].LocalProductInformation->Set(_ModelSerialCode,_ProductCode,_ModelID,_SwCode,_ModelVersion,_LoadEquivalency,_N2kVersion,_CertificationLevel);
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  InvalidateProductInformationCache();
+#endif
 }
 
 //*****************************************************************************
@@ -836,6 +916,9 @@ void tNMEA2000::SetConfigurationInformation(const char *ManufacturerInformation,
 
   SetCharBuf(ManufacturerInformation,ManInfoLen,Info);
   ConfigurationInformation.ManufacturerInformation=(ManufacturerInformation?Info:0);
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  ConfigurationInformationCache.Invalidate();
+#endif
 }
 
 //*****************************************************************************
@@ -847,21 +930,95 @@ void tNMEA2000::SetProgmemConfigurationInformation(const char *ManufacturerInfor
   ConfigurationInformation.ManufacturerInformation=ManufacturerInformation;
   ConfigurationInformation.InstallationDescription1=InstallationDescription1;
   ConfigurationInformation.InstallationDescription2=InstallationDescription2;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  ConfigurationInformationCache.Invalidate();
+#endif
+}
+
+//*****************************************************************************
+void tNMEA2000::tPGNTable::Free() {
+  if ( Allocated && PGNs!=0 ) delete[] PGNs;
+  PGNs=0; Size=0; Allocated=false;
+}
+
+//*****************************************************************************
+void tNMEA2000::tPGNTable::Build(const unsigned long *DefaultList, const unsigned long *DeviceList) {
+  size_t Count=0;
+  unsigned long PGN;
+
+  Free();
+  for (Count=0; pgm_read_dword(&DefaultList[Count])!=0; Count++);
+
+  if ( DeviceList==0 ) { // Default list is sorted, so use it directly from PROGMEM
+    PGNs=DefaultList;
+    Size=Count;
+    return;
+  }
+
+  for (int i=0; pgm_read_dword(&DeviceList[i])!=0; i++, Count++);
+  if ( Count>0xffff ) Count=0xffff;
+
+  unsigned long *Table=new unsigned long[Count];
+  if ( Table==0 ) return;
+
+  // Insertion sort, since lists are short and mostly sorted.
+  const unsigned long *Lists[2]={ DefaultList, DeviceList };
+  for (int l=0; l<2; l++) {
+    for (int i=0; (PGN=pgm_read_dword(&Lists[l][i]))!=0 && Size<Count; i++) {
+      uint16_t j=Size;
+      while ( j>0 && Table[j-1]>PGN ) j--;
+      if ( j>0 && Table[j-1]==PGN ) continue; // Duplicate
+      for (uint16_t k=Size; k>j; k--) Table[k]=Table[k-1];
+      Table[j]=PGN;
+      Size++;
+    }
+  }
+  PGNs=Table;
+  Allocated=true;
+}
+
+//*****************************************************************************
+int tNMEA2000::tPGNTable::Find(unsigned long PGN) const {
+  int Low=0;
+  int High=(int)Size-1;
+
+  while ( Low<=High ) {
+    int Mid=(Low+High)>>1;
+    unsigned long MidPGN=Get(Mid);
+    if ( MidPGN==PGN ) return Mid;
+    if ( MidPGN<PGN ) { Low=Mid+1; } else { High=Mid-1; }
+  }
+
+  return -1;
+}
+
+//*****************************************************************************
+void tNMEA2000::UpdatePGNTables(int iDev) {
+  tInternalDevice &Device=Devices[iDev];
+  if ( !Device.PGNTablesInvalid ) return;
+
+  Device.TxPGNTable.Build(DefTransmitMessages,Device.TransmitMessages);
+  Device.RxPGNTable.Build(DefReceiveMessages,Device.ReceiveMessages);
+
+  if ( Device.PGNSequenceCounters!=0 ) delete[] Device.PGNSequenceCounters;
+  Device.MaxPGNSequenceCounters=Device.TxPGNTable.Size+1; // Reserve 1 for undefined PGNs
+  Device.PGNSequenceCounters=new uint8_t[Device.MaxPGNSequenceCounters];
+  if ( Device.PGNSequenceCounters!=0 ) {
+    memset(Device.PGNSequenceCounters,0,Device.MaxPGNSequenceCounters);
+  } else {
+    Device.MaxPGNSequenceCounters=0;
+  }
+  Device.PGNTablesInvalid=false;
 }
 
 //*****************************************************************************
 size_t tNMEA2000::GetFastPacketTxPGNCount(int iDev) {
   if ( !IsValidDevice(iDev) ) return 0;
-  unsigned long ListPGN;
+  UpdatePGNTables(iDev);
   size_t FPTxPGNCount=0;
 
-  for (int i=0; (ListPGN=pgm_read_dword(&DefTransmitMessages[i]))!=0; i++) {
-    if ( IsFastPacketPGN(ListPGN) ) FPTxPGNCount++;
-  }
-  if (Devices[iDev].TransmitMessages!=0) {
-    for (int i=0; (ListPGN=pgm_read_dword(&Devices[iDev].TransmitMessages[i]))!=0; i++) {
-      if ( IsFastPacketPGN(ListPGN) ) FPTxPGNCount++;
-    }
+  for (uint16_t i=0; i<Devices[iDev].TxPGNTable.Size; i++) {
+    if ( IsFastPacketPGN(Devices[iDev].TxPGNTable.Get(i)) ) FPTxPGNCount++;
   }
 
   return FPTxPGNCount;
@@ -870,31 +1027,16 @@ size_t tNMEA2000::GetFastPacketTxPGNCount(int iDev) {
 //*****************************************************************************
 int tNMEA2000::GetSequenceCounter(unsigned long PGN, int iDev) {
   if ( !IsValidDevice(iDev) ) return 0;
+  UpdatePGNTables(iDev);
 
-  if ( Devices[iDev].PGNSequenceCounters==0 ) { // Sequence counters has not yet been initialized
-    Devices[iDev].MaxPGNSequenceCounters=GetFastPacketTxPGNCount(iDev)+1; // Reserve 1 for undefined PGNs
-    Devices[iDev].PGNSequenceCounters=new unsigned long[Devices[iDev].MaxPGNSequenceCounters];
-    for ( size_t i=0; i<Devices[iDev].MaxPGNSequenceCounters; i++ ) Devices[iDev].PGNSequenceCounters[i]=0;
-  }
-  if ( Devices[iDev].PGNSequenceCounters==0 ) return 0; // Should not be. Only in case of memory allocation problem.
-  size_t last=Devices[iDev].MaxPGNSequenceCounters-1;
-  unsigned long sc;
-  for ( size_t i=0; i<last; i++ ) {
-    if ( Devices[iDev].PGNSequenceCounters[i]==0 ) { // Empty place, use this
-      Devices[iDev].PGNSequenceCounters[i]=PGN;
-      return 0; // Start from sequence 0
-    }
-    if ( (Devices[iDev].PGNSequenceCounters[i]&0x00ffffff) == PGN ) { // Found counter, use it
-      sc=Devices[iDev].PGNSequenceCounters[i]>>24;
-      sc++; if (sc>7) sc=0; // Get next counter
-      Devices[iDev].PGNSequenceCounters[i]=PGN | (sc << 24);
-      return sc;
-    }
-  }
-  // PGN counter not found, so use common
-  sc=Devices[iDev].PGNSequenceCounters[last];
-  sc++; if (sc>7) sc=0;
-  Devices[iDev].PGNSequenceCounters[last]=sc;
+  tInternalDevice &Device=Devices[iDev];
+  if ( Device.PGNSequenceCounters==0 ) return 0; // Should not be. Only in case of memory allocation problem.
+  size_t Counter=Device.MaxPGNSequenceCounters-1; // Common for PGNs not on list
+  int Index=Device.TxPGNTable.Find(PGN);
+  if ( Index>=0 ) Counter=Index;
+
+  uint8_t sc=Device.PGNSequenceCounters[Counter];
+  Device.PGNSequenceCounters[Counter]=(sc+1) & 0x07;
   return sc;
 }
 
@@ -914,17 +1056,8 @@ void CopyProgmemString(const char *str, size_t MaxLen, char *buf) {
 //*****************************************************************************
 bool tNMEA2000::IsTxPGN(unsigned long PGN, int iDev) {
   if ( !IsValidDevice(iDev) ) return false;
-  unsigned long ListPGN;
-
-  for (int i=0; (ListPGN=pgm_read_dword(&DefTransmitMessages[i]))!=0; i++) {
-    if ( ListPGN==PGN ) return true;
-  }
-  if (Devices[iDev].TransmitMessages!=0) {
-    for (int i=0; (ListPGN=pgm_read_dword(&Devices[iDev].TransmitMessages[i]))!=0; i++) {
-      if ( ListPGN==PGN ) return true;
-    }
-  }
-  return false;
+  UpdatePGNTables(iDev);
+  return Devices[iDev].TxPGNTable.Find(PGN)>=0;
 }
 
 //*****************************************************************************
@@ -1081,6 +1214,10 @@ void tNMEA2000::SetInstallationDescription1(const char *InstallationDescription1
   SetCharBuf(InstallationDescription1,Max_N2kConfigurationInfoField_len,Info);
   ConfigurationInformation.InstallationDescription1=(InstallationDescription1?Info:0);
   InstallationDescriptionChanged=true;
+  JournalChanged(ji_InstallationDescription);
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  ConfigurationInformationCache.Invalidate();
+#endif
 }
 
 //*****************************************************************************
@@ -1090,6 +1227,10 @@ void tNMEA2000::SetInstallationDescription2(const char *InstallationDescription2
   SetCharBuf(InstallationDescription2,Max_N2kConfigurationInfoField_len,Info);
   ConfigurationInformation.InstallationDescription2=(InstallationDescription2?Info:0);
   InstallationDescriptionChanged=true;
+  JournalChanged(ji_InstallationDescription);
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  ConfigurationInformationCache.Invalidate();
+#endif
 }
 
 //*****************************************************************************
@@ -1168,11 +1309,13 @@ void tNMEA2000::SetDeviceInformationInstances(
   if ( Devices[iDev].DeviceInformation.GetDeviceInstance()!=DeviceInstance) {
     Devices[iDev].DeviceInformation.SetDeviceInstance(DeviceInstance);
     DeviceInformationChanged=true;
+    JournalChanged(ji_Instances);
   }
 
   if (_SystemInstance!=0xff && Devices[iDev].DeviceInformation.GetSystemInstance()!=_SystemInstance) {
     Devices[iDev].DeviceInformation.SetSystemInstance(_SystemInstance);
     DeviceInformationChanged=true;
+    JournalChanged(ji_Instances);
   }
 
   // Send delayed. Had problems with some devices with too fast response.
@@ -1182,21 +1325,25 @@ void tNMEA2000::SetDeviceInformationInstances(
 //*****************************************************************************
 void tNMEA2000::SetSingleFrameMessages(const unsigned long *_SingleFrameMessages) {
   SingleFrameMessages[0]=_SingleFrameMessages;
+  InvalidateCANIdCache();
 }
 
 //*****************************************************************************
 void tNMEA2000::SetFastPacketMessages(const unsigned long *_FastPacketMessages) {
   FastPacketMessages[0]=_FastPacketMessages;
+  InvalidateCANIdCache();
 }
 
 //*****************************************************************************
 void tNMEA2000::ExtendSingleFrameMessages(const unsigned long *_SingleFrameMessages) {
   SingleFrameMessages[1]=_SingleFrameMessages;
+  InvalidateCANIdCache();
 }
 
 //*****************************************************************************
 void tNMEA2000::ExtendFastPacketMessages(const unsigned long *_FastPacketMessages) {
   FastPacketMessages[1]=_FastPacketMessages;
+  InvalidateCANIdCache();
 }
 
 //*****************************************************************************
@@ -1204,6 +1351,10 @@ void tNMEA2000::ExtendTransmitMessages(const unsigned long *_Messages, int iDev)
   if ( !IsValidDevice(iDev) ) return;
   InitDevices();
   Devices[iDev].TransmitMessages=_Messages;
+  Devices[iDev].PGNTablesInvalid=true;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  Devices[iDev].TxPGNListCache.Invalidate();
+#endif
 }
 
 //*****************************************************************************
@@ -1211,6 +1362,10 @@ void tNMEA2000::ExtendReceiveMessages(const unsigned long *_Messages, int iDev)
   if ( !IsValidDevice(iDev) ) return;
   InitDevices();
   Devices[iDev].ReceiveMessages=_Messages;
+  Devices[iDev].PGNTablesInvalid=true;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  Devices[iDev].RxPGNListCache.Invalidate();
+#endif
 }
 
 //*****************************************************************************
@@ -1221,6 +1376,7 @@ void tNMEA2000::SetMode(tN2kMode _N2kMode, uint8_t _N2kSource) {
     Devices[i].N2kSource=_N2kSource+i;
     Devices[i].UpdateAddressClaimEndSource();
   }
+  UpdateSourceDeviceIndex();
   AddressChanged=false;
 }
 
@@ -1248,6 +1404,17 @@ bool tNMEA2000::Open() {
       if ( MaxN2kCANMsgs==0 ) MaxN2kCANMsgs=5;
       N2kCANMsgBuf = new tN2kCANMsg[MaxN2kCANMsgs];
       for (int i=0; i<MaxN2kCANMsgs; i++) N2kCANMsgBuf[i].FreeMessage();
+      #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+      if ( MaxLargeMsgs>0 ) {
+        // Reserve data for all large messages as one block.
+        unsigned char *LargeData=new unsigned char[MaxLargeMsgs*tN2kLargeMsg::MaxLargeDataLen];
+        LargeMsgBuf=new tN2kLargeMsg[MaxLargeMsgs];
+        for (int i=0; i<MaxLargeMsgs; i++) {
+          LargeMsgBuf[i].LargeData=&(LargeData[i*tN2kLargeMsg::MaxLargeDataLen]);
+          LargeMsgBuf[i].Clear();
+        }
+      }
+      #endif
 
       #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
       // On first open try add also default group function handlers
@@ -1268,6 +1435,7 @@ bool tNMEA2000::Open() {
     if ( !OpenScheduler.IsTime() ) return false;
     bool Notify=( (ForwardStream!=0) && (ForwardType==tNMEA2000::fwdt_Text) );
     if ( (dbMode!=dm_None) || CANOpen() ) {
+      if ( dbMode==dm_None && SubscriptionCount>0 ) SetHardwareFilters();
       OpenState=os_WaitOpen;
       OpenScheduler.FromNow(200);
       if ( Notify ) ForwardStream->println(F("CAN device ready"));
@@ -1282,10 +1450,21 @@ bool tNMEA2000::Open() {
   // Initialization so we start sending delayed.
   if ( OpenState==os_WaitOpen && OpenScheduler.IsTime() ) {
     OpenState=os_Open;
+    #if !defined(N2K_NO_JOURNAL)
+    RestoreJournal(ji_Source | ji_Instances | ji_InstallationDescription); // Claim with last saved address
+    #endif
     StartAddressClaim();
     tN2kSyncScheduler::SetSyncOffset();
+    for (uint16_t i=0; i<PeriodicMsgCount; i++) PeriodicMsgs[i].Scheduler.UpdateNextTime();
+    RebuildPeriodicMsgQueue();
     #if !defined(N2K_NO_HEARTBEAT_SUPPORT)
     SetHeartbeatIntervalAndOffset(DefaultHeartbeatInterval,10000); // Init default hearbeat interval and offset.
+    #if !defined(N2K_NO_SLOT_ALLOCATOR)
+    AllocateHeartbeatSlots();
+    #endif
+    #endif
+    #if !defined(N2K_NO_JOURNAL)
+    RestoreJournal(ji_Heartbeat);
     #endif
     if ( OnOpen!=0 ) OnOpen();
   } else {
@@ -1300,9 +1479,221 @@ bool tNMEA2000::Open() {
   return OpenState>=os_WaitOpen;
 }
 
+#if !defined(N2K_NO_JOURNAL)
+// Journal key has setting type on high nibble and device index on low nibble.
+#define N2kJournalKey(Type,iDev) ((uint8_t)(((Type)<<4) | (iDev)))
+#define N2kJournalSource 1
+#define N2kJournalInstances 2
+#define N2kJournalHeartbeat 3
+#define N2kJournalInstallationDescription1 4
+#define N2kJournalInstallationDescription2 5
+#define N2kJournalMaxDevices 16
+
+//*****************************************************************************
+void tNMEA2000::WriteJournal() {
+  if ( Journal==0 || JournalPending==0 ) return;
+
+  uint8_t Done=JournalPending;
+  for (int i=0; i<DeviceCount && i<N2kJournalMaxDevices; i++) {
+    tInternalDevice &Device=Devices[i];
+    if ( (JournalPending & ji_Source)!=0 ) {
+      if ( IsAddressClaimStarted(i) ) {
+        Done&=~ji_Source;
+      } else if ( Device.N2kSource<=N2kMaxCanBusAddress ) {
+        Journal->Write(N2kJournalKey(N2kJournalSource,i),&Device.N2kSource,1);
+      }
+    }
+    if ( (JournalPending & ji_Instances)!=0 ) {
+      uint8_t Instances[2]={ Device.DeviceInformation.GetDeviceInstance(), Device.DeviceInformation.GetSystemInstance() };
+      Journal->Write(N2kJournalKey(N2kJournalInstances,i),Instances,2);
+    }
+#if !defined(N2K_NO_HEARTBEAT_SUPPORT)
+    if ( (JournalPending & ji_Heartbeat)!=0 ) {
+      uint8_t Heartbeat[8];
+      uint32_t Period=Device.HeartbeatScheduler.GetPeriod();
+      uint32_t Offset=Device.HeartbeatScheduler.GetOffset();
+      for (uint8_t b=0; b<4; b++) {
+        Heartbeat[b]=(uint8_t)(Period>>(8*b));
+        Heartbeat[4+b]=(uint8_t)(Offset>>(8*b));
+      }
+      Journal->Write(N2kJournalKey(N2kJournalHeartbeat,i),Heartbeat,8);
+    }
+#endif
+  }
+
+#if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
+  if ( (JournalPending & ji_InstallationDescription)!=0 ) {
+    char Buf[Max_N2kConfigurationInfoField_len];
+    GetInstallationDescription1(Buf,Max_N2kConfigurationInfoField_len);
+    Journal->Write(N2kJournalKey(N2kJournalInstallationDescription1,0),Buf,strlen(Buf));
+    GetInstallationDescription2(Buf,Max_N2kConfigurationInfoField_len);
+    Journal->Write(N2kJournalKey(N2kJournalInstallationDescription2,0),Buf,strlen(Buf));
+  }
+#endif
+
+  JournalPending&=~Done;
+}
+
+//*****************************************************************************
+void tNMEA2000::RestoreJournal(uint8_t Items) {
+  if ( Journal==0 ) return;
+
+  InitDevices();
+  for (int i=0; i<DeviceCount && i<N2kJournalMaxDevices; i++) {
+    tInternalDevice &Device=Devices[i];
+    if ( (Items & ji_Source)!=0 ) {
+      uint8_t Source;
+      uint8_t Len=1;
+      if ( Journal->Read(N2kJournalKey(N2kJournalSource,i),&Source,Len) && Len==1 && Source<=N2kMaxCanBusAddress ) {
+        Device.N2kSource=Source;
+        Device.UpdateAddressClaimEndSource();
+      }
+    }
+    if ( (Items & ji_Instances)!=0 ) {
+      uint8_t Instances[2];
+      uint8_t Len=2;
+      if ( Journal->Read(N2kJournalKey(N2kJournalInstances,i),Instances,Len) && Len==2 ) {
+        Device.DeviceInformation.SetDeviceInstance(Instances[0]);
+        Device.DeviceInformation.SetSystemInstance(Instances[1]);
+      }
+    }
+#if !defined(N2K_NO_HEARTBEAT_SUPPORT)
+    if ( (Items & ji_Heartbeat)!=0 ) {
+      uint8_t Heartbeat[8];
+      uint8_t Len=8;
+      if ( Journal->Read(N2kJournalKey(N2kJournalHeartbeat,i),Heartbeat,Len) && Len==8 ) {
+        uint32_t Period=0;
+        uint32_t Offset=0;
+        for (uint8_t b=0; b<4; b++) {
+          Period|=(uint32_t)Heartbeat[b]<<(8*b);
+          Offset|=(uint32_t)Heartbeat[4+b]<<(8*b);
+        }
+        if ( Period>=1000 && Period<=MaxHeartbeatInterval ) {
+          Device.HeartbeatScheduler.SetPeriodAndOffset(Period,Offset);
+          ProtocolTimerChanged();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+          ReserveSlots();
+#endif
+        }
+      }
+    }
+#endif
+  }
+  if ( (Items & ji_Source)!=0 ) UpdateSourceDeviceIndex();
+
+#if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
+  if ( (Items & ji_InstallationDescription)!=0 ) {
+    char Buf[Max_N2kConfigurationInfoField_len];
+    uint8_t Len=Max_N2kConfigurationInfoField_len-1;
+    bool Changed=InstallationDescriptionChanged;
+    if ( Journal->Read(N2kJournalKey(N2kJournalInstallationDescription1,0),Buf,Len) ) {
+      Buf[Len]=0;
+      SetInstallationDescription1(Buf);
+    }
+    Len=Max_N2kConfigurationInfoField_len-1;
+    if ( Journal->Read(N2kJournalKey(N2kJournalInstallationDescription2,0),Buf,Len) ) {
+      Buf[Len]=0;
+      SetInstallationDescription2(Buf);
+    }
+    InstallationDescriptionChanged=Changed;
+  }
+#endif
+
+  JournalPending&=~Items;
+}
+#endif
+
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+// Resent information will be delayed to least loaded slot on this range.
+#define N2kSlotMinDelay 150
+#define N2kSlotDelaySpan 100
+
+//*****************************************************************************
+// Frames needed for message. Fast packet first frame has 6 data bytes and
+// others 7. Larger than fast packet messages will be sent with TP.
+static uint8_t N2kFrameCount(int DataLen, bool FastPacket) {
+  if ( DataLen>tN2kMsg::MaxDataLen ) return 0xff;
+  if ( !FastPacket || DataLen<=6 ) return 1;
+  return 1+(DataLen-6+6)/7;
+}
+
+//*****************************************************************************
+void tNMEA2000::SetSlotAllocator(tN2kSlotAllocator *_SlotAllocator) {
+  SlotAllocator=_SlotAllocator;
+  ReserveSlots();
+}
+
+//*****************************************************************************
+uint8_t tNMEA2000::GetPeriodicMsgFrames(const tPeriodicMsg &Msg) {
+  bool FastPacket=IsFastPacketPGN(Msg.PGN);
+
+  // Length of produced message is not known, so assume short fast packet.
+  if ( Msg.TemplateData==0 || Msg.TemplateDataLen==0 ) return FastPacket?3:1;
+  return N2kFrameCount(Msg.TemplateDataLen,FastPacket);
+}
+
+//*****************************************************************************
+void tNMEA2000::ReserveSlots(int SkipPeriodicMsg, bool Heartbeats) {
+  if ( SlotAllocator==0 ) return;
+
+  SlotAllocator->ClearReserved();
+#if !defined(N2K_NO_HEARTBEAT_SUPPORT)
+  for (int i=0; Heartbeats && Devices!=0 && i<DeviceCount; i++) {
+    const tN2kSyncScheduler &Heartbeat=Devices[i].HeartbeatScheduler;
+    if ( Heartbeat.IsEnabled() ) SlotAllocator->Reserve(Heartbeat.GetPeriod(),Heartbeat.GetOffset(),1);
+  }
+#else
+  (void)Heartbeats;
+#endif
+  for (uint16_t i=0; i<PeriodicMsgCount; i++) {
+    const tPeriodicMsg &Msg=PeriodicMsgs[i];
+    if ( (int)i==SkipPeriodicMsg || !Msg.Scheduler.IsEnabled() ) continue;
+    SlotAllocator->Reserve(Msg.Scheduler.GetPeriod(),Msg.Scheduler.GetOffset(),GetPeriodicMsgFrames(Msg));
+  }
+}
+
+//*****************************************************************************
+void tNMEA2000::AllocateHeartbeatSlots() {
+#if !defined(N2K_NO_HEARTBEAT_SUPPORT)
+  if ( SlotAllocator==0 ) return;
+
+  ReserveSlots(-1,false);
+  for (int i=0; i<DeviceCount; i++) {
+    tN2kSyncScheduler &Heartbeat=Devices[i].HeartbeatScheduler;
+    if ( !Heartbeat.IsEnabled() ) continue;
+    Heartbeat.SetPeriodAndOffset(Heartbeat.GetPeriod(),SlotAllocator->Allocate(Heartbeat.GetPeriod(),1,Heartbeat.GetOffset()));
+  }
+  ProtocolTimerChanged();
+#endif
+}
+
+//*****************************************************************************
+unsigned long tNMEA2000::GetSlotDelay(const tN2kMsg &N2kMsg) {
+  return SlotAllocator->GetDelay(N2kMillis64()-tN2kSyncScheduler::GetSyncOffset(),
+                                 N2kSlotMinDelay,N2kSlotDelaySpan,
+                                 N2kFrameCount(N2kMsg.DataLen,IsFastPacket(N2kMsg)));
+}
+#endif
+
 //*****************************************************************************
-void tNMEA2000::Restart() {
-  StartAddressClaim();
+void tNMEA2000::Restart(tRestartMode Mode) {
+  if ( Mode==rm_Cold ) {
+    if ( N2kCANMsgBuf!=0 ) {
+      for (int i=0; i<MaxN2kCANMsgs; i++) N2kCANMsgBuf[i].FreeMessage();
+    }
+    StartAddressClaim();
+    return;
+  }
+
+  for (int i=0; i<DeviceCount; i++) {
+    if ( IsAddressClaimStarted(i) ) continue; // Running claim will do the job
+    if ( Devices[i].N2kSource>N2kMaxCanBusAddress ) {
+      GetNextAddress(i,true);
+      StartAddressClaim(i);
+    } else {
+      SendIsoAddressClaim(0xff,i);
+    }
+  }
 }
 
 /************************************************************************//**
@@ -1364,6 +1755,8 @@ bool tNMEA2000::SendFrames()
     temp = (CANSendFrameBufferRead + 1) % MaxCANSendFrames;
     if ( CANSendFrame(CANSendFrameBuf[temp].id, CANSendFrameBuf[temp].len, CANSendFrameBuf[temp].buf, CANSendFrameBuf[temp].wait_sent) ) {
       CANSendFrameBufferRead=temp;
+      HandleSentFrame(CANSendFrameBuf[temp].id,CANSendFrameBuf[temp].len,CANSendFrameBuf[temp].buf,true);
+      N2kTrace(N2kte_FrameSent,CANSendFrameBuf[temp].id,CANSendFrameBuf[temp].len);
       N2kFrameOutDbgStart("Frame unbuffered "); N2kFrameOutDbgln(CANSendFrameBuf[temp].id);
     } else return false;
   }
@@ -1378,18 +1771,124 @@ bool tNMEA2000::SendFrame(unsigned long id, unsigned char len, const unsigned ch
     tCANSendFrame *Frame=GetNextFreeCANSendFrame();
     if ( Frame==0 ) {
       N2kFrameOutDbgStart("Frame failed "); N2kFrameOutDbgln(id);
+      Stats.SendBufferFull++;
       return false;
     }
+    Stats.FramesBuffered++;
     len=N2kMin<unsigned char>(len,8);
     Frame->id=id;
     Frame->len=len;
     Frame->wait_sent=wait_sent;
     for (int i=0; i<len; i++) Frame->buf[i]=buf[i];
     N2kFrameOutDbgStart("Frame buffered "); N2kFrameOutDbgln(id);
+    N2kTrace(N2kte_FrameQueued,id,len);
+  } else {
+    HandleSentFrame(id,len,buf,false);
+    N2kTrace(N2kte_FrameSent,id,len);
+  }
+  Stats.FramesSent++;
+
+  return true;
+}
+
+//*****************************************************************************
+void tNMEA2000::HandleSentFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool Unbuffered) {
+  len=N2kMin<unsigned char>(len,8);
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+  // Own periodic transmissions have been reserved on allocator, so measure only other own traffic.
+  // Origin of unbuffered frames is not known, so they will be always measured.
+  if ( SlotAllocator!=0 && (Unbuffered || !SendingReservedMsg) ) SlotAllocator->AddFrame(N2kMillis64()-tN2kSyncScheduler::GetSyncOffset());
+#else
+  (void)Unbuffered;
+#endif
+#if !defined(N2K_NO_TX_PACER)
+  if ( TxPacer!=0 ) TxPacer->AddFrame(N2kMillis64(),len);
+#endif
+  if ( FrameMonitor!=0 ) FrameMonitor->HandleFrame(id,len,buf,true,N2kMicros64());
+}
+
+//*****************************************************************************
+bool tNMEA2000::IsPacedMsg(const tN2kMsg &N2kMsg) {
+#if !defined(N2K_NO_TX_PACER)
+  if ( TxPacer==0 || N2kMsg.Priority<=TxPacer->GetBypassPriority() ) return false;
+
+  return ( N2kMsg.PGN==TP_DT || IsFastPacket(N2kMsg) );
+#else
+  (void)N2kMsg;
+  return false;
+#endif
+}
+
+//*****************************************************************************
+bool tNMEA2000::SendPacedFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent) {
+#if !defined(N2K_NO_TX_PACER)
+  if ( TxPacer==0 ) return SendFrame(id,len,buf,wait_sent);
+
+  SendDeferredFrames();
+  uint64_t Now=N2kMillis64();
+  if ( !TxPacer->HasDeferred() && TxPacer->CanTake(Now,len) ) {
+    if ( !SendFrame(id,len,buf,wait_sent) ) return false;
+    TxPacer->Take(Now,len);
+    return true;
+  }
+
+  // Keep frame order by deferring also, when there are earlier frames waiting
+  if ( !TxPacer->Defer(id,len,buf,wait_sent) ) {
+    N2kFrameOutDbgStart("Frame failed "); N2kFrameOutDbgln(id);
+    Stats.SendBufferFull++;
+    return false;
+  }
+  Stats.FramesDeferred++;
+  N2kFrameOutDbgStart("Frame deferred "); N2kFrameOutDbgln(id);
+  N2kTrace(N2kte_FrameQueued,id,len);
+
+  return true;
+#else
+  return SendFrame(id,len,buf,wait_sent);
+#endif
+}
+
+//*****************************************************************************
+bool tNMEA2000::CanDeferFrames(uint8_t FrameCount) {
+#if !defined(N2K_NO_TX_PACER)
+  return ( TxPacer==0 || TxPacer->GetFreeFrames()>=FrameCount );
+#else
+  (void)FrameCount;
+  return true;
+#endif
+}
+
+//*****************************************************************************
+void tNMEA2000::SendDeferredFrames() {
+#if !defined(N2K_NO_TX_PACER)
+  if ( TxPacer==0 || !TxPacer->HasDeferred() ) return;
+
+  uint64_t Now=N2kMillis64();
+  const tN2kTxPacer::tFrame *Frame;
+  // Do not fill library buffer with bulk frames. They could block other frames.
+  while ( SendFrames() && (Frame=TxPacer->GetDeferred())!=0 && TxPacer->CanTake(Now,Frame->len) ) {
+    if ( !SendFrame(Frame->id,Frame->len,Frame->buf,Frame->wait_sent) ) return;
+    TxPacer->Take(Now,Frame->len);
+    TxPacer->RemoveDeferred();
+  }
+#endif
+}
+
+#if !defined(N2K_NO_TX_PACER)
+//*****************************************************************************
+bool tNMEA2000::SetTxPacer(tN2kTxPacer *_TxPacer) {
+  if ( TxPacer!=0 ) { // Do not lose frames deferred by previous pacer
+    const tN2kTxPacer::tFrame *Frame;
+    while ( (Frame=TxPacer->GetDeferred())!=0 ) {
+      if ( !SendFrame(Frame->id,Frame->len,Frame->buf,Frame->wait_sent) ) return false; // Keep rest on previous pacer
+      TxPacer->RemoveDeferred();
+    }
   }
+  TxPacer=_TxPacer;
 
   return true;
 }
+#endif
 
 #if !defined(N2K_NO_HEARTBEAT_SUPPORT)
 //*****************************************************************************
@@ -1413,7 +1912,12 @@ void tNMEA2000::SetHeartbeatIntervalAndOffset(uint32_t interval, uint32_t offset
       bool changed=( Devices[i].HeartbeatScheduler.GetPeriod()!=interval || Devices[i].HeartbeatScheduler.GetOffset()!=offset ); 
       if ( changed ) {
         Devices[i].HeartbeatScheduler.SetPeriodAndOffset(interval,offset);
+        ProtocolTimerChanged();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+        ReserveSlots();
+#endif
         DeviceInformationChanged=true;
+        JournalChanged(ji_Heartbeat);
       }
     }
   }
@@ -1442,7 +1946,13 @@ void tNMEA2000::SendHeartbeat(bool force) {
         Devices[iDev].HeartbeatScheduler.UpdateNextTime();
         tN2kMsg N2kMsg;
         SetHeartbeat(N2kMsg,Devices[iDev].HeartbeatScheduler.GetPeriod(),force?0xff:Devices[iDev].HeartbeatSequence);
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+        SendingReservedMsg=!force;
+        SendMsg(N2kMsg,iDev);
+        SendingReservedMsg=false;
+#else
         SendMsg(N2kMsg,iDev);
+#endif
         if ( !force ) {
           Devices[iDev].HeartbeatSequence++;
           if ( Devices[iDev].HeartbeatSequence>252 ) Devices[iDev].HeartbeatSequence=0;
@@ -1454,79 +1964,318 @@ void tNMEA2000::SendHeartbeat(bool force) {
 #endif
 
 //*****************************************************************************
-tNMEA2000::tCANSendFrame *tNMEA2000::GetNextFreeCANSendFrame() {
-  if (CANSendFrameBuf==0) return 0;
-
-  uint16_t temp = (CANSendFrameBufferWrite + 1) % MaxCANSendFrames;
-
-  if (temp != CANSendFrameBufferRead) {
-    CANSendFrameBufferWrite = temp;
-    return &(CANSendFrameBuf[CANSendFrameBufferWrite]);
-  } else {
-    return 0;
+int tNMEA2000::FindPeriodicMsg(unsigned long PGN, int iDev) const {
+  for (uint16_t i=0; i<PeriodicMsgCount; i++) {
+    if ( PeriodicMsgs[i].PGN==PGN && PeriodicMsgs[i].Device==iDev ) return i;
   }
+
+  return -1;
 }
 
 //*****************************************************************************
-void tNMEA2000::SendPendingInformation() {
-  for (int i=0; i<DeviceCount; i++ ) {
-    if (  Devices[i].HasPendingInformation ) {
-      #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-      SendPendingTPMessage(i);
-      #endif
-      if ( Devices[i].QueryPendingIsoAddressClaim() ) {
-        SendIsoAddressClaim(0xff,i);
-        Devices[i].ClearPendingIsoAddressClaim();
-      }
-      if ( Devices[i].QueryPendingProductInformation() ) SendProductInformation(i);
-      if ( Devices[i].QueryPendingConfigurationInformation() ) SendConfigurationInformation(i);
-    }
-  }
+// Producer for template messages. Template has been already copied to message.
+static bool N2kPeriodicMsgTemplate(tN2kMsg &, int) {
+  return true;
 }
 
 //*****************************************************************************
-// Sends message to N2k bus
-//
-bool tNMEA2000::SendMsg(const tN2kMsg &N2kMsg, int DeviceIndex) {
-  if ( dbMode==dm_None ) {
-    if ( OpenState!=os_Open ) {
-      if ( !(Open() && OpenState==os_Open) ) return false;  // Can not do much
+bool tNMEA2000::AddPeriodicMsg(unsigned long PGN, uint32_t Period, tPeriodicMsgProducer Producer,
+                               uint32_t Offset, int iDev, unsigned char Priority) {
+  if ( iDev<0 || iDev>=DeviceCount || iDev>=0xff || PGN==0 || Period==0 || Producer==0 ) return false;
+
+  int Index=FindPeriodicMsg(PGN,iDev);
+
+  if ( Index<0 ) {
+    if ( PeriodicMsgCount>=PeriodicMsgCapacity ) {
+      if ( PeriodicMsgCapacity>=0xfff0 ) return false;
+      uint16_t NewCapacity=PeriodicMsgCapacity+16;
+      tPeriodicMsg *NewMsgs=new tPeriodicMsg[NewCapacity];
+      uint16_t *NewQueue=new uint16_t[NewCapacity];
+      if ( NewMsgs==0 || NewQueue==0 ) { delete[] NewMsgs; delete[] NewQueue; return false; }
+      for (uint16_t i=0; i<PeriodicMsgCount; i++) NewMsgs[i]=PeriodicMsgs[i];
+      delete[] PeriodicMsgs;
+      delete[] PeriodicMsgQueue;
+      PeriodicMsgs=NewMsgs;
+      PeriodicMsgQueue=NewQueue;
+      PeriodicMsgCapacity=NewCapacity;
     }
+    Index=PeriodicMsgCount++;
+    PeriodicMsgs[Index].TemplateData=0;
+    PeriodicMsgs[Index].TemplateDataLen=0;
+  } else if ( Producer!=N2kPeriodicMsgTemplate ) {
+    delete[] PeriodicMsgs[Index].TemplateData;
+    PeriodicMsgs[Index].TemplateData=0;
   }
 
-  bool result=false;
+  tPeriodicMsg &Msg=PeriodicMsgs[Index];
+  Msg.PGN=PGN;
+  Msg.Producer=Producer;
+  Msg.Device=iDev;
+  Msg.Priority=Priority;
+
+  if ( Offset==0xffffffff ) {
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    if ( SlotAllocator!=0 ) {
+      ReserveSlots(Index);
+      Offset=SlotAllocator->Allocate(Period,GetPeriodicMsgFrames(Msg));
+    } else
+#endif
+    {
+      // Spread messages over period with golden ratio sequence, so that
+      // any number of messages will be evenly distributed.
+      Offset=(uint32_t)(((uint64_t)(Index*40503U & 0xffff)*Period)>>16);
+    }
+  }
 
-  if ( DeviceIndex>=DeviceCount) return result;
-  N2kMsg.CheckDestination();
-  if (DeviceIndex>=0) { N2kMsg.ForceSource(Devices[DeviceIndex].N2kSource); } else { DeviceIndex=0; }
+  Msg.DefaultPeriod=Period;
+  Msg.DefaultOffset=Offset;
+  Msg.Scheduler.SetPeriodAndOffset(Period,Offset);
+  RebuildPeriodicMsgQueue();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+  ReserveSlots();
+#endif
 
-  if ( N2kMsg.Source>N2kMaxCanBusAddress && N2kMsg.PGN!=N2kPGNIsoAddressClaim ) return false; // CAN bus address range is 0-251. Anyway allow ISO address claim mgs.
+  return true;
+}
 
-  unsigned long canId=N2ktoCanID(N2kMsg.Priority,N2kMsg.PGN,N2kMsg.Source, N2kMsg.Destination);
+//*****************************************************************************
+bool tNMEA2000::AddPeriodicMsg(const tN2kMsg &N2kMsg, uint32_t Period, uint32_t Offset, int iDev) {
+  if ( !AddPeriodicMsg(N2kMsg.PGN,Period,N2kPeriodicMsgTemplate,Offset,iDev,N2kMsg.Priority) ) return false;
 
-  if ( canId==0 ) { // PGN validity - N2ktoCanID returns 0 for invalid PGN
-//    if (ForwardStream!=0 && ForwardType==tNMEA2000::fwdt_Text) { ForwardStream->print(F("Invalid PGN ")); ForwardStream->println(N2kMsg.PGN); }
+  tPeriodicMsg &Msg=PeriodicMsgs[FindPeriodicMsg(N2kMsg.PGN,iDev)];
+  if ( Msg.TemplateData==0 ) Msg.TemplateData=new unsigned char[tN2kMsg::MaxDataLen];
+  if ( Msg.TemplateData==0 ) {
+    RemovePeriodicMsg(N2kMsg.PGN,iDev);
     return false;
   }
 
-  if (N2kMode==N2km_ListenOnly) return false; // Do not send anything on listen only mode
+  return UpdatePeriodicMsg(N2kMsg,iDev);
+}
 
-  if (N2kMsg.PGN==0) return false;
+//*****************************************************************************
+bool tNMEA2000::UpdatePeriodicMsg(const tN2kMsg &N2kMsg, int iDev) {
+  int Index=FindPeriodicMsg(N2kMsg.PGN,iDev);
 
-  switch (dbMode) {
-    case dm_None:
-      N2kMsgDbgStart("Send PGN:"); N2kMsgDbgln(N2kMsg.PGN);
-      N2kMsgDbgStart(" - can ID:"); N2kMsgDbgln(canId);
-      if ( IsAddressClaimStarted(DeviceIndex) && N2kMsg.PGN!=N2kPGNIsoAddressClaim ) return false;
+  if ( Index<0 || PeriodicMsgs[Index].TemplateData==0 ) return false;
 
-      if (N2kMsg.DataLen<=8 && !IsFastPacket(N2kMsg) ) { // We can send single frame
-          DbgPrintBuf(N2kMsg.DataLen, N2kMsg.Data,true);
-          result=SendFrame(canId, N2kMsg.DataLen, N2kMsg.Data,false);
-          if (!result && ForwardStream!=0 && ForwardType==tNMEA2000::fwdt_Text) { ForwardStream->print(F("PGN ")); ForwardStream->print(N2kMsg.PGN); ForwardStream->println(F(" send failed")); }
-          N2kPrintFreeMemory("SendMsg, single frame");
-      } else { // Send it as fast packet in multiple frames
-#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-        if ( N2kMsg.IsTPMessage() ) {
+  tPeriodicMsg &Msg=PeriodicMsgs[Index];
+  Msg.TemplateDataLen=( N2kMsg.DataLen<tN2kMsg::MaxDataLen ? N2kMsg.DataLen : tN2kMsg::MaxDataLen );
+  memcpy(Msg.TemplateData,N2kMsg.Data,Msg.TemplateDataLen);
+  Msg.TemplateDestination=N2kMsg.Destination;
+  Msg.Priority=N2kMsg.Priority;
+
+  return true;
+}
+
+//*****************************************************************************
+void tNMEA2000::RemovePeriodicMsg(unsigned long PGN, int iDev) {
+  int Index=FindPeriodicMsg(PGN,iDev);
+
+  if ( Index<0 ) return;
+  delete[] PeriodicMsgs[Index].TemplateData;
+  PeriodicMsgCount--;
+  if ( Index<PeriodicMsgCount ) PeriodicMsgs[Index]=PeriodicMsgs[PeriodicMsgCount];
+  RebuildPeriodicMsgQueue();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+  ReserveSlots();
+#endif
+}
+
+//*****************************************************************************
+bool tNMEA2000::SetPeriodicMsgInterval(unsigned long PGN, uint32_t Period, uint32_t Offset, int iDev) {
+  int Index=FindPeriodicMsg(PGN,iDev);
+
+  if ( Index<0 ) return false;
+
+  tPeriodicMsg &Msg=PeriodicMsgs[Index];
+  if ( Period==0xffffffff ) {
+    Period=Msg.Scheduler.GetPeriod();
+  } else if ( Period==0xfffffffe ) {
+    Period=Msg.DefaultPeriod;
+  }
+  if ( Offset==0xffffffff ) {
+    Offset=Msg.Scheduler.GetOffset();
+  } else if ( Offset==0xfffffffe ) {
+    Offset=Msg.DefaultOffset;
+  }
+  Msg.Scheduler.SetPeriodAndOffset(Period,Offset);
+  RebuildPeriodicMsgQueue();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+  ReserveSlots();
+#endif
+
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000::GetPeriodicMsgInterval(unsigned long PGN, uint32_t &Period, uint32_t &Offset, int iDev) const {
+  int Index=FindPeriodicMsg(PGN,iDev);
+
+  if ( Index<0 ) return false;
+
+  Period=( PeriodicMsgs[Index].Scheduler.IsEnabled() ? PeriodicMsgs[Index].Scheduler.GetPeriod() : 0 );
+  Offset=PeriodicMsgs[Index].Scheduler.GetOffset();
+
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000::SendPeriodicMsg(unsigned long PGN, int iDev) {
+  int Index=FindPeriodicMsg(PGN,iDev);
+
+  return ( Index>=0 && SendPeriodicMsgByIndex(Index) );
+}
+
+//*****************************************************************************
+bool tNMEA2000::SendPeriodicMsgByIndex(uint16_t Index) {
+  const tPeriodicMsg &Msg=PeriodicMsgs[Index];
+  int iDev=Msg.Device;
+
+  if ( !IsActiveNode() || iDev>=DeviceCount || IsAddressClaimStarted(iDev) ) return false;
+
+  tN2kMsg N2kMsg;
+  if ( Msg.TemplateData!=0 ) {
+    N2kMsg.Init(Msg.Priority,Msg.PGN,0xff,Msg.TemplateDestination);
+    memcpy(N2kMsg.Data,Msg.TemplateData,Msg.TemplateDataLen);
+    N2kMsg.DataLen=Msg.TemplateDataLen;
+  }
+  unsigned char Priority=Msg.Priority;
+  if ( !Msg.Producer(N2kMsg,iDev) ) return false;
+  if ( Priority!=0xff ) N2kMsg.Priority=Priority;
+
+  return SendMsg(N2kMsg,iDev);
+}
+
+//*****************************************************************************
+void tNMEA2000::SiftDownPeriodicMsgQueue(uint16_t Pos) {
+  uint16_t Entry=PeriodicMsgQueue[Pos];
+  uint64_t Time=PeriodicMsgs[Entry].Scheduler.GetNextTime();
+
+  for (uint16_t Child=2*Pos+1; Child<PeriodicMsgQueueCount; Child=2*Pos+1) {
+    if ( Child+1<PeriodicMsgQueueCount &&
+         PeriodicMsgs[PeriodicMsgQueue[Child+1]].Scheduler.GetNextTime()<PeriodicMsgs[PeriodicMsgQueue[Child]].Scheduler.GetNextTime() ) Child++;
+    if ( Time<=PeriodicMsgs[PeriodicMsgQueue[Child]].Scheduler.GetNextTime() ) break;
+    PeriodicMsgQueue[Pos]=PeriodicMsgQueue[Child];
+    Pos=Child;
+  }
+  PeriodicMsgQueue[Pos]=Entry;
+}
+
+//*****************************************************************************
+void tNMEA2000::RebuildPeriodicMsgQueue() {
+  PeriodicMsgQueueCount=0;
+  for (uint16_t i=0; i<PeriodicMsgCount; i++) {
+    if ( PeriodicMsgs[i].Scheduler.IsEnabled() ) PeriodicMsgQueue[PeriodicMsgQueueCount++]=i;
+  }
+  for (uint16_t Pos=PeriodicMsgQueueCount/2; Pos>0; Pos--) SiftDownPeriodicMsgQueue(Pos-1);
+  ProtocolTimerChanged();
+}
+
+//*****************************************************************************
+void tNMEA2000::SendPendingPeriodicMsgs() {
+  while ( PeriodicMsgQueueCount>0 ) {
+    uint16_t Index=PeriodicMsgQueue[0];
+    tN2kSyncScheduler &Scheduler=PeriodicMsgs[Index].Scheduler;
+
+    if ( !Scheduler.IsTime() ) break;
+    // Next time will be always in future, so late messages are not repeated.
+    Scheduler.UpdateNextTime();
+    SiftDownPeriodicMsgQueue(0);
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    SendingReservedMsg=true;
+    SendPeriodicMsgByIndex(Index);
+    SendingReservedMsg=false;
+#else
+    SendPeriodicMsgByIndex(Index);
+#endif
+  }
+}
+
+//*****************************************************************************
+tNMEA2000::tCANSendFrame *tNMEA2000::GetNextFreeCANSendFrame() {
+  if (CANSendFrameBuf==0) return 0;
+
+  uint16_t temp = (CANSendFrameBufferWrite + 1) % MaxCANSendFrames;
+
+  if (temp != CANSendFrameBufferRead) {
+    CANSendFrameBufferWrite = temp;
+    return &(CANSendFrameBuf[CANSendFrameBufferWrite]);
+  } else {
+    return 0;
+  }
+}
+
+//*****************************************************************************
+void tNMEA2000::SendPendingInformation() {
+  for (int i=0; i<DeviceCount; i++ ) {
+    if (  Devices[i].HasPendingInformation ) {
+      #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+      SendPendingTPMessage(i);
+      #endif
+      if ( Devices[i].QueryPendingIsoAddressClaim() ) {
+        SendIsoAddressClaim(0xff,i);
+        Devices[i].ClearPendingIsoAddressClaim();
+      }
+      if ( Devices[i].QueryPendingProductInformation() ) SendProductInformation(i);
+      if ( Devices[i].QueryPendingConfigurationInformation() ) SendConfigurationInformation(i);
+    }
+  }
+}
+
+//*****************************************************************************
+// Sends message to N2k bus
+//
+bool tNMEA2000::SendMsg(const tN2kMsg &N2kMsg, int DeviceIndex) {
+  if ( dbMode==dm_None ) {
+    if ( OpenState!=os_Open ) {
+      if ( !(Open() && OpenState==os_Open) ) return false;  // Can not do much
+    }
+  }
+
+  bool result=false;
+  bool Paced;
+
+  if ( DeviceIndex>=DeviceCount) return result;
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+  // TP destination is carried on TP.CM, so also PDU2 messages can be sent to given destination.
+  if ( !N2kMsg.IsTPMessage() ) N2kMsg.CheckDestination();
+#else
+  N2kMsg.CheckDestination();
+#endif
+  if (DeviceIndex>=0) { N2kMsg.ForceSource(Devices[DeviceIndex].N2kSource); } else { DeviceIndex=0; }
+
+  if ( N2kMsg.Source>N2kMaxCanBusAddress && N2kMsg.PGN!=N2kPGNIsoAddressClaim ) return false; // CAN bus address range is 0-251. Anyway allow ISO address claim mgs.
+
+  unsigned long canId=N2ktoCanID(N2kMsg.Priority,N2kMsg.PGN,N2kMsg.Source, N2kMsg.Destination);
+
+  if ( canId==0 ) { // PGN validity - N2ktoCanID returns 0 for invalid PGN
+//    if (ForwardStream!=0 && ForwardType==tNMEA2000::fwdt_Text) { ForwardStream->print(F("Invalid PGN ")); ForwardStream->println(N2kMsg.PGN); }
+    return false;
+  }
+
+  if (N2kMode==N2km_ListenOnly) return false; // Do not send anything on listen only mode
+
+  if (N2kMsg.PGN==0) return false;
+
+  switch (dbMode) {
+    case dm_None:
+      N2kMsgDbgStart("Send PGN:"); N2kMsgDbgln(N2kMsg.PGN);
+      N2kMsgDbgStart(" - can ID:"); N2kMsgDbgln(canId);
+      if ( IsAddressClaimStarted(DeviceIndex) && N2kMsg.PGN!=N2kPGNIsoAddressClaim ) return false;
+      Paced=IsPacedMsg(N2kMsg);
+
+      if (N2kMsg.DataLen<=8 && !IsFastPacket(N2kMsg) ) { // We can send single frame
+          DbgPrintBuf(N2kMsg.DataLen, N2kMsg.Data,true);
+          if ( Paced ) {
+            result=SendPacedFrame(canId, N2kMsg.DataLen, N2kMsg.Data,false);
+          } else {
+            result=SendFrame(canId, N2kMsg.DataLen, N2kMsg.Data,false);
+          }
+          if (!result && ForwardStream!=0 && ForwardType==tNMEA2000::fwdt_Text) { ForwardStream->print(F("PGN ")); ForwardStream->print(N2kMsg.PGN); ForwardStream->println(F(" send failed")); }
+          N2kPrintFreeMemory("SendMsg, single frame");
+      } else { // Send it as fast packet in multiple frames
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+        if ( N2kMsg.IsTPMessage() ) {
           result=StartSendTPMessage(N2kMsg,DeviceIndex);
         } else
 #endif
@@ -1534,8 +2283,10 @@ bool tNMEA2000::SendMsg(const tN2kMsg &N2kMsg, int DeviceIndex) {
           unsigned char temp[8]; // {0,0,0,0,0,0,0,0};
           int cur=0;
           int frames=(N2kMsg.DataLen>6 ? (N2kMsg.DataLen-6-1)/7+1+1 : 1 );
-          int Order=GetSequenceCounter(N2kMsg.PGN,DeviceIndex)<<5;
-          result=true;
+          // Do not start paced fast packet, which would be truncated by full pacer queue
+          result=( !Paced || CanDeferFrames(frames) );
+          if ( !result ) Stats.SendBufferFull++;
+          int Order=( result ? GetSequenceCounter(N2kMsg.PGN,DeviceIndex)<<5 : 0 );
           for (int i = 0; i<frames && result; i++) {
               temp[0] = i|Order; //frame counter
               if (i==0) {
@@ -1559,7 +2310,7 @@ bool tNMEA2000::SendMsg(const tN2kMsg &N2kMsg, int DeviceIndex) {
               }
 
               DbgPrintBuf(8,temp,true);
-              result=SendFrame(canId, 8, temp, true);
+              result=( Paced ? SendPacedFrame(canId, 8, temp, true) : SendFrame(canId, 8, temp, true) );
               if (!result && ForwardStream!=0 && ForwardType==tNMEA2000::fwdt_Text) {
                 ForwardStream->print(F("PGN ")); ForwardStream->print(N2kMsg.PGN);
                 ForwardStream->print(F(", frame:")); ForwardStream->print(i); ForwardStream->print(F("/")); ForwardStream->print(frames);
@@ -1568,6 +2319,13 @@ bool tNMEA2000::SendMsg(const tN2kMsg &N2kMsg, int DeviceIndex) {
           }
         }
       };
+      if ( result ) {
+        Stats.MessagesSent++;
+        if ( PGNStats!=0 ) {
+          tPGNStats *PGNStat=FindPGNStats(N2kMsg.PGN);
+          if ( PGNStat!=0 ) PGNStat->Sent++;
+        }
+      } else Stats.SendFailed++;
       if ( ForwardOwnMessages() ) ForwardMessage(N2kMsg);
       break;
     case dm_ClearText:
@@ -1664,6 +2422,14 @@ bool tNMEA2000::CheckKnownMessage(unsigned long PGN, bool &SystemMessage, bool &
  * \param buf     Pointer to a buffer
  */
 void CopyBufToCANMsg(tN2kCANMsg &CANMsg, unsigned char start, unsigned char len, unsigned char *buf) {
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+        if ( CANMsg.LargeMsg!=0 ) {
+          for (int j=start; (j<len) & (CANMsg.CopiedLen<tN2kLargeMsg::MaxLargeDataLen); j++, CANMsg.CopiedLen++) {
+            CANMsg.LargeMsg->LargeData[CANMsg.CopiedLen]=buf[j];
+          }
+          return;
+        }
+#endif
         for (int j=start; (j<len) & (CANMsg.CopiedLen<CANMsg.N2kMsg.MaxDataLen); j++, CANMsg.CopiedLen++) {
           CANMsg.N2kMsg.Data[CANMsg.CopiedLen]=buf[j];
         }
@@ -1695,9 +2461,14 @@ void tNMEA2000::FindFreeCANMsgIndex(unsigned long PGN, unsigned char Source, uns
       OldestMsgTime=N2kCANMsgBuf[MsgIndex].N2kMsg.MsgTime;
     }
   }
-  if ( MsgIndex==MaxN2kCANMsgs && N2kHasElapsed(OldestMsgTime,Max_N2kMsgBuf_Time,CurTime) ) {
-    MsgIndex=OldestIndex; // Use the old one, which has timed out
-    N2kCANMsgBuf[MsgIndex].FreeMessage();
+  if ( MsgIndex==MaxN2kCANMsgs ) {
+    if ( N2kHasElapsed(OldestMsgTime,Max_N2kMsgBuf_Time,CurTime) ) {
+      MsgIndex=OldestIndex; // Use the old one, which has timed out
+      N2kCANMsgBuf[MsgIndex].FreeMessage();
+      Stats.MsgSlotTimeouts++;
+    } else {
+      Stats.MsgSlotExhausted++;
+    }
   }
 
 }
@@ -1705,9 +2476,10 @@ void tNMEA2000::FindFreeCANMsgIndex(unsigned long PGN, unsigned char Source, uns
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
 
 //*****************************************************************************
-bool tNMEA2000::SendTPCM_BAM(int iDev) {
+bool tNMEA2000::SendTPCM_BAM(int iDev, int iSession) {
   if ( !IsActiveNode() ) return false;
 
+  const tN2kMsg &TPMsg=Devices[iDev].TPSessions[iSession].Msg;
   tN2kMsg N2kMsg;
 
   N2kMsg.Source=Devices[iDev].N2kSource;
@@ -1715,29 +2487,30 @@ bool tNMEA2000::SendTPCM_BAM(int iDev) {
   N2kMsg.SetPGN(TP_CM);
   N2kMsg.Priority=6;
   N2kMsg.AddByte(TP_CM_BAM);
-  int nBytes=Devices[iDev].PendingTPMsg.DataLen;
+  int nBytes=TPMsg.DataLen;
   N2kMsg.Add2ByteUInt(nBytes);
   N2kMsg.AddByte(nBytes/7+(nBytes%7!=0?1:0));
   N2kMsg.AddByte(0xff); // Reserved;
-  N2kMsg.Add3ByteInt(Devices[iDev].PendingTPMsg.PGN);
+  N2kMsg.Add3ByteInt(TPMsg.PGN);
   return SendMsg(N2kMsg,iDev);
 }
 
 //*****************************************************************************
-bool tNMEA2000::SendTPCM_RTS(int iDev) {
+bool tNMEA2000::SendTPCM_RTS(int iDev, int iSession) {
   if ( !IsActiveNode() ) return false;
 
+  const tN2kMsg &TPMsg=Devices[iDev].TPSessions[iSession].Msg;
   tN2kMsg N2kMsg;
   N2kMsg.Source=Devices[iDev].N2kSource;
-  N2kMsg.Destination=Devices[iDev].PendingTPMsg.Destination;
+  N2kMsg.Destination=TPMsg.Destination;
   N2kMsg.SetPGN(TP_CM);
   N2kMsg.Priority=6;
   N2kMsg.AddByte(TP_CM_RTS);
-  int nBytes=Devices[iDev].PendingTPMsg.DataLen;
+  int nBytes=TPMsg.DataLen;
   N2kMsg.Add2ByteUInt(nBytes);
   N2kMsg.AddByte(nBytes/7+(nBytes%7!=0?1:0));
   N2kMsg.AddByte(0xff); // Reserved;
-  N2kMsg.Add3ByteInt(Devices[iDev].PendingTPMsg.PGN);
+  N2kMsg.Add3ByteInt(TPMsg.PGN);
   return SendMsg(N2kMsg,iDev);
 }
 
@@ -1783,6 +2556,7 @@ void tNMEA2000::SendTPCM_Abort(unsigned long PGN, unsigned char Destination, int
   tN2kMsg N2kMsg;
 
   if ( !IsActiveNode() ) return;
+  Stats.TPAbortsSent++;
   N2kMsg.Source=Devices[iDev].N2kSource;
   N2kMsg.Destination=Destination;
   N2kMsg.SetPGN(TP_CM);
@@ -1799,27 +2573,40 @@ void tNMEA2000::SendTPCM_Abort(unsigned long PGN, unsigned char Destination, int
 //*****************************************************************************
 // Caller should take care of not calling this after all has been done.
 // Use HasAllTPDTSent for checking.
-bool tNMEA2000::SendTPDT(int iDev) {
+bool tNMEA2000::SendTPDT(int iDev, int iSession) {
+  tTPSession &Session=Devices[iDev].TPSessions[iSession];
   tN2kMsg N2kMsg;
   N2kMsg.Source=Devices[iDev].N2kSource;
-  N2kMsg.Destination=Devices[iDev].PendingTPMsg.Destination;
+  N2kMsg.Destination=Session.Msg.Destination;
   N2kMsg.SetPGN(TP_DT);
   N2kMsg.Priority=6;
-  N2kMsg.AddByte(Devices[iDev].NextDTSequence+1);
-  int iByteToSend=Devices[iDev].NextDTSequence*7;
+  N2kMsg.AddByte(Session.NextDTSequence+1);
+  int iByteToSend=Session.NextDTSequence*7;
   for ( int i=0; i<7; i++,iByteToSend++ ) {
-    if ( iByteToSend<Devices[iDev].PendingTPMsg.DataLen ) {
-      N2kMsg.AddByte(Devices[iDev].PendingTPMsg.Data[iByteToSend]);
+    if ( iByteToSend<Session.Msg.DataLen ) {
+      N2kMsg.AddByte(Session.Msg.Data[iByteToSend]);
     } else N2kMsg.AddByte(0xff);
   }
-  Devices[iDev].NextDTSequence++;
+  Session.NextDTSequence++;
 
   return SendMsg(N2kMsg,iDev);
 }
 
 //*****************************************************************************
-bool tNMEA2000::HasAllTPDTSent(int iDev) {
-  return ( Devices[iDev].NextDTSequence*7>=Devices[iDev].PendingTPMsg.DataLen );
+bool tNMEA2000::HasAllTPDTSent(int iDev, int iSession) {
+  const tTPSession &Session=Devices[iDev].TPSessions[iSession];
+  return ( Session.NextDTSequence*7>=Session.Msg.DataLen );
+}
+
+//*****************************************************************************
+int tNMEA2000::FindTPSession(int iDev, unsigned char Destination) const {
+  const tInternalDevice &Device=Devices[iDev];
+
+  for (int i=0; i<Device.MaxTPSessions; i++) {
+    if ( !Device.TPSessions[i].IsFree() && Device.TPSessions[i].Msg.Destination==Destination ) return i;
+  }
+
+  return -1;
 }
 
 //*****************************************************************************
@@ -1852,12 +2639,23 @@ bool tNMEA2000::TestHandleTPMessage(unsigned long PGN, unsigned char Source, uns
           }
         } else { // Start transport
           N2kMsgDbgStart("Use msg slot: "); N2kMsgDbgln(MsgIndex);
+          // Slot may have session, which peer now restarts. Drop it and return its large message to pool.
+          N2kCANMsgBuf[MsgIndex].FreeMessage();
           bool FastPacket;
           N2kCANMsgBuf[MsgIndex].KnownMessage=CheckKnownMessage(TransportPGN,N2kCANMsgBuf[MsgIndex].SystemMessage,FastPacket);
-          if ( nBytes < tN2kMsg::MaxDataLen &&  // Currently we can handle only tN2kMsg::MaxDataLen long messages
+          // Longer than tN2kMsg::MaxDataLen messages can be handled only, if we have large message pool.
+          tN2kLargeMsg *LargeMsg=( nBytes>=tN2kMsg::MaxDataLen && nBytes<=tN2kLargeMsg::MaxLargeDataLen ? FindFreeLargeMsg() : 0 );
+          if ( (nBytes < tN2kMsg::MaxDataLen || LargeMsg!=0) &&
                (N2kCANMsgBuf[MsgIndex].KnownMessage || !HandleOnlyKnownMessages()) ) {
             N2kCANMsgBuf[MsgIndex].FreeMsg=false;
             N2kCANMsgBuf[MsgIndex].N2kMsg.Init(7 /* Priority? */,TransportPGN,Source,Destination);
+            if ( LargeMsg!=0 ) {
+              LargeMsg->Init(7,TransportPGN,Source,Destination,nBytes);
+              N2kCANMsgBuf[MsgIndex].LargeMsg=LargeMsg;
+            }
+#if defined(N2K_FRAME_TIMESTAMP)
+            N2kCANMsgBuf[MsgIndex].N2kMsg.FirstFrameTime=RxFrameTime;
+#endif
             N2kCANMsgBuf[MsgIndex].CopiedLen=0;
             N2kCANMsgBuf[MsgIndex].LastFrame=0;
             N2kCANMsgBuf[MsgIndex].N2kMsg.DataLen=nBytes;
@@ -1877,39 +2675,45 @@ bool tNMEA2000::TestHandleTPMessage(unsigned long PGN, unsigned char Source, uns
         }
         break;
       }
-      case TP_CM_CTS:
+      case TP_CM_CTS: {
         if ( !IsValidDevice(iDev) ) break; // Should never fail
         N2kMsgDbgStart("Got TP CTS"); N2kMsgDbgln(MsgIndex);
-        if ( IsBroadcast(Devices[iDev].PendingTPMsg.Destination) ) break; // We should not get controls for broadcast TP msg
-        if ( Devices[iDev].PendingTPMsg.PGN!=TransportPGN ) { // Some failure on communication
-          EndSendTPMessage(iDev); // Should we retry from beginning?
+        // Controls are sent by receiver, so find session where it is destination. Broadcast sessions will never match.
+        int iSession=FindTPSession(iDev,Source);
+        if ( iSession<0 ) break;
+        if ( Devices[iDev].TPSessions[iSession].Msg.PGN!=TransportPGN ) { // Some failure on communication
+          EndSendTPMessage(iDev,iSession); // Should we retry from beginning?
           break;
         }
         // Now respond with next data packets
         if ( buf[1]>0 ) { // Note that with 0, receiver wants to have break
-          if ( buf[2]-1!=Devices[iDev].NextDTSequence ) { // We got sequence error
-            EndSendTPMessage(iDev); // Should we retry from beginning?
+          if ( buf[2]-1!=Devices[iDev].TPSessions[iSession].NextDTSequence ) { // We got sequence error
+            EndSendTPMessage(iDev,iSession); // Should we retry from beginning?
             break;
           }
           uint8_t MaxTPSequences=buf[1];
           bool TPDTResult=true;
-          for ( uint8_t iSeq=0; TPDTResult &&iSeq<MaxTPSequences && !HasAllTPDTSent(iDev); iSeq++ ) TPDTResult&=SendTPDT(iDev);
-          if ( !TPDTResult ) EndSendTPMessage(iDev);
+          for ( uint8_t iSeq=0; TPDTResult &&iSeq<MaxTPSequences && !HasAllTPDTSent(iDev,iSession); iSeq++ ) TPDTResult&=SendTPDT(iDev,iSession);
+          if ( !TPDTResult ) {
+            EndSendTPMessage(iDev,iSession);
+            break;
+          }
         }
-        Devices[iDev].NextDTSendTime.FromNow(100); // Set timeout for next response
+        Devices[iDev].TPSessions[iSession].Timer.FromNow(TP_ResponseTimeout); // Set timeout for next response
+        ProtocolTimerChanged();
         break;
+      }
       case TP_CM_ACK:
+      case TP_CM_Abort: {
         if ( !IsValidDevice(iDev) ) break; // Should never fail
-        N2kMsgDbgStart("Got TP ACK"); N2kMsgDbgln(MsgIndex);
-        if ( IsBroadcast(Devices[iDev].PendingTPMsg.Destination) ) break; // We should not get controls for broadcast TP msg
-        EndSendTPMessage(iDev);
-        break;
-      case TP_CM_Abort:
-        if ( !IsValidDevice(iDev) ) break; // Should never fail
-        N2kMsgDbgStart("Got TP Abort"); N2kMsgDbgln(MsgIndex);
-        if ( IsBroadcast(Devices[iDev].PendingTPMsg.Destination) ) break; // We should not get controls for broadcast TP msg
-        EndSendTPMessage(iDev);
+        N2kMsgDbgStart(TP_CM_Control==TP_CM_ACK?"Got TP ACK":"Got TP Abort"); N2kMsgDbgln(MsgIndex);
+        int iSession=FindTPSession(iDev,Source);
+        if ( iSession>=0 && Devices[iDev].TPSessions[iSession].Msg.PGN==TransportPGN ) {
+          if ( TP_CM_Control==TP_CM_Abort ) Stats.TPAbortsReceived++;
+          EndSendTPMessage(iDev,iSession);
+        }
         break;
+      }
       default:
         ;
     }
@@ -1936,8 +2740,18 @@ bool tNMEA2000::TestHandleTPMessage(unsigned long PGN, unsigned char Source, uns
         N2kCANMsgBuf[MsgIndex].LastFrame=buf[0];
         // Transport protocol is slower, so to avoid timeout, we reset message time
         N2kCANMsgBuf[MsgIndex].N2kMsg.MsgTime=N2kMillis();
+#if defined(N2K_FRAME_TIMESTAMP)
+        N2kCANMsgBuf[MsgIndex].N2kMsg.LastFrameTime=RxFrameTime;
+#endif
         if ( N2kCANMsgBuf[MsgIndex].CopiedLen>=N2kCANMsgBuf[MsgIndex].N2kMsg.DataLen ) { // all done
           N2kCANMsgBuf[MsgIndex].Ready=true;
+          if ( N2kCANMsgBuf[MsgIndex].LargeMsg!=0 ) {
+            N2kCANMsgBuf[MsgIndex].LargeMsg->UpdateData();
+#if defined(N2K_FRAME_TIMESTAMP)
+            N2kCANMsgBuf[MsgIndex].LargeMsg->FirstFrameTime=N2kCANMsgBuf[MsgIndex].N2kMsg.FirstFrameTime;
+            N2kCANMsgBuf[MsgIndex].LargeMsg->LastFrameTime=RxFrameTime;
+#endif
+          }
           if ( N2kCANMsgBuf[MsgIndex].TPRequireCTS>0 && iDev>=0 ) { // send response
             SendTPCM_EndAck(N2kCANMsgBuf[MsgIndex].N2kMsg.PGN,Source,iDev,N2kCANMsgBuf[MsgIndex].N2kMsg.DataLen,N2kCANMsgBuf[MsgIndex].LastFrame);
           }
@@ -1948,6 +2762,8 @@ bool tNMEA2000::TestHandleTPMessage(unsigned long PGN, unsigned char Source, uns
         }
       } else { // Wrong packet - either we lost packet or sender sends wrong, so free this
         N2kMsgDbgStart("Invalid packet: "); N2kMsgDbgln(buf[0]);
+        Stats.TPLostPackets++;
+        CountPGNError(N2kCANMsgBuf[MsgIndex].N2kMsg.PGN);
         if ( N2kCANMsgBuf[MsgIndex].TPRequireCTS>0 && iDev>=0 ) { // We need to abort transport
           SendTPCM_Abort(N2kCANMsgBuf[MsgIndex].N2kMsg.PGN,Source,iDev,TP_CM_AbortTimeout);  // Abort transport
         }
@@ -1962,45 +2778,72 @@ bool tNMEA2000::TestHandleTPMessage(unsigned long PGN, unsigned char Source, uns
   return false;
 }
 
+//*****************************************************************************
+tN2kLargeMsg *tNMEA2000::FindFreeLargeMsg() {
+  for (int i=0; i<MaxLargeMsgs; i++) {
+    if ( LargeMsgBuf[i].PGN==0 ) return &(LargeMsgBuf[i]);
+  }
+
+  return 0;
+}
+
 //*****************************************************************************
 bool tNMEA2000::StartSendTPMessage(const tN2kMsg& msg, int iDev) {
   if ( !IsValidDevice(iDev) ) return false;
 
-  if ( Devices[iDev].PendingTPMsg.PGN!=0 ) return false; // No room for sending TP message
+  tInternalDevice &Device=Devices[iDev];
+  // Only one session per destination is allowed. This covers also single BAM session.
+  if ( FindTPSession(iDev,msg.Destination)>=0 ) return false;
 
-  int result=false;
+  int iSession;
+  for (iSession=0; iSession<Device.MaxTPSessions && !Device.TPSessions[iSession].IsFree(); iSession++);
+  if ( iSession==Device.MaxTPSessions ) return false; // No room for sending TP message
 
-  Devices[iDev].HasPendingInformation=true;
-  Devices[iDev].PendingTPMsg=msg;
-  Devices[iDev].NextDTSequence=0;
-  Devices[iDev].NextDTSendTime.FromNow(50);
+  bool result=false;
+  tTPSession &Session=Device.TPSessions[iSession];
+
+  Device.ActiveTPSessions++;
+  Device.HasPendingInformation=true;
+  Session.Msg=msg;
+  Session.NextDTSequence=0;
+  Session.Timer.FromNow(TP_DTInterval);
+  ProtocolTimerChanged();
   if ( IsBroadcast(msg.Destination) ) { // Start with BAM
-    result=SendTPCM_BAM(iDev);
+    result=SendTPCM_BAM(iDev,iSession);
   } else {
-    result=SendTPCM_RTS(iDev);
+    result=SendTPCM_RTS(iDev,iSession);
   }
 
-  if ( !result ) EndSendTPMessage(iDev); // Currently no retry
+  if ( !result ) EndSendTPMessage(iDev,iSession); // Currently no retry
 
   return result;
 }
 
 //*****************************************************************************
-void tNMEA2000::EndSendTPMessage(int iDev) {
-  Devices[iDev].PendingTPMsg.Clear();
-  Devices[iDev].NextDTSendTime.Disable();
+void tNMEA2000::EndSendTPMessage(int iDev, int iSession) {
+  tTPSession &Session=Devices[iDev].TPSessions[iSession];
+
+  if ( Session.IsFree() ) return;
+  Session.Msg.Clear();
+  Session.Timer.Disable();
+  Devices[iDev].ActiveTPSessions--;
   Devices[iDev].UpdateHasPendingInformation();
 }
 
 //*****************************************************************************
 void tNMEA2000::SendPendingTPMessage(int iDev) {
-  if ( Devices[iDev].PendingTPMsg.PGN!=0 && Devices[iDev].NextDTSendTime.IsTime() ) { // Pending message and timed out
-    if ( IsBroadcast(Devices[iDev].PendingTPMsg.Destination) ) { // For broadcast we just send next data
-      SendTPDT(iDev);
-      Devices[iDev].NextDTSendTime.FromNow(50);
-      if ( HasAllTPDTSent(iDev) ) EndSendTPMessage(iDev); // All done
+  tInternalDevice &Device=Devices[iDev];
+
+  for (int iSession=0; iSession<Device.MaxTPSessions && Device.ActiveTPSessions>0; iSession++) {
+    tTPSession &Session=Device.TPSessions[iSession];
+    if ( Session.IsFree() || !Session.Timer.IsTime() ) continue;
+
+    if ( IsBroadcast(Session.Msg.Destination) ) { // For broadcast we just send next data
+      SendTPDT(iDev,iSession);
+      Session.Timer.FromNow(TP_DTInterval);
+      if ( HasAllTPDTSent(iDev,iSession) ) EndSendTPMessage(iDev,iSession); // All done
     } else { // We have not got response from receiver within timeout, so just end. Or should we retry?
-      EndSendTPMessage(iDev);
+      EndSendTPMessage(iDev,iSession);
     }
   }
 }
@@ -2023,13 +2866,18 @@ uint8_t tNMEA2000::SetN2kCANBufMsg(unsigned long canId, unsigned char len, unsig
   bool SystemMessage;
   bool KnownMessage;
   uint8_t MsgIndex=MaxN2kCANMsgs;
+  uint8_t Action=GetCANIdAction(canId);
+
+    if ( (Action & cia_Known)==0 && HandleOnlyKnownMessages() ) return MsgIndex;
 
     CanIdToN2k(canId,Priority,PGN,Source,Destination);
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-    if ( !TestHandleTPMessage(PGN,Source,Destination,len,buf,MsgIndex) )
+    if ( (Action & cia_TPControl)==0 || !TestHandleTPMessage(PGN,Source,Destination,len,buf,MsgIndex) )
 #endif
     {
-      KnownMessage=CheckKnownMessage(PGN,SystemMessage,FastPacket);
+      KnownMessage=((Action & cia_Known)!=0);
+      SystemMessage=((Action & cia_System)!=0);
+      FastPacket=((Action & cia_FastPacket)!=0);
       if ( KnownMessage || !HandleOnlyKnownMessages() ) {
         if (FastPacket && !IsFastPacketFirstFrame(buf[0]) ) { // Not first frame
         N2kFrameInDbgStart("New frame="); N2kFrameInDbg(PGN); N2kFrameInDbg(" frame="); N2kFrameInDbg(buf[0],HEX); N2kFrameInDbgln();
@@ -2051,12 +2899,16 @@ uint8_t tNMEA2000::SetN2kCANBufMsg(unsigned long canId, unsigned char len, unsig
             } else { // We have lost frame, so free this
               N2kFrameErrDbgStart("Lost frame ");  N2kFrameErrDbg(N2kCANMsgBuf[MsgIndex].LastFrame); N2kFrameErrDbg("/");  N2kFrameErrDbg(buf[0]);
               N2kFrameErrDbg(", source ");  N2kFrameErrDbg(Source); N2kFrameErrDbg(" for: "); N2kFrameErrDbgln(PGN);
+              Stats.LostFrames++;
+              CountPGNError(PGN);
               N2kCANMsgBuf[MsgIndex].FreeMessage();
               MsgIndex=MaxN2kCANMsgs;
             }
           } else {  // Orphan frame
               N2kFrameErrDbgStart("Orphan frame "); N2kFrameErrDbg(buf[0]); N2kFrameErrDbg(", source ");
               N2kFrameErrDbg(Source); N2kFrameErrDbg(" for: "); N2kFrameErrDbgln(PGN);
+              Stats.OrphanFrames++;
+              CountPGNError(PGN);
           }
         } else { // Handle first frame
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
@@ -2066,12 +2918,16 @@ uint8_t tNMEA2000::SetN2kCANBufMsg(unsigned long canId, unsigned char len, unsig
 #endif
           if ( MsgIndex<MaxN2kCANMsgs ) { // we found free place, so handle frame
             N2kMsgRxDbgStart("Use msg slot: "); N2kMsgRxDbgln(MsgIndex);
+            N2kTrace(N2kte_SlotAllocated,PGN,MsgIndex);
             N2kCANMsgBuf[MsgIndex].FreeMsg=false;
             N2kCANMsgBuf[MsgIndex].KnownMessage=KnownMessage;
             N2kCANMsgBuf[MsgIndex].SystemMessage=SystemMessage;
             N2kCANMsgBuf[MsgIndex].N2kMsg.Init(Priority,PGN,Source,Destination);
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
             N2kCANMsgBuf[MsgIndex].N2kMsg.SetIsTPMessage(false);
+#endif
+#if defined(N2K_FRAME_TIMESTAMP)
+            N2kCANMsgBuf[MsgIndex].N2kMsg.FirstFrameTime=RxFrameTime;
 #endif
             N2kCANMsgBuf[MsgIndex].CopiedLen=0;
             if (FastPacket) {
@@ -2089,6 +2945,9 @@ uint8_t tNMEA2000::SetN2kCANBufMsg(unsigned long canId, unsigned char len, unsig
         }
 
         if ( MsgIndex<MaxN2kCANMsgs ) {
+#if defined(N2K_FRAME_TIMESTAMP)
+          N2kCANMsgBuf[MsgIndex].N2kMsg.LastFrameTime=RxFrameTime;
+#endif
           N2kCANMsgBuf[MsgIndex].Ready=(N2kCANMsgBuf[MsgIndex].CopiedLen>=N2kCANMsgBuf[MsgIndex].N2kMsg.DataLen);
           if ( !N2kCANMsgBuf[MsgIndex].Ready ) MsgIndex=MaxN2kCANMsgs; // If packet is not ready, do not return index to it
         }
@@ -2099,16 +2958,62 @@ uint8_t tNMEA2000::SetN2kCANBufMsg(unsigned long canId, unsigned char len, unsig
 }
 
 //*****************************************************************************
- int tNMEA2000::FindSourceDeviceIndex(unsigned char Source) const {
-   int i=DeviceCount;
+uint8_t tNMEA2000::GetCANIdAction(unsigned long canId) {
+#if !defined(N2K_NO_CANID_CACHE)
+  uint32_t Key=(canId & 0x03ffff00UL);
+  uint8_t Slot=((Key>>8) ^ (Key>>16)) & (N2K_CANID_CACHE_SIZE-1);
+
+  if ( CANIdCache[Slot]!=0 && (CANIdCache[Slot] & 0xffffff00UL)==Key ) return CANIdCache[Slot] & 0xff;
+#endif
 
-     if ( Source<=253 ) {
-       for (i=0; i<DeviceCount && Devices[i].N2kSource!=Source; i++);
-     }
+  unsigned char Priority, Source, Destination;
+  unsigned long PGN;
+  bool SystemMessage, FastPacket;
+  uint8_t Action=cia_Cached;
+
+  CanIdToN2k(canId,Priority,PGN,Source,Destination);
+  if ( CheckKnownMessage(PGN,SystemMessage,FastPacket) ) Action|=cia_Known;
+  if ( SystemMessage ) Action|=cia_System;
+  if ( FastPacket ) Action|=cia_FastPacket;
+  if ( PGN==TP_CM || PGN==TP_DT ) Action|=cia_TPControl;
+#if !defined(N2K_NO_CANID_CACHE)
+  CANIdCache[Slot]=Key | Action;
+#endif
+
+  return Action;
+}
 
+//*****************************************************************************
+void tNMEA2000::InvalidateCANIdCache() {
+#if !defined(N2K_NO_CANID_CACHE)
+  memset(CANIdCache,0,sizeof(CANIdCache));
+#endif
+}
+
+//*****************************************************************************
+ int tNMEA2000::FindSourceDeviceIndex(unsigned char Source) const {
+   if ( Source>253 || Devices==0 ) return -1;
+
+   if ( SourceDeviceIndex!=0 ) {
+     uint8_t i=SourceDeviceIndex[Source];
      return (i<DeviceCount?i:-1);
+   }
+
+   return ( Devices[0].N2kSource==Source?0:-1 );
  }
 
+//*****************************************************************************
+void tNMEA2000::UpdateSourceDeviceIndex() {
+  InvalidateCANIdCache();
+  if ( SourceDeviceIndex==0 ) return;
+
+  memset(SourceDeviceIndex,0xff,256);
+  // Walk backwards so that on conflict first device owns the source as with linear search.
+  for (int i=DeviceCount-1; i>=0; i--) {
+    if ( Devices[i].N2kSource<=253 ) SourceDeviceIndex[Devices[i].N2kSource]=i;
+  }
+}
+
 //*****************************************************************************
 bool tNMEA2000::IsMySource(unsigned char Source) {
     return (FindSourceDeviceIndex(Source)!=-1);
@@ -2117,6 +3022,7 @@ bool tNMEA2000::IsMySource(unsigned char Source) {
 //*****************************************************************************
 void tNMEA2000::ForwardMessage(const tN2kMsg &N2kMsg) {
   if ( !ForwardEnabled() || ( !( ForwardOwnMessages() && IsMySource(N2kMsg.Source) ) && N2kMode==N2km_NodeOnly ) ) return;
+  if ( ForwardRuleCount>0 && !PassForwardRules(N2kMsg) ) return;
 
   switch (ForwardType) {
     case fwdt_Actisense:
@@ -2130,7 +3036,105 @@ void tNMEA2000::ForwardMessage(const tN2kMsg &N2kMsg) {
 
 //*****************************************************************************
 void tNMEA2000::ForwardMessage(const tN2kCANMsg &N2kCanMsg) {
-  if ( N2kCanMsg.KnownMessage || !ForwardOnlyKnownMessages() ) ForwardMessage(N2kCanMsg.N2kMsg);
+  if ( N2kCanMsg.KnownMessage || !ForwardOnlyKnownMessages() ) ForwardMessage(N2kCanMsg.GetN2kMsg());
+}
+
+//*****************************************************************************
+bool tNMEA2000::AddForwardRule(unsigned long PGN, uint16_t Interval, uint8_t Flags, uint16_t RefreshInterval, unsigned char Source) {
+  if ( ForwardRuleCount>=ForwardRuleCapacity ) {
+    if ( ForwardRuleCapacity>=0xf0 ) return false;
+    uint8_t NewCapacity=ForwardRuleCapacity+16;
+    tForwardRule *NewRules=new tForwardRule[NewCapacity];
+    if ( NewRules==0 ) return false;
+    for (uint8_t i=0; i<ForwardRuleCount; i++) NewRules[i]=ForwardRules[i];
+    delete[] ForwardRules;
+    ForwardRules=NewRules;
+    ForwardRuleCapacity=NewCapacity;
+  }
+
+  tForwardRule &Rule=ForwardRules[ForwardRuleCount];
+  Rule.PGN=PGN;
+  Rule.Source=Source;
+  Rule.Flags=Flags;
+  Rule.Interval=Interval;
+  Rule.RefreshInterval=RefreshInterval;
+  Rule.Forwarded=0;
+  Rule.Decimated=0;
+  Rule.Suppressed=0;
+  ForwardRuleCount++;
+
+  return true;
+}
+
+//*****************************************************************************
+void tNMEA2000::ClearForwardRules() {
+  ForwardRuleCount=0;
+  ForwardStateCount=0;
+}
+
+//*****************************************************************************
+// FNV-1a hash of message data for change detection.
+static uint32_t N2kForwardHash(const unsigned char *Data, int DataLen) {
+  uint32_t Hash=2166136261UL;
+
+  Hash=(Hash ^ (uint8_t)DataLen)*16777619UL;
+  for (int i=0; i<DataLen; i++) Hash=(Hash ^ Data[i])*16777619UL;
+
+  return Hash;
+}
+
+//*****************************************************************************
+bool tNMEA2000::PassForwardRules(const tN2kMsg &N2kMsg) {
+  uint8_t iRule;
+
+  for (iRule=0;
+       iRule<ForwardRuleCount &&
+       !( ForwardRules[iRule].PGN==N2kMsg.PGN && (ForwardRules[iRule].Source==0xff || ForwardRules[iRule].Source==N2kMsg.Source) );
+       iRule++);
+  if ( iRule==ForwardRuleCount ) return true;
+
+  tForwardRule &Rule=ForwardRules[iRule];
+  uint32_t Hash=N2kForwardHash(N2kMsg.Data,N2kMsg.DataLen);
+  unsigned long Now=N2kMillis();
+  uint8_t iState;
+
+  for (iState=0; iState<ForwardStateCount && !(ForwardStates[iState].Rule==iRule && ForwardStates[iState].Source==N2kMsg.Source); iState++);
+
+  if ( iState==ForwardStateCount ) { // First message from this source
+    if ( ForwardStateCount>=ForwardStateCapacity ) {
+      if ( ForwardStateCapacity>=0xf0 ) { Rule.Forwarded++; return true; }
+      uint8_t NewCapacity=ForwardStateCapacity+16;
+      tForwardState *NewStates=new tForwardState[NewCapacity];
+      if ( NewStates==0 ) { Rule.Forwarded++; return true; }
+      for (uint8_t i=0; i<ForwardStateCount; i++) NewStates[i]=ForwardStates[i];
+      delete[] ForwardStates;
+      ForwardStates=NewStates;
+      ForwardStateCapacity=NewCapacity;
+    }
+    ForwardStates[iState].Rule=iRule;
+    ForwardStates[iState].Source=N2kMsg.Source;
+    ForwardStateCount++;
+  } else {
+    tForwardState &State=ForwardStates[iState];
+    bool Changed=(State.Hash!=Hash);
+    unsigned long Elapsed=Now-State.LastTime;
+
+    if ( !Changed && (Rule.Flags & fwdr_SuppressUnchanged)!=0 &&
+         ( Rule.RefreshInterval==0 || Elapsed<Rule.RefreshInterval ) ) {
+      Rule.Suppressed++;
+      return false;
+    }
+    if ( Elapsed<Rule.Interval && !( Changed && (Rule.Flags & fwdr_PassChanges)!=0 ) ) {
+      Rule.Decimated++;
+      return false;
+    }
+  }
+
+  ForwardStates[iState].Hash=Hash;
+  ForwardStates[iState].LastTime=Now;
+  Rule.Forwarded++;
+
+  return true;
 }
 
 //*****************************************************************************
@@ -2146,6 +3150,7 @@ void tNMEA2000::SendIsoAddressClaim(unsigned char Destination, int DeviceIndex,
   // Set pending, if we have delayed it.
   if ( FromNow>0 ) {
     Devices[DeviceIndex].SetPendingIsoAddressClaim(FromNow);
+    ProtocolTimerChanged();
     return;
   }
 
@@ -2163,6 +3168,33 @@ template <typename T> void PROGMEM_readAnything (const T * sce, T& dest)
 
 #define MAX_PGNS_IN_LIST 74
 
+#if !defined(N2K_NO_RESPONSE_CACHE)
+//*****************************************************************************
+void tNMEA2000::tCachedResponse::Set(const tN2kMsg &N2kMsg) {
+  if ( Data==0 ) Data=new unsigned char[tN2kMsg::MaxDataLen];
+  if ( Data==0 || N2kMsg.DataLen<=0 ) return;
+  DataLen=N2kMsg.DataLen;
+  memcpy(Data,N2kMsg.Data,DataLen);
+}
+
+//*****************************************************************************
+bool tNMEA2000::tCachedResponse::Get(tN2kMsg &N2kMsg, unsigned long PGN, unsigned char Priority) const {
+  if ( !IsValid() ) return false;
+  N2kMsg.SetPGN(PGN);
+  N2kMsg.Priority=Priority;
+  memcpy(N2kMsg.Data,Data,DataLen);
+  N2kMsg.DataLen=DataLen;
+  return true;
+}
+
+//*****************************************************************************
+void tNMEA2000::InvalidateProductInformationCache() {
+  if ( Devices==0 ) return;
+  // Devices without own information use first device information, so invalidate all.
+  for (int i=0; i<DeviceCount; i++) Devices[i].ProductInformationCache.Invalidate();
+}
+#endif
+
 //*****************************************************************************
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
 void tNMEA2000::SendTxPGNList(unsigned char Destination, int DeviceIndex, bool UseTP) {
@@ -2174,25 +3206,25 @@ void tNMEA2000::SendTxPGNList(unsigned char Destination, int DeviceIndex) {
   if ( !IsValidDevice(DeviceIndex) ) return;
 
   tN2kMsg RespondMsg(Devices[DeviceIndex].N2kSource);
-  unsigned long PGN;
 
     RespondMsg.Destination=Destination;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    if ( !Devices[DeviceIndex].TxPGNListCache.Get(RespondMsg,126464L,6) ) {
+#endif
     RespondMsg.SetPGN(126464L);
     RespondMsg.Priority=6;
+    RespondMsg.AddByte(N2kpgnl_transmit);
+    UpdatePGNTables(DeviceIndex);
+    for (uint16_t i=0; i<Devices[DeviceIndex].TxPGNTable.Size && i<MAX_PGNS_IN_LIST; i++ ) {
+      RespondMsg.Add3ByteInt(Devices[DeviceIndex].TxPGNTable.Get(i));
+    }
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    Devices[DeviceIndex].TxPGNListCache.Set(RespondMsg);
+    }
+#endif
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
     RespondMsg.SetIsTPMessage(UseTP);
 #endif
-    RespondMsg.AddByte(N2kpgnl_transmit);
-    // First add default messages
-    size_t PGNCount=0;
-    for (int i=0; (PGN=pgm_read_dword(&DefTransmitMessages[i]))!=0 && PGNCount<MAX_PGNS_IN_LIST; i++, PGNCount++ ) {
-      RespondMsg.Add3ByteInt(PGN);
-    }
-    if (Devices[DeviceIndex].TransmitMessages!=0) {
-      for (int i=0; (PGN=pgm_read_dword(&Devices[DeviceIndex].TransmitMessages[i]))!=0 && PGNCount<MAX_PGNS_IN_LIST; i++, PGNCount++ ) {
-        RespondMsg.Add3ByteInt(PGN);
-      }
-    }
     SendMsg(RespondMsg,DeviceIndex);
 }
 
@@ -2207,25 +3239,25 @@ void tNMEA2000::SendRxPGNList(unsigned char Destination, int DeviceIndex) {
   if ( !IsValidDevice(DeviceIndex) ) return;
 
   tN2kMsg RespondMsg(Devices[DeviceIndex].N2kSource);
-  unsigned long PGN;
 
     RespondMsg.Destination=Destination;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    if ( !Devices[DeviceIndex].RxPGNListCache.Get(RespondMsg,126464L,6) ) {
+#endif
     RespondMsg.SetPGN(126464L);
     RespondMsg.Priority=6;
+    RespondMsg.AddByte(N2kpgnl_receive);
+    UpdatePGNTables(DeviceIndex);
+    for (uint16_t i=0; i<Devices[DeviceIndex].RxPGNTable.Size && i<MAX_PGNS_IN_LIST; i++ ) {
+      RespondMsg.Add3ByteInt(Devices[DeviceIndex].RxPGNTable.Get(i));
+    }
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    Devices[DeviceIndex].RxPGNListCache.Set(RespondMsg);
+    }
+#endif
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
     RespondMsg.SetIsTPMessage(UseTP);
 #endif
-    RespondMsg.AddByte(N2kpgnl_receive);
-    // First add default messages
-    size_t PGNCount=0;
-    for (int i=0; (PGN=pgm_read_dword(&DefReceiveMessages[i]))!=0 && PGNCount<MAX_PGNS_IN_LIST; i++, PGNCount++ ) {
-      RespondMsg.Add3ByteInt(PGN);
-    }
-    if (Devices[DeviceIndex].ReceiveMessages!=0) {
-      for (int i=0; (PGN=pgm_read_dword(&Devices[DeviceIndex].ReceiveMessages[i]))!=0 && PGNCount<MAX_PGNS_IN_LIST; i++, PGNCount++ ) {
-        RespondMsg.Add3ByteInt(PGN);
-      }
-    }
     SendMsg(RespondMsg,DeviceIndex);
 }
 
@@ -2270,6 +3302,11 @@ bool tNMEA2000::SendProductInformation(int iDev) {
     if ( Devices[iPIDev].ProductInformation==0 ) iPIDev=0; // Use first device product information
     if ( Devices[iPIDev].ProductInformation==0 ) return false; // Can not do anything.
 
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    if ( Devices[iDev].ProductInformationCache.Get(RespondMsg,126996L,6) ) {
+      // Encoded on earlier response
+    } else
+#endif
     if ( Devices[iPIDev].ProductInformation==Devices[iPIDev].LocalProductInformation ) {
       SetN2kProductInformation(RespondMsg,Devices[iPIDev].ProductInformation->N2kVersion,
                                           Devices[iPIDev].ProductInformation->ProductCode,
@@ -2282,6 +3319,9 @@ bool tNMEA2000::SendProductInformation(int iDev) {
     } else {
       SetN2kPGN126996Progmem(RespondMsg,Devices[iPIDev].ProductInformation);
     }
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    Devices[iDev].ProductInformationCache.Set(RespondMsg);
+#endif
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
     RespondMsg.Destination=Destination;
     RespondMsg.SetIsTPMessage(UseTP);
@@ -2291,7 +3331,15 @@ bool tNMEA2000::SendProductInformation(int iDev) {
       return true;
     }
 
-    Devices[iDev].SetPendingProductInformation();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    if ( SlotAllocator!=0 ) {
+      Devices[iDev].SetPendingProductInformation(GetSlotDelay(RespondMsg));
+    } else
+#endif
+    {
+      Devices[iDev].SetPendingProductInformation();
+    }
+    ProtocolTimerChanged();
     return false;
 }
 
@@ -2308,6 +3356,11 @@ bool tNMEA2000::SendConfigurationInformation(int DeviceIndex) {
   if ( !IsValidDevice(DeviceIndex) ) return false;
   tN2kMsg RespondMsg(Devices[DeviceIndex].N2kSource);
 
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    if ( ConfigurationInformationCache.Get(RespondMsg,126998L,6) ) {
+      // Encoded on earlier response
+    } else
+#endif
     if ( ConfigurationInformation.ManufacturerInformation!=0 ||
          ConfigurationInformation.InstallationDescription1!=0 ||
          ConfigurationInformation.InstallationDescription2!=0 ) {
@@ -2316,6 +3369,9 @@ bool tNMEA2000::SendConfigurationInformation(int DeviceIndex) {
                                        ConfigurationInformation.InstallationDescription1,
                                        ConfigurationInformation.InstallationDescription2,
                                        LocalConfigurationInformationData==0);
+#if !defined(N2K_NO_RESPONSE_CACHE)
+        ConfigurationInformationCache.Set(RespondMsg);
+#endif
     } else { // No information provided, so respond not available
       SetN2kPGNISOAcknowledgement(RespondMsg,1,0xff,126998L);
     }
@@ -2329,7 +3385,15 @@ bool tNMEA2000::SendConfigurationInformation(int DeviceIndex) {
       return true;
     }
 
-    Devices[DeviceIndex].SetPendingConfigurationInformation();
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    if ( SlotAllocator!=0 ) {
+      Devices[DeviceIndex].SetPendingConfigurationInformation(GetSlotDelay(RespondMsg));
+    } else
+#endif
+    {
+      Devices[DeviceIndex].SetPendingConfigurationInformation();
+    }
+    ProtocolTimerChanged();
     return false;
 }
 
@@ -2339,17 +3403,35 @@ void tNMEA2000::RespondISORequest(const tN2kMsg &N2kMsg, bool Addressed, unsigne
 
     switch (RequestedPGN) {
       case 60928L: /*ISO Address Claim*/  // Someone is asking others to claim their addresses
-        SendIsoAddressClaim(0xff,iDev);
+        if ( Devices[iDev].PendingIsoAddressClaim.IsEnabled() ) {
+          Stats.ISORequestsCoalesced++; // Broadcast response is already coming
+        } else {
+          SendIsoAddressClaim(0xff,iDev,ISORequestCoalesceTime);
+        }
         break;
       case 126464L:
         SendTxPGNList(N2kMsg.Source,iDev);
         SendRxPGNList(N2kMsg.Source,iDev);
         break;
       case 126996L: /* Product information */
-        SendProductInformation(iDev);
+        if ( Devices[iDev].PendingProductInformation.IsEnabled() ) {
+          Stats.ISORequestsCoalesced++;
+        } else if ( ISORequestCoalesceTime>0 ) {
+          Devices[iDev].SetPendingProductInformation(ISORequestCoalesceTime);
+          ProtocolTimerChanged();
+        } else {
+          SendProductInformation(iDev);
+        }
         break;
       case 126998L: /* Configuration information */
-        SendConfigurationInformation(iDev);
+        if ( Devices[iDev].PendingConfigurationInformation.IsEnabled() ) {
+          Stats.ISORequestsCoalesced++;
+        } else if ( ISORequestCoalesceTime>0 ) {
+          Devices[iDev].SetPendingConfigurationInformation(ISORequestCoalesceTime);
+          ProtocolTimerChanged();
+        } else {
+          SendConfigurationInformation(iDev);
+        }
         break;
       default:
         /* If user has established a handler */
@@ -2396,24 +3478,68 @@ void tNMEA2000::HandleISORequest(const tN2kMsg &N2kMsg) {
 // Document https://web.archive.org/web/20170609033039/http://www.nmea.org/Assets/20140109%20nmea-2000-corrigendum-tc201401031%20pgn%20126208.pdf
 // defines that systems should respond to NMEA Request/Command/Acknowledge group function PGN 126208.
 // Here we first call callback and if that will not handle function, we use default handler.
-void tNMEA2000::RespondGroupFunction(const tN2kMsg &N2kMsg, tN2kGroupFunctionCode GroupFunctionCode, unsigned long PGNForGroupFunction, int iDev) {
-    // Find group function handler for PGN
-    tN2kGroupFunctionHandler *pGroupFunctionHandler;
-    for ( pGroupFunctionHandler=pGroupFunctionHandlers; pGroupFunctionHandler!=0; pGroupFunctionHandler=pGroupFunctionHandler->pNext) {
-      if ( pGroupFunctionHandler->PGN==PGNForGroupFunction ) {
-        // For matching PGN we run handler and exit always
-        pGroupFunctionHandler->Handle(N2kMsg,GroupFunctionCode, PGNForGroupFunction,iDev);
-        return;
-      } else if ( pGroupFunctionHandler->PGN==0 &&
-                  pGroupFunctionHandler->Handle(N2kMsg,GroupFunctionCode, PGNForGroupFunction,iDev)
-                ) {
-        // If handler PGN is 0, we try handler and exit, if it does it. Default handler has PGN=0, but
-        // it is at end of list. This allows user to add handlers, which tries to handle all PGNs.
-        return;
-      }
+void tNMEA2000::RespondGroupFunction(const tN2kMsg &N2kMsg, tN2kGroupFunctionCode GroupFunctionCode, unsigned long PGNForGroupFunction, int iHandler, int iDev) {
+    if ( iHandler>=0 ) {
+      // For matching PGN we run handler and exit always
+      GroupFunctionHandlerIndex[iHandler]->Handle(N2kMsg,GroupFunctionCode,PGNForGroupFunction,iDev);
+      return;
+    }
+
+    // If handler PGN is 0, we try handler and exit, if it does it. Default handler has PGN=0, but
+    // it is at end of list. This allows user to add handlers, which tries to handle all PGNs.
+    for (uint16_t i=GroupFunctionPGNHandlerCount; i<GroupFunctionHandlerCount; i++) {
+      if ( GroupFunctionHandlerIndex[i]->Handle(N2kMsg,GroupFunctionCode,PGNForGroupFunction,iDev) ) return;
     }
 }
 
+//*****************************************************************************
+void tNMEA2000::UpdateGroupFunctionHandlerIndex() {
+  tN2kGroupFunctionHandler *pGroupFunctionHandler;
+  uint16_t Count=0;
+
+  for ( pGroupFunctionHandler=pGroupFunctionHandlers; pGroupFunctionHandler!=0; pGroupFunctionHandler=pGroupFunctionHandler->pNext) Count++;
+
+  if ( Count>GroupFunctionHandlerIndexSize ) {
+    delete[] GroupFunctionHandlerIndex;
+    GroupFunctionHandlerIndex=new tN2kGroupFunctionHandler*[Count];
+    GroupFunctionHandlerIndexSize=( GroupFunctionHandlerIndex!=0 ? Count : 0 );
+  }
+  GroupFunctionHandlerCount=0;
+  GroupFunctionPGNHandlerCount=0;
+  if ( GroupFunctionHandlerIndex==0 ) return;
+
+  // PGN specific handlers first with insertion sort. Sort is stable, so on
+  // duplicate PGN first handler on list will be used as before.
+  for ( pGroupFunctionHandler=pGroupFunctionHandlers; pGroupFunctionHandler!=0; pGroupFunctionHandler=pGroupFunctionHandler->pNext) {
+    if ( pGroupFunctionHandler->PGN==0 ) continue;
+    uint16_t i;
+    for (i=GroupFunctionPGNHandlerCount; i>0 && GroupFunctionHandlerIndex[i-1]->PGN>pGroupFunctionHandler->PGN; i--) {
+      GroupFunctionHandlerIndex[i]=GroupFunctionHandlerIndex[i-1];
+    }
+    GroupFunctionHandlerIndex[i]=pGroupFunctionHandler;
+    GroupFunctionPGNHandlerCount++;
+  }
+  GroupFunctionHandlerCount=GroupFunctionPGNHandlerCount;
+  for ( pGroupFunctionHandler=pGroupFunctionHandlers; pGroupFunctionHandler!=0; pGroupFunctionHandler=pGroupFunctionHandler->pNext) {
+    if ( pGroupFunctionHandler->PGN==0 ) GroupFunctionHandlerIndex[GroupFunctionHandlerCount++]=pGroupFunctionHandler;
+  }
+  GroupFunctionHandlerIndexValid=true;
+}
+
+//*****************************************************************************
+int tNMEA2000::FindGroupFunctionHandler(unsigned long PGN) {
+  if ( !GroupFunctionHandlerIndexValid ) UpdateGroupFunctionHandlerIndex();
+
+  int Low=0;
+  int High=GroupFunctionPGNHandlerCount;
+  while ( Low<High ) { // Find first handler with PGN>=requested
+    int Mid=(Low+High)/2;
+    if ( GroupFunctionHandlerIndex[Mid]->PGN<PGN ) { Low=Mid+1; } else { High=Mid; }
+  }
+
+  return ( Low<GroupFunctionPGNHandlerCount && GroupFunctionHandlerIndex[Low]->PGN==PGN ? Low : -1 );
+}
+
 //*****************************************************************************
 // Document https://web.archive.org/web/20170609033039/http://www.nmea.org/Assets/20140109%20nmea-2000-corrigendum-tc201401031%20pgn%20126208.pdf
 // defines that systems should respond to NMEA Request/Command/Acknowledge group function PGN 126208.
@@ -2427,10 +3553,12 @@ void tNMEA2000::HandleGroupFunction(const tN2kMsg &N2kMsg) {
 
     if (!tN2kGroupFunctionHandler::Parse(N2kMsg,GroupFunctionCode,PGNForGroupFunction)) return;
     N2kMsgDbgStart("Group function: "); N2kMsgDbgln(PGNForGroupFunction);
+    // Handler lookup will be done only once for all devices.
+    int iHandler=FindGroupFunctionHandler(PGNForGroupFunction);
     if ( tNMEA2000::IsBroadcast(N2kMsg.Destination) ) { // broadcast -> respond from all devices
-      for (iDev=0; iDev<DeviceCount; iDev++) RespondGroupFunction(N2kMsg,GroupFunctionCode,PGNForGroupFunction,iDev);
+      for (iDev=0; iDev<DeviceCount; iDev++) RespondGroupFunction(N2kMsg,GroupFunctionCode,PGNForGroupFunction,iHandler,iDev);
     } else {
-      RespondGroupFunction(N2kMsg,GroupFunctionCode,PGNForGroupFunction,iDev);
+      RespondGroupFunction(N2kMsg,GroupFunctionCode,PGNForGroupFunction,iHandler,iDev);
     }
 }
 #endif
@@ -2445,11 +3573,13 @@ void tNMEA2000::StartAddressClaim(int iDev) {
     }
     SendIsoAddressClaim(0xff,iDev);
     Devices[iDev].AddressClaimTimer.FromNow(N2kAddressClaimTimeout);
+    ProtocolTimerChanged();
   }
 }
 
 //*****************************************************************************
 void tNMEA2000::StartAddressClaim() {
+  ClearClaimedAddresses(); // Forget nodes which may have left the bus and learn again
   for (int i=0; i<DeviceCount; i++) {
     if ( Devices[i].N2kSource==N2kNullCanBusAddress ) GetNextAddress(i,true); // On restart try address claiming from the beginning
     StartAddressClaim(i);
@@ -2474,8 +3604,12 @@ bool tNMEA2000::IsAddressClaimStarted(int iDev) {
 
 //*****************************************************************************
 void tNMEA2000::HandleISOAddressClaim(const tN2kMsg &N2kMsg) {
+  if ( N2kMsg.Source>N2kMaxCanBusAddress ) return; // Cannot claim address or invalid source
   int iDev=FindSourceDeviceIndex(N2kMsg.Source);
-  if ( N2kMsg.Source==N2kNullCanBusAddress || iDev==-1 ) return; // if the address is not same as we have, we do nothing
+  if ( iDev==-1 ) { // if the address is not same as we have, we just remember that it is in use
+    SetAddressClaimed(N2kMsg.Source);
+    return;
+  }
 
   int Index=0;
   uint64_t CallerName=N2kMsg.GetUInt64(Index);
@@ -2483,6 +3617,7 @@ void tNMEA2000::HandleISOAddressClaim(const tN2kMsg &N2kMsg) {
     if (Devices[iDev].DeviceInformation.GetName()<CallerName) { // We can keep our address, so just reclaim it
       SendIsoAddressClaim(0xff,iDev);
     } else { // we have to try an other address
+      SetAddressClaimed(N2kMsg.Source);
       if ( Devices[iDev].DeviceInformation.GetName()==CallerName && IsAddressClaimStarted(iDev) ) {
         // If the name is same, then the first instance will get claim and change its address.
         // This should not happen, if user takes care of setting unique ID for device information.
@@ -2490,6 +3625,7 @@ void tNMEA2000::HandleISOAddressClaim(const tN2kMsg &N2kMsg) {
         // Try to solve situation by changing our device instance.
         Devices[iDev].DeviceInformation.SetDeviceInstance(Devices[iDev].DeviceInformation.GetDeviceInstance()+1);
         DeviceInformationChanged=true;
+        JournalChanged(ji_Instances);
       } else {
         GetNextAddress(iDev);
       }
@@ -2504,8 +3640,10 @@ void tNMEA2000::HandleCommandedAddress(uint64_t CommandedName, unsigned char New
       Devices[iDev].N2kSource!=NewAddress) { // We have been commanded to set our address
     Devices[iDev].N2kSource=NewAddress;
     Devices[iDev].UpdateAddressClaimEndSource();
+    UpdateSourceDeviceIndex();
     StartAddressClaim(iDev);
     AddressChanged=true;
+    JournalChanged(ji_Source);
   }
 }
 
@@ -2536,6 +3674,7 @@ void tNMEA2000::SetN2kSource(unsigned char _iAddr, int _iDev) {
   InitDevices();
   Devices[_iDev].N2kSource= _iAddr;
   Devices[_iDev].UpdateAddressClaimEndSource();
+  UpdateSourceDeviceIndex();
 }
 
 //*****************************************************************************
@@ -2556,33 +3695,57 @@ bool tNMEA2000::ReadResetDeviceInformationChanged() {
 
 //*****************************************************************************
 void tNMEA2000::GetNextAddress(int DeviceIndex, bool RestartAtEnd) {
-  bool FoundSame;
-  // Currently simply add address
+  tInternalDevice &Device=Devices[DeviceIndex];
   // Note that 251 is the last source. We do not send data if address is higher than that.
 
-  do {
-    if ( Devices[DeviceIndex].N2kSource==N2kNullCanBusAddress ) {
-      if ( RestartAtEnd ) {
-        // For null address start from beginning.
-        Devices[DeviceIndex].N2kSource=14;
-        Devices[DeviceIndex].UpdateAddressClaimEndSource();
-      } else return;
-    } else if (Devices[DeviceIndex].N2kSource!=Devices[DeviceIndex].AddressClaimEndSource) {
-      Devices[DeviceIndex].N2kSource++;
-      // Roll to start?
-      if ( Devices[DeviceIndex].N2kSource>N2kMaxCanBusAddress ) Devices[DeviceIndex].N2kSource=0;
-    } else {
-      Devices[DeviceIndex].N2kSource=N2kNullCanBusAddress; // Force null address = cannot claim address
+  if ( Device.N2kSource==N2kNullCanBusAddress ) {
+    if ( !RestartAtEnd ) return;
+    // For null address start from beginning.
+    Device.N2kSource=14;
+    Device.UpdateAddressClaimEndSource();
+    if ( IsAddressFree(Device.N2kSource,DeviceIndex) ) {
+      UpdateSourceDeviceIndex();
       AddressChanged=true;
+      JournalChanged(ji_Source);
       return;
     }
-    FoundSame=false;
-    // Check that we do not have same on our list
-    for (int i=0; i<DeviceCount && !FoundSame; i++) {
-      if (i!=DeviceIndex) FoundSame=(Devices[DeviceIndex].N2kSource==Devices[i].N2kSource);
-    }
-  } while (FoundSame);
+  }
+
+  // Skip addresses we know are in use so that we need only one claim round.
+  uint8_t Source=N2kNullCanBusAddress;
+  for (uint8_t Next=Device.N2kSource; Next!=Device.AddressClaimEndSource; ) {
+    Next++;
+    // Roll to start?
+    if ( Next>N2kMaxCanBusAddress ) Next=0;
+    if ( IsAddressFree(Next,DeviceIndex) ) { Source=Next; break; }
+  }
+
+  // If no free address found we will get null address = cannot claim address
+  Device.N2kSource=Source;
+  UpdateSourceDeviceIndex();
   AddressChanged=true;
+  JournalChanged(ji_Source);
+}
+
+//*****************************************************************************
+bool tNMEA2000::IsAddressFree(uint8_t Source, int DeviceIndex) const {
+  if ( Source>N2kMaxCanBusAddress || IsAddressClaimed(Source) ) return false;
+  int iDev=FindSourceDeviceIndex(Source);
+  return ( iDev==-1 || iDev==DeviceIndex );
+}
+
+//*****************************************************************************
+void tNMEA2000::SetAddressClaimed(uint8_t Source, bool Claimed) {
+  if ( Claimed ) {
+    ClaimedAddresses[Source>>5]|=(1UL<<(Source & 0x1f));
+  } else {
+    ClaimedAddresses[Source>>5]&=~(1UL<<(Source & 0x1f));
+  }
+}
+
+//*****************************************************************************
+void tNMEA2000::ClearClaimedAddresses() {
+  for (int i=0; i<8; i++) ClaimedAddresses[i]=0;
 }
 
 //*****************************************************************************
@@ -2592,23 +3755,24 @@ bool tNMEA2000::HandleReceivedSystemMessage(int MsgIndex) {
    if ( N2kMode==N2km_SendOnly || N2kMode==N2km_ListenAndSend ) return result;
 
     if ( N2kCANMsgBuf[MsgIndex].SystemMessage ) {
-      if ( ForwardSystemMessages() ) ForwardMessage(N2kCANMsgBuf[MsgIndex].N2kMsg);
+      const tN2kMsg &N2kMsg=N2kCANMsgBuf[MsgIndex].GetN2kMsg();
+      if ( ForwardSystemMessages() ) ForwardMessage(N2kMsg);
       if ( N2kMode!=N2km_ListenOnly ) { // Note that in listen only mode we will not inform us to the bus
-        switch (N2kCANMsgBuf[MsgIndex].N2kMsg.PGN) {
+        switch (N2kMsg.PGN) {
           case 59392L: /*ISO Acknowledgement*/
             break;
           case 59904L: /*ISO Request*/
-            HandleISORequest(N2kCANMsgBuf[MsgIndex].N2kMsg);
+            HandleISORequest(N2kMsg);
             break;
           case 60928L: /*ISO Address Claim*/
-            HandleISOAddressClaim(N2kCANMsgBuf[MsgIndex].N2kMsg);
+            HandleISOAddressClaim(N2kMsg);
             break;
           case 65240L: /*Commanded Address*/
-            HandleCommandedAddress(N2kCANMsgBuf[MsgIndex].N2kMsg);
+            HandleCommandedAddress(N2kMsg);
             break;
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
           case 126208L: /*NMEA Request/Command/Acknowledge group function*/
-            HandleGroupFunction(N2kCANMsgBuf[MsgIndex].N2kMsg);
+            HandleGroupFunction(N2kMsg);
             break;
 #endif
         }
@@ -2624,7 +3788,6 @@ void tNMEA2000::ParseMessages() {
     unsigned long canId;
     unsigned char len = 0;
     unsigned char buf[8];
-    uint8_t MsgIndex;
     static const int MaxReadFramesOnParse=20;
     int FramesRead=0;
 //    tN2kMsg N2kMsg;
@@ -2636,45 +3799,469 @@ void tNMEA2000::ParseMessages() {
     if (dbMode != dm_None) return; // No much to do here, when in Debug mode
 
     SendFrames();
-    SendPendingInformation();
+    SendDeferredFrames();
+    HandleProtocolTimers();
 #if defined(DEBUG_NMEA2000_ISR)
     TestISR();
 #endif
 
+#if defined(N2K_FRAME_TIMESTAMP)
+    while (FramesRead<MaxReadFramesOnParse && CANGetTimestampedFrame(canId,len,buf,RxFrameTime) ) { // check if data coming
+#else
     while (FramesRead<MaxReadFramesOnParse && CANGetFrame(canId,len,buf) ) {           // check if data coming
+#endif
         FramesRead++;
-        N2kMsgRxDbgStart("Received frame, can ID:"); N2kMsgRxDbg(canId); N2kMsgRxDbg(" len:"); N2kMsgRxDbg(len); N2kMsgRxDbg(" data:"); DbgPrintBuf(len,buf,false); N2kMsgRxDbgln();
-        MsgIndex=SetN2kCANBufMsg(canId,len,buf);
-        if (MsgIndex<MaxN2kCANMsgs) {
-          if ( !HandleReceivedSystemMessage(MsgIndex) ) {
-            N2kMsgRxDbgStart(" - Non system message, MsgIndex: "); N2kMsgRxDbgln(MsgIndex);
-            ForwardMessage(N2kCANMsgBuf[MsgIndex]);
-          }
-//          N2kCANMsgBuf[MsgIndex].N2kMsg.Print(Serial);
-          RunMessageHandlers(N2kCANMsgBuf[MsgIndex].N2kMsg);
-          N2kCANMsgBuf[MsgIndex].FreeMessage();
-          N2kMsgRxDbgStart(" - Free message, MsgIndex: "); N2kMsgRxDbg(MsgIndex); N2kMsgRxDbgln();
-        }
+        HandleReceivedFrame(canId,len,buf);
+    }
+    if ( FramesRead==MaxReadFramesOnParse ) Stats.ParseTruncated++;
+}
+
+//*****************************************************************************
+void tNMEA2000::HandleReceivedFrame(unsigned long canId, unsigned char len, unsigned char *buf) {
+    uint8_t MsgIndex;
+
+    N2kMsgRxDbgStart("Received frame, can ID:"); N2kMsgRxDbg(canId); N2kMsgRxDbg(" len:"); N2kMsgRxDbg(len); N2kMsgRxDbg(" data:"); DbgPrintBuf(len,buf,false); N2kMsgRxDbgln();
+    Stats.FramesReceived++;
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    if ( SlotAllocator!=0 ) SlotAllocator->AddFrame(N2kMillis64()-tN2kSyncScheduler::GetSyncOffset());
+#endif
+#if !defined(N2K_NO_TX_PACER)
+    if ( TxPacer!=0 ) TxPacer->AddFrame(N2kMillis64(),len);
+#endif
+    N2kTrace(N2kte_FrameReceived,canId,len);
+    if ( FrameMonitor!=0 ) {
+#if defined(N2K_FRAME_TIMESTAMP)
+      FrameMonitor->HandleFrame(canId,len,buf,false,RxFrameTime);
+#else
+      FrameMonitor->HandleFrame(canId,len,buf,false,N2kMicros64());
+#endif
+    }
+    if ( !IsSubscribedFrame(canId) ) {
+      Stats.FramesFiltered++;
+      return;
+    }
+    MsgIndex=SetN2kCANBufMsg(canId,len,buf);
+    if (MsgIndex<MaxN2kCANMsgs) {
+      N2kTrace(N2kte_MsgComplete,N2kCANMsgBuf[MsgIndex].N2kMsg.PGN,N2kCANMsgBuf[MsgIndex].N2kMsg.Source);
+      Stats.MessagesReceived++;
+      if ( PGNStats!=0 ) {
+        tPGNStats *PGNStat=FindPGNStats(N2kCANMsgBuf[MsgIndex].N2kMsg.PGN);
+        if ( PGNStat!=0 ) PGNStat->Received++;
+      }
+      if ( !HandleReceivedSystemMessage(MsgIndex) ) {
+        N2kMsgRxDbgStart(" - Non system message, MsgIndex: "); N2kMsgRxDbgln(MsgIndex);
+        ForwardMessage(N2kCANMsgBuf[MsgIndex]);
+      }
+      N2kTrace(N2kte_HandlerStart,N2kCANMsgBuf[MsgIndex].N2kMsg.PGN,N2kCANMsgBuf[MsgIndex].N2kMsg.Source);
+      RunMessageHandlers(N2kCANMsgBuf[MsgIndex].GetN2kMsg());
+      N2kTrace(N2kte_HandlerEnd,N2kCANMsgBuf[MsgIndex].N2kMsg.PGN,N2kCANMsgBuf[MsgIndex].N2kMsg.Source);
+      N2kCANMsgBuf[MsgIndex].FreeMessage();
+      N2kMsgRxDbgStart(" - Free message, MsgIndex: "); N2kMsgRxDbg(MsgIndex); N2kMsgRxDbgln();
     }
+}
+
+//*****************************************************************************
+bool tNMEA2000::InjectFrame(unsigned long id, unsigned char len, const unsigned char *buf, uint64_t FrameTime) {
+    unsigned char FrameBuf[8];
+
+    if ( OpenState!=os_Open ) {
+      if ( !(Open() && OpenState==os_Open) ) return false;
+    }
+    if ( len>8 ) len=8;
+
+    memcpy(FrameBuf,buf,len);
+#if defined(N2K_FRAME_TIMESTAMP)
+    RxFrameTime=( FrameTime!=0 ? FrameTime : N2kMicros64() );
+#else
+    (void)FrameTime;
+#endif
+    HandleReceivedFrame(id,len,FrameBuf);
+
+    return true;
+}
+
+//*****************************************************************************
+void tNMEA2000::InjectMsg(const tN2kMsg &N2kMsg) {
+    ForwardMessage(N2kMsg);
+    RunMessageHandlers(N2kMsg);
+}
+
+//*****************************************************************************
+void tNMEA2000::HandleProtocolTimers() {
+  uint64_t Now=N2kMillis64();
+
+  if ( Now<=NextProtocolEventTime ) return;
+
+  for (int i=0; i<DeviceCount; i++) IsAddressClaimStarted(i); // Finishes address claim on timeout
+  SendPendingInformation();
+#if !defined(N2K_NO_HEARTBEAT_SUPPORT)
+  SendHeartbeat();
+#endif
+  if ( StatsDumpScheduler.IsTime() ) {
+    StatsDumpScheduler.FromNow(StatsDumpPeriod);
+    SendStatsDump();
+  }
+  SendPendingPeriodicMsgs();
+#if !defined(N2K_NO_JOURNAL)
+  WriteJournal();
+#endif
+  UpdateNextProtocolEventTime(Now);
+}
+
+//*****************************************************************************
+inline void N2kMinTime(uint64_t &Min, uint64_t Time) { if ( Time<Min ) Min=Time; }
+
+//*****************************************************************************
+void tNMEA2000::UpdateNextProtocolEventTime(uint64_t Now) {
+  uint64_t Next=N2kScheduler64Disabled;
 
+  for (int i=0; i<DeviceCount; i++) {
+    const tInternalDevice &Device=Devices[i];
+    N2kMinTime(Next,Device.PendingIsoAddressClaim.GetNextTime64(Now));
+    N2kMinTime(Next,Device.PendingProductInformation.GetNextTime64(Now));
+    N2kMinTime(Next,Device.PendingConfigurationInformation.GetNextTime64(Now));
+    // Heartbeat will be delayed until address claim has been finished.
+    N2kMinTime(Next,Device.AddressClaimTimer.GetNextTime64(Now));
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+    for (int iSession=0; iSession<Device.MaxTPSessions && Device.ActiveTPSessions>0; iSession++) {
+      if ( !Device.TPSessions[iSession].IsFree() ) N2kMinTime(Next,Device.TPSessions[iSession].Timer.GetNextTime64(Now));
+    }
+#endif
 #if !defined(N2K_NO_HEARTBEAT_SUPPORT)
-    SendHeartbeat();
+    N2kMinTime(Next,Device.HeartbeatScheduler.GetNextTime());
 #endif
+  }
+  N2kMinTime(Next,StatsDumpScheduler.GetNextTime64(Now));
+  if ( PeriodicMsgQueueCount>0 ) N2kMinTime(Next,PeriodicMsgs[PeriodicMsgQueue[0]].Scheduler.GetNextTime());
+
+  NextProtocolEventTime=Next;
+}
+
+//*****************************************************************************
+uint64_t tNMEA2000::GetNextProtocolEventTime() const {
+  if ( CANSendFrameBufferRead!=CANSendFrameBufferWrite ) return 0; // Frames waiting for driver
+#if !defined(N2K_NO_TX_PACER)
+  if ( TxPacer!=0 && TxPacer->HasDeferred() ) {
+    uint64_t Next=TxPacer->GetNextSendTime(N2kMillis64());
+    if ( Next<NextProtocolEventTime ) return Next;
+  }
+#endif
+
+  return NextProtocolEventTime;
+}
+
+//*****************************************************************************
+void tNMEA2000::ResetStats() {
+  memset(&Stats,0,sizeof(Stats));
+  PGNStatsCount=0;
+}
+
+//*****************************************************************************
+void tNMEA2000::SetPGNStatsSize(uint16_t _MaxPGNStats) {
+  if ( _MaxPGNStats==MaxPGNStats ) return;
+
+  delete[] PGNStats;
+  PGNStats=( _MaxPGNStats>0 ? new tPGNStats[_MaxPGNStats] : 0 );
+  MaxPGNStats=( PGNStats!=0 ? _MaxPGNStats : 0 );
+  PGNStatsCount=0;
+}
+
+//*****************************************************************************
+tNMEA2000::tPGNStats *tNMEA2000::FindPGNStats(unsigned long PGN) {
+  for (uint16_t i=0; i<PGNStatsCount; i++) {
+    if ( PGNStats[i].PGN==PGN ) return &PGNStats[i];
+  }
+
+  if ( PGNStatsCount>=MaxPGNStats ) {
+    Stats.PGNStatsFull++;
+    return 0;
+  }
+
+  tPGNStats *PGNStat=&PGNStats[PGNStatsCount++];
+  PGNStat->PGN=PGN;
+  PGNStat->Received=0;
+  PGNStat->Sent=0;
+  PGNStat->Errors=0;
+
+  return PGNStat;
+}
+
+//*****************************************************************************
+static void SetStatsBuf4ByteUInt(unsigned char *Buf, size_t &Index, uint32_t v) {
+  Buf[Index++]=v; Buf[Index++]=v>>8; Buf[Index++]=v>>16; Buf[Index++]=v>>24;
+}
+
+//*****************************************************************************
+static void SetStatsBufPGNEntry(unsigned char *Buf, size_t &Index, const tNMEA2000::tPGNStats &PGNStat) {
+  Buf[Index++]=PGNStat.PGN; Buf[Index++]=PGNStat.PGN>>8; Buf[Index++]=PGNStat.PGN>>16;
+  SetStatsBuf4ByteUInt(Buf,Index,PGNStat.Received);
+  SetStatsBuf4ByteUInt(Buf,Index,PGNStat.Sent);
+  SetStatsBuf4ByteUInt(Buf,Index,PGNStat.Errors);
+}
+
+//*****************************************************************************
+size_t tNMEA2000::GetStatsDump(unsigned char *Buf, size_t BufSize) const {
+  const size_t CounterCount=sizeof(tStats)/sizeof(uint32_t);
+  size_t Len=4+CounterCount*4+2+PGNStatsCount*15;
+  size_t Index=0;
+
+  if ( Buf==0 || BufSize<Len ) return 0;
+
+  Buf[Index++]='N';
+  Buf[Index++]='S';
+  Buf[Index++]=1; // Version
+  Buf[Index++]=CounterCount;
+  const uint32_t *Counters=(const uint32_t *)&Stats;
+  for (size_t i=0; i<CounterCount; i++) SetStatsBuf4ByteUInt(Buf,Index,Counters[i]);
+  Buf[Index++]=PGNStatsCount;
+  Buf[Index++]=PGNStatsCount>>8;
+  for (uint16_t i=0; i<PGNStatsCount; i++) SetStatsBufPGNEntry(Buf,Index,PGNStats[i]);
+
+  return Index;
+}
+
+//*****************************************************************************
+void tNMEA2000::SetStatsDump(N2kStream *_StatsStream, uint32_t Period) {
+  StatsStream=_StatsStream;
+  StatsDumpPeriod=Period;
+  if ( StatsStream!=0 && StatsDumpPeriod>0 ) {
+    StatsDumpScheduler.FromNow(StatsDumpPeriod);
+  } else {
+    StatsDumpScheduler.Disable();
+  }
+  ProtocolTimerChanged();
+}
+
+//*****************************************************************************
+void tNMEA2000::SendStatsDump() {
+  if ( StatsStream==0 ) return;
+
+  // Write header and counters with empty PGN table and then PGN entries one by one.
+  uint16_t Count=PGNStatsCount;
+  unsigned char Buf[4+sizeof(tStats)+2];
+  PGNStatsCount=0;
+  size_t Len=GetStatsDump(Buf,sizeof(Buf));
+  PGNStatsCount=Count;
+  Buf[Len-2]=Count;
+  Buf[Len-1]=Count>>8;
+  StatsStream->write(Buf,Len);
+  for (uint16_t i=0; i<Count; i++) {
+    size_t Index=0;
+    SetStatsBufPGNEntry(Buf,Index,PGNStats[i]);
+    StatsStream->write(Buf,Index);
+  }
+}
+
+//*****************************************************************************
+// PGNs library itself must receive, when subscriptions are in use.
+static const unsigned long SubscriptionSystemPGNs[] PROGMEM = {
+  59392L, // ISO Acknowledgement
+  59904L, // ISO Request
+  60160L, // ISO Transport Protocol, Data Transfer
+  60416L, // ISO Transport Protocol, Connection Management
+  60928L, // ISO Address Claim
+  65240L, // Commanded Address
+  126208L, // Group function
+  0 };
+
+//*****************************************************************************
+bool tNMEA2000::Subscribe(unsigned long FirstPGN, unsigned long LastPGN, unsigned char Source) {
+  if ( LastPGN==0 ) LastPGN=FirstPGN;
+  if ( LastPGN<FirstPGN || LastPGN>0x3ffff ) return false;
+
+  if ( SubscriptionCount>=SubscriptionCapacity ) {
+    if ( SubscriptionCapacity>=0xf0 ) return false;
+    uint8_t NewCapacity=SubscriptionCapacity+16;
+    tSubscription *NewSubscriptions=new tSubscription[NewCapacity];
+    if ( NewSubscriptions==0 ) return false;
+    for (uint8_t i=0; i<SubscriptionCount; i++) NewSubscriptions[i]=Subscriptions[i];
+    delete[] Subscriptions;
+    Subscriptions=NewSubscriptions;
+    SubscriptionCapacity=NewCapacity;
+  }
+
+  Subscriptions[SubscriptionCount].FirstPGN=FirstPGN;
+  Subscriptions[SubscriptionCount].LastPGN=LastPGN;
+  Subscriptions[SubscriptionCount].Source=Source;
+  SubscriptionCount++;
+  UpdateCANFilters();
+
+  return true;
+}
+
+//*****************************************************************************
+void tNMEA2000::ClearSubscriptions() {
+  SubscriptionCount=0;
+  UpdateCANFilters();
+}
+
+//*****************************************************************************
+bool tNMEA2000::AddCANFilter(unsigned long id, unsigned long mask) {
+  id&=mask;
+  // Skip filter, if some existing filter already covers it.
+  for (uint16_t i=0; i<CANFilterCount; i++) {
+    if ( (CANFilters[i].mask & mask)==CANFilters[i].mask && ((id ^ CANFilters[i].id) & CANFilters[i].mask)==0 ) return true;
+  }
+
+  if ( CANFilterCount>=CANFilterCapacity ) {
+    uint16_t NewCapacity=CANFilterCapacity+16;
+    tCANFilter *NewFilters=new tCANFilter[NewCapacity];
+    if ( NewFilters==0 ) return false;
+    for (uint16_t i=0; i<CANFilterCount; i++) NewFilters[i]=CANFilters[i];
+    delete[] CANFilters;
+    CANFilters=NewFilters;
+    CANFilterCapacity=NewCapacity;
+  }
+
+  CANFilters[CANFilterCount].id=id;
+  CANFilters[CANFilterCount].mask=mask;
+  CANFilterCount++;
+
+  return true;
+}
+
+//*****************************************************************************
+// PGN is on CAN id bits 8-25. For PDU1 PGNs bits 8-15 is destination, so it
+// will be left out from mask.
+bool tNMEA2000::AddCANFilterRange(unsigned long FirstPGN, unsigned long LastPGN, unsigned char Source) {
+  while ( FirstPGN<=LastPGN ) {
+    unsigned long Size=1;
+    while ( Size<0x40000 && (FirstPGN & (Size*2-1))==0 && FirstPGN+Size*2-1<=LastPGN ) Size*=2;
+
+    unsigned long mask=(0x3ffffUL & ~(Size-1))<<8;
+    if ( Size<256 && ((FirstPGN>>8) & 0xff)<240 ) mask&=~0xff00UL;
+    if ( Source!=0xff ) mask|=0xff;
+    if ( !AddCANFilter((FirstPGN<<8) | Source,mask) ) return false;
+
+    FirstPGN+=Size;
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+static inline uint8_t N2kBitCount(unsigned long v) {
+  uint8_t Count=0;
+  for (; v!=0; v&=v-1) Count++;
+  return Count;
+}
+
+//*****************************************************************************
+void tNMEA2000::UpdateCANFilters() {
+  CANFilterCount=0;
+
+  if ( SubscriptionCount>0 ) {
+    for (uint8_t i=0; pgm_read_dword(&SubscriptionSystemPGNs[i])!=0; i++) {
+      unsigned long PGN=pgm_read_dword(&SubscriptionSystemPGNs[i]);
+      AddCANFilterRange(PGN,PGN,0xff);
+    }
+    for (uint8_t i=0; i<SubscriptionCount; i++) {
+      AddCANFilterRange(Subscriptions[i].FirstPGN,Subscriptions[i].LastPGN,Subscriptions[i].Source);
+    }
+
+    // Merge filters, which differ only by one masked bit.
+    bool Merged=true;
+    while ( Merged ) {
+      Merged=false;
+      for (uint16_t i=0; i<CANFilterCount && !Merged; i++) {
+        for (uint16_t j=i+1; j<CANFilterCount && !Merged; j++) {
+          unsigned long Diff=CANFilters[i].id ^ CANFilters[j].id;
+          if ( CANFilters[i].mask==CANFilters[j].mask && N2kBitCount(Diff)==1 ) {
+            CANFilters[i].mask&=~Diff;
+            CANFilters[i].id&=CANFilters[i].mask;
+            CANFilters[j]=CANFilters[--CANFilterCount];
+            Merged=true;
+          }
+        }
+      }
+    }
+  }
+
+  if ( OpenState>=os_WaitOpen && dbMode==dm_None ) SetHardwareFilters();
+}
+
+//*****************************************************************************
+void tNMEA2000::SetHardwareFilters() {
+  uint8_t MaxFilters=CANGetMaxFilters();
+
+  if ( MaxFilters==0 ) return;
+  if ( SubscriptionCount==0 ) {
+    CANSetFilters(0,0);
+    return;
+  }
+  if ( CANFilterCount<=MaxFilters ) {
+    CANSetFilters(CANFilters,CANFilterCount);
+    return;
+  }
+
+  // Widen filters pairwise by keeping as many mask bits as possible.
+  // Software filter still rejects extra frames.
+  tCANFilter *Filters=new tCANFilter[CANFilterCount];
+  if ( Filters==0 ) return;
+  uint16_t Count=CANFilterCount;
+  for (uint16_t i=0; i<Count; i++) Filters[i]=CANFilters[i];
+  while ( Count>MaxFilters ) {
+    uint16_t Best_i=0, Best_j=1;
+    uint8_t BestBits=0;
+    for (uint16_t i=0; i<Count; i++) {
+      for (uint16_t j=i+1; j<Count; j++) {
+        uint8_t Bits=N2kBitCount(Filters[i].mask & Filters[j].mask & ~(Filters[i].id ^ Filters[j].id));
+        if ( Bits>BestBits ) { BestBits=Bits; Best_i=i; Best_j=j; }
+      }
+    }
+    Filters[Best_i].mask&=Filters[Best_j].mask & ~(Filters[Best_i].id ^ Filters[Best_j].id);
+    Filters[Best_i].id&=Filters[Best_i].mask;
+    Filters[Best_j]=Filters[--Count];
+  }
+  CANSetFilters(Filters,Count);
+  delete[] Filters;
 }
 
 //*****************************************************************************
 void tNMEA2000::RunMessageHandlers(const tN2kMsg &N2kMsg) {
-  if ( MsgHandler!=0 ) MsgHandler(N2kMsg);
+  if ( MsgHandler!=0 ) {
+    if ( !HandlerTiming ) {
+      MsgHandler(N2kMsg);
+    } else {
+      uint64_t Start=N2kMicros64();
+      MsgHandler(N2kMsg);
+      UpdateHandlerStats(MsgHandlerStats,0,N2kMsg,N2kMicros64()-Start);
+    }
+  }
 
   tMsgHandler *MsgHandler=MsgHandlers;
+  tMsgHandler *Next;
+  // Next handler is taken before call, since slow handler callback may detach called handler.
   // Loop through all PGN handlers
-  for ( ;MsgHandler!=0 && MsgHandler->GetPGN()==0; MsgHandler=MsgHandler->pNext) MsgHandler->HandleMsg(N2kMsg);
+  for ( ;MsgHandler!=0 && MsgHandler->GetPGN()==0; MsgHandler=Next) {
+    Next=MsgHandler->pNext;
+    CallMsgHandler(MsgHandler,N2kMsg);
+  }
   // Loop through specific PGN handlers
-  for ( ;MsgHandler!=0 && MsgHandler->GetPGN()<=N2kMsg.PGN; MsgHandler=MsgHandler->pNext) {
-    if ( MsgHandler->GetPGN()==N2kMsg.PGN ) MsgHandler->HandleMsg(N2kMsg);
+  for ( ;MsgHandler!=0 && MsgHandler->GetPGN()<=N2kMsg.PGN; MsgHandler=Next) {
+    Next=MsgHandler->pNext;
+    if ( MsgHandler->GetPGN()==N2kMsg.PGN ) CallMsgHandler(MsgHandler,N2kMsg);
   }
 }
 
+//*****************************************************************************
+void tNMEA2000::UpdateHandlerStats(tHandlerStats &HandlerStats, tMsgHandler *Handler, const tN2kMsg &N2kMsg, uint32_t Time) {
+  HandlerStats.Calls++;
+  HandlerStats.TotalTime+=Time;
+  if ( Time>HandlerStats.MaxTime ) HandlerStats.MaxTime=Time;
+  if ( HandlerBudget>0 && Time>HandlerBudget ) {
+    HandlerStats.OverBudget++;
+    Stats.HandlersOverBudget++;
+    if ( SlowHandlerCallback!=0 ) SlowHandlerCallback(Handler,N2kMsg,Time);
+  }
+}
+
+//*****************************************************************************
+void tNMEA2000::ResetHandlerStats() {
+  memset(&MsgHandlerStats,0,sizeof(MsgHandlerStats));
+  for (tMsgHandler *MsgHandler=MsgHandlers; MsgHandler!=0; MsgHandler=MsgHandler->pNext) MsgHandler->ResetHandlerStats();
+}
+
 //*****************************************************************************
 void tNMEA2000::SetOnOpen(void (*_OnOpen)()) {
   OnOpen=_OnOpen;
@@ -2736,6 +4323,7 @@ void tNMEA2000::SetISORqstHandler(bool(*ISORequestHandler)(unsigned long Request
 void tNMEA2000::RemoveGroupFunctionHandler(tN2kGroupFunctionHandler *pGroupFunctionHandler) {
   if (pGroupFunctionHandler==0 || pGroupFunctionHandlers==0 ) return;
 
+  GroupFunctionHandlerIndexValid=false;
   tN2kGroupFunctionHandler* pPrevGroupFunctionHandler=pGroupFunctionHandlers;
   // Handle, if first
   if ( pPrevGroupFunctionHandler==pGroupFunctionHandler ) {
@@ -2754,6 +4342,7 @@ void tNMEA2000::RemoveGroupFunctionHandler(tN2kGroupFunctionHandler *pGroupFunct
 void tNMEA2000::AddGroupFunctionHandler(tN2kGroupFunctionHandler *pGroupFunctionHandler) {
   if (pGroupFunctionHandler==0) return;
   RemoveGroupFunctionHandler(pGroupFunctionHandler);
+  GroupFunctionHandlerIndexValid=false;
   // Add to the end on the list
   if ( pGroupFunctionHandlers==0 ) { // If there is none set, put it to first
     pGroupFunctionHandlers=pGroupFunctionHandler;
@@ -51,10 +51,23 @@
 #include "N2kMsg.h"
 #include "N2kCANMsg.h"
 #include "N2kTimer.h"
+#include <string.h>
 
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
 #include "N2kGroupFunction.h"
 #endif
+
+#if !defined(N2K_NO_JOURNAL)
+#include "N2kJournal.h"
+#endif
+
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+#include "N2kSlotAllocator.h"
+#endif
+
+#if !defined(N2K_NO_TX_PACER)
+#include "N2kTxPacer.h"
+#endif
 /** \brief PGN for an ISO Address Claim message */
 #define N2kPGNIsoAddressClaim 60928L
 /** \brief PGN for a Production Information message */
@@ -102,6 +115,23 @@
 #define Max_N2kMsgBuf_Time 100
 /** \brief Number of message groups */
 #define N2kMessageGroups 2
+/************************************************************************//**
+ * \brief Size of received CAN id action cache
+ *
+ * Must be power of two. Define N2K_NO_CANID_CACHE to disable cache.
+ */
+#ifndef N2K_CANID_CACHE_SIZE
+#define N2K_CANID_CACHE_SIZE 32
+#endif
+/************************************************************************//**
+ * \brief Default time in ms, how long responses to ISO requests will be
+ *        held for coalescing duplicate requests.
+ *
+ * See \ref tNMEA2000::SetISORequestCoalesceTime
+ */
+#ifndef N2K_ISO_REQUEST_COALESCE_TIME
+#define N2K_ISO_REQUEST_COALESCE_TIME 50
+#endif
 /** \brief Max CAN Bus Address given by the library*/
 #define N2kMaxCanBusAddress 251
 /** \brief Null Address (???)*/
@@ -608,6 +638,25 @@ public:
       /** \brief Get the list of received PGNs from this device*/
       virtual const unsigned long * GetReceivePGNs() const { return 0; }
   };
+
+  /************************************************************************//**
+   * \struct tHandlerStats
+   * \brief Execution time statistics for message handler
+   *
+   * Statistics will be collected only, when handler timing has been enabled
+   * with \ref EnableHandlerTiming.
+   */
+  struct tHandlerStats {
+    /** \brief Number of timed calls */
+    uint32_t Calls;
+    /** \brief Number of calls, which exceeded handler budget */
+    uint32_t OverBudget;
+    /** \brief Longest call time in us */
+    uint32_t MaxTime;
+    /** \brief Cumulative call time in us */
+    uint64_t TotalTime;
+  };
+
   /************************************************************************//**
    * \class tMsgHandler
    * \brief Message handler class
@@ -620,6 +669,8 @@ public:
       tMsgHandler *pNext;
       /** \brief Pointer to a tNMEA2000 object*/
       tNMEA2000 *pNMEA2000;
+      /** \brief Execution time statistics */
+      tHandlerStats HandlerStats;
     protected:
       /** Parameter Group Number*/
       unsigned long PGN;
@@ -643,6 +694,7 @@ public:
        */
       tMsgHandler(unsigned long _PGN=0, tNMEA2000 *_pNMEA2000=0) {
         PGN=_PGN; pNext=0; pNMEA2000=0;
+        ResetHandlerStats();
         if ( _pNMEA2000!=0 ) _pNMEA2000->AttachMsgHandler(this);
       }
       /*******************************************************************//**
@@ -654,9 +706,156 @@ public:
        * \return unsigned long 
        */
       inline unsigned long GetPGN() const { return PGN; }
+      /** \brief Execution time statistics. See \ref EnableHandlerTiming */
+      const tHandlerStats &GetHandlerStats() const { return HandlerStats; }
+      /** \brief Clear execution time statistics */
+      void ResetHandlerStats() { memset(&HandlerStats,0,sizeof(HandlerStats)); }
+  };
+
+  /************************************************************************//**
+   * \class tFrameMonitor
+   * \brief Monitor for all received and sent CAN frames
+   *
+   * Monitor will be called for each received frame before library handles
+   * it and for each sent frame, when library hands it to CAN driver. Frames
+   * waiting on library send buffer or on transmit pacer queue will be
+   * reported later, when they are handed to driver. This can be used e.g.,
+   * for recording raw bus traffic. See \ref tN2kFrameLogWriter.
+   */
+  class tFrameMonitor {
+    public:
+      virtual ~tFrameMonitor() {}
+      /*******************************************************************//**
+       * \brief Handles a frame
+       *
+       * \param id        ID of the CAN frame
+       * \param len       length of payload
+       * \param buf       buffer with the payload
+       * \param Tx        true for sent frame, false for received frame
+       * \param FrameTime Frame time in microseconds on N2kMicros64() time base
+       */
+      virtual void HandleFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool Tx, uint64_t FrameTime)=0;
+  };
+
+  /************************************************************************//**
+   * \struct tCANFilter
+   * \brief CAN id acceptance filter
+   *
+   * Frame will be accepted, if (FrameId & mask)==(id & mask). Mask covers
+   * only bits 0-25 (PGN and source), so priority is never filtered.
+   */
+  struct tCANFilter {
+    unsigned long id;
+    unsigned long mask;
+  };
+
+  /** \brief Flags for \ref tForwardRule */
+  enum tForwardRuleFlags {
+    /** \brief Drop messages with payload equal to last forwarded */
+    fwdr_SuppressUnchanged=0x01,
+    /** \brief Changed payload bypasses decimation interval */
+    fwdr_PassChanges=0x02
+  };
+
+  /************************************************************************//**
+   * \struct tForwardRule
+   * \brief Forward decimation and deduplication rule
+   *
+   * Rule state is kept separately for each PGN and source pair, so rule
+   * with any source decimates each sender independently.
+   */
+  struct tForwardRule {
+    unsigned long PGN;
+    /** \brief Source or 0xff for any source */
+    unsigned char Source;
+    /** \brief Flags, see \ref tForwardRuleFlags */
+    uint8_t Flags;
+    /** \brief Minimum interval in ms between forwarded messages */
+    uint16_t Interval;
+    /** \brief Interval in ms to forward unchanged payload anyway, 0 for never */
+    uint16_t RefreshInterval;
+    /** \brief Messages forwarded */
+    uint32_t Forwarded;
+    /** \brief Messages dropped by interval */
+    uint32_t Decimated;
+    /** \brief Messages dropped as unchanged */
+    uint32_t Suppressed;
+  };
+
+  /************************************************************************//**
+   * \struct tStats
+   * \brief Runtime statistics counters
+   *
+   * Counters are always collected. Read them with \ref GetStats and clear
+   * with \ref ResetStats. Counters wrap around on overflow.
+   */
+  struct tStats {
+    /** \brief Frames read from driver or injected */
+    uint32_t FramesReceived;
+    /** \brief Frames accepted for sending */
+    uint32_t FramesSent;
+    /** \brief Frames, which had to be buffered on library send buffer */
+    uint32_t FramesBuffered;
+    /** \brief Frames dropped, since send buffer was full */
+    uint32_t SendBufferFull;
+    /** \brief Complete messages received */
+    uint32_t MessagesReceived;
+    /** \brief Messages successfully sent */
+    uint32_t MessagesSent;
+    /** \brief Messages, which sending failed */
+    uint32_t SendFailed;
+    /** \brief Fast packet frames without first frame */
+    uint32_t OrphanFrames;
+    /** \brief Fast packet messages dropped due to wrong frame sequence */
+    uint32_t LostFrames;
+    /** \brief Messages dropped, since there was no free message slot */
+    uint32_t MsgSlotExhausted;
+    /** \brief Incomplete messages freed for new message by timeout */
+    uint32_t MsgSlotTimeouts;
+    /** \brief ISO TP messages dropped due to wrong packet sequence */
+    uint32_t TPLostPackets;
+    /** \brief ISO TP aborts sent */
+    uint32_t TPAbortsSent;
+    /** \brief ISO TP aborts received for own sessions */
+    uint32_t TPAbortsReceived;
+    /** \brief ParseMessages calls, which stopped on read frame limit */
+    uint32_t ParseTruncated;
+    /** \brief Received or sent PGNs, which did not fit to PGN stats table */
+    uint32_t PGNStatsFull;
+    /** \brief Message handler calls, which exceeded handler budget */
+    uint32_t HandlersOverBudget;
+    /** \brief Received frames rejected by subscription filter */
+    uint32_t FramesFiltered;
+    /** \brief ISO requests dropped, since response was already pending */
+    uint32_t ISORequestsCoalesced;
+    /** \brief Bulk frames deferred by transmit pacing. See \ref SetTxPacer */
+    uint32_t FramesDeferred;
+  };
+
+  /************************************************************************//**
+   * \struct tPGNStats
+   * \brief Per PGN statistics counters. See \ref SetPGNStatsSize.
+   */
+  struct tPGNStats {
+    unsigned long PGN;
+    /** \brief Complete messages received */
+    uint32_t Received;
+    /** \brief Messages successfully sent */
+    uint32_t Sent;
+    /** \brief Orphan, lost or sequence error frames */
+    uint32_t Errors;
   };
 
 public:
+  /************************************************************************//**
+   * \brief Callback to build periodic message. See \ref AddPeriodicMsg
+   *
+   * \param N2kMsg  Message to be filled
+   * \param iDev    Index of the device sending message
+   * \return true to send message, false to skip this period
+   */
+  typedef bool (*tPeriodicMsgProducer)(tN2kMsg &N2kMsg, int iDev);
+
   /************************************************************************//**
    * \enum    tForwardType
    * \brief   Type how to forward messages in listen mode
@@ -763,6 +962,94 @@ protected:
                   ,os_Open			///< State Open
                } tOpenState;
 
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+  /************************************************************************//**
+   * \class   tTPSession
+   * \brief   Outgoing ISO Transport Protocol session
+   *
+   * Each internal device has table of sessions, so it can send multi packet
+   * messages to several destinations at the same time. There can be only
+   * one session per destination and only one broadcast (BAM) session.
+   */
+  class tTPSession {
+  public:
+    /** \brief Message under transport. PGN 0 means free session */
+    tN2kMsg Msg;
+    /** \brief For BAM time to send next data packet. For RTS/CTS timeout 
+     * for response from receiver.*/
+    tN2kScheduler Timer;
+    /** \brief Next Sequence*/
+    uint8_t NextDTSequence;
+
+    tTPSession() : NextDTSequence(0) {}
+    /** \brief Check is session free */
+    bool IsFree() const { return Msg.PGN==0; }
+  };
+#endif
+
+#if !defined(N2K_NO_RESPONSE_CACHE)
+  /************************************************************************//**
+   * \class   tCachedResponse
+   * \brief   Encoded data of response message
+   *
+   * Responses to ISO requests for product information, configuration
+   * information and PGN lists are built from information, which changes
+   * rarely. Encoded data will be saved on first send and later responses
+   * only copy it to message. Data buffer will be allocated on first use.
+   * Define N2K_NO_RESPONSE_CACHE to disable cache.
+   */
+  class tCachedResponse {
+  public:
+    /** \brief Encoded message data */
+    unsigned char *Data;
+    /** \brief Length of encoded data. 0 means invalid. */
+    uint8_t DataLen;
+
+    tCachedResponse() : Data(0), DataLen(0) {}
+    ~tCachedResponse() { if ( Data!=0 ) delete[] Data; }
+    /** \brief Check is cached data valid */
+    bool IsValid() const { return DataLen>0; }
+    /** \brief Invalidate cached data */
+    void Invalidate() { DataLen=0; }
+    /** \brief Save data of built message */
+    void Set(const tN2kMsg &N2kMsg);
+    /** \brief Set message PGN and data from cache. Source and destination
+     *         will be kept. Returns false, if cache is not valid. */
+    bool Get(tN2kMsg &N2kMsg, unsigned long PGN, unsigned char Priority) const;
+  };
+#endif
+
+  /************************************************************************//**
+   * \class   tPGNTable
+   * \brief   Sorted PGN table for fast lookup
+   *
+   * Table points to library default PGN list in PROGMEM, which is sorted,
+   * until device has own PGN list. Then default and device lists will be
+   * merged to sorted table without duplicates, which is allocated from heap.
+   */
+  class tPGNTable {
+  public:
+    /** \brief Table entries in PROGMEM or in heap */
+    const unsigned long *PGNs;
+    /** \brief Number of entries on table */
+    uint16_t Size;
+    /** \brief Entries have been allocated from heap */
+    bool Allocated;
+
+    tPGNTable() : PGNs(0), Size(0), Allocated(false) {}
+    ~tPGNTable() { Free(); }
+    /** \brief Free allocated entries and set table empty */
+    void Free();
+    /** \brief Get PGN at index */
+    unsigned long Get(uint16_t i) const { return ( Allocated ? PGNs[i] : pgm_read_dword(&PGNs[i]) ); }
+    /** \brief Build table from sorted default list in PROGMEM and optional
+     *         device list in PROGMEM, which may be unsorted. */
+    void Build(const unsigned long *DefaultList, const unsigned long *DeviceList);
+    /** \brief Find PGN from table. Returns table index or -1, if PGN is
+     *         not on table. */
+    int Find(unsigned long PGN) const;
+  };
+
   /************************************************************************//**
    * \class   tInternalDevice
    * \brief   This class represents an internal device
@@ -802,9 +1089,16 @@ protected:
     /** \brief Pointer to a buffer that holds all supported receive
      * PGNs for this device*/
     const unsigned long *ReceiveMessages;
-    /** \brief Fast packet PGNs sequence counters*/
-    unsigned long *PGNSequenceCounters;
-    /** \brief Fast packet PGNs sequence counters*/
+    /** \brief Sorted default and device transmit PGNs */
+    tPGNTable TxPGNTable;
+    /** \brief Sorted default and device receive PGNs */
+    tPGNTable RxPGNTable;
+    /** \brief PGN tables must be rebuilt before use */
+    bool PGNTablesInvalid;
+    /** \brief Fast packet sequence counters indexed as \ref TxPGNTable.
+     *          Last one is common for PGNs, which are not on transmit list. */
+    uint8_t *PGNSequenceCounters;
+    /** \brief Number of \ref PGNSequenceCounters */
     size_t MaxPGNSequenceCounters;
     /** \brief Holds the highest source address for Address Claim process*/
     uint8_t AddressClaimEndSource;
@@ -812,12 +1106,20 @@ protected:
     bool HasPendingInformation;
 
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-      /** \brief Pending N2k message */
-      tN2kMsg PendingTPMsg;
-      /** \brief Timestamp, when next data packet can be send on TP broadcast*/
-      tN2kScheduler NextDTSendTime; 
-      /** \brief Next Sequence*/
-      uint8_t NextDTSequence;
+      /** \brief Table of outgoing TP sessions */
+      tTPSession *TPSessions;
+      /** \brief Size of \ref TPSessions table */
+      uint8_t MaxTPSessions;
+      /** \brief Number of sessions in use */
+      uint8_t ActiveTPSessions;
+#endif
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    /** \brief Encoded product information response */
+    tCachedResponse ProductInformationCache;
+    /** \brief Encoded transmit PGN list response */
+    tCachedResponse TxPGNListCache;
+    /** \brief Encoded receive PGN list response */
+    tCachedResponse RxPGNListCache;
 #endif
 #if !defined(N2K_NO_HEARTBEAT_SUPPORT)
 	/** \brief Interval for Heartbeat */
@@ -840,9 +1142,10 @@ protected:
       ProductInformation=0; LocalProductInformation=0; ManufacturerSerialCode=0;
       AddressClaimEndSource=N2kMaxCanBusAddress; //GetNextAddressFromBeginning=true;
       TransmitMessages=0; ReceiveMessages=0;
+      PGNTablesInvalid=true;
       PGNSequenceCounters=0; MaxPGNSequenceCounters=0;
 #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-      NextDTSequence=0;
+      TPSessions=0; MaxTPSessions=0; ActiveTPSessions=0;
 #endif
 
 #if !defined(N2K_NO_HEARTBEAT_SUPPORT)
@@ -877,6 +1180,8 @@ protected:
      * \sa tNMEA2000::SendProductInformation 
      */
     void SetPendingProductInformation() { PendingProductInformation.FromNow(187+N2kSource*8); HasPendingInformation=true; } // Use strange increment to avoid synchronize
+    /** \brief Set pending ProductInformation message with given delay in ms */
+    void SetPendingProductInformation(unsigned long FromNow) { PendingProductInformation.FromNow(FromNow); HasPendingInformation=true; }
     /** \brief Resets \ref PendingProductInformation to zero*/
     void ClearPendingProductInformation() { PendingProductInformation.Disable(); UpdateHasPendingInformation(); }
     /*********************************************************************//**
@@ -899,6 +1204,8 @@ protected:
      * \sa tNMEA2000::SendConfigurationInformation 
      */
     void SetPendingConfigurationInformation() { PendingConfigurationInformation.FromNow(187+N2kSource*10); HasPendingInformation=true; } // Use strange increment to avoid synchronize
+    /** \brief Set pending ConfigurationInformation message with given delay in ms */
+    void SetPendingConfigurationInformation(unsigned long FromNow) { PendingConfigurationInformation.FromNow(FromNow); HasPendingInformation=true; }
     /** \brief Resets \ref PendingConfigurationInformation to zero*/
     void ClearPendingConfigurationInformation() { PendingConfigurationInformation.Disable(); UpdateHasPendingInformation(); }
     /*********************************************************************//**
@@ -924,7 +1231,7 @@ protected:
                             || PendingProductInformation.IsEnabled()
                             || PendingConfigurationInformation.IsEnabled()
                             #if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
-                            || NextDTSendTime.IsEnabled()
+                            || ActiveTPSessions>0
                             #endif
                             ;
     }
@@ -961,11 +1268,98 @@ protected:
     N2kStream *ForwardStream;
     /** \brief  Pointer to a buffer for Message Handlers*/
     tMsgHandler *MsgHandlers;
+    /** \brief  Monitor for raw frames. See \ref SetFrameMonitor */
+    tFrameMonitor *FrameMonitor;
+    /** \brief  Runtime statistics. See \ref GetStats */
+    tStats Stats;
+    /** \brief  Per PGN statistics table or 0 */
+    tPGNStats *PGNStats;
+    /** \brief  Size of \ref PGNStats table */
+    uint16_t MaxPGNStats;
+    /** \brief  Number of used entries on \ref PGNStats */
+    uint16_t PGNStatsCount;
+    /** \brief  Stream for periodic statistics dump. See \ref SetStatsDump */
+    N2kStream *StatsStream;
+    /** \brief  Period for statistics dump in ms */
+    uint32_t StatsDumpPeriod;
+    /** \brief  Scheduler for statistics dump */
+    tN2kScheduler StatsDumpScheduler;
+
+    /** \brief  Library managed periodic message. See \ref AddPeriodicMsg */
+    struct tPeriodicMsg {
+      unsigned long PGN;
+      /** \brief  Producer callback or 0 for template */
+      tPeriodicMsgProducer Producer;
+      /** \brief  Template data buffer of tN2kMsg::MaxDataLen or 0 for producer */
+      unsigned char *TemplateData;
+      int TemplateDataLen;
+      unsigned char TemplateDestination;
+      tN2kSyncScheduler Scheduler;
+      uint32_t DefaultPeriod;
+      uint32_t DefaultOffset;
+      uint8_t Device;
+      /** \brief  Priority to use or 0xff for message own priority */
+      uint8_t Priority;
+    };
+    /** \brief  Periodic messages for all devices */
+    tPeriodicMsg *PeriodicMsgs;
+    uint16_t PeriodicMsgCount;
+    uint16_t PeriodicMsgCapacity;
+    /** \brief  Binary min heap of enabled \ref PeriodicMsgs indexes by next
+     *          send time. Root is the next deadline. */
+    uint16_t *PeriodicMsgQueue;
+    uint16_t PeriodicMsgQueueCount;
+    /** \brief  Message handler timing enabled. See \ref EnableHandlerTiming */
+    bool HandlerTiming;
+    /** \brief  Handler time budget in us or 0 */
+    uint32_t HandlerBudget;
+    /** \brief  Callback for handler calls exceeding budget */
+    void (*SlowHandlerCallback)(tMsgHandler *Handler, const tN2kMsg &N2kMsg, uint32_t Time);
+    /** \brief  Execution time statistics for \ref MsgHandler */
+    tHandlerStats MsgHandlerStats;
+
+    /** \brief Subscribed PGN range. See \ref Subscribe */
+    struct tSubscription {
+      unsigned long FirstPGN;
+      unsigned long LastPGN;
+      unsigned char Source;
+    };
+    /** \brief  Subscriptions or 0 for no subscriptions */
+    tSubscription *Subscriptions;
+    uint8_t SubscriptionCount;
+    uint8_t SubscriptionCapacity;
+    /** \brief  Exact acceptance filters compiled from subscriptions */
+    tCANFilter *CANFilters;
+    uint16_t CANFilterCount;
+    uint16_t CANFilterCapacity;
+
+    /** \brief  Last forwarded message state for forward rule and source */
+    struct tForwardState {
+      uint8_t Rule;
+      unsigned char Source;
+      uint32_t Hash;
+      unsigned long LastTime;
+    };
+    /** \brief  Forward rules or 0 for no rules */
+    tForwardRule *ForwardRules;
+    uint8_t ForwardRuleCount;
+    uint8_t ForwardRuleCapacity;
+    tForwardState *ForwardStates;
+    uint8_t ForwardStateCount;
+    uint8_t ForwardStateCapacity;
 
     /** Open the Scheduler */
     tN2kScheduler OpenScheduler;
     /** State of the .... */
     tOpenState OpenState;
+    /** \brief Earliest N2kMillis64() time, when any protocol timer (pending
+     * information, address claim, TP sessions or heartbeat) may need 
+     * handling. 0 forces check on next \ref ParseMessages.*/
+    uint64_t NextProtocolEventTime;
+#if defined(N2K_FRAME_TIMESTAMP)
+    /** \brief Receive time of the frame under handling in microseconds */
+    uint64_t RxFrameTime;
+#endif
     /** \brief  Flag that the address has changed */
     bool AddressChanged;
     /** \brief  Flag that the device information has changed */
@@ -975,16 +1369,51 @@ protected:
     tInternalDevice *Devices;
     /** \brief  Number of devices */
     int DeviceCount;
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+    /** \brief  Number of concurrent outgoing TP sessions per device */
+    uint8_t MaxTPSessions;
+#endif
 //    unsigned long N2kSource[Max_N2kDevices];
+    /** \brief  Source address to \ref Devices index lookup table. Allocated 
+     *          only for multi device setup. Unused entries are 0xff. */
+    uint8_t *SourceDeviceIndex;
+    /** \brief  Bitmap of addresses claimed by other nodes on the bus, 
+     *          learned from received address claims. */
+    uint32_t ClaimedAddresses[8];
 
     /** \brief  Pointer to a buffer for local Configuration Information*/
     char *LocalConfigurationInformationData;
     /** \brief Configuration Information of the device*/
     tConfigurationInformation ConfigurationInformation;
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    /** \brief Encoded configuration information response. Same for all devices. */
+    tCachedResponse ConfigurationInformationCache;
+#endif
 
     const unsigned long *SingleFrameMessages[N2kMessageGroups];
     const unsigned long *FastPacketMessages[N2kMessageGroups];
 
+    /** \brief Flags for receive action resolved from CAN id PGN bits */
+    enum tCANIdAction {
+      cia_Cached=0x01,
+      cia_Known=0x02,
+      cia_System=0x04,
+      cia_FastPacket=0x08,
+      cia_TPControl=0x10
+    };
+#if !defined(N2K_NO_RESPONSE_CACHE)
+    /*********************************************************************//**
+     * \brief Invalidate cached product information responses of all devices
+     */
+    void InvalidateProductInformationCache();
+#endif
+#if !defined(N2K_NO_CANID_CACHE)
+    /** \brief Direct mapped receive action cache. Entry holds CAN id PGN
+     *          bits (id bits 8-25) on bits 8-25 and \ref tCANIdAction flags
+     *          on low byte. Entry 0 is empty. */
+    uint32_t CANIdCache[N2K_CANID_CACHE_SIZE];
+#endif
+
     /*********************************************************************//**
      * \struct  tCANSendFrame
      * \brief   Structure holds all the data needed for a valid CAN-Message
@@ -1019,6 +1448,16 @@ protected:
      * - \ref tNMEA2000::SetN2kCANMsgBufSize()
      */
     uint8_t MaxN2kCANMsgs;
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+    /** \brief Pool of messages for receiving ISO TP messages longer than
+     * \ref tN2kMsg::MaxDataLen
+     * \sa 
+     * - \ref tNMEA2000::SetN2kLargeMsgBufSize()
+     */
+    tN2kLargeMsg *LargeMsgBuf;
+    /** \brief Size of \ref LargeMsgBuf */
+    uint8_t MaxLargeMsgs;
+#endif
 
     /** \brief Buffer for library send out CAN frames
      * 
@@ -1077,10 +1516,38 @@ protected:
     void (*MsgHandler)(const tN2kMsg &N2kMsg);  
     /** \brief Handler callbacks for 'ISORequest' messages */
     bool (*ISORqstHandler)(unsigned long RequestedPGN, unsigned char Requester, int DeviceIndex);
+    /** \brief Time in ms to hold broadcast responses to ISO requests. 0 means respond immediately. */
+    uint16_t ISORequestCoalesceTime;
+#if !defined(N2K_NO_JOURNAL)
+    /** \brief Journal for persistent settings or 0. See \ref SetJournal */
+    tN2kJournal *Journal;
+    /** \brief Settings waiting to be written to journal as \ref tJournalItem bits */
+    uint8_t JournalPending;
+#endif
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    /** \brief Send slot allocator or 0. See \ref SetSlotAllocator */
+    tN2kSlotAllocator *SlotAllocator;
+    /** \brief Periodic message or heartbeat, which has reserved slots, is being sent */
+    bool SendingReservedMsg;
+#endif
+#if !defined(N2K_NO_TX_PACER)
+    /** \brief Transmit pacer or 0. See \ref SetTxPacer */
+    tN2kTxPacer *TxPacer;
+#endif
 
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
     /** \brief Pointer to Buffer for GRoup Function Handlers*/
     tN2kGroupFunctionHandler *pGroupFunctionHandlers;
+    /** \brief Group function handlers ordered for lookup. PGN specific
+     *         handlers are first sorted by PGN and PGN 0 handlers last in
+     *         list order. Rebuilt on first use after list has changed. */
+    tN2kGroupFunctionHandler **GroupFunctionHandlerIndex;
+    uint16_t GroupFunctionHandlerIndexSize;
+    /** \brief Number of handlers on \ref GroupFunctionHandlerIndex */
+    uint16_t GroupFunctionHandlerCount;
+    /** \brief Number of PGN specific handlers on \ref GroupFunctionHandlerIndex */
+    uint16_t GroupFunctionPGNHandlerCount;
+    bool GroupFunctionHandlerIndexValid;
 #endif
 
 protected:
@@ -1133,6 +1600,55 @@ protected:
      * \retval false  Nothing read. 
      */
     virtual bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf)=0;
+
+    /*********************************************************************//**
+     * \brief Maximum number of hardware acceptance filters driver supports
+     *
+     * Driver writer can override this and \ref CANSetFilters, if CAN
+     * controller has acceptance filters. Default 0 means no hardware filters
+     * and library filters received frames only on software.
+     */
+    virtual uint8_t CANGetMaxFilters() const { return 0; }
+
+    /*********************************************************************//**
+     * \brief Set hardware acceptance filters
+     *
+     * Library calls this after \ref CANOpen and when subscriptions change.
+     * Filter set will never be larger than \ref CANGetMaxFilters. Filters
+     * may accept more than subscribed, since library still filters frames
+     * on software. Extended frames matching any filter must be accepted.
+     *
+     * \param Filters   Acceptance filters
+     * \param Count     Number of filters. 0 means accept all frames.
+     *
+     * \retval true     Filters set
+     * \retval false    Driver could not set filters
+     */
+    virtual bool CANSetFilters(const tCANFilter * /*Filters*/, uint8_t /*Count*/) { return false; }
+
+#if defined(N2K_FRAME_TIMESTAMP)
+    /*********************************************************************//**
+     * \brief Read frame with receive timestamp from driver class.
+     * 
+     * Default implementation reads frame with \ref CANGetFrame and stamps
+     * it with current N2kMicros64() time. Driver writer can override this,
+     * if CAN controller or receive interrupt can provide more accurate
+     * timestamp. Timestamp must be on N2kMicros64() time base.
+     * 
+     * \param id        ID of the CAN frame
+     * \param len       length of payload for the message
+     * \param buf       buffer for the payload
+     * \param FrameTime Receive time of the frame in microseconds
+     * 
+     * \retval true   New frame read from buffer.
+     * \retval false  Nothing read. 
+     */
+    virtual bool CANGetTimestampedFrame(unsigned long &id, unsigned char &len, unsigned char *buf, uint64_t &FrameTime) {
+      if ( !CANGetFrame(id,len,buf) ) return false;
+      FrameTime=N2kMicros64();
+      return true;
+    }
+#endif
     
     /*********************************************************************//**
      * \brief Initialize CAN Frame buffers
@@ -1169,6 +1685,19 @@ protected:
      * \retval false  Message could not be sent.
      */
     bool SendFrames();
+
+    /**********************************************************************//**
+     * \brief Handle frame, which has been handed to CAN driver
+     *
+     * Updates slot allocator and transmit pacer bus load and calls frame
+     * monitor.
+     *
+     * \param id          CAN id
+     * \param len         Frame length
+     * \param buf         Frame data
+     * \param Unbuffered  Frame has been sent from library send buffer
+     */
+    void HandleSentFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool Unbuffered);
     /**********************************************************************//**
      * \brief Sends a single CAN frame
      * 
@@ -1185,6 +1714,44 @@ protected:
      */
     bool SendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true);
 
+    /*********************************************************************//**
+     * \brief Check, should message frames be paced
+     *
+     * Fast packet and ISO TP data transfer messages with lower priority
+     * than pacer bypass priority will be paced.
+     *
+     * \param N2kMsg  Message to be sent
+     */
+    bool IsPacedMsg(const tN2kMsg &N2kMsg);
+
+    /*********************************************************************//**
+     * \brief Sends a single bulk CAN frame through transmit pacer
+     *
+     * Frame will be sent with \ref SendFrame, if pacer has tokens for it
+     * and there are no earlier deferred frames. Otherwise frame will be
+     * deferred to pacer queue.
+     *
+     * \retval true   Frame has been sent or deferred
+     * \retval false  Pacer queue is full
+     */
+    bool SendPacedFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true);
+
+    /*********************************************************************//**
+     * \brief Check, does pacer queue have room for given number of frames
+     *
+     * \param FrameCount  Number of frames
+     * \retval true   All frames can be deferred or pacing is not used
+     * \retval false  Pacer queue does not have room for all frames
+     */
+    bool CanDeferFrames(uint8_t FrameCount);
+
+    /*********************************************************************//**
+     * \brief Sends deferred frames, which pacer allows
+     *
+     * Deferred frames will be sent only, when library send buffer is empty.
+     */
+    void SendDeferredFrames();
+
     /*********************************************************************//**
      * \brief Get the Next Free CAN Frame from \ref CANSendFrameBuf
      * \return tCANSendFrame* 
@@ -1206,6 +1773,217 @@ protected:
      */
     void SendPendingInformation();
 
+    /*********************************************************************//**
+     * \brief Handle all due protocol timers
+     *
+     * Runs pending information, TP session and heartbeat handling only, if 
+     * \ref NextProtocolEventTime has been reached. Otherwise this costs 
+     * only one clock read.
+     */
+    void HandleProtocolTimers();
+
+    /*********************************************************************//**
+     * \brief Calculate \ref NextProtocolEventTime from all device timers
+     *
+     * \param Now     Current time as N2kMillis64()
+     */
+    void UpdateNextProtocolEventTime(uint64_t Now);
+
+    /*********************************************************************//**
+     * \brief Inform that some protocol timer has been set
+     *
+     * This must be called always, when any timer handled on 
+     * \ref HandleProtocolTimers has been set.
+     */
+    void ProtocolTimerChanged() { NextProtocolEventTime=0; }
+
+    /*********************************************************************//**
+     * \enum  tJournalItem
+     * \brief Settings saved to journal. Used as bits on \ref JournalPending.
+     */
+    enum tJournalItem {
+      ji_Source=0x01,
+      ji_Instances=0x02,
+      ji_Heartbeat=0x04,
+      ji_InstallationDescription=0x08
+    };
+
+    /*********************************************************************//**
+     * \brief Inform that setting saved to journal has been changed
+     *
+     * Settings will be written on \ref HandleProtocolTimers.
+     *
+     * \param Items   Changed settings as \ref tJournalItem bits
+     */
+    void JournalChanged(uint8_t Items) {
+#if !defined(N2K_NO_JOURNAL)
+      if ( Journal!=0 ) { JournalPending|=Items; ProtocolTimerChanged(); }
+#else
+      (void)Items;
+#endif
+    }
+
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    /*********************************************************************//**
+     * \brief Reserve slots for all heartbeats and periodic messages
+     *
+     * Reservations will be rebuilt from scratch, so this must be called
+     * after any schedule has been changed.
+     *
+     * \param SkipPeriodicMsg  Index on \ref PeriodicMsgs not to reserve or -1
+     * \param Heartbeats       Reserve also heartbeats
+     */
+    void ReserveSlots(int SkipPeriodicMsg=-1, bool Heartbeats=true);
+
+    /*********************************************************************//**
+     * \brief Allocate heartbeat offsets for all devices
+     *
+     * Default heartbeat offsets will be spread to least loaded slots.
+     */
+    void AllocateHeartbeatSlots();
+
+    /*********************************************************************//**
+     * \brief Get delay for resending information to least loaded slot
+     *
+     * \param N2kMsg  Message to be sent
+     * \return Delay in ms
+     */
+    unsigned long GetSlotDelay(const tN2kMsg &N2kMsg);
+
+    /*********************************************************************//**
+     * \brief Estimate number of frames for periodic message
+     *
+     * \param Msg     Periodic message
+     */
+    uint8_t GetPeriodicMsgFrames(const tPeriodicMsg &Msg);
+#endif
+
+#if !defined(N2K_NO_JOURNAL)
+    /*********************************************************************//**
+     * \brief Write pending settings to journal
+     *
+     * Source address will be written only after address claim has been
+     * finished, so that addresses tried during claim will not be written.
+     */
+    void WriteJournal();
+
+    /*********************************************************************//**
+     * \brief Restore settings from journal
+     *
+     * Restored settings will not set change flags like
+     * \ref DeviceInformationChanged, since they are already saved.
+     *
+     * \param Items   Settings to restore as \ref tJournalItem bits
+     */
+    void RestoreJournal(uint8_t Items);
+#endif
+
+    /*********************************************************************//**
+     * \brief Find periodic message for device
+     *
+     * \param PGN   PGN of periodic message
+     * \param iDev  Index of the device on \ref Devices
+     * \return Index on \ref PeriodicMsgs or -1, if not found
+     */
+    int FindPeriodicMsg(unsigned long PGN, int iDev) const;
+
+    /*********************************************************************//**
+     * \brief Rebuild \ref PeriodicMsgQueue from enabled periodic messages
+     *
+     * Must be called after any periodic message has been added, removed or
+     * its period or offset changed.
+     */
+    void RebuildPeriodicMsgQueue();
+
+    /*********************************************************************//**
+     * \brief Move \ref PeriodicMsgQueue entry down to its heap position
+     *
+     * \param Pos   Position on queue
+     */
+    void SiftDownPeriodicMsgQueue(uint16_t Pos);
+
+    /*********************************************************************//**
+     * \brief Send all periodic messages, which deadline has passed
+     *
+     * Only queue root will be tested, so there is no cost for messages,
+     * which are not yet due.
+     */
+    void SendPendingPeriodicMsgs();
+
+    /*********************************************************************//**
+     * \brief Build and send periodic message
+     *
+     * \param Index  Index on \ref PeriodicMsgs
+     * \return true, if message was sent
+     */
+    bool SendPeriodicMsgByIndex(uint16_t Index);
+
+    /*********************************************************************//**
+     * \brief Find or add PGN to \ref PGNStats table
+     *
+     * \param PGN     PGN to find
+     * \return Pointer to stats entry or 0, if table is disabled or full
+     */
+    tPGNStats *FindPGNStats(unsigned long PGN);
+
+    /*********************************************************************//**
+     * \brief Count error to PGN stats
+     */
+    void CountPGNError(unsigned long PGN) {
+      if ( PGNStats==0 ) return;
+      tPGNStats *PGNStat=FindPGNStats(PGN);
+      if ( PGNStat!=0 ) PGNStat->Errors++;
+    }
+
+    /*********************************************************************//**
+     * \brief Write statistics dump to \ref StatsStream
+     */
+    void SendStatsDump();
+
+    /*********************************************************************//**
+     * \brief Update handler statistics after timed call
+     *
+     * \param HandlerStats   Statistics to update
+     * \param Handler        Handler object or 0 for \ref MsgHandler
+     * \param N2kMsg         Handled message
+     * \param Time           Call time in us
+     */
+    void UpdateHandlerStats(tHandlerStats &HandlerStats, tMsgHandler *Handler, const tN2kMsg &N2kMsg, uint32_t Time);
+
+    /*********************************************************************//**
+     * \brief Add filter to \ref CANFilters
+     */
+    bool AddCANFilter(unsigned long id, unsigned long mask);
+
+    /*********************************************************************//**
+     * \brief Add filters for PGN range as aligned power of two blocks
+     */
+    bool AddCANFilterRange(unsigned long FirstPGN, unsigned long LastPGN, unsigned char Source);
+
+    /*********************************************************************//**
+     * \brief Compile \ref Subscriptions to \ref CANFilters and set
+     * hardware filters
+     */
+    void UpdateCANFilters();
+
+    /*********************************************************************//**
+     * \brief Give filters to driver reduced to its filter count
+     */
+    void SetHardwareFilters();
+
+    /*********************************************************************//**
+     * \brief Call message handler with optional timing
+     */
+    void CallMsgHandler(tMsgHandler *Handler, const tN2kMsg &N2kMsg) {
+      if ( !HandlerTiming ) {
+        Handler->HandleMsg(N2kMsg);
+      } else {
+        uint64_t Start=N2kMicros64();
+        Handler->HandleMsg(N2kMsg);
+        UpdateHandlerStats(Handler->HandlerStats,Handler,N2kMsg,N2kMicros64()-Start);
+      }
+    }
+
 protected:
     /*********************************************************************//**
      * \brief Initialize all devices
@@ -1250,6 +2028,14 @@ protected:
      * \param MsgIndex      Index 
      */
     void FindFreeCANMsgIndex(unsigned long PGN, unsigned char Source, unsigned char Destination, bool TPMsg, uint8_t &MsgIndex);
+
+    /*********************************************************************//**
+     * \brief Find free message from \ref LargeMsgBuf pool
+     *
+     * \return Pointer to free large message or 0, if pool is disabled or 
+     *         all messages are in use.
+     */
+    tN2kLargeMsg *FindFreeLargeMsg();
 #else
     /*********************************************************************//**
      * \brief Find index for free space for a message on \ref N2kCANMsgBuf
@@ -1282,6 +2068,18 @@ protected:
      */
     uint8_t SetN2kCANBufMsg(unsigned long canId, unsigned char len, unsigned char *buf);
 
+    /*********************************************************************//**
+     * \brief Handle single received CAN frame
+     *
+     * Frame will be added to \ref N2kCANMsgBuf and, if message is ready,
+     * it will be handled, forwarded and sent to message handlers.
+     *
+     * \param canId     ID of CAN message
+     * \param len       length of payload
+     * \param buf       buffer for payload of message
+     */
+    void HandleReceivedFrame(unsigned long canId, unsigned char len, unsigned char *buf);
+
     /*********************************************************************//**
      * \brief Check if this PNG is a fast packet message
      * 
@@ -1366,6 +2164,17 @@ protected:
      * \param N2kCanMsg  N2k CAN message object, see \ref tN2kCANMsg
      */
     void ForwardMessage(const tN2kCANMsg &N2kCanMsg);
+
+    /*********************************************************************//**
+     * \brief Test message against forward rules
+     *
+     * Updates rule counters and state for message PGN and source.
+     *
+     * \param N2kMsg   Message to be forwarded
+     * \retval true    Forward message
+     * \retval false   Drop message
+     */
+    bool PassForwardRules(const tN2kMsg &N2kMsg);
     
     /*********************************************************************//**
      * \brief Respond to an ISO request
@@ -1376,6 +2185,10 @@ protected:
      * 
      * If non of this fits the RequestedPGN, we directly respond to the 
      * requester NAK. ( \ref SetN2kPGNISOAcknowledgement)
+     *
+     * Address claim, product information and configuration information
+     * will be responded with broadcast after \ref ISORequestCoalesceTime.
+     * Requests for them received while response is pending will be dropped.
      * 
      * \param N2kMsg        Reference to a N2kMsg Object
      * \param RequestedPGN  Requested PGN
@@ -1407,9 +2220,26 @@ protected:
      * \param N2kMsg        Reference to a N2kMsg Object
      * \param GroupFunctionCode 
      * \param PGNForGroupFunction 
+     * \param iHandler      Index of PGN specific handler on
+     *                      \ref GroupFunctionHandlerIndex or -1 to try
+     *                      PGN 0 handlers. See \ref FindGroupFunctionHandler
      * \param iDev          index of the device on \ref Devices
      */
-    void RespondGroupFunction(const tN2kMsg &N2kMsg, tN2kGroupFunctionCode GroupFunctionCode, unsigned long PGNForGroupFunction, int iDev);
+    void RespondGroupFunction(const tN2kMsg &N2kMsg, tN2kGroupFunctionCode GroupFunctionCode, unsigned long PGNForGroupFunction, int iHandler, int iDev);
+
+    /*********************************************************************//**
+     * \brief Rebuild \ref GroupFunctionHandlerIndex from handler list
+     */
+    void UpdateGroupFunctionHandlerIndex();
+
+    /*********************************************************************//**
+     * \brief Find PGN specific group function handler
+     *
+     * \param PGN  PGN for group function
+     * \return Index on \ref GroupFunctionHandlerIndex or -1, if there is
+     *         no handler for PGN.
+     */
+    int FindGroupFunctionHandler(unsigned long PGN);
 
     /*********************************************************************//**
      * \brief Handles a Group Function
@@ -1431,54 +2261,116 @@ protected:
      */
     void StartAddressClaim(int iDev);
 
-    /*********************************************************************//**
-     * \brief Starting the ISO Address Claim for all devices
+    /*********************************************************************//**
+     * \brief Starting the ISO Address Claim for all devices
+     *
+     */
+    void StartAddressClaim();
+
+    /*********************************************************************//**
+     * \brief Checks if the IsoAddressClaim is already started
+     * 
+     * \param iDev          index of the device on \ref Devices
+     * \retval true 
+     * \retval false 
+     */
+    bool IsAddressClaimStarted(int iDev);
+
+    /**********************************************************************//**
+     * \brief Handles an IsoAddressClaim
+     *
+     * \param N2kMsg        Reference to a N2kMsg Object
+     */
+    void HandleISOAddressClaim(const tN2kMsg &N2kMsg);
+
+    /**********************************************************************//**
+     * \brief Handles if we get commanded to set a new address
+     *
+     * \param CommandedName   Device name that have been commanded to set 
+     *                        new address
+     * \param NewAddress      new address for the device  
+     * \param iDev          index of the device on \ref Devices
+     */
+    void HandleCommandedAddress(uint64_t CommandedName, unsigned char NewAddress, int iDev);
+
+     /**********************************************************************//**
+     * \brief Handles if we get commanded to set a new address
+     *
+     * \param N2kMsg        Reference to a N2kMsg Object
+     */
+    void HandleCommandedAddress(const tN2kMsg &N2kMsg);
+
+    /**********************************************************************//**
+     * \brief Get the next free address for the device
+     *
+     * \param DeviceIndex     index of the device on \ref Devices
+     * \param RestartAtEnd    Restart the search from the beginning if the 
+     *                        search for the free source has reached 
+     *                        \ref N2kNullCanBusAddress
+     */
+    void GetNextAddress(int DeviceIndex, bool RestartAtEnd=false);
+
+    /**********************************************************************//**
+     * \brief Checks if the address can be claimed by the device
+     *
+     * Address is free, if it has not been seen claimed by other nodes and
+     * it is not used by any other of our own devices.
+     *
+     * \param Source          Source address to check
+     * \param DeviceIndex     index of the device on \ref Devices
+     * \retval true 
+     * \retval false 
+     */
+    bool IsAddressFree(uint8_t Source, int DeviceIndex) const;
+
+    /**********************************************************************//**
+     * \brief Marks source address claimed or free on \ref ClaimedAddresses
      *
+     * \param Source          Source address
+     * \param Claimed         true, if address has been claimed by other node
      */
-    void StartAddressClaim();
+    void SetAddressClaimed(uint8_t Source, bool Claimed=true);
 
-    /*********************************************************************//**
-     * \brief Checks if the IsoAddressClaim is already started
-     * 
-     * \param iDev          index of the device on \ref Devices
+    /**********************************************************************//**
+     * \brief Checks from \ref ClaimedAddresses if address has been claimed
+     *        by other node
+     *
+     * \param Source          Source address
      * \retval true 
      * \retval false 
      */
-    bool IsAddressClaimStarted(int iDev);
+    bool IsAddressClaimed(uint8_t Source) const { return (ClaimedAddresses[Source>>5] & (1UL<<(Source & 0x1f)))!=0; }
 
     /**********************************************************************//**
-     * \brief Handles an IsoAddressClaim
-     *
-     * \param N2kMsg        Reference to a N2kMsg Object
+     * \brief Clears all learned address claims on \ref ClaimedAddresses
      */
-    void HandleISOAddressClaim(const tN2kMsg &N2kMsg);
+    void ClearClaimedAddresses();
 
     /**********************************************************************//**
-     * \brief Handles if we get commanded to set a new address
+     * \brief Get receive action for CAN id
      *
-     * \param CommandedName   Device name that have been commanded to set 
-     *                        new address
-     * \param NewAddress      new address for the device  
-     * \param iDev          index of the device on \ref Devices
+     * Action depends only on PGN part of CAN id and message lists, so it
+     * will be resolved with \ref CheckKnownMessage only once for each
+     * PGN and then read from \ref CANIdCache.
+     *
+     * \param canId  Received CAN id
+     * \return Combination of \ref tCANIdAction flags
      */
-    void HandleCommandedAddress(uint64_t CommandedName, unsigned char NewAddress, int iDev);
+    uint8_t GetCANIdAction(unsigned long canId);
 
-     /**********************************************************************//**
-     * \brief Handles if we get commanded to set a new address
+    /**********************************************************************//**
+     * \brief Clears \ref CANIdCache
      *
-     * \param N2kMsg        Reference to a N2kMsg Object
+     * Must be called, when message lists or device addresses change.
      */
-    void HandleCommandedAddress(const tN2kMsg &N2kMsg);
+    void InvalidateCANIdCache();
 
     /**********************************************************************//**
-     * \brief Get the next free address for the device
+     * \brief Rebuilds \ref SourceDeviceIndex lookup table
      *
-     * \param DeviceIndex     index of the device on \ref Devices
-     * \param RestartAtEnd    Restart the search from the beginning if the 
-     *                        search for the free source has reached 
-     *                        \ref N2kNullCanBusAddress
+     * This must be called always after any device source has been changed.
      */
-    void GetNextAddress(int DeviceIndex, bool RestartAtEnd=false);
+    void UpdateSourceDeviceIndex();
 
     /**********************************************************************//**
      * \brief Checks if the source belongs to a device on \ref Devices 
@@ -1506,6 +2398,14 @@ protected:
      */
     size_t GetFastPacketTxPGNCount(int iDev);
 
+    /*********************************************************************//**
+     * \brief Rebuild device PGN tables and sequence counters, if they
+     *        have been invalidated.
+     *
+     * \param iDev    index of the device on \ref Devices
+     */
+    void UpdatePGNTables(int iDev);
+
     /*********************************************************************//**
      * \brief Is message forwarding enabled
      * \sa
@@ -1630,22 +2530,24 @@ protected:
      * 
      * This is used for Broadcast messages
      *
-     * \param iDev    index of the device on \ref Devices
+     * \param iDev      index of the device on \ref Devices
+     * \param iSession  index of the session on device \ref tInternalDevice::TPSessions
      * 
      * \retval true 
      * \retval false 
      */
-    bool SendTPCM_BAM(int iDev);
+    bool SendTPCM_BAM(int iDev, int iSession);
 
     /*********************************************************************//**
      * \brief   Send ISO Transport Protocol message RTS
      *
-     * \param iDev    index of the device on \ref Devices
+     * \param iDev      index of the device on \ref Devices
+     * \param iSession  index of the session on device \ref tInternalDevice::TPSessions
      * 
      * \retval true 
      * \retval false 
      */
-    bool SendTPCM_RTS(int iDev);
+    bool SendTPCM_RTS(int iDev, int iSession);
 
     /*********************************************************************//**
      * \brief   Send ISO Transport Protocol message CTS
@@ -1686,23 +2588,35 @@ protected:
      * \note Caller should take care of not calling this after all has been 
      *        done. Use \ref HasAllTPDTSent for checking.
      * 
-     * \param iDev    index of the device on \ref Devices
+     * \param iDev      index of the device on \ref Devices
+     * \param iSession  index of the session on device \ref tInternalDevice::TPSessions
      * 
      * \retval true   Message was send successful
      * \retval false 
      */
-    bool SendTPDT(int iDev);
+    bool SendTPDT(int iDev, int iSession);
 
     /*********************************************************************//**
      * \brief Check if all data bytes of the multi packet message has been send 
      *        successful
      *
-     * \param iDev    index of the device on \ref Devices
+     * \param iDev      index of the device on \ref Devices
+     * \param iSession  index of the session on device \ref tInternalDevice::TPSessions
      * 
      * \retval true 
      * \retval false 
      */
-    bool HasAllTPDTSent(int iDev);
+    bool HasAllTPDTSent(int iDev, int iSession);
+
+    /*********************************************************************//**
+     * \brief Find active ISO-TP session for destination
+     *
+     * \param iDev          index of the device on \ref Devices
+     * \param Destination   Destination of the session. For BAM 0xff.
+     * 
+     * \return int  Index of the session, not found = -1
+     */
+    int FindTPSession(int iDev, unsigned char Destination) const;
 
     /*********************************************************************//**
      * \brief Start sending an ISO-TP message
@@ -1718,13 +2632,17 @@ protected:
     /*********************************************************************//**
      * \brief Ends sending of ISO-TP message
      *
-     * \param iDev    index of the device on \ref Devices
+     * \param iDev      index of the device on \ref Devices
+     * \param iSession  index of the session on device \ref tInternalDevice::TPSessions
      */
-    void EndSendTPMessage(int iDev);
+    void EndSendTPMessage(int iDev, int iSession);
 
     /*********************************************************************//**
      * \brief Send pending ISO-TP Messages
      *
+     * Sends next data packet for broadcast sessions and ends sessions, 
+     * which receiver has not responded in time.
+     *
      * \param iDev    index of the device on \ref Devices
      */
     void SendPendingTPMessage(int iDev);
@@ -1869,6 +2787,43 @@ public:
      */
     virtual void SetN2kCANReceiveFrameBufSize(const uint16_t _MaxCANReceiveFrames) { if ( !IsInitialized() ) MaxCANReceiveFrames=_MaxCANReceiveFrames; }
 
+#if !defined(N2K_NO_ISO_MULTI_PACKET_SUPPORT)
+    /*********************************************************************//**
+     * \brief Set count of concurrent outgoing ISO-TP sessions per device.
+     *
+     * As default each device can send only one ISO Transport Protocol 
+     * message at a time. If several devices on bus request e.g. product
+     * information at the same time, responses will be serialized and 
+     * requests may fail, if previous transfer is still in progress. 
+     * Increasing session count allows device respond several requesters
+     * in parallel. Each session reserves one tN2kMsg from memory.
+     *
+     * If you use this function, call it once before \ref tNMEA2000::Open() and 
+     * before any device related function like tNMEA2000::SetProductInformation.
+     * If you call it later, function has no effect.
+     *
+     * \param _MaxTPSessions  Number of concurrent sessions per device (1-10)
+     */
+    void SetN2kTPSessionCount(const uint8_t _MaxTPSessions) { if ( Devices==0 && _MaxTPSessions>=1 && _MaxTPSessions<=10 ) MaxTPSessions=_MaxTPSessions; }
+
+    /*********************************************************************//**
+     * \brief Set count of large message buffers
+     *
+     * ISO Transport Protocol allows messages up to 1785 bytes, but as default
+     * library receives only messages up to \ref tN2kMsg::MaxDataLen bytes.
+     * With this function you can reserve pool of buffers for receiving 
+     * longer messages. Each buffer takes about 2 kB of memory. Received 
+     * large messages will be passed to message handlers as \ref tN2kLargeMsg.
+     * See \ref tN2kMsg::IsLargeMsg.
+     *
+     * Function has to be called before communication opens. See \ref tNMEA2000::Open().
+     *
+     * \param _MaxLargeMsgs  Number of large messages, which can be received
+     *                       concurrently. 0 disables large messages.
+     */
+    void SetN2kLargeMsgBufSize(const uint8_t _MaxLargeMsgs) { if (N2kCANMsgBuf==0) { MaxLargeMsgs=_MaxLargeMsgs; }; }
+#endif
+
     /*********************************************************************//**
      * \brief Set the Product Information of this device.
      *
@@ -2549,6 +3504,126 @@ public:
     void SetHeartbeatInterval(unsigned long interval, bool SetAsDefault=true, int iDev=-1) __attribute__ ((deprecated));
 #endif
 
+    /*********************************************************************//**
+     * \brief Add library managed periodic message
+     *
+     * Instead of own tN2kSyncScheduler for each message on loop(), you can
+     * let library send periodic messages. All periodic messages are kept on
+     * single deadline queue, so there is no cost between deadlines even
+     * with hundreds of messages. Missed periods will be skipped, so
+     * messages never burst.
+     *
+     * Library applies interval and offset changes requested with
+     * PGN 126208 Request group function for periodic PGNs. Remember to
+     * list periodic PGNs also on transmit messages (\ref ExtendTransmitMessages).
+     *
+     * Producer will be called when message is due. It should fill message
+     * and return true or return false to skip this period. Producer must
+     * not add or remove periodic messages.
+     *
+     * \code
+     *  bool SendTemperature(tN2kMsg &N2kMsg, int) {
+     *    SetN2kTemperature(N2kMsg,1,1,N2kts_MainCabinTemperature,ReadCabinTemp());
+     *    return true;
+     *  }
+     *  ...
+     *  NMEA2000.AddPeriodicMsg(130312L,2000,SendTemperature);
+     * \endcode
+     *
+     * \param PGN       PGN of the message
+     * \param Period    Default period in ms
+     * \param Producer  Callback to build message
+     * \param Offset    Default offset in ms. 0xffffffff=library selects
+     *                  offset to spread messages over period.
+     * \param iDev      Index of the device on \ref Devices
+     * \param Priority  Priority for message or 0xff to use priority set
+     *                  by producer
+     *
+     * \retval true     Message added or updated
+     * \retval false    Invalid parameters or out of memory
+     */
+    bool AddPeriodicMsg(unsigned long PGN, uint32_t Period, tPeriodicMsgProducer Producer,
+                        uint32_t Offset=0xffffffff, int iDev=0, unsigned char Priority=0xff);
+
+    /*********************************************************************//**
+     * \brief Add library managed periodic message from template
+     *
+     * Library keeps copy of the message and sends it periodically. Update
+     * message content with \ref UpdatePeriodicMsg. See also
+     * \ref AddPeriodicMsg with producer.
+     *
+     * \param N2kMsg    Message template
+     * \param Period    Default period in ms
+     * \param Offset    Default offset in ms. 0xffffffff=library selects
+     *                  offset to spread messages over period.
+     * \param iDev      Index of the device on \ref Devices
+     *
+     * \retval true     Message added or updated
+     * \retval false    Invalid parameters or out of memory
+     */
+    bool AddPeriodicMsg(const tN2kMsg &N2kMsg, uint32_t Period, uint32_t Offset=0xffffffff, int iDev=0);
+
+    /*********************************************************************//**
+     * \brief Update template of periodic message
+     *
+     * \param N2kMsg    New message content
+     * \param iDev      Index of the device on \ref Devices
+     * \return true, if template periodic message for PGN was found
+     */
+    bool UpdatePeriodicMsg(const tN2kMsg &N2kMsg, int iDev=0);
+
+    /*********************************************************************//**
+     * \brief Remove periodic message
+     *
+     * \param PGN       PGN of the message
+     * \param iDev      Index of the device on \ref Devices
+     */
+    void RemovePeriodicMsg(unsigned long PGN, int iDev=0);
+
+    /*********************************************************************//**
+     * \brief Set period and offset of periodic message
+     *
+     * \param PGN       PGN of the message
+     * \param Period    Period in ms. 0xffffffff=keep current,
+     *                  0xfffffffe=restore default, 0=turn off
+     * \param Offset    Offset in ms. 0xffffffff=keep current,
+     *                  0xfffffffe=restore default
+     * \param iDev      Index of the device on \ref Devices
+     * \return true, if periodic message for PGN was found
+     */
+    bool SetPeriodicMsgInterval(unsigned long PGN, uint32_t Period, uint32_t Offset=0xffffffff, int iDev=0);
+
+    /*********************************************************************//**
+     * \brief Get period and offset of periodic message
+     *
+     * \param PGN       PGN of the message
+     * \param Period    Current period in ms. 0 if turned off.
+     * \param Offset    Current offset in ms
+     * \param iDev      Index of the device on \ref Devices
+     * \return true, if periodic message for PGN was found
+     */
+    bool GetPeriodicMsgInterval(unsigned long PGN, uint32_t &Period, uint32_t &Offset, int iDev=0) const;
+
+    /*********************************************************************//**
+     * \brief Check if PGN is library managed periodic message for device
+     *
+     * \param PGN       PGN of the message
+     * \param iDev      Index of the device on \ref Devices
+     */
+    bool IsPeriodicMsg(unsigned long PGN, int iDev=0) const { return FindPeriodicMsg(PGN,iDev)>=0; }
+
+    /*********************************************************************//**
+     * \brief Send periodic message immediately
+     *
+     * Sending does not change schedule. This can be used e.g., to respond
+     * ISO or group function request.
+     *
+     * \param PGN       PGN of the message
+     * \param iDev      Index of the device on \ref Devices
+     * \return true, if message was sent
+     */
+    bool SendPeriodicMsg(unsigned long PGN, int iDev=0);
+
     /*********************************************************************//**
      * \brief Set the library mode and start source address.
      *
@@ -2633,6 +3708,17 @@ public:
      */
     inline bool IsOpen() const { return OpenState==os_Open; }
 
+    /*********************************************************************//**
+     * \enum  tRestartMode
+     * \brief Restart modes for \ref Restart
+     */
+    enum tRestartMode {
+      /** \brief Forget learned addresses and run full address claim */
+      rm_Cold,
+      /** \brief Keep addresses and send single address claim */
+      rm_Warm
+    };
+
     /*********************************************************************//**
      * \brief Restart the device
      * 
@@ -2640,9 +3726,22 @@ public:
      * which may go to sleep or of the bus in any way. Function is under 
      * development.
      * 
-     * \note At the moment this functions just restarts the IsoAddressClaim
+     * On cold restart learned address claims and partially received 
+     * messages will be forgotten and address claim will be restarted. 
+     * Device can not send other messages until address claim has been 
+     * finished.
+     *
+     * Warm restart is meant e.g. for gateway, which has reset its CAN driver
+     * and has been only shortly off the bus. Devices keep their source
+     * addresses and send single address claim, learned address claims,
+     * partially received messages and TP sessions will be kept and sending
+     * continues immediately. If other node contests address, it will be 
+     * handled as any other address claim. Devices without valid address 
+     * will start normal address claim.
+     *
+     * \param Mode  Restart mode
      */
-    void Restart();
+    void Restart(tRestartMode Mode=rm_Cold);
 
     /*********************************************************************//**
      * \brief Send message to the NMEA2000 bus.
@@ -2712,6 +3811,55 @@ public:
      * See example TemperatureMonitor.ino.
      */
     void ParseMessages();
+
+    /*********************************************************************//**
+     * \brief Inject received CAN frame
+     *
+     * Frame will be handled as it would have been read from CAN driver.
+     * This can be used e.g., for replaying recorded logs. Object will be
+     * opened, if it has not been done yet.
+     *
+     * \param id        ID of the CAN frame
+     * \param len       length of payload
+     * \param buf       buffer with the payload
+     * \param FrameTime Receive time of the frame in microseconds on
+     *                  N2kMicros64() time base. If 0, current time will be used.
+     *
+     * \retval true     Frame has been handled
+     * \retval false    Object is not open
+     */
+    bool InjectFrame(unsigned long id, unsigned char len, const unsigned char *buf, uint64_t FrameTime=0);
+
+    /*********************************************************************//**
+     * \brief Inject received complete message
+     *
+     * Message will be forwarded and sent to message handlers as it would
+     * have been received from bus. Message will not be handled as system
+     * message.
+     *
+     * \param N2kMsg    Reference to a N2kMsg Object
+     */
+    void InjectMsg(const tN2kMsg &N2kMsg);
+
+    /*********************************************************************//**
+     * \brief Get time, when library needs next time to be run
+     *
+     * If your system can sleep or wait for CAN frames, you can use this to 
+     * find out how long it can be done without breaking library timings
+     * like heartbeat, TP transfers or pending responses. Time does not
+     * include your own message scheduling.
+     * 
+     * \code {.cpp}
+     * uint64_t Next=NMEA2000.GetNextProtocolEventTime();
+     * uint64_t Now=N2kMillis64();
+     * WaitCANFrame(Next>Now?Next-Now:0); // Wait frame or timeout
+     * NMEA2000.ParseMessages();
+     * \endcode
+     * 
+     * \return uint64_t  N2kMillis64() time for next event. 0, if 
+     *                   \ref ParseMessages should be called immediately.
+     */
+    uint64_t GetNextProtocolEventTime() const;
     
     /*********************************************************************//**
      * \brief Set OnOpen callback function
@@ -2742,6 +3890,242 @@ public:
      */
     void SetMsgHandler(void (*_MsgHandler)(const tN2kMsg &N2kMsg));
 
+    /*********************************************************************//**
+     * \brief Set monitor for raw received and sent frames
+     *
+     * \param _FrameMonitor  Monitor object or 0 to disable monitoring
+     */
+    void SetFrameMonitor(tFrameMonitor *_FrameMonitor) { FrameMonitor=_FrameMonitor; }
+
+#if !defined(N2K_NO_JOURNAL)
+    /*********************************************************************//**
+     * \brief Set journal for persistent settings
+     *
+     * Library writes source address, device and system instances, heartbeat
+     * interval and offset and installation descriptions to journal, when
+     * they change e.g. by group function from bus. On \ref Open saved
+     * settings will be restored, so device starts with its last claimed
+     * address and there is no need to poll change flags and save all
+     * settings on application.
+     *
+     * Journal must be opened with \ref tN2kJournal::Open before calling
+     * \ref Open. Settings are saved for first 16 devices.
+     *
+     * \param _Journal  Journal or 0 to disable saving
+     */
+    void SetJournal(tN2kJournal *_Journal) { Journal=_Journal; JournalPending=0; }
+#endif
+
+#if !defined(N2K_NO_SLOT_ALLOCATOR)
+    /*********************************************************************//**
+     * \brief Set allocator for spreading periodic transmissions
+     *
+     * Without allocator periodic messages added with automatic offset will
+     * be spread by their index, all devices get same default heartbeat
+     * offset and information resend delays depends on source address.
+     * With many devices e.g. on gateway this may cause bursts of frames.
+     *
+     * With allocator library keeps count of frames on each time slot for
+     * all heartbeats and periodic messages of all devices and measures
+     * frames received from bus and other own frames like responses and TP
+     * transfers. Default heartbeat offsets, automatic periodic 
+     * message offsets and information resend delays will be set to least 
+     * loaded slots. Allocator should be set before adding periodic
+     * messages and calling \ref Open.
+     *
+     * \param _SlotAllocator  Allocator or 0 to disable allocation
+     */
+    void SetSlotAllocator(tN2kSlotAllocator *_SlotAllocator);
+#endif
+
+#if !defined(N2K_NO_TX_PACER)
+    /*********************************************************************//**
+     * \brief Set transmit pacer for low priority bulk traffic
+     *
+     * Without pacer fast packet frames and ISO TP data transfer frames will
+     * be sent back to back. E.g. on gateway forwarding long messages this
+     * may saturate bus and delay messages from other devices.
+     *
+     * With pacer library measures bus load from received and sent frames.
+     * Fast packet and TP data frames with priority lower than pacer bypass
+     * priority will be sent at rate, which keeps bus load at pacer target
+     * load. Frames, which can not be sent immediately, will be counted to
+     * \ref tStats::FramesDeferred and sent later from \ref ParseMessages.
+     * Single frame messages and priority 0-3 traffic will never be paced.
+     *
+     * \param _TxPacer  Pacer or 0 to disable pacing. Deferred frames
+     *                  on previous pacer will be sent first.
+     *
+     * \retval true   Pacer has been set
+     * \retval false  Library send buffer got full before all frames on
+     *                previous pacer could be sent. Previous pacer stays in
+     *                use with rest of its frames, so call again later e.g.,
+     *                after \ref ParseMessages.
+     */
+    bool SetTxPacer(tN2kTxPacer *_TxPacer);
+#endif
+
+    /*********************************************************************//**
+     * \brief Get runtime statistics
+     *
+     * Statistics show problems, which otherwise would be visible only with
+     * debug builds, like lost fast packet frames or full send buffer.
+     * \sa
+     * - \ref ResetStats
+     * - \ref GetStatsDump
+     */
+    const tStats &GetStats() const { return Stats; }
+
+    /*********************************************************************//**
+     * \brief Clear all statistics counters including per PGN stats
+     */
+    void ResetStats();
+
+    /*********************************************************************//**
+     * \brief Set size of per PGN statistics table
+     *
+     * Per PGN statistics are disabled by default. Table entries will be
+     * taken in use in order PGNs are seen. When table is full, new PGNs will
+     * be counted to \ref tStats::PGNStatsFull. Each entry takes 16 bytes.
+     *
+     * \param _MaxPGNStats  Number of PGNs to collect. 0 disables per PGN stats.
+     */
+    void SetPGNStatsSize(uint16_t _MaxPGNStats);
+
+    /*********************************************************************//**
+     * \brief Get per PGN statistics table
+     *
+     * \param Count   Number of used entries
+     * \return Pointer to table or 0, if per PGN stats are disabled
+     */
+    const tPGNStats *GetPGNStats(uint16_t &Count) const { Count=PGNStatsCount; return PGNStats; }
+
+    /*********************************************************************//**
+     * \brief Get statistics in compact binary form
+     *
+     * Format (little endian): 'N','S', version (1), number of counters (1),
+     * counters as 4 byte values in \ref tStats order, number of PGN entries (2)
+     * and PGN entries: PGN (3), Received (4), Sent (4), Errors (4).
+     *
+     * \param Buf       Buffer for dump
+     * \param BufSize   Buffer size
+     * \return Dump length or 0, if buffer is too small
+     */
+    size_t GetStatsDump(unsigned char *Buf, size_t BufSize) const;
+
+    /*********************************************************************//**
+     * \brief Write statistics dump periodically to stream
+     *
+     * Dump will be written from \ref ParseMessages in \ref GetStatsDump
+     * format.
+     *
+     * \param _StatsStream    Stream to write dump or 0 to disable
+     * \param Period          Dump period in ms
+     */
+    void SetStatsDump(N2kStream *_StatsStream, uint32_t Period=60000);
+
+    /*********************************************************************//**
+     * \brief Enable message handler execution time accounting
+     *
+     * Slow message handlers delay \ref ParseMessages, which may cause
+     * receive buffer overflows on driver. With timing enabled library
+     * measures each handler call with N2kMicros64() and collects call count,
+     * cumulative and maximum time for each handler. Timing costs two clock
+     * reads per handler call, so it is disabled by default.
+     *
+     * If budget has been set, calls exceeding it will be counted to
+     * \ref tHandlerStats::OverBudget and \ref tStats::HandlersOverBudget
+     * and reported to callback set by \ref SetSlowHandlerCallback.
+     *
+     * \sa
+     * - \ref tMsgHandler::GetHandlerStats
+     * - \ref GetMsgHandlerStats
+     *
+     * \param Enable    Enable timing
+     * \param Budget    Time budget for single handler call in us. 0 disables
+     *                  budget check.
+     */
+    void EnableHandlerTiming(bool Enable=true, uint32_t Budget=0) { HandlerTiming=Enable; HandlerBudget=Budget; }
+
+    /*********************************************************************//**
+     * \brief Set callback for handler calls exceeding budget
+     *
+     * Callback will be called right after slow handler call. It can e.g.,
+     * log the handler or detach it with \ref DetachMsgHandler and handle
+     * its messages later on own task. Callback must not detach any other
+     * handler. For handler set with \ref SetMsgHandler Handler will be 0.
+     *
+     * \param _SlowHandlerCallback  Callback or 0 to disable
+     */
+    void SetSlowHandlerCallback(void (*_SlowHandlerCallback)(tMsgHandler *Handler, const tN2kMsg &N2kMsg, uint32_t Time)) {
+      SlowHandlerCallback=_SlowHandlerCallback;
+    }
+
+    /** \brief Execution time statistics for handler set with \ref SetMsgHandler */
+    const tHandlerStats &GetMsgHandlerStats() const { return MsgHandlerStats; }
+
+    /*********************************************************************//**
+     * \brief Clear execution time statistics of all handlers
+     */
+    void ResetHandlerStats();
+
+    /*********************************************************************//**
+     * \brief Subscribe PGN range
+     *
+     * By default library reads and handles all frames on bus. With
+     * subscriptions library rejects all other frames by CAN id before any
+     * other handling. Subscriptions will be compiled to minimal set of CAN id
+     * acceptance filters. If driver supports hardware filters (see
+     * \ref CANGetMaxFilters), filters will be also set to CAN controller,
+     * so unsubscribed frames never reach library.
+     *
+     * System messages library needs for its own operation (ISO request,
+     * acknowledge, transport protocol, address claim, commanded address
+     * and group function) will be always accepted. If you use e.g.,
+     * tN2kDeviceList, subscribe also PGNs it needs.
+     *
+     * \code
+     *  NMEA2000.Subscribe(127245L);                  // Rudder from any source
+     *  NMEA2000.Subscribe(127488L,127489L);          // Engine
+     *  NMEA2000.Subscribe(129025L,129029L,22);       // Position data from source 22
+     * \endcode
+     *
+     * \param FirstPGN    First PGN of range
+     * \param LastPGN     Last PGN of range. 0 for single PGN.
+     * \param Source      Source to accept or 0xff for any source
+     *
+     * \retval true       Subscription added
+     * \retval false      Invalid range or out of memory
+     */
+    bool Subscribe(unsigned long FirstPGN, unsigned long LastPGN=0, unsigned char Source=0xff);
+
+    /*********************************************************************//**
+     * \brief Remove all subscriptions, so that all frames will be accepted
+     */
+    void ClearSubscriptions();
+
+    /*********************************************************************//**
+     * \brief Check does received frame match subscriptions
+     *
+     * \param canId   CAN id of frame
+     * \retval true   Frame is subscribed or there are no subscriptions
+     */
+    bool IsSubscribedFrame(unsigned long canId) const {
+      if ( SubscriptionCount==0 ) return true;
+      for (uint16_t i=0; i<CANFilterCount; i++) {
+        if ( ((canId ^ CANFilters[i].id) & CANFilters[i].mask)==0 ) return true;
+      }
+      return false;
+    }
+
+    /*********************************************************************//**
+     * \brief Get exact acceptance filters compiled from subscriptions
+     *
+     * \param Count   Number of filters
+     * \return Filters
+     */
+    const tCANFilter *GetCANFilters(uint16_t &Count) const { Count=CANFilterCount; return CANFilters; }
+
     /*********************************************************************//**
      * \brief Attach a  message handler for incoming N2kMessages
      * 
@@ -2792,6 +4176,24 @@ public:
      */
     void SetISORqstHandler(bool(*ISORequestHandler)(unsigned long RequestedPGN, unsigned char Requester, int DeviceIndex));
 
+    /*********************************************************************//**
+     * \brief Set time for coalescing duplicate ISO requests
+     *
+     * On power up all displays on bus may request address claim, product
+     * information and configuration information from all devices. Library
+     * responds to these requests always with broadcast, so one response
+     * serves all requesters. Response will be sent after given time and all
+     * requests for same PGN to same device received meanwhile will be
+     * dropped. Dropped requests will be counted to
+     * \ref tStats::ISORequestsCoalesced.
+     *
+     * Default is \ref N2K_ISO_REQUEST_COALESCE_TIME.
+     *
+     * \param _ISORequestCoalesceTime  Time in ms. 0 disables coalescing
+     *                                 and requests will be responded immediately.
+     */
+    void SetISORequestCoalesceTime(uint16_t _ISORequestCoalesceTime) { ISORequestCoalesceTime=_ISORequestCoalesceTime; }
+
 #if !defined(N2K_NO_GROUP_FUNCTION_SUPPORT)
     
     /**********************************************************************//**
@@ -2948,6 +4350,50 @@ public:
     void SetForwardOwnMessages(bool v=true) {
         if (v) { ForwardMode |= FwdModeBit_OwnMessages;  } else { ForwardMode &= ~FwdModeBit_OwnMessages; }
       }
+
+    /*********************************************************************//**
+     * \brief Add forward decimation and deduplication rule
+     *
+     * Rules are tested before message will be formatted to forward stream,
+     * so dropped messages save both CPU time and stream bandwidth. First
+     * matching rule will be used, so add source specific rules before
+     * rules for any source. Messages without matching rule will be
+     * forwarded as before.
+     *
+     * Payload change is detected by hash of message data. Note that
+     * messages with sequence id on data change always.
+     *
+     * \code
+     *  NMEA2000.AddForwardRule(127250L,1000);                  // Heading max 1 Hz
+     *  NMEA2000.AddForwardRule(129025L,1000);                  // Position max 1 Hz
+     *  NMEA2000.AddForwardRule(127505L,0,tNMEA2000::fwdr_SuppressUnchanged,10000); // Fluid level on change or every 10 s
+     *  NMEA2000.AddForwardRule(127501L,5000,tNMEA2000::fwdr_SuppressUnchanged | tNMEA2000::fwdr_PassChanges); // Switch status changes immediately
+     * \endcode
+     *
+     * \param PGN              PGN for rule
+     * \param Interval         Minimum interval in ms between forwarded messages
+     * \param Flags            Rule flags, see \ref tForwardRuleFlags
+     * \param RefreshInterval  With fwdr_SuppressUnchanged interval in ms to
+     *                         forward unchanged payload anyway. 0 for never.
+     * \param Source           Source for rule or 0xff for any source
+     *
+     * \retval true       Rule added
+     * \retval false      Out of memory
+     */
+    bool AddForwardRule(unsigned long PGN, uint16_t Interval, uint8_t Flags=0, uint16_t RefreshInterval=0, unsigned char Source=0xff);
+
+    /*********************************************************************//**
+     * \brief Remove all forward rules
+     */
+    void ClearForwardRules();
+
+    /*********************************************************************//**
+     * \brief Get forward rules with their counters
+     *
+     * \param Count   Number of rules
+     * \return Pointer to rules or 0, if there is no rules
+     */
+    const tForwardRule *GetForwardRules(uint8_t &Count) const { Count=ForwardRuleCount; return ForwardRules; }
     
     /*********************************************************************//**
      * \brief Set the Handle Only Known Messages
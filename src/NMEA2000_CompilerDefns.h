@@ -78,4 +78,13 @@
  */
 // #define N2K_NO_HEARTBEAT_SUPPORT 1          //Uncomment as needed
 
+/***********************************************************************//**
+ * \brief Activation of microsecond frame timestamps
+ * Received messages will be stamped with first and last frame receive 
+ * time in microseconds, see tN2kMsg::FirstFrameTime. Timestamps are
+ * disabled as default and must be enabled with this definition for library
+ * and application. Uses 16 B ram for each message buffer.
+ */
+// #define N2K_FRAME_TIMESTAMP 1               //Uncomment as needed
+
 #endif
@@ -0,0 +1,323 @@
+/*
+ * NMEA2000_Virtual.cpp
+ *
+ * Copyright (c) 2024 NMEA2000 library contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "NMEA2000_Virtual.h"
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+
+#include <string.h>
+
+#define VirtualTxQueueSize 3    // Typical CAN controller transmit buffer count
+#define VirtualRxQueueSize 32   // Default receive queue size
+#define ErrorFrameBits 23       // Error flag, echo, delimiter and interframe space
+
+//*****************************************************************************
+// Shifts bits to stuffed bitstream and counts stuff bits. Bits are handled
+// MSB first.
+class tCANBitStuffer {
+protected:
+  uint8_t LastBit;
+  uint8_t RunLength;
+  uint16_t Crc;
+
+public:
+  uint16_t Bits;
+
+  tCANBitStuffer() : LastBit(0xff), RunLength(0), Crc(0), Bits(0) {}
+
+  void AddBit(uint8_t Bit, bool UpdateCrc=true) {
+    if ( UpdateCrc ) {
+      uint8_t CrcNext=Bit ^ ((Crc>>14) & 0x01);
+      Crc=(Crc<<1) & 0x7fff;
+      if ( CrcNext ) Crc^=0x4599;
+    }
+    Bits++;
+    if ( Bit==LastBit ) {
+      RunLength++;
+    } else {
+      LastBit=Bit;
+      RunLength=1;
+    }
+    if ( RunLength==5 ) { // Insert complement bit, which also starts new run
+      Bits++;
+      LastBit=!Bit;
+      RunLength=1;
+    }
+  }
+
+  void AddBits(uint32_t Value, uint8_t Count) {
+    for (; Count>0; Count--) AddBit((Value>>(Count-1)) & 0x01);
+  }
+
+  void AddCrc() {
+    uint16_t FrameCrc=Crc;
+    for (uint8_t i=15; i>0; i--) AddBit((FrameCrc>>(i-1)) & 0x01,false);
+  }
+};
+
+//*****************************************************************************
+uint16_t tN2kVirtualBus::FrameBitCount(unsigned long id, unsigned char len, const unsigned char *buf) {
+  tCANBitStuffer Stuffer;
+
+  if ( len>8 ) len=8;
+  Stuffer.AddBit(0);                     // SOF
+  Stuffer.AddBits(id>>18,11);            // Base id
+  Stuffer.AddBits(0x03,2);               // SRR, IDE
+  Stuffer.AddBits(id & 0x3ffff,18);      // Extended id
+  Stuffer.AddBits(0x00,3);               // RTR, r1, r0
+  Stuffer.AddBits(len,4);                // DLC
+  for (unsigned char i=0; i<len; i++) Stuffer.AddBits(buf[i],8);
+  Stuffer.AddCrc();
+
+  // CRC delimiter, ACK slot, ACK delimiter, EOF and interframe space are not stuffed
+  return Stuffer.Bits+1+2+7+3;
+}
+
+//*****************************************************************************
+uint64_t tN2kVirtualClock::Time=0;
+
+tN2kVirtualClock::tN2kVirtualClock(uint64_t StartTime) {
+  Time=StartTime;
+  N2kSetClockSource(GetTime);
+}
+
+//*****************************************************************************
+tN2kVirtualClock::~tN2kVirtualClock() {
+  N2kSetClockSource(0);
+}
+
+//*****************************************************************************
+tN2kVirtualBus::tN2kVirtualBus(uint32_t _BitRate) {
+  FirstNode=0;
+  BitRate=(_BitRate>0?_BitRate:250000);
+  ErrorThreshold=0;
+  DropThreshold=0;
+  RandomState=0x12345678;
+  TxPending=0;
+  BusFreeTime=0;
+  ResetStats();
+}
+
+//*****************************************************************************
+uint32_t tN2kVirtualBus::ToThreshold(double Probability) {
+  if ( Probability<=0.0 ) return 0;
+  if ( Probability>=1.0 ) return 0xffffffff;
+  return (uint32_t)(Probability*4294967295.0);
+}
+
+//*****************************************************************************
+// xorshift32 is enough for injection and gives repeatable runs with seed.
+bool tN2kVirtualBus::RandomEvent(uint32_t Threshold) {
+  if ( Threshold==0 ) return false;
+  RandomState^=RandomState<<13;
+  RandomState^=RandomState>>17;
+  RandomState^=RandomState<<5;
+  return RandomState<=Threshold;
+}
+
+//*****************************************************************************
+bool tN2kVirtualBus::Attach(tNMEA2000_Virtual *Node) {
+  if ( Node==0 || Node->Bus!=0 ) return false;
+
+  Node->Bus=this;
+  Node->NextNode=FirstNode;
+  FirstNode=Node;
+
+  return true;
+}
+
+//*****************************************************************************
+void tN2kVirtualBus::Detach(tNMEA2000_Virtual *Node) {
+  if ( Node==0 || Node->Bus!=this ) return;
+
+  for (tNMEA2000_Virtual **pNode=&FirstNode; *pNode!=0; pNode=&((*pNode)->NextNode) ) {
+    if ( *pNode==Node ) {
+      *pNode=Node->NextNode;
+      break;
+    }
+  }
+  if ( Node->TxQueue!=0 ) {
+    TxPending-=Node->TxQueue->count();
+    Node->TxQueue->clear();
+  }
+  Node->NextNode=0;
+  Node->Bus=0;
+}
+
+//*****************************************************************************
+void tN2kVirtualBus::Deliver(tNMEA2000_Virtual *Sender, unsigned long id, unsigned char len, const unsigned char *buf, uint64_t FrameTime) {
+  for (tNMEA2000_Virtual *Node=FirstNode; Node!=0; Node=Node->NextNode) {
+    if ( Node==Sender || Node->RxQueue==0 ) continue;
+    if ( RandomEvent(DropThreshold) ) {
+      DropCount++;
+      continue;
+    }
+    tNMEA2000_Virtual::tVirtualFrame *Frame=Node->RxQueue->getAddRef();
+    if ( Frame==0 ) {
+      OverrunCount++;
+      continue;
+    }
+    Frame->id=id;
+    Frame->len=len;
+    memcpy(Frame->buf,buf,len);
+    Frame->Time=FrameTime;
+  }
+}
+
+//*****************************************************************************
+void tN2kVirtualBus::Run() {
+  if ( TxPending==0 ) return;
+
+  uint64_t Now=N2kMicros64()*1000;
+
+  while ( TxPending>0 ) {
+    // Bus arbitration starts, when bus is free and at least one frame is waiting
+    uint64_t Start=0xffffffffffffffffULL;
+    tNMEA2000_Virtual *Node;
+    tNMEA2000_Virtual::tVirtualFrame *Frame;
+    for (Node=FirstNode; Node!=0; Node=Node->NextNode) {
+      if ( Node->TxQueue!=0 && (Frame=Node->TxQueue->peek())!=0 && Frame->Time*1000<Start ) Start=Frame->Time*1000;
+    }
+    if ( Start<BusFreeTime ) Start=BusFreeTime;
+    if ( Start>Now ) break;
+
+    // Lowest id of waiting frames wins
+    tNMEA2000_Virtual *Winner=0;
+    tNMEA2000_Virtual::tVirtualFrame *WinnerFrame=0;
+    for (Node=FirstNode; Node!=0; Node=Node->NextNode) {
+      if ( Node->TxQueue==0 || (Frame=Node->TxQueue->peek())==0 || Frame->Time*1000>Start ) continue;
+      if ( WinnerFrame==0 || (Frame->id & 0x1fffffff)<(WinnerFrame->id & 0x1fffffff) ) {
+        Winner=Node;
+        WinnerFrame=Frame;
+      }
+    }
+
+    uint64_t End=Start+BitTime(FrameBitCount(WinnerFrame->id,WinnerFrame->len,WinnerFrame->buf));
+    if ( End>Now ) break;
+
+    if ( RandomEvent(ErrorThreshold) ) {
+      // Frame will be destroyed and controller retries it after error frame
+      End+=BitTime(ErrorFrameBits);
+      ErrorCount++;
+    } else {
+      tNMEA2000_Virtual::tVirtualFrame Sent;
+      Winner->TxQueue->read(Sent);
+      TxPending--;
+      FrameCount++;
+      Deliver(Winner,Sent.id,Sent.len,Sent.buf,End/1000);
+    }
+    BusyTime+=End-Start;
+    BusFreeTime=End;
+  }
+}
+
+//*****************************************************************************
+tNMEA2000_Virtual::tNMEA2000_Virtual(tN2kVirtualBus *_Bus) : tNMEA2000() {
+  Bus=0;
+  NextNode=0;
+  TxQueue=0;
+  RxQueue=0;
+  SetBus(_Bus);
+}
+
+//*****************************************************************************
+tNMEA2000_Virtual::~tNMEA2000_Virtual() {
+  if ( Bus!=0 ) Bus->Detach(this);
+  delete TxQueue;
+  delete RxQueue;
+}
+
+//*****************************************************************************
+void tNMEA2000_Virtual::SetBus(tN2kVirtualBus *_Bus) {
+  if ( Bus==_Bus ) return;
+  if ( Bus!=0 ) Bus->Detach(this);
+  if ( _Bus!=0 ) _Bus->Attach(this);
+}
+
+//*****************************************************************************
+void tNMEA2000_Virtual::InitCANFrameBuffers() {
+  if ( RxQueue==0 ) {
+    if ( MaxCANReceiveFrames==0 ) MaxCANReceiveFrames=VirtualRxQueueSize;
+    TxQueue=new tRingBuffer<tVirtualFrame>(VirtualTxQueueSize);
+    RxQueue=new tRingBuffer<tVirtualFrame>(MaxCANReceiveFrames);
+  }
+
+  tNMEA2000::InitCANFrameBuffers();
+}
+
+//*****************************************************************************
+bool tNMEA2000_Virtual::CANOpen() {
+  return Bus!=0;
+}
+
+//*****************************************************************************
+bool tNMEA2000_Virtual::CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool /*wait_sent*/) {
+  if ( Bus==0 || TxQueue==0 ) return false;
+
+  tVirtualFrame *Frame=TxQueue->getAddRef();
+  if ( Frame==0 ) return false;
+
+  if ( len>8 ) len=8;
+  Frame->id=id;
+  Frame->len=len;
+  memcpy(Frame->buf,buf,len);
+  Frame->Time=N2kMicros64();
+  Bus->TxPending++;
+
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000_Virtual::CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf) {
+  if ( RxQueue==0 ) return false;
+  if ( Bus!=0 ) Bus->Run();
+
+  const tVirtualFrame *Frame=RxQueue->getReadRef();
+  if ( Frame==0 ) return false;
+
+  id=Frame->id;
+  len=Frame->len;
+  memcpy(buf,Frame->buf,len);
+
+  return true;
+}
+
+#if defined(N2K_FRAME_TIMESTAMP)
+//*****************************************************************************
+bool tNMEA2000_Virtual::CANGetTimestampedFrame(unsigned long &id, unsigned char &len, unsigned char *buf, uint64_t &FrameTime) {
+  if ( RxQueue==0 ) return false;
+  if ( Bus!=0 ) Bus->Run();
+
+  const tVirtualFrame *Frame=RxQueue->getReadRef();
+  if ( Frame==0 ) return false;
+
+  id=Frame->id;
+  len=Frame->len;
+  memcpy(buf,Frame->buf,len);
+  FrameTime=Frame->Time;
+
+  return true;
+}
+#endif
+
+#endif
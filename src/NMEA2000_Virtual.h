@@ -0,0 +1,308 @@
+/*
+ * NMEA2000_Virtual.h
+ *
+ * Copyright (c) 2024 NMEA2000 library contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*************************************************************************//**
+ * \file  NMEA2000_Virtual.h
+ * \brief In process virtual CAN bus for host simulation
+ *
+ * tN2kVirtualBus connects any number of tNMEA2000_Virtual nodes inside one
+ * process. It can be used to test address claim, transport protocol and
+ * device discovery with many simulated nodes without any hardware.
+ *
+ * The bus simulates:
+ *  - arbitration. When several nodes have frame waiting, frame with lowest
+ *    CAN id wins as on real bus.
+ *  - bit timing. Each frame occupies the bus for its real length including
+ *    stuff bits, CRC, ACK, EOF and interframe space on selected bit rate
+ *    (default 250 kbit/s). Frames will be delivered to receivers when their
+ *    transmission has ended on N2kMicros64() time.
+ *  - error injection. Frame can be destroyed with error frame, after which
+ *    sender retransmits it as CAN controller does.
+ *  - drop injection. Single receiver can lose frame.
+ *
+ * Bus is driven by nodes - each tNMEA2000_Virtual::ParseMessages() runs
+ * bus with \ref tN2kVirtualBus::Run. Module is not thread safe, so all nodes
+ * must be handled on same thread.
+ *
+ * \code
+ *  tN2kVirtualBus Bus;
+ *  tNMEA2000_Virtual Node1(&Bus), Node2(&Bus);
+ *
+ *  Node1.SetMode(tNMEA2000::N2km_NodeOnly,22);
+ *  Node2.SetMode(tNMEA2000::N2km_ListenAndNode,23);
+ *  Node1.Open(); Node2.Open();
+ *  while (true) {
+ *    Node1.ParseMessages();
+ *    Node2.ParseMessages();
+ *  }
+ * \endcode
+ *
+ * Module is available only on Linux hosts.
+ */
+
+#ifndef _NMEA2000_VIRTUAL_H_
+#define _NMEA2000_VIRTUAL_H_
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+
+#include "NMEA2000.h"
+#include "RingBuffer.h"
+
+class tNMEA2000_Virtual;
+
+/************************************************************************//**
+ * \class tN2kVirtualClock
+ * \brief Simulated time for virtual bus runs
+ *
+ * While clock object exists, N2kMillis64() and N2kMicros64() return its
+ * time, which moves only with \ref Advance. With it simulation results do
+ * not depend on host load. Only one clock may exist at a time.
+ *
+ * \code
+ *  tN2kVirtualClock Clock;
+ *  for (int i=0; i<10000; i++) { // simulate 1 s
+ *    Clock.Advance(100);
+ *    Node1.ParseMessages();
+ *    Node2.ParseMessages();
+ *  }
+ * \endcode
+ */
+class tN2kVirtualClock {
+protected:
+  static uint64_t Time;
+  static uint64_t GetTime() { return Time; }
+
+public:
+  /************************************************************************//**
+   * \brief Constructor, which starts simulated time
+   * \param StartTime  Initial time in microseconds
+   */
+  tN2kVirtualClock(uint64_t StartTime=1000000);
+  /** \brief Destructor, which restores system clock */
+  ~tN2kVirtualClock();
+
+  /************************************************************************//**
+   * \brief Move simulated time forward
+   * \param us  Time step in microseconds
+   */
+  void Advance(uint64_t us) { Time+=us; }
+};
+
+/************************************************************************//**
+ * \class tN2kVirtualBus
+ * \brief Simulated CAN bus connecting tNMEA2000_Virtual nodes
+ * \ingroup group_coreSupplementary
+ */
+class tN2kVirtualBus {
+protected:
+  /** \brief First attached node. Nodes are linked with NextNode. */
+  tNMEA2000_Virtual *FirstNode;
+  /** \brief Bus bit rate in bits/s */
+  uint32_t BitRate;
+  /** \brief Error injection probability scaled to 0-0xffffffff */
+  uint32_t ErrorThreshold;
+  /** \brief Drop injection probability scaled to 0-0xffffffff */
+  uint32_t DropThreshold;
+  /** \brief State of the random generator used for injection */
+  uint32_t RandomState;
+  /** \brief Number of frames waiting for transmission on all nodes */
+  uint32_t TxPending;
+  /** \brief Time in ns, when bus will be idle */
+  uint64_t BusFreeTime;
+
+  /** \brief Number of successfully transmitted frames */
+  uint32_t FrameCount;
+  /** \brief Number of frames destroyed by injected errors */
+  uint32_t ErrorCount;
+  /** \brief Number of frames dropped on single receiver */
+  uint32_t DropCount;
+  /** \brief Number of frames lost due to full receive queue */
+  uint32_t OverrunCount;
+  /** \brief Time in ns bus has been busy */
+  uint64_t BusyTime;
+
+protected:
+  /*********************************************************************//**
+   * \brief Random event test for injection.
+   * \param Threshold   Probability scaled to 0-0xffffffff
+   * \retval true       Event should happen
+   */
+  bool RandomEvent(uint32_t Threshold);
+  /*********************************************************************//**
+   * \brief Convert probability 0.0-1.0 to threshold
+   */
+  static uint32_t ToThreshold(double Probability);
+  /*********************************************************************//**
+   * \brief Bus time in ns for given number of bits
+   */
+  uint64_t BitTime(uint32_t Bits) const { return (uint64_t)Bits*1000000000ULL/BitRate; }
+  /*********************************************************************//**
+   * \brief Deliver transmitted frame to all other nodes.
+   */
+  void Deliver(tNMEA2000_Virtual *Sender, unsigned long id, unsigned char len, const unsigned char *buf, uint64_t FrameTime);
+
+  friend class tNMEA2000_Virtual;
+
+public:
+  /*********************************************************************//**
+   * \brief Constructor for the virtual bus
+   * \param _BitRate  Bus bit rate in bits/s
+   */
+  tN2kVirtualBus(uint32_t _BitRate=250000);
+
+  /*********************************************************************//**
+   * \brief Set bus bit rate in bits/s
+   */
+  void SetBitRate(uint32_t _BitRate) { if ( _BitRate>0 ) BitRate=_BitRate; }
+  /*********************************************************************//**
+   * \brief Get bus bit rate in bits/s
+   */
+  uint32_t GetBitRate() const { return BitRate; }
+
+  /*********************************************************************//**
+   * \brief Set probability for frame to be destroyed by error frame
+   *
+   * Destroyed frame will be lost for all nodes, it occupies the bus and
+   * error frame will be sent after it. Sender retransmits frame.
+   *
+   * \param Probability   Probability 0.0 - 1.0
+   */
+  void SetErrorRate(double Probability) { ErrorThreshold=ToThreshold(Probability); }
+  /*********************************************************************//**
+   * \brief Set probability for single receiver to lose frame
+   *
+   * \param Probability   Probability 0.0 - 1.0
+   */
+  void SetDropRate(double Probability) { DropThreshold=ToThreshold(Probability); }
+  /*********************************************************************//**
+   * \brief Set seed for injection random generator for repeatable runs
+   */
+  void SetRandomSeed(uint32_t Seed) { RandomState=(Seed!=0?Seed:1); }
+
+  /*********************************************************************//**
+   * \brief Attach node to the bus.
+   * \retval true   Node attached
+   * \retval false  Node is already attached to some bus.
+   */
+  bool Attach(tNMEA2000_Virtual *Node);
+  /*********************************************************************//**
+   * \brief Detach node from the bus. Pending frames of node will be lost.
+   */
+  void Detach(tNMEA2000_Virtual *Node);
+
+  /*********************************************************************//**
+   * \brief Run the bus
+   *
+   * Arbitrates and transmits all frames, which transmission has ended
+   * by current N2kMicros64() time. This is called automatically on node
+   * frame reading, so normally there is no need to call it.
+   */
+  void Run();
+
+  /*********************************************************************//**
+   * \brief Calculate number of bits for extended data frame on bus
+   *
+   * Count includes stuff bits, CRC, ACK, EOF and interframe space.
+   *
+   * \param id    CAN id
+   * \param len   Data length
+   * \param buf   Data
+   * \return Number of bits
+   */
+  static uint16_t FrameBitCount(unsigned long id, unsigned char len, const unsigned char *buf);
+
+  /** \brief Number of successfully transmitted frames */
+  uint32_t GetFrameCount() const { return FrameCount; }
+  /** \brief Number of frames destroyed by injected errors */
+  uint32_t GetErrorCount() const { return ErrorCount; }
+  /** \brief Number of frames dropped by drop injection */
+  uint32_t GetDropCount() const { return DropCount; }
+  /** \brief Number of frames lost due to full receive queue */
+  uint32_t GetOverrunCount() const { return OverrunCount; }
+  /** \brief Time in us bus has been busy */
+  uint64_t GetBusyTime() const { return BusyTime/1000; }
+  /** \brief Reset bus counters */
+  void ResetStats() { FrameCount=0; ErrorCount=0; DropCount=0; OverrunCount=0; BusyTime=0; }
+};
+
+/************************************************************************//**
+ * \class tNMEA2000_Virtual
+ * \brief NMEA2000 driver class for tN2kVirtualBus
+ * \ingroup group_core
+ *
+ * Driver has small transmit queue simulating CAN controller transmit
+ * buffers. Library send frame buffer will be used, when it is full.
+ * Receive queue size can be set with \ref tNMEA2000::SetN2kCANReceiveFrameBufSize.
+ */
+class tNMEA2000_Virtual : public tNMEA2000 {
+protected:
+  /** \brief Frame on driver queues */
+  struct tVirtualFrame {
+    unsigned long id;
+    unsigned char len;
+    unsigned char buf[8];
+    /** \brief Queue time on transmit, end of frame time on receive in us */
+    uint64_t Time;
+  };
+
+  /** \brief Bus node is attached to */
+  tN2kVirtualBus *Bus;
+  /** \brief Next node on the bus */
+  tNMEA2000_Virtual *NextNode;
+  /** \brief Simulated CAN controller transmit buffers */
+  tRingBuffer<tVirtualFrame> *TxQueue;
+  /** \brief Simulated CAN controller receive buffer */
+  tRingBuffer<tVirtualFrame> *RxQueue;
+
+  friend class tN2kVirtualBus;
+
+protected:
+  bool CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true);
+  bool CANOpen();
+  bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf);
+#if defined(N2K_FRAME_TIMESTAMP)
+  bool CANGetTimestampedFrame(unsigned long &id, unsigned char &len, unsigned char *buf, uint64_t &FrameTime);
+#endif
+  void InitCANFrameBuffers();
+
+public:
+  /*********************************************************************//**
+   * \brief Constructor for the virtual driver
+   * \param _Bus  Bus to attach node. Can be set later with \ref SetBus.
+   */
+  tNMEA2000_Virtual(tN2kVirtualBus *_Bus=0);
+  virtual ~tNMEA2000_Virtual();
+
+  /*********************************************************************//**
+   * \brief Attach node to the bus. Must be called before Open.
+   */
+  void SetBus(tN2kVirtualBus *_Bus);
+  /*********************************************************************//**
+   * \brief Get bus node has been attached to
+   */
+  tN2kVirtualBus *GetBus() const { return Bus; }
+};
+
+#endif
+
+#endif
@@ -23,7 +23,6 @@
 */
 
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
 #include "Seasmart.h"
 
@@ -94,27 +93,31 @@ size_t N2kToSeasmart(const tN2kMsg &msg, uint32_t timestamp, char *buffer, size_
   return (size_t)(s - buffer);
 }
 
+static int hexDigitValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
 /*
  * Attempts to read n bytes in hexadecimal from input string to value.
+ * Terminating null is not a hex digit, so reading stops on end of string.
  *
  * Returns true if successful, false otherwise.
  */
 static bool readNHexByte(const char *s, unsigned int n, uint32_t &value) {
   value=(uint32_t)(-1); // required to avoid warning about uninitialized variable.
-  if (strlen(s) < 2*n) {
-    return false;
-  }
+  uint32_t result = 0;
   for (unsigned int i = 0; i < 2*n; i++) {
-    if (!isxdigit(s[i])) {
+    int digit = hexDigitValue(s[i]);
+    if (digit < 0) {
       return false;
     }
+    result = (result << 4) | digit;
   }
 
-  char sNumber[2*n + 1];
-  strncpy(sNumber, s, sizeof(sNumber));
-  sNumber[sizeof(sNumber) - 1] = 0;
-
-  value = strtol(sNumber, 0, 16);
+  value = result;
   return true;
 }
 
@@ -58,6 +58,20 @@
  */
 size_t N2kToSeasmart(const tN2kMsg &msg, uint32_t timestamp, char *buffer, size_t size);
 
+/************************************************************************//**
+ * \brief Converts a tN2kMsg into a $PCDIN NMEA sentence using message time
+ * 
+ * Same as above, but timestamp will be taken from message with
+ * tN2kMsg::GetMsgTime(). With frame timestamps enabled it is receive time
+ * of the first frame of the message.
+ * 
+ * \param msg         Reference to a N2kMsg Object 
+ * \param buffer      char array buffer for seasmart message
+ * \param size        size of the char buffer
+ * \return size_t 
+ */
+inline size_t N2kToSeasmart(const tN2kMsg &msg, char *buffer, size_t size) { return N2kToSeasmart(msg,msg.GetMsgTime(),buffer,size); }
+
 /************************************************************************//**
  * \brief Converts a null terminated $PCDIN NMEA sentence into a tN2kMsg
  * 
@@ -0,0 +1,362 @@
+/*
+ * Bus load benchmark for tNMEA2000::ParseMessages
+ *
+ * Synthetic traffic profiles are generated as CAN frames, serialized on
+ * simulated 250 kbit/s bus and then fed as fast as possible through
+ * tNMEA2000::ParseMessages with in memory driver. Results are printed as
+ * one JSON object per profile:
+ *
+ *  {"profile":"sailing_yacht","frames":...,"messages":...,"frames_per_sec":...,
+ *   "msgs_per_sec":...,"latency_p50_ns":...,"latency_p99_ns":...,
+ *   "peak_heap_bytes":...,"max_rss_kb":...,"bus_load":...}
+ *
+ * Latency is measured from reading last frame of message from driver to
+ * message handler call. Program returns non zero, if any generated message
+ * was not received.
+ *
+ * Usage: N2kBenchmark [--quick] [--seconds N] [--profile name]
+ */
+
+#include <NMEA2000.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kMessages.h>
+#include <N2kTimer.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+//*****************************************************************************
+// Heap tracking for peak memory
+static size_t HeapInUse=0;
+static size_t HeapPeak=0;
+
+static const size_t HeapHeader=16; // Keeps alignment of returned block
+
+void *operator new(size_t Size) {
+  unsigned char *Block=(unsigned char *)malloc(Size+HeapHeader);
+  if ( Block==0 ) throw std::bad_alloc();
+  *(size_t *)Block=Size;
+  HeapInUse+=Size;
+  if ( HeapInUse>HeapPeak ) HeapPeak=HeapInUse;
+  return Block+HeapHeader;
+}
+
+void *operator new[](size_t Size) { return operator new(Size); }
+
+void operator delete(void *p) noexcept {
+  if ( p==0 ) return;
+  unsigned char *Block=(unsigned char *)p-HeapHeader;
+  HeapInUse-=*(size_t *)Block;
+  free(Block);
+}
+
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+//*****************************************************************************
+static inline uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//*****************************************************************************
+struct tBenchFrame {
+  unsigned long id;
+  unsigned char len;
+  unsigned char buf[8];
+};
+
+//*****************************************************************************
+// Driver feeding pregenerated frames.
+class tNMEA2000_Bench : public tNMEA2000 {
+public:
+  const std::vector<tBenchFrame> *Frames;
+  size_t NextFrame;
+  uint64_t LastFrameReadTime;
+
+  tNMEA2000_Bench() : Frames(0), NextFrame(0), LastFrameReadTime(0) {}
+  bool Done() const { return Frames==0 || NextFrame>=Frames->size(); }
+
+protected:
+  bool CANSendFrame(unsigned long, unsigned char, const unsigned char *, bool) { return true; }
+  bool CANOpen() { return true; }
+  bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf) {
+    if ( Done() ) return false;
+    const tBenchFrame &Frame=(*Frames)[NextFrame++];
+    id=Frame.id; len=Frame.len; memcpy(buf,Frame.buf,len);
+    LastFrameReadTime=NowNs();
+    return true;
+  }
+};
+
+static tNMEA2000_Bench *BenchNode=0;
+static std::vector<uint32_t> Latencies;
+
+static void HandleMsg(const tN2kMsg &) {
+  Latencies.push_back((uint32_t)(NowNs()-BenchNode->LastFrameReadTime));
+}
+
+//*****************************************************************************
+// Traffic generation
+typedef void (*tBuildMsg)(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char Instance);
+
+struct tTrafficSource {
+  unsigned char Source;
+  unsigned char Instance;
+  uint32_t PeriodUs;
+  bool FastPacket;
+  tBuildMsg Build;
+};
+
+static void BuildHeading(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) { SetN2kPGN127250(N2kMsg,Seq,1.0+Seq*1e-4,N2kDoubleNA,0.1,N2khr_true); }
+static void BuildRudder(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char Instance) { SetN2kPGN127245(N2kMsg,0.01*(Seq%10),Instance,N2kRDO_NoDirectionOrder,N2kDoubleNA); }
+static void BuildBoatSpeed(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) { SetN2kPGN128259(N2kMsg,Seq,3.5,N2kDoubleNA,N2kSWRT_Paddle_wheel); }
+static void BuildDepth(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) { SetN2kPGN128267(N2kMsg,Seq,12.5,0.5,100); }
+static void BuildPosition(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) { SetN2kPGN129025(N2kMsg,60.0+Seq*1e-6,25.0); }
+static void BuildCOGSOG(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) { SetN2kPGN129026(N2kMsg,Seq,N2khr_true,1.2,3.4); }
+static void BuildWind(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) { SetN2kPGN130306(N2kMsg,Seq,7.5,0.7,N2kWind_Apparent); }
+static void BuildGNSS(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char) {
+  SetN2kPGN129029(N2kMsg,Seq,19000,3600.0+Seq,60.0,25.0,10.0,N2kGNSSt_GPS,N2kGNSSm_GNSSfix,12,0.8,1.5,18.0,0,N2kGNSSt_GPS,0,N2kDoubleNA);
+}
+static void BuildEngineRapid(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char Instance) { SetN2kPGN127488(N2kMsg,Instance,1800+Seq%100,N2kDoubleNA,0); }
+static void BuildEngineDynamic(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char Instance) {
+  SetN2kPGN127489(N2kMsg,Instance,400000,363.0,353.0,14.2,20.5,3600.0*Seq,N2kDoubleNA,N2kDoubleNA,50,60,tN2kEngineDiscreteStatus1(),tN2kEngineDiscreteStatus2());
+}
+static void BuildAISClassA(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char Instance) {
+  SetN2kPGN129038(N2kMsg,1,N2kaisr_Initial,230000000+Instance,60.1,25.1,true,false,Seq%60,1.0,5.0,N2kaischannel_A_VDL_reception,1.0,0,N2kaisns_Under_Way_Motoring,0xff);
+}
+static void BuildAISClassB(tN2kMsg &N2kMsg, uint32_t Seq, unsigned char Instance) {
+  SetN2kPGN129039(N2kMsg,18,N2kaisr_Initial,230100000+Instance,60.2,25.2,true,false,Seq%60,1.0,4.0,N2kaischannel_A_VDL_reception,1.0,N2kaisunit_ClassB_SOTDMA,false,false,false,false,N2kaismode_Autonomous,false,0xff);
+}
+static void BuildAISStatic(tN2kMsg &N2kMsg, uint32_t, unsigned char Instance) {
+  SetN2kPGN129794(N2kMsg,5,N2kaisr_Initial,230000000+Instance,9000000+Instance,"OH1234","BENCH VESSEL",70,120,20,10,60,19000,3600,7.5,"HELSINKI",N2kaisv_ITU_R_M_1371_1,N2kGNSSt_GPS,N2kaisdte_Ready,N2kaischannel_A_VDL_reception,0xff);
+}
+
+//*****************************************************************************
+static void AddNavigationSources(std::vector<tTrafficSource> &Sources, uint32_t RapidUs) {
+  tTrafficSource Nav[]={
+    {10,0,RapidUs,false,BuildHeading},
+    {10,0,RapidUs,false,BuildRudder},
+    {11,0,250000,false,BuildCOGSOG},
+    {11,0,RapidUs,false,BuildPosition},
+    {11,0,1000000,true,BuildGNSS},
+    {12,0,1000000,false,BuildBoatSpeed},
+    {12,0,1000000,false,BuildDepth},
+    {13,0,RapidUs,false,BuildWind},
+  };
+  Sources.insert(Sources.end(),Nav,Nav+sizeof(Nav)/sizeof(Nav[0]));
+}
+
+//*****************************************************************************
+static void AddAISSources(std::vector<tTrafficSource> &Sources, unsigned char Targets) {
+  for (unsigned char i=0; i<Targets; i++) {
+    // Class A targets report every 2-10 s, class B every 30 s. Static data every 6 min.
+    tTrafficSource ClassA={20,i,(uint32_t)(2000000+(i%5)*2000000),true,BuildAISClassA};
+    tTrafficSource ClassB={20,(unsigned char)(i+128),30000000,true,BuildAISClassB};
+    tTrafficSource Static={20,i,360000000,true,BuildAISStatic};
+    Sources.push_back(ClassA);
+    Sources.push_back(ClassB);
+    Sources.push_back(Static);
+  }
+}
+
+//*****************************************************************************
+static void AddEngineSources(std::vector<tTrafficSource> &Sources, unsigned char Engines) {
+  for (unsigned char i=0; i<Engines; i++) {
+    tTrafficSource Rapid={(unsigned char)(40+i),i,100000,false,BuildEngineRapid};
+    tTrafficSource Dynamic={(unsigned char)(40+i),i,100000,true,BuildEngineDynamic};
+    Sources.push_back(Rapid);
+    Sources.push_back(Dynamic);
+  }
+}
+
+//*****************************************************************************
+static void AddFrame(std::vector<tBenchFrame> &Frames, unsigned long id, unsigned char len, const unsigned char *buf) {
+  tBenchFrame Frame;
+  Frame.id=id; Frame.len=len;
+  memset(Frame.buf,0xff,8);
+  memcpy(Frame.buf,buf,len);
+  Frames.push_back(Frame);
+}
+
+//*****************************************************************************
+// Split message to frames as sender library would do.
+static void MsgToFrames(std::vector<tBenchFrame> &Frames, const tN2kMsg &N2kMsg, bool FastPacket, unsigned char Sequence) {
+  unsigned long id=((unsigned long)(N2kMsg.Priority & 0x7)<<26) | (N2kMsg.PGN<<8) | N2kMsg.Source;
+
+  if ( !FastPacket ) {
+    AddFrame(Frames,id,N2kMsg.DataLen,N2kMsg.Data);
+    return;
+  }
+
+  unsigned char buf[8];
+  int Index=0;
+  buf[0]=(Sequence & 0x07)<<5;
+  buf[1]=N2kMsg.DataLen;
+  for (int i=2; i<8; i++) buf[i]=( Index<N2kMsg.DataLen ? N2kMsg.Data[Index++] : 0xff );
+  AddFrame(Frames,id,8,buf);
+  for (unsigned char Frame=1; Index<N2kMsg.DataLen; Frame++) {
+    buf[0]=((Sequence & 0x07)<<5) | (Frame & 0x1f);
+    for (int i=1; i<8; i++) buf[i]=( Index<N2kMsg.DataLen ? N2kMsg.Data[Index++] : 0xff );
+    AddFrame(Frames,id,8,buf);
+  }
+}
+
+//*****************************************************************************
+struct tProfile {
+  std::string Name;
+  std::vector<tBenchFrame> Frames;
+  size_t Messages;
+  double BusLoad;
+};
+
+//*****************************************************************************
+// Generates messages in time order and serializes frames on simulated bus.
+// Bus can not carry over 100% load, so on overload messages will be sent
+// back to back.
+static void GenerateProfile(tProfile &Profile, std::vector<tTrafficSource> &Sources, uint32_t Seconds) {
+  uint64_t Duration=(uint64_t)Seconds*1000000;
+  std::vector<uint64_t> NextTime(Sources.size());
+  std::vector<uint32_t> Seq(Sources.size(),0);
+  uint64_t BusFreeTime=0; // ns
+  uint64_t BusyTime=0;
+  tN2kMsg N2kMsg;
+
+  for (size_t i=0; i<Sources.size(); i++) NextTime[i]=(i*1733)%Sources[i].PeriodUs; // Spread offsets
+  Profile.Messages=0;
+
+  while ( true ) {
+    size_t Next=0;
+    for (size_t i=1; i<Sources.size(); i++) if ( NextTime[i]<NextTime[Next] ) Next=i;
+    if ( NextTime[Next]>=Duration ) break;
+
+    tTrafficSource &Source=Sources[Next];
+    N2kMsg.Clear();
+    Source.Build(N2kMsg,Seq[Next],Source.Instance);
+    N2kMsg.Source=Source.Source;
+    size_t FirstFrame=Profile.Frames.size();
+    MsgToFrames(Profile.Frames,N2kMsg,Source.FastPacket,Seq[Next]);
+    Profile.Messages++;
+    Seq[Next]++;
+
+    if ( BusFreeTime<NextTime[Next]*1000 ) BusFreeTime=NextTime[Next]*1000;
+    for (size_t i=FirstFrame; i<Profile.Frames.size(); i++) {
+      const tBenchFrame &Frame=Profile.Frames[i];
+      uint64_t FrameTime=(uint64_t)tN2kVirtualBus::FrameBitCount(Frame.id,Frame.len,Frame.buf)*4000; // 250 kbit/s
+      BusFreeTime+=FrameTime;
+      BusyTime+=FrameTime;
+    }
+    NextTime[Next]+=Source.PeriodUs;
+  }
+
+  uint64_t End=std::max(BusFreeTime,Duration*1000);
+  Profile.BusLoad=(double)BusyTime/End;
+}
+
+//*****************************************************************************
+static void SetupProfile(tProfile &Profile, const std::string &Name, uint32_t Seconds) {
+  std::vector<tTrafficSource> Sources;
+
+  Profile.Name=Name;
+  if ( Name=="sailing_yacht" ) {
+    AddNavigationSources(Sources,100000);
+    AddAISSources(Sources,60);
+  } else if ( Name=="motor_yacht" ) {
+    AddNavigationSources(Sources,100000);
+    AddEngineSources(Sources,2);
+    AddAISSources(Sources,10);
+  } else { // saturated
+    AddNavigationSources(Sources,10000);
+    AddEngineSources(Sources,4);
+    AddAISSources(Sources,100);
+    for (size_t i=0; i<Sources.size(); i++) Sources[i].PeriodUs=std::max(Sources[i].PeriodUs/4,(uint32_t)10000);
+  }
+  GenerateProfile(Profile,Sources,Seconds);
+}
+
+//*****************************************************************************
+static bool RunProfile(tProfile &Profile) {
+  size_t HeapBase=HeapInUse;
+  HeapPeak=HeapInUse;
+  Latencies.clear();
+  Latencies.reserve(Profile.Messages);
+  size_t HeapReserved=HeapInUse-HeapBase;
+
+  double Elapsed;
+  size_t PeakHeap;
+  {
+    tNMEA2000_Bench Node;
+    BenchNode=&Node;
+    Node.SetN2kCANMsgBufSize(10);
+    Node.SetMode(tNMEA2000::N2km_ListenOnly);
+    Node.EnableForward(false);
+    Node.SetMsgHandler(HandleMsg);
+    uint64_t Timeout=N2kMillis64()+2000;
+    while ( !Node.IsOpen() && N2kMillis64()<Timeout ) Node.ParseMessages();
+
+    Node.Frames=&Profile.Frames;
+    uint64_t Start=NowNs();
+    while ( !Node.Done() ) Node.ParseMessages();
+    Elapsed=(NowNs()-Start)/1e9;
+    PeakHeap=HeapPeak-HeapBase-HeapReserved+sizeof(Node);
+    BenchNode=0;
+  }
+
+  size_t Received=Latencies.size();
+  std::sort(Latencies.begin(),Latencies.end());
+  uint32_t P50=( Received>0 ? Latencies[Received/2] : 0 );
+  uint32_t P99=( Received>0 ? Latencies[std::min(Received-1,Received*99/100)] : 0 );
+  struct rusage Usage;
+  getrusage(RUSAGE_SELF,&Usage);
+
+  printf("{\"profile\":\"%s\",\"frames\":%zu,\"messages\":%zu,\"expected_messages\":%zu,"
+         "\"seconds\":%.6f,\"frames_per_sec\":%.0f,\"msgs_per_sec\":%.0f,"
+         "\"latency_p50_ns\":%u,\"latency_p99_ns\":%u,\"peak_heap_bytes\":%zu,\"max_rss_kb\":%ld,\"bus_load\":%.3f}\n",
+         Profile.Name.c_str(),Profile.Frames.size(),Received,Profile.Messages,
+         Elapsed,Profile.Frames.size()/Elapsed,Received/Elapsed,
+         P50,P99,PeakHeap,Usage.ru_maxrss,Profile.BusLoad);
+  fflush(stdout);
+
+  if ( Received!=Profile.Messages ) {
+    fprintf(stderr,"%s: received %zu messages, expected %zu\n",Profile.Name.c_str(),Received,Profile.Messages);
+    return false;
+  }
+  return true;
+}
+
+//*****************************************************************************
+int main(int argc, char **argv) {
+  uint32_t Seconds=60;
+  std::string Only;
+
+  for (int i=1; i<argc; i++) {
+    if ( strcmp(argv[i],"--quick")==0 ) {
+      Seconds=5;
+    } else if ( strcmp(argv[i],"--seconds")==0 && i+1<argc ) {
+      Seconds=atoi(argv[++i]);
+    } else if ( strcmp(argv[i],"--profile")==0 && i+1<argc ) {
+      Only=argv[++i];
+    } else {
+      fprintf(stderr,"Usage: %s [--quick] [--seconds N] [--profile sailing_yacht|motor_yacht|saturated]\n",argv[0]);
+      return 2;
+    }
+  }
+
+  const char *Profiles[]={"sailing_yacht","motor_yacht","saturated"};
+  bool Ok=true;
+
+  for (size_t i=0; i<sizeof(Profiles)/sizeof(Profiles[0]); i++) {
+    if ( !Only.empty() && Only!=Profiles[i] ) continue;
+    tProfile Profile;
+    SetupProfile(Profile,Profiles[i],Seconds);
+    Ok&=RunProfile(Profile);
+  }
+
+  return Ok?0:1;
+}
@@ -0,0 +1,218 @@
+#include <catch.hpp>
+#include <N2kFrameLog.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kMessages.h>
+#include <N2kTimer.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+//*****************************************************************************
+class tStringStream : public N2kStream {
+public:
+  std::string Data;
+  int read() { return -1; }
+  int peek() { return -1; }
+  size_t write(const uint8_t* data, size_t size) { Data.append((const char *)data,size); return size; }
+};
+
+#define RudderId 0x09f10d16UL    // 127245 from 22
+#define HeadingId 0x09f11216UL   // 127250 from 22
+#define ProductId 0x18ef0016UL   // PDU1 61184 to 0 from 22
+
+//*****************************************************************************
+// Writes 1000 frames 10 ms apart. Every 100th frame is heading, others rudder.
+static void WriteTestLog(tN2kFrameLogWriter &Writer) {
+  unsigned char buf[8]={0x01,0xff,0xff,0x10,0x00,0xff,0xff,0xff};
+
+  REQUIRE(Writer.Open(1700000000000000ULL));
+  for (uint32_t i=0; i<1000; i++) {
+    buf[3]=i; buf[4]=i>>8;
+    if ( i%100==50 ) {
+      Writer.WriteFrame(HeadingId,8,buf,false,1000000+i*10000);
+    } else {
+      Writer.WriteFrame(RudderId,(i%3==0?8:6),buf,i%2==0,1000000+i*10000);
+    }
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Frame log write and read", "[framelog]") {
+  tStringStream Log;
+  tN2kFrameLogWriter Writer(&Log,256,4);
+  tN2kFrameLogReader Reader;
+  tN2kFrameLogReader::tMemorySource Source;
+  tN2kFrameLogReader::tRecord Record;
+
+  WriteTestLog(Writer);
+  Writer.Close();
+  REQUIRE(Writer.GetFrameCount()==1000);
+  REQUIRE(Writer.GetSize()==Log.Data.size());
+  REQUIRE(Log.Data.size()<1000*N2kFrameLogRecordSize*2/3); // Compressed
+
+  Source.Set(Log.Data.data(),Log.Data.size());
+  REQUIRE(Reader.Open(&Source));
+  REQUIRE(Reader.GetStartTime()==1700000000000000ULL);
+  REQUIRE(Reader.GetBlockCount()>4); // Several index segments
+  REQUIRE(Reader.GetFirstTime()==1000000);
+  REQUIRE(Reader.GetLastTime()==1000000+999*10000);
+
+  SECTION("All frames") {
+    uint32_t Count=0;
+    while ( Reader.ReadNext(Record) ) {
+      REQUIRE(Record.Time==1000000+Count*10000);
+      REQUIRE(Record.buf[3]==(unsigned char)Count);
+      REQUIRE(Record.buf[4]==(unsigned char)(Count>>8));
+      if ( Count%100==50 ) {
+        REQUIRE(Record.id==HeadingId);
+      } else {
+        REQUIRE(Record.id==RudderId);
+        REQUIRE(Record.len==(Count%3==0?8:6));
+        REQUIRE(Record.Tx==(Count%2==0));
+      }
+      Count++;
+    }
+    REQUIRE(Count==1000);
+  }
+
+  SECTION("Time range") {
+    Reader.Seek(1000000+500*10000,1000000+509*10000);
+    uint32_t Count=0;
+    while ( Reader.ReadNext(Record) ) {
+      REQUIRE(Record.Time==1000000+(500+Count)*10000);
+      Count++;
+    }
+    REQUIRE(Count==10);
+  }
+
+  SECTION("PGN filter") {
+    Reader.Seek(0,0xffffffffffffffffULL,127250L);
+    uint32_t Count=0;
+    while ( Reader.ReadNext(Record) ) {
+      REQUIRE(Record.id==HeadingId);
+      REQUIRE(Record.Time==1000000+(Count*100+50)*10000);
+      Count++;
+    }
+    REQUIRE(Count==10);
+
+    Reader.Seek(0,0xffffffffffffffffULL,129025L);
+    REQUIRE_FALSE(Reader.ReadNext(Record));
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Frame log details", "[framelog]") {
+  tStringStream Log;
+  tN2kFrameLogWriter Writer(&Log,256,4);
+  tN2kFrameLogReader Reader;
+  tN2kFrameLogReader::tMemorySource Source;
+  tN2kFrameLogReader::tRecord Record;
+
+  SECTION("Missing trailer") {
+    WriteTestLog(Writer);
+    Writer.Flush();
+    // Drop partial data as on power loss
+    std::string Data=Log.Data+"N2KB";
+    Source.Set(Data.data(),Data.size());
+
+    REQUIRE(Reader.Open(&Source));
+    REQUIRE(Reader.GetBlockCount()>4);
+    Reader.Seek(1000000+990*10000);
+    uint32_t Count=0;
+    while ( Reader.ReadNext(Record) ) Count++;
+    REQUIRE(Count==10);
+  }
+
+  SECTION("Long gap and PDU1") {
+    unsigned char buf[3]={0x14,0xf0,0x01};
+    REQUIRE(Writer.Open());
+    Writer.WriteFrame(ProductId,3,buf,true,1000);
+    Writer.WriteFrame(ProductId,3,buf,true,3600000000ULL);
+    Writer.WriteFrame(ProductId,3,buf,true,100); // Clamped to previous time
+    Writer.Close();
+
+    Source.Set(Log.Data.data(),Log.Data.size());
+    REQUIRE(Reader.Open(&Source));
+    Reader.Seek(0,0xffffffffffffffffULL,61184L);
+    REQUIRE(Reader.ReadNext(Record));
+    REQUIRE(Record.Time==1000);
+    REQUIRE(Record.len==3);
+    REQUIRE(Record.Tx);
+    REQUIRE(Reader.ReadNext(Record));
+    REQUIRE(Record.Time==3600000000ULL);
+    REQUIRE(Reader.ReadNext(Record));
+    REQUIRE(Record.Time==3600000000ULL);
+    REQUIRE_FALSE(Reader.ReadNext(Record));
+  }
+
+  SECTION("Not a frame log") {
+    Source.Set("N2KFRAW1\0\0\0\0\0\0\0\0",16);
+    REQUIRE_FALSE(Reader.Open(&Source));
+    REQUIRE_FALSE(Reader.ReadNext(Record));
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Frame log from tNMEA2000", "[framelog]") {
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[2];
+  tStringStream Log;
+  tN2kFrameLogWriter Writer(&Log);
+  tN2kFrameLogReader Reader;
+  tN2kFrameLogFile File;
+  tN2kFrameLogReader::tRecord Record;
+  tN2kMsg N2kMsg;
+  char FileName[]="/tmp/N2kFrameLogTestXXXXXX";
+
+  for (size_t i=0; i<2; i++) {
+    Nodes[i].SetBus(&Bus);
+    Nodes[i].SetDeviceInformation(3000+i,130,25,2046);
+    Nodes[i].SetMode(tNMEA2000::N2km_ListenAndNode,40+i);
+    Nodes[i].EnableForward(false);
+    Nodes[i].Open();
+  }
+  REQUIRE(Writer.Open());
+  Nodes[1].SetFrameMonitor(&Writer);
+
+  uint64_t End=N2kMillis64()+500;
+  while ( N2kMillis64()<End ) {
+    Nodes[0].ParseMessages();
+    Nodes[1].ParseMessages();
+  }
+  SetN2kRudder(N2kMsg,0.1);
+  Nodes[1].SendMsg(N2kMsg);
+  SetN2kGNSS(N2kMsg,1,19000,43200,60.1,22.5,10.0,N2kGNSSt_GPS,N2kGNSSm_GNSSfix,12,0.8); // Fast packet
+  Nodes[0].SendMsg(N2kMsg);
+  End=N2kMillis64()+50;
+  while ( N2kMillis64()<End ) {
+    Nodes[0].ParseMessages();
+    Nodes[1].ParseMessages();
+  }
+  Writer.Close();
+
+  int Handle=mkstemp(FileName);
+  REQUIRE(Handle>=0);
+  REQUIRE(write(Handle,Log.Data.data(),Log.Data.size())==(ssize_t)Log.Data.size());
+  close(Handle);
+  REQUIRE(File.Open(FileName));
+  unlink(FileName);
+  REQUIRE(Reader.Open(&File));
+
+  size_t RudderTx=0, GNSSRx=0, ClaimTx=0, ClaimRx=0;
+  uint64_t LastTime=0;
+  while ( Reader.ReadNext(Record) ) {
+    REQUIRE(Record.Time>=LastTime);
+    LastTime=Record.Time;
+    unsigned long PGN=tN2kFrameLogReader::GetPGN(Record.id);
+    if ( PGN==127245L && Record.Tx ) RudderTx++;
+    if ( PGN==129029L && !Record.Tx ) GNSSRx++;
+    if ( PGN==60928L ) {
+      if ( Record.Tx ) { ClaimTx++; } else { ClaimRx++; }
+    }
+  }
+  REQUIRE(Writer.GetFrameCount()>0);
+  REQUIRE(RudderTx==1);
+  REQUIRE(GNSSRx==7);
+  REQUIRE(ClaimTx>=1);
+  REQUIRE(ClaimRx>=1);
+}
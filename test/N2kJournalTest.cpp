@@ -0,0 +1,238 @@
+#include <catch.hpp>
+#include <N2kJournal.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kTimer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//*****************************************************************************
+class tTempFile {
+public:
+  char Name[32];
+  tTempFile() {
+    strcpy(Name,"/tmp/N2kJournalTestXXXXXX");
+    int Handle=mkstemp(Name);
+    if ( Handle>=0 ) close(Handle);
+  }
+  ~tTempFile() { unlink(Name); }
+};
+
+//*****************************************************************************
+// Storage, which fails all writes after given count like on power loss
+class tFailingStorage : public tN2kJournalStorage {
+public:
+  tN2kJournalStorage *Storage;
+  int WritesLeft;
+  tFailingStorage(tN2kJournalStorage *_Storage, int _WritesLeft) : Storage(_Storage), WritesLeft(_WritesLeft) {}
+  uint32_t GetSize() { return Storage->GetSize(); }
+  uint32_t GetCapacity() { return Storage->GetCapacity(); }
+  bool Read(uint32_t Offset, void *Buf, size_t Len) { return Storage->Read(Offset,Buf,Len); }
+  bool Write(uint32_t Offset, const void *Buf, size_t Len) {
+    if ( WritesLeft==0 ) return false;
+    WritesLeft--;
+    return Storage->Write(Offset,Buf,Len);
+  }
+  bool Erase(uint32_t Offset, uint32_t Len) {
+    if ( WritesLeft==0 ) return false;
+    WritesLeft--;
+    return Storage->Erase(Offset,Len);
+  }
+};
+
+//*****************************************************************************
+static void ParseFor(tNMEA2000_Virtual *Nodes, size_t Count, uint32_t ms) {
+  uint64_t End=N2kMillis64()+ms;
+  while ( N2kMillis64()<End ) {
+    for (size_t i=0; i<Count; i++) Nodes[i].ParseMessages();
+  }
+}
+
+//*****************************************************************************
+static bool ReadString(tN2kJournal &Journal, uint8_t Key, char *Buf, uint8_t Size) {
+  uint8_t Len=Size-1;
+  if ( !Journal.Read(Key,Buf,Len) ) return false;
+  Buf[Len]=0;
+  return true;
+}
+
+//*****************************************************************************
+TEST_CASE("Journal write and read", "[journal]") {
+  tTempFile File;
+  tN2kJournalFile Storage;
+  char Buf[32];
+
+  REQUIRE(Storage.Open(File.Name,128));
+  tN2kJournal Journal(&Storage,4);
+  REQUIRE(Journal.Open());
+  REQUIRE(Journal.GetSize()==0);
+
+  REQUIRE(Journal.Write(1,"first",5));
+  REQUIRE(Journal.Write(2,"x",1));
+  REQUIRE(Journal.Write(1,"second",6));
+  REQUIRE(Journal.Write(1,"second",6)); // Unchanged, not written
+  REQUIRE(Journal.GetWriteCount()==3);
+  REQUIRE(Journal.GetSize()==5+1+6+3*N2kJournalRecordOverhead);
+  REQUIRE(ReadString(Journal,1,Buf,sizeof(Buf)));
+  REQUIRE(strcmp(Buf,"second")==0);
+  REQUIRE_FALSE(Journal.Contains(3));
+
+  SECTION("Reopen") {
+    tN2kJournal Reopened(&Storage,4);
+    REQUIRE(Reopened.Open());
+    REQUIRE(Reopened.GetCount()==2);
+    REQUIRE(ReadString(Reopened,1,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"second")==0);
+    REQUIRE(ReadString(Reopened,2,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"x")==0);
+  }
+
+  SECTION("Compact when full") {
+    for (int i=0; i<20; i++) {
+      snprintf(Buf,sizeof(Buf),"value %i",i);
+      REQUIRE(Journal.Write(1,Buf,strlen(Buf)));
+    }
+    REQUIRE(Journal.GetCompactCount()>0);
+    REQUIRE(Journal.GetSize()<=64-N2kJournalAreaHeaderSize);
+
+    tN2kJournal Reopened(&Storage,4);
+    REQUIRE(Reopened.Open());
+    REQUIRE(ReadString(Reopened,1,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"value 19")==0);
+    REQUIRE(ReadString(Reopened,2,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"x")==0);
+    char Long[50];
+    memset(Long,'a',sizeof(Long));
+    REQUIRE_FALSE(Journal.Write(3,Long,sizeof(Long))); // Does not fit even after compaction
+  }
+
+  SECTION("Broken record") {
+    unsigned char Partial[4]={ N2kJournalMarker, 2, 5, 'y' }; // Power lost during write
+    REQUIRE(Storage.Write(Storage.GetSize(),Partial,sizeof(Partial))); // After last record on first area
+
+    tN2kJournal Reopened(&Storage,4);
+    REQUIRE(Reopened.Open());
+    REQUIRE(Reopened.GetCompactCount()==1);
+    REQUIRE(Reopened.GetSize()==6+1+2*N2kJournalRecordOverhead);
+    REQUIRE(Reopened.Write(2,"z",1));
+
+    tN2kJournal Again(&Storage,4);
+    REQUIRE(Again.Open());
+    REQUIRE(ReadString(Again,2,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"z")==0);
+    REQUIRE(ReadString(Again,1,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"second")==0);
+  }
+
+  SECTION("Too many keys") {
+    tN2kJournal Small(&Storage,1);
+    REQUIRE_FALSE(Small.Open()); // Compaction would lose key
+    REQUIRE_FALSE(Small.Write(1,"a",1));
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Journal power loss during compaction", "[journal]") {
+  char Buf[32];
+  bool Done=false;
+
+  // Lose power after each write step of compaction in turn. Values must survive always.
+  for (int Writes=0; Writes<32 && !Done; Writes++) {
+    tTempFile File;
+    tN2kJournalFile Storage;
+    REQUIRE(Storage.Open(File.Name,128));
+    {
+      tN2kJournal Journal(&Storage,4);
+      REQUIRE(Journal.Open());
+      REQUIRE(Journal.Write(1,"first",5));
+      REQUIRE(Journal.Write(2,"x",1));
+      REQUIRE(Journal.Write(1,"second",6));
+      REQUIRE(Journal.Compact()); // Move to second area, so that next compaction erases first one
+    }
+
+    tFailingStorage Failing(&Storage,Writes);
+    {
+      tN2kJournal Journal(&Failing,4);
+      REQUIRE(Journal.Open());
+      Done=Journal.Compact();
+    }
+
+    tN2kJournal Reopened(&Storage,4);
+    REQUIRE(Reopened.Open());
+    REQUIRE(ReadString(Reopened,1,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"second")==0);
+    REQUIRE(ReadString(Reopened,2,Buf,sizeof(Buf)));
+    REQUIRE(strcmp(Buf,"x")==0);
+    REQUIRE(Reopened.Write(3,"new",3));
+  }
+  REQUIRE(Done);
+}
+
+//*****************************************************************************
+TEST_CASE("Journal settings from tNMEA2000", "[journal]") {
+  tTempFile File;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[2];
+  char Buf[Max_N2kConfigurationInfoField_len];
+
+  {
+    tN2kJournalFile Storage;
+    REQUIRE(Storage.Open(File.Name));
+    tN2kJournal Journal(&Storage);
+    REQUIRE(Journal.Open());
+
+    // Node 0 has lower NAME and keeps address 40, so node 1 has to change.
+    for (size_t i=0; i<2; i++) {
+      Nodes[i].SetBus(&Bus);
+      Nodes[i].SetDeviceInformation(1000+i,130,25,2046);
+      Nodes[i].SetMode(tNMEA2000::N2km_ListenAndNode,40);
+      Nodes[i].EnableForward(false);
+    }
+    Nodes[1].SetJournal(&Journal);
+    Nodes[0].Open();
+    ParseFor(Nodes,1,300);
+    Nodes[1].Open();
+    ParseFor(Nodes,2,600);
+    REQUIRE(Nodes[0].GetN2kSource()==40);
+    REQUIRE(Nodes[1].GetN2kSource()!=40);
+
+    Nodes[1].SetDeviceInformationInstances(3,1,2);
+    Nodes[1].SetInstallationDescription1("Engine room");
+    Nodes[1].SetHeartbeatIntervalAndOffset(5000,300);
+    ParseFor(Nodes,2,10);
+    uint32_t Writes=Journal.GetWriteCount();
+    REQUIRE(Writes>=5);
+
+    // Unchanged settings will not be written again.
+    Nodes[1].SetInstallationDescription1("Engine room");
+    ParseFor(Nodes,2,10);
+    REQUIRE(Journal.GetWriteCount()==Writes);
+  }
+
+  // Restart node 1 with same journal
+  tNMEA2000_Virtual Node;
+  tN2kJournalFile Storage;
+  REQUIRE(Storage.Open(File.Name));
+  tN2kJournal Journal(&Storage);
+  REQUIRE(Journal.Open());
+  Node.SetBus(&Bus);
+  Node.SetDeviceInformation(1001,130,25,2046);
+  Node.SetInstallationDescription1("Default");
+  Node.SetMode(tNMEA2000::N2km_ListenAndNode,40);
+  Node.EnableForward(false);
+  Node.SetJournal(&Journal);
+  Node.ReadResetInstallationDescriptionChanged();
+  unsigned char ExpectedSource=Nodes[1].GetN2kSource();
+  Node.Open();
+  ParseFor(&Node,1,300);
+
+  REQUIRE(Node.GetN2kSource()==ExpectedSource);
+  REQUIRE(Node.GetDeviceInformation().GetDeviceInstance()==((1<<3) | 3));
+  REQUIRE(Node.GetDeviceInformation().GetSystemInstance()==2);
+  REQUIRE(Node.GetHeartbeatInterval()==5000);
+  REQUIRE(Node.GetHeartbeatOffset()==300);
+  Node.GetInstallationDescription1(Buf,sizeof(Buf));
+  REQUIRE(strcmp(Buf,"Engine room")==0);
+  REQUIRE_FALSE(Node.ReadResetInstallationDescriptionChanged());
+}
@@ -0,0 +1,251 @@
+#include <catch.hpp>
+#include <N2kLogReplay.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kMessages.h>
+#include <Seasmart.h>
+#include <N2kStream.h>
+#include <N2kTimer.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+//*****************************************************************************
+class tStringStream : public N2kStream {
+public:
+  std::string Data;
+  int read() { return -1; }
+  int peek() { return -1; }
+  size_t write(const uint8_t* data, size_t size) { Data.append((const char *)data,size); return size; }
+};
+
+static std::vector<tN2kMsg> ReplayedMsgs;
+
+static void HandleMsg(const tN2kMsg &N2kMsg) {
+  ReplayedMsgs.push_back(N2kMsg);
+}
+
+static const char CandumpLog[]=
+  "(1436509052.249713) can0 09F80104#0D0A1B2C3D4E5F60\n"
+  "(1436509052.350000) can0 123#0102\n"
+  "(1436509052.449713) can0 09F80104#0E0A1B2C3D4E5F60\n";
+
+static const char CandumpScreen[]=
+  "  can0  09F80104   [8]  0D 0A 1B 2C 3D 4E 5F 60\r\n"
+  "\r\n"
+  "  can0  09F80104   [8]  0D 0A 1B 2C\r\n"
+  "  can0  09F80104   [3]  01 02 03\r\n";
+
+//*****************************************************************************
+TEST_CASE("Log format detection", "[replay]") {
+  tStringStream Actisense;
+  tN2kMsg N2kMsg;
+  char Seasmart[100];
+
+  SetN2kRudder(N2kMsg,0.1);
+  N2kMsg.SendInActisenseFormat(&Actisense);
+  N2kToSeasmart(N2kMsg,1234,Seasmart,sizeof(Seasmart));
+  unsigned char Raw[16]={'N','2','K','F','R','A','W','1',0,0,0,0,0,0,0,0};
+
+  REQUIRE(tN2kLogReplay::DetectFormat((const unsigned char *)Actisense.Data.data(),Actisense.Data.size())==tN2kLogReplay::lf_Actisense);
+  REQUIRE(tN2kLogReplay::DetectFormat((const unsigned char *)Seasmart,strlen(Seasmart))==tN2kLogReplay::lf_Seasmart);
+  REQUIRE(tN2kLogReplay::DetectFormat((const unsigned char *)CandumpLog,strlen(CandumpLog))==tN2kLogReplay::lf_Candump);
+  REQUIRE(tN2kLogReplay::DetectFormat((const unsigned char *)CandumpScreen,strlen(CandumpScreen))==tN2kLogReplay::lf_Candump);
+  REQUIRE(tN2kLogReplay::DetectFormat(Raw,sizeof(Raw))==tN2kLogReplay::lf_RawFrames);
+  REQUIRE(tN2kLogReplay::DetectFormat((const unsigned char *)"hello\n",6)==tN2kLogReplay::lf_Unknown);
+}
+
+//*****************************************************************************
+TEST_CASE("Log decoding", "[replay]") {
+  tN2kLogReplay Replay;
+  tN2kLogReplay::tRecord Record;
+  tN2kMsg N2kMsg;
+
+  SECTION("Actisense") {
+    tStringStream Log;
+    SetN2kRudder(N2kMsg,0.1);
+    N2kMsg.Source=16; // Escaped on stream
+    N2kMsg.SendInActisenseFormat(&Log);
+    size_t Corrupt=Log.Data.size()+8;
+    SetN2kTemperature(N2kMsg,1,1,N2kts_MainCabinTemperature,293.0);
+    N2kMsg.SendInActisenseFormat(&Log);
+    Log.Data[Corrupt]^=0x01;
+    SetN2kWindSpeed(N2kMsg,1,5.0,1.0,N2kWind_Apparent);
+    N2kMsg.SendInActisenseFormat(&Log);
+
+    REQUIRE(Replay.OpenBuffer(Log.Data.data(),Log.Data.size()));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Type==tN2kLogReplay::rt_Msg);
+    REQUIRE(Record.Msg.PGN==127245L);
+    REQUIRE(Record.Msg.Source==16);
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Msg.PGN==130306L);
+    REQUIRE(Record.Msg.DataLen==N2kMsg.DataLen);
+    REQUIRE(memcmp(Record.Msg.Data,N2kMsg.Data,N2kMsg.DataLen)==0);
+    REQUIRE_FALSE(Replay.ReadNext(Record));
+    REQUIRE(Replay.GetErrorCount()==1);
+  }
+
+  SECTION("Actisense empty frame") {
+    // Other Actisense message followed by empty frame must not let empty frame be classified by previous data.
+    std::string Log("\x10\x02\xa0\x01\x00\x5f\x10\x03" "\x10\x02\x10\x03",12);
+    tStringStream Msg;
+    SetN2kRudder(N2kMsg,0.1);
+    N2kMsg.SendInActisenseFormat(&Msg);
+    Log+=Msg.Data;
+
+    REQUIRE(Replay.OpenBuffer(Log.data(),Log.size()));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Msg.PGN==127245L);
+    REQUIRE(Replay.GetErrorCount()==1);
+  }
+
+  SECTION("Seasmart") {
+    std::string Log="$GPGGA,skipped*00\r\n";
+    char Line[100];
+    SetN2kRudder(N2kMsg,0.1);
+    N2kMsg.Source=22;
+    N2kToSeasmart(N2kMsg,1000,Line,sizeof(Line));
+    Log+=Line; Log+="\r\n";
+    N2kToSeasmart(N2kMsg,1100,Line,sizeof(Line));
+    Log+=Line;
+
+    REQUIRE(Replay.OpenBuffer(Log.data(),Log.size()));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Msg.PGN==127245L);
+    REQUIRE(Record.Msg.Source==22);
+    REQUIRE(Record.Time==1000000);
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Time==1100000);
+    REQUIRE_FALSE(Replay.ReadNext(Record));
+    REQUIRE(Replay.GetErrorCount()==0);
+  }
+
+  SECTION("Candump log") {
+    REQUIRE(Replay.OpenBuffer(CandumpLog,strlen(CandumpLog)));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Type==tN2kLogReplay::rt_Frame);
+    REQUIRE(Record.id==0x09F80104);
+    REQUIRE(Record.len==8);
+    REQUIRE(Record.buf[0]==0x0D);
+    REQUIRE(Record.Time==1436509052249713ULL);
+    REQUIRE(Replay.ReadNext(Record)); // Standard frame skipped
+    REQUIRE(Record.buf[0]==0x0E);
+    REQUIRE_FALSE(Replay.ReadNext(Record));
+    REQUIRE(Replay.GetRecordCount()==2);
+  }
+
+  SECTION("Candump screen") {
+    REQUIRE(Replay.OpenBuffer(CandumpScreen,strlen(CandumpScreen)));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.len==8);
+    REQUIRE(Record.buf[7]==0x60);
+    REQUIRE(Replay.ReadNext(Record)); // Short line is error
+    REQUIRE(Record.len==3);
+    REQUIRE(Record.buf[2]==0x03);
+    REQUIRE(Replay.GetErrorCount()==1);
+  }
+
+  SECTION("Raw frames") {
+    unsigned char Raw[4*16]={
+      'N','2','K','F','R','A','W','1', 0x10,0x27,0,0,0,0,0,0,                         // Start 10000 us
+      0xe8,0x03,0,0x20, 0x04,0x01,0xf8,0x09, 1,2,0xff,0xff,0xff,0xff,0xff,0xff,       // +1000 us, len 2
+      0,0,0,0xf0, 0,0,0,0, 0x40,0x42,0x0f,0,0,0,0,0,                                 // Sync 1000000 us
+      0x0a,0,0,0x80, 0x04,0x01,0xf8,0x09, 1,2,3,4,5,6,7,8                             // +10 us, len 8
+    };
+    REQUIRE(Replay.OpenBuffer(Raw,sizeof(Raw)));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.id==0x09f80104);
+    REQUIRE(Record.len==2);
+    REQUIRE(Record.Time==11000);
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.len==8);
+    REQUIRE(Record.buf[7]==8);
+    REQUIRE(Record.Time==1000010);
+    REQUIRE_FALSE(Replay.ReadNext(Record));
+  }
+
+  SECTION("Frame log") {
+    tStringStream Log;
+    tN2kFrameLogWriter Writer(&Log);
+    unsigned char Buf[8]={1,2,3,4,5,6,7,8};
+
+    Writer.Open(5000);
+    Writer.WriteFrame(0x09f80104,8,Buf,false,10000);
+    Buf[0]=9;
+    Writer.WriteFrame(0x09f80104,8,Buf,true,10500);
+    Writer.Close();
+
+    REQUIRE(tN2kLogReplay::DetectFormat((const unsigned char *)Log.Data.data(),Log.Data.size())==tN2kLogReplay::lf_FrameLog);
+    REQUIRE(Replay.OpenBuffer(Log.Data.data(),Log.Data.size()));
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Type==tN2kLogReplay::rt_Frame);
+    REQUIRE(Record.id==0x09f80104);
+    REQUIRE(Record.len==8);
+    REQUIRE(Record.buf[0]==1);
+    REQUIRE(Record.Time==10000);
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.buf[0]==9);
+    REQUIRE(Record.Time==10500);
+    REQUIRE_FALSE(Replay.ReadNext(Record));
+    REQUIRE(Replay.IsEnd());
+
+    Replay.Rewind();
+    REQUIRE(Replay.ReadNext(Record));
+    REQUIRE(Record.Time==10000);
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Log replay to tNMEA2000", "[replay]") {
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual NMEA2000(&Bus);
+  tN2kLogReplay Replay;
+  char FileName[]="/tmp/N2kLogReplayTestXXXXXX";
+  int Handle=mkstemp(FileName);
+  REQUIRE(Handle>=0);
+
+  // Fast packet 129029 split to frames, 100 ms between frames
+  const char Log[]=
+    "(1.000000) can0 0DF80500#00102B5A4D008C0C\n"
+    "(1.100000) can0 0DF80500#01E0C8E8D7EC20A4\n"
+    "(1.200000) can0 0DF80500#0207A7C09F05D03D\n"
+    "(1.300000) can0 0DF80500#03270FD81A0002FF\n"
+    "(1.400000) can0 0DF80500#04FFFFFFFFFFFFFF\n"
+    "(1.500000) can0 0DF80500#05FFFFFFFF10FCBF\n"
+    "(1.600000) can0 0DF80500#06FFFF0000FFFFFF\n";
+  REQUIRE(write(Handle,Log,strlen(Log))==(ssize_t)strlen(Log));
+  close(Handle);
+
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  NMEA2000.EnableForward(false);
+  NMEA2000.SetMsgHandler(HandleMsg);
+  ReplayedMsgs.clear();
+  REQUIRE(Replay.Open(FileName));
+  unlink(FileName);
+  REQUIRE(Replay.GetFormat()==tN2kLogReplay::lf_Candump);
+
+  SECTION("As fast as possible") {
+    uint64_t Timeout=N2kMillis64()+1000;
+    while ( !Replay.IsEnd() && N2kMillis64()<Timeout ) Replay.Replay(NMEA2000);
+
+    REQUIRE(Replay.IsEnd());
+    REQUIRE(ReplayedMsgs.size()==1);
+    REQUIRE(ReplayedMsgs[0].PGN==129029L);
+    REQUIRE(ReplayedMsgs[0].Source==0);
+  }
+
+  SECTION("Time scaled") {
+    uint64_t Timeout=N2kMillis64()+1000;
+    while ( !NMEA2000.IsOpen() && N2kMillis64()<Timeout ) NMEA2000.ParseMessages();
+    Replay.SetTimeScale(10); // 10 ms between frames
+
+    REQUIRE(Replay.Replay(NMEA2000)==1);
+    REQUIRE(Replay.Replay(NMEA2000)==0);
+    uint64_t Start=N2kMillis64();
+    while ( !Replay.IsEnd() ) Replay.Replay(NMEA2000);
+
+    REQUIRE(N2kMillis64()-Start>=50);
+    REQUIRE(ReplayedMsgs.size()==1);
+  }
+}
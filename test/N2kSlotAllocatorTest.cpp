@@ -0,0 +1,169 @@
+#include <catch.hpp>
+#include <N2kSlotAllocator.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kMessages.h>
+#include <N2kTimer.h>
+#include <map>
+#include <set>
+
+//*****************************************************************************
+static bool ProduceRudder(tN2kMsg &N2kMsg, int /*iDev*/) {
+  SetN2kRudder(N2kMsg,0.1);
+  return true;
+}
+
+//*****************************************************************************
+// Counts frames sent by nodes on 10 ms bins
+class tBinMonitor : public tNMEA2000::tFrameMonitor {
+public:
+  std::map<uint64_t,uint32_t> Bins;
+  unsigned long PGN;
+  tBinMonitor(unsigned long _PGN) : PGN(_PGN) {}
+  void HandleFrame(unsigned long id, unsigned char /*len*/, const unsigned char * /*buf*/, bool Tx, uint64_t FrameTime) {
+    if ( Tx && ((id>>8) & 0x3ffff)==PGN ) Bins[FrameTime/10000]++;
+  }
+  uint32_t GetPeak() const {
+    uint32_t Peak=0;
+    for (std::map<uint64_t,uint32_t>::const_iterator it=Bins.begin(); it!=Bins.end(); ++it) {
+      if ( it->second>Peak ) Peak=it->second;
+    }
+    return Peak;
+  }
+};
+
+//*****************************************************************************
+TEST_CASE("Slot allocator", "[slots]") {
+  tN2kSlotAllocator Allocator(10,100);
+
+  SECTION("Spreads periodic transmissions") {
+    tN2kSlotAllocator Golden(10,100);
+    std::set<uint32_t> Phases;
+    // Mixed periods as on gateway: 100 ms rudder, 250 ms attitude, 1000 ms fast packets
+    const uint32_t Periods[]={ 100,100,100,100,100,100,250,250,250,250,1000,1000,1000,1000 };
+    const uint8_t Frames[]={ 1,1,1,1,1,1,1,1,1,1,3,3,3,3 };
+    for (size_t i=0; i<sizeof(Periods)/sizeof(Periods[0]); i++) {
+      uint32_t Offset=Allocator.Allocate(Periods[i],Frames[i]);
+      REQUIRE(Offset<Periods[i]);
+      if ( Periods[i]==100 ) Phases.insert(Offset);
+      Golden.Reserve(Periods[i],(uint32_t)(((uint64_t)(i*40503U & 0xffff)*Periods[i])>>16),Frames[i]);
+    }
+    REQUIRE(Phases.size()==6);
+    REQUIRE(Allocator.GetPeakReserved()<=3);
+    REQUIRE(Allocator.GetPeakReserved()<Golden.GetPeakReserved());
+  }
+
+  SECTION("Offset keeps min offset") {
+    uint32_t First=Allocator.Allocate(60000,1,10000);
+    uint32_t Second=Allocator.Allocate(60000,1,10000);
+    REQUIRE(First>=10000);
+    REQUIRE(Second>=10000);
+    REQUIRE(Second<11000);
+    REQUIRE(First!=Second);
+  }
+
+  SECTION("Avoids measured load") {
+    // Other node sends burst of 5 frames at 30 ms phase of each 100 ms
+    for (uint64_t t=0; t<1000; t+=100) {
+      for (int i=0; i<5; i++) Allocator.AddFrame(t+32);
+    }
+    Allocator.AddFrame(1000); // Next window, previous measurement predicts load
+    for (int i=0; i<9; i++) {
+      uint32_t Offset=Allocator.Allocate(100,1);
+      REQUIRE(Offset/10!=3);
+    }
+  }
+
+  SECTION("Single transmissions are spread") {
+    uint32_t First=Allocator.GetDelay(0,150,100,20);
+    uint32_t Second=Allocator.GetDelay(0,150,100,20);
+    REQUIRE(First>=150);
+    REQUIRE(First<=250);
+    REQUIRE(Second>=150);
+    REQUIRE(Second<=250);
+    REQUIRE(First/10!=Second/10);
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Slot allocation on tNMEA2000", "[slots]") {
+  const int DeviceCount=8;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Gateway;
+  tNMEA2000_Virtual Display;
+  tN2kSlotAllocator Allocator;
+  tBinMonitor Monitor(127245L);
+  uint32_t Period, Offset;
+
+  Gateway.SetBus(&Bus);
+  Gateway.SetDeviceCount(DeviceCount);
+  for (int i=0; i<DeviceCount; i++) Gateway.SetDeviceInformation(4000+i,130,25,2046,4,i);
+  Gateway.SetMode(tNMEA2000::N2km_ListenAndNode,60);
+  Gateway.EnableForward(false);
+  Gateway.SetSlotAllocator(&Allocator);
+  for (int i=0; i<DeviceCount; i++) {
+    REQUIRE(Gateway.AddPeriodicMsg(127245L,100,ProduceRudder,0xffffffff,i));
+  }
+  Gateway.SetFrameMonitor(&Monitor);
+  Display.SetBus(&Bus);
+  Display.SetDeviceInformation(5000,130,25,2046);
+  Display.SetMode(tNMEA2000::N2km_ListenAndNode,80);
+  Display.EnableForward(false);
+  Gateway.Open();
+  Display.Open();
+
+  std::set<uint32_t> Phases;
+  for (int i=0; i<DeviceCount; i++) {
+    REQUIRE(Gateway.GetPeriodicMsgInterval(127245L,Period,Offset,i));
+    Phases.insert(Offset/10);
+  }
+  REQUIRE(Phases.size()==DeviceCount);
+
+  uint64_t End=N2kMillis64()+1500;
+  while ( N2kMillis64()<End ) {
+    Gateway.ParseMessages();
+    Display.ParseMessages();
+  }
+
+  std::set<uint32_t> HeartbeatOffsets;
+  for (int i=0; i<DeviceCount; i++) {
+    REQUIRE(Gateway.GetHeartbeatOffset(i)>=10000);
+    HeartbeatOffsets.insert(Gateway.GetHeartbeatOffset(i));
+  }
+  REQUIRE(HeartbeatOffsets.size()==DeviceCount);
+
+  // All devices send rudder every 100 ms, but on own 10 ms slots.
+  REQUIRE(Monitor.Bins.size()>=DeviceCount*8);
+  REQUIRE(Monitor.GetPeak()<=2);
+}
+
+//*****************************************************************************
+TEST_CASE("Slot allocator measures own traffic", "[slots]") {
+  tN2kVirtualClock Clock;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Node;
+  tN2kSlotAllocator Allocator;
+  tN2kMsg N2kMsg;
+  uint32_t Period, Offset;
+
+  Node.SetBus(&Bus);
+  Node.SetDeviceInformation(6000,130,25,2046);
+  Node.SetMode(tNMEA2000::N2km_ListenAndNode,60);
+  Node.EnableForward(false);
+  Node.SetSlotAllocator(&Allocator);
+  Node.Open();
+
+  // Own burst of 5 messages at 10 ms phase of each 100 ms. Heartbeat has
+  // reserved 0 ms phase, so without measurement 10 ms would be selected.
+  SetN2kRudder(N2kMsg,0.1);
+  for (int Step=0; Step<25000; Step++) {
+    Clock.Advance(100);
+    if ( Node.IsOpen() && (N2kMillis64()-tN2kSyncScheduler::GetSyncOffset())%100==10 && Step%10==0 ) {
+      for (int i=0; i<5; i++) Node.SendMsg(N2kMsg);
+    }
+    Node.ParseMessages();
+  }
+
+  REQUIRE(Node.AddPeriodicMsg(127245L,100,ProduceRudder));
+  REQUIRE(Node.GetPeriodicMsgInterval(127245L,Period,Offset));
+  REQUIRE(Offset/10!=1);
+}
@@ -0,0 +1,104 @@
+#include <catch.hpp>
+#include <N2kTrace.h>
+#include <N2kFrameLog.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kMessages.h>
+#include <N2kTimer.h>
+#include <string>
+#include <vector>
+
+//*****************************************************************************
+class tStringStream : public N2kStream {
+public:
+  std::string Data;
+  int read() { return -1; }
+  int peek() { return -1; }
+  size_t write(const uint8_t* data, size_t size) { Data.append((const char *)data,size); return size; }
+};
+
+//*****************************************************************************
+static std::vector<tN2kTraceRecord> GetTrace() {
+  std::vector<tN2kTraceRecord> Records;
+  tN2kTraceRing *Ring=tN2kTraceRing::Current();
+  uint32_t Start=( Ring->Head>N2K_TRACE_RING_SIZE ? Ring->Head-N2K_TRACE_RING_SIZE : 0 );
+  for (uint32_t i=Start; i!=Ring->Head; i++) Records.push_back(Ring->Records[i & (N2K_TRACE_RING_SIZE-1)]);
+  return Records;
+}
+
+//*****************************************************************************
+static int FindEvent(const std::vector<tN2kTraceRecord> &Records, uint8_t Event, uint32_t Arg1, size_t From=0) {
+  for (size_t i=From; i<Records.size(); i++) {
+    if ( Records[i].Event==Event && Records[i].Arg1==Arg1 ) return i;
+  }
+  return -1;
+}
+
+//*****************************************************************************
+TEST_CASE("Trace ring", "[trace]") {
+  N2kTraceClear();
+  tN2kTraceRing *Ring=tN2kTraceRing::Current();
+  REQUIRE(Ring==tN2kTraceRing::Current());
+
+  for (uint32_t i=0; i<N2K_TRACE_RING_SIZE+10; i++) N2kTrace(N2kte_FrameReceived,i,8);
+  std::vector<tN2kTraceRecord> Records=GetTrace();
+
+  REQUIRE(Records.size()==N2K_TRACE_RING_SIZE);
+  REQUIRE(Records.front().Arg1==10); // Oldest overwritten
+  REQUIRE(Records.back().Arg1==N2K_TRACE_RING_SIZE+9);
+  REQUIRE(Records.front().Time<=Records.back().Time);
+}
+
+//*****************************************************************************
+TEST_CASE("Trace receive path", "[trace]") {
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[2];
+  tN2kMsg N2kMsg;
+
+  for (size_t i=0; i<2; i++) {
+    Nodes[i].SetBus(&Bus);
+    Nodes[i].SetDeviceInformation(4000+i,130,25,2046);
+    Nodes[i].SetMode(tNMEA2000::N2km_ListenAndNode,50+i);
+    Nodes[i].EnableForward(false);
+    Nodes[i].Open();
+  }
+  uint64_t End=N2kMillis64()+500;
+  while ( N2kMillis64()<End ) {
+    Nodes[0].ParseMessages();
+    Nodes[1].ParseMessages();
+  }
+
+  N2kTraceClear();
+  SetN2kGNSS(N2kMsg,1,19000,43200,60.1,22.5,10.0,N2kGNSSt_GPS,N2kGNSSm_GNSSfix,12,0.8); // Fast packet
+  Nodes[0].SendMsg(N2kMsg);
+  End=N2kMillis64()+50;
+  while ( N2kMillis64()<End ) {
+    Nodes[0].ParseMessages();
+    Nodes[1].ParseMessages();
+  }
+
+  std::vector<tN2kTraceRecord> Records=GetTrace();
+  unsigned long id=Records.empty()?0:Records[0].Arg1;
+  REQUIRE(Records.size()>=7+7+4);
+  REQUIRE(Records[0].Event==N2kte_FrameSent);
+  REQUIRE(tN2kFrameLogReader::GetPGN(id)==129029L);
+
+  int Received=FindEvent(Records,N2kte_FrameReceived,id);
+  int Slot=FindEvent(Records,N2kte_SlotAllocated,129029L);
+  int Complete=FindEvent(Records,N2kte_MsgComplete,129029L);
+  int Start=FindEvent(Records,N2kte_HandlerStart,129029L);
+  int Done=FindEvent(Records,N2kte_HandlerEnd,129029L);
+  REQUIRE(Received>=0);
+  REQUIRE(Slot>Received);
+  REQUIRE(Complete>Slot);
+  REQUIRE(Start>Complete);
+  REQUIRE(Done>Start);
+  REQUIRE(Records[Complete].Arg2==50);
+
+  tStringStream JSON;
+  REQUIRE(N2kTraceExportJSON(&JSON)==Records.size());
+  REQUIRE(JSON.Data.find("{\"traceEvents\":[")==0);
+  REQUIRE(JSON.Data.find("\"name\":\"Handlers\",\"ph\":\"B\"")!=std::string::npos);
+  REQUIRE(JSON.Data.find("\"name\":\"Handlers\",\"ph\":\"E\"")!=std::string::npos);
+  REQUIRE(JSON.Data.find("\"name\":\"FrameReceived\",\"ph\":\"i\",\"s\":\"t\"")!=std::string::npos);
+  REQUIRE(JSON.Data.rfind("]")!=std::string::npos);
+}
@@ -0,0 +1,232 @@
+#include <catch.hpp>
+#include <N2kTxPacer.h>
+#include <NMEA2000_Virtual.h>
+#include <N2kTimer.h>
+#include <vector>
+
+static unsigned long BulkReceived=0;
+
+static void HandleMsg(const tN2kMsg &N2kMsg) {
+  if ( N2kMsg.PGN==129540L ) BulkReceived++;
+}
+
+//*****************************************************************************
+// Records PGN and time of sent frames
+class tTxMonitor : public tNMEA2000::tFrameMonitor {
+public:
+  struct tTxFrame { unsigned long PGN; uint64_t Time; };
+  std::vector<tTxFrame> Frames;
+  void HandleFrame(unsigned long id, unsigned char /*len*/, const unsigned char * /*buf*/, bool Tx, uint64_t FrameTime) {
+    if ( !Tx ) return;
+    tTxFrame Frame={ (id>>8) & 0x1ffff, FrameTime };
+    Frames.push_back(Frame);
+  }
+  size_t Count(unsigned long PGN) const {
+    size_t n=0;
+    for (size_t i=0; i<Frames.size(); i++) if ( Frames[i].PGN==PGN ) n++;
+    return n;
+  }
+};
+
+//*****************************************************************************
+static void SetMsg(tN2kMsg &N2kMsg, unsigned long PGN, unsigned char Priority, int DataLen) {
+  N2kMsg.SetPGN(PGN);
+  N2kMsg.Priority=Priority;
+  for (int i=0; i<DataLen; i++) N2kMsg.AddByte(i);
+}
+
+//*****************************************************************************
+TEST_CASE("Transmit pacer", "[pacer]") {
+  tN2kTxPacer Pacer(60,4);
+  const uint16_t Bits=tN2kTxPacer::FrameBits(8);
+
+  SECTION("Token bucket") {
+    // Burst of 4 frames after idle, then 60 % of 250 kbit/s = 150 bits/ms
+    for (int i=0; i<4; i++) REQUIRE(Pacer.Take(1000,8));
+    REQUIRE_FALSE(Pacer.Take(1000,8));
+    REQUIRE(Pacer.Take(1000+(Bits+149)/150,8));
+    REQUIRE_FALSE(Pacer.Take(1000+(Bits+149)/150,8));
+  }
+
+  SECTION("Zero minimum load does not stall") {
+    // Other traffic fills whole bus, bulk frames still get 1 % = 2.5 bits/ms
+    Pacer.SetPacing(0,0);
+    for (int i=0; i<200; i++) Pacer.AddFrame(1000+i/2,8);
+    for (int i=0; i<4; i++) REQUIRE(Pacer.Take(1100,8));
+    REQUIRE_FALSE(Pacer.Take(1100,8));
+    REQUIRE(Pacer.Take(1100+(Bits+1)/2,8));
+  }
+
+  SECTION("Check does not take tokens") {
+    for (int i=0; i<8; i++) REQUIRE(Pacer.CanTake(1000,8));
+    for (int i=0; i<4; i++) REQUIRE(Pacer.Take(1000,8));
+    REQUIRE_FALSE(Pacer.CanTake(1000,8));
+  }
+
+  SECTION("Rate follows bus load") {
+    // 100 frames on 100 ms window is about 52 % load
+    for (int i=0; i<100; i++) Pacer.AddFrame(1000+i,8);
+    for (int i=0; i<4; i++) REQUIRE(Pacer.Take(1100,8));
+    REQUIRE(Pacer.GetBusLoad()==52);
+    // Only 8 % = 20 bits/ms left to target
+    REQUIRE_FALSE(Pacer.Take(1100+(Bits+149)/150,8));
+    REQUIRE(Pacer.Take(1100+(Bits+19)/20,8));
+  }
+
+  SECTION("Deferred queue") {
+    unsigned char Buf[8]={ 1,2,3,4,5,6,7,8 };
+    for (unsigned long i=0; i<4; i++) REQUIRE(Pacer.Defer(i,8,Buf,true));
+    REQUIRE_FALSE(Pacer.Defer(4,8,Buf,true));
+    REQUIRE(Pacer.GetDeferredFrames()==4);
+    REQUIRE(Pacer.GetFreeFrames()==0);
+    for (int i=0; i<4; i++) REQUIRE(Pacer.Take(1000,8));
+    REQUIRE(Pacer.GetNextSendTime(1000)==(uint64_t)(1000+(Bits+149)/150));
+    for (unsigned long i=0; i<4; i++) {
+      REQUIRE(Pacer.GetDeferred()->id==i);
+      Pacer.RemoveDeferred();
+    }
+    REQUIRE(Pacer.GetDeferred()==0);
+    REQUIRE(Pacer.GetPeakDeferredFrames()==4);
+    REQUIRE(Pacer.GetDeferredCount()==4);
+  }
+}
+
+//*****************************************************************************
+template <class T> static void ParseAll(tN2kVirtualClock &Clock, T *Nodes, size_t Count, uint32_t ms) {
+  for (uint32_t Step=0; Step<ms*10; Step++) {
+    Clock.Advance(100);
+    for (size_t i=0; i<Count; i++) Nodes[i].ParseMessages();
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Transmit pacing on tNMEA2000", "[pacer]") {
+  tN2kVirtualClock Clock;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[2];
+  tN2kTxPacer Pacer(60,128);
+  tTxMonitor Monitor;
+  tN2kMsg N2kMsg;
+
+  for (size_t i=0; i<2; i++) {
+    Nodes[i].SetBus(&Bus);
+    Nodes[i].SetDeviceInformation(1000+i,130,25,2046);
+    Nodes[i].SetMode(tNMEA2000::N2km_ListenAndNode,30+i);
+    Nodes[i].EnableForward(false);
+  }
+  Nodes[0].SetTxPacer(&Pacer);
+  Nodes[0].SetFrameMonitor(&Monitor);
+  Nodes[1].SetMsgHandler(HandleMsg);
+  BulkReceived=0;
+  for (size_t i=0; i<2; i++) Nodes[i].Open();
+  ParseAll(Clock,Nodes,2,600);
+  Monitor.Frames.clear();
+
+  // Burst of 5 low priority messages, 20 frames each, then high priority position
+  SetMsg(N2kMsg,129540L,6,134);
+  for (int i=0; i<5; i++) REQUIRE(Nodes[0].SendMsg(N2kMsg));
+  N2kMsg.Clear();
+  SetMsg(N2kMsg,129029L,3,43);
+  REQUIRE(Nodes[0].SendMsg(N2kMsg));
+
+  // Position will be handed to driver before waiting bulk frames
+  ParseAll(Clock,Nodes,2,10);
+  REQUIRE(Nodes[0].GetStats().FramesDeferred>0);
+  REQUIRE(Monitor.Count(129029L)==7);
+  REQUIRE(Monitor.Count(129540L)<100);
+
+  ParseAll(Clock,Nodes,2,500);
+
+  REQUIRE(Monitor.Count(129540L)==100);
+  REQUIRE(BulkReceived==5);
+  REQUIRE_FALSE(Pacer.HasDeferred());
+  // 100 frames at 150 bits/ms takes more than 80 ms
+  uint64_t First=0xffffffffffffffffULL, Last=0;
+  for (size_t i=0; i<Monitor.Frames.size(); i++) {
+    if ( Monitor.Frames[i].PGN!=129540L ) continue;
+    if ( Monitor.Frames[i].Time<First ) First=Monitor.Frames[i].Time;
+    Last=Monitor.Frames[i].Time;
+  }
+  REQUIRE(Last-First>=80000);
+  REQUIRE(Nodes[0].GetStats().SendBufferFull==0);
+}
+
+//*****************************************************************************
+// Virtual node, which CAN controller can be set to refuse frames
+class tRefusingNode : public tNMEA2000_Virtual {
+public:
+  bool Refuse;
+  tRefusingNode() : Refuse(false) {}
+protected:
+  bool CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true) {
+    return !Refuse && tNMEA2000_Virtual::CANSendFrame(id,len,buf,wait_sent);
+  }
+};
+
+//*****************************************************************************
+TEST_CASE("Transmit pacing failures", "[pacer]") {
+  tN2kVirtualClock Clock;
+  tN2kVirtualBus Bus;
+  tRefusingNode Nodes[2];
+  tN2kTxPacer Pacer(60,24);
+  tN2kMsg N2kMsg;
+
+  for (size_t i=0; i<2; i++) {
+    Nodes[i].SetBus(&Bus);
+    Nodes[i].SetDeviceInformation(2000+i,130,25,2046);
+    Nodes[i].SetMode(tNMEA2000::N2km_ListenAndNode,30+i);
+    Nodes[i].EnableForward(false);
+  }
+  Nodes[0].SetTxPacer(&Pacer);
+  Nodes[1].SetMsgHandler(HandleMsg);
+  BulkReceived=0;
+  SetMsg(N2kMsg,129540L,6,134); // 20 frames
+
+  SECTION("Failed send keeps tokens") {
+    Nodes[0].SetN2kCANSendFrameBufSize(0);
+    for (size_t i=0; i<2; i++) Nodes[i].Open();
+    ParseAll(Clock,Nodes,2,600);
+
+    Nodes[0].Refuse=true;
+    REQUIRE_FALSE(Nodes[0].SendMsg(N2kMsg));
+    // Full burst is still available at same time
+    for (int i=0; i<4; i++) REQUIRE(Pacer.Take(N2kMillis64(),8));
+  }
+
+  SECTION("Pacer change keeps frames, which can not be sent") {
+    Nodes[0].SetN2kCANSendFrameBufSize(4);
+    for (size_t i=0; i<2; i++) Nodes[i].Open();
+    ParseAll(Clock,Nodes,2,600);
+
+    REQUIRE(Nodes[0].SendMsg(N2kMsg));
+    uint16_t Deferred=Pacer.GetDeferredFrames();
+    REQUIRE(Deferred>4);
+    Nodes[0].Refuse=true;
+    REQUIRE_FALSE(Nodes[0].SetTxPacer(0));
+    REQUIRE(Pacer.HasDeferred());
+    REQUIRE(Pacer.GetDeferredFrames()<Deferred);
+
+    Nodes[0].Refuse=false;
+    for (int i=0; i<100 && !Nodes[0].SetTxPacer(0); i++) ParseAll(Clock,Nodes,2,1);
+    REQUIRE_FALSE(Pacer.HasDeferred());
+    ParseAll(Clock,Nodes,2,50);
+    REQUIRE(BulkReceived==1);
+  }
+
+  SECTION("Fast packet is not started without queue room") {
+    for (size_t i=0; i<2; i++) Nodes[i].Open();
+    ParseAll(Clock,Nodes,2,600);
+
+    REQUIRE(Nodes[0].SendMsg(N2kMsg)); // 4 frames sent, 16 deferred
+    REQUIRE(Pacer.GetDeferredFrames()==16);
+    REQUIRE_FALSE(Nodes[0].SendMsg(N2kMsg));
+    REQUIRE(Pacer.GetDeferredFrames()==16);
+    REQUIRE(Nodes[0].GetStats().SendBufferFull==1);
+
+    ParseAll(Clock,Nodes,2,500);
+    REQUIRE(BulkReceived==1);
+    REQUIRE(Nodes[0].SendMsg(N2kMsg));
+    ParseAll(Clock,Nodes,2,500);
+    REQUIRE(BulkReceived==2);
+  }
+}
@@ -0,0 +1,1265 @@
+#include <catch.hpp>
+#include <NMEA2000.h>
+#include <N2kTimer.h>
+#include <N2kMessages.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <string.h>
+
+//*****************************************************************************
+// Minimal in memory driver. Frames to be received are pushed to RxFrames and
+// all sent frames are collected to TxFrames.
+class tNMEA2000_Test : public tNMEA2000 {
+public:
+  struct tFrame {
+    unsigned long id;
+    unsigned char len;
+    unsigned char buf[8];
+    uint64_t Time;
+  };
+  std::deque<tFrame> RxFrames;
+  std::vector<tFrame> TxFrames;
+  bool TxBlocked;
+  uint8_t MaxFilters;
+  std::vector<tCANFilter> HWFilters;
+
+  tNMEA2000_Test() : TxBlocked(false), MaxFilters(0) {}
+
+  bool HWAccepts(unsigned long id) const {
+    if ( HWFilters.empty() ) return true;
+    for (size_t i=0; i<HWFilters.size(); i++) {
+      if ( ((id ^ HWFilters[i].id) & HWFilters[i].mask)==0 ) return true;
+    }
+    return false;
+  }
+
+  void AddRxFrame(unsigned long id, unsigned char len, const unsigned char *buf, uint64_t Time=0) {
+    tFrame Frame;
+    Frame.id=id; Frame.len=len; memcpy(Frame.buf,buf,len); Frame.Time=Time;
+    RxFrames.push_back(Frame);
+  }
+
+  void AddRxAddressClaim(unsigned char Source, uint64_t Name) {
+    unsigned char buf[8];
+    for (int i=0; i<8; i++) buf[i]=(Name>>(8*i)) & 0xff;
+    AddRxFrame((6UL<<26) | (0xeeffUL<<8) | Source,8,buf);
+  }
+
+  void ParseFor(uint32_t ms) {
+    uint64_t End=N2kMillis64()+ms;
+    while ( N2kMillis64()<End ) ParseMessages();
+  }
+
+  size_t CountTxFrames(unsigned long PGN, unsigned char Control=0) {
+    size_t Count=0;
+    for (size_t i=0; i<TxFrames.size(); i++) {
+      if ( ((TxFrames[i].id>>8) & 0x1ff00)==PGN && (Control==0 || TxFrames[i].buf[0]==Control) ) Count++;
+    }
+    return Count;
+  }
+
+  void AddRxTPCTS(unsigned char Source, unsigned char Destination, unsigned long PGN, unsigned char nPackets, unsigned char NextPacket) {
+    unsigned char buf[8]={17,nPackets,NextPacket,0xff,0xff,(unsigned char)(PGN & 0xff),(unsigned char)((PGN>>8) & 0xff),(unsigned char)((PGN>>16) & 0xff)};
+    AddRxFrame((7UL<<26) | (0xec00UL<<8) | ((unsigned long)Destination<<8) | Source,8,buf);
+  }
+
+  bool OpenAndWait() {
+    uint64_t Timeout=N2kMillis64()+2000;
+    while ( !IsOpen() && N2kMillis64()<Timeout ) ParseMessages();
+    return IsOpen();
+  }
+
+protected:
+  bool CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool /*wait_sent*/) {
+    if ( TxBlocked ) return false;
+    tFrame Frame;
+    Frame.id=id; Frame.len=len; memcpy(Frame.buf,buf,len);
+    TxFrames.push_back(Frame);
+    return true;
+  }
+  bool CANOpen() { return true; }
+  uint8_t CANGetMaxFilters() const { return MaxFilters; }
+  bool CANSetFilters(const tCANFilter *Filters, uint8_t Count) {
+    HWFilters.assign(Filters,Filters+Count);
+    return true;
+  }
+  bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf) {
+    if ( RxFrames.empty() ) return false;
+    id=RxFrames.front().id; len=RxFrames.front().len; memcpy(buf,RxFrames.front().buf,len);
+    RxFrames.pop_front();
+    return true;
+  }
+#if defined(N2K_FRAME_TIMESTAMP)
+  bool CANGetTimestampedFrame(unsigned long &id, unsigned char &len, unsigned char *buf, uint64_t &FrameTime) {
+    if ( RxFrames.empty() ) return false;
+    FrameTime=( RxFrames.front().Time!=0 ? RxFrames.front().Time : N2kMicros64() );
+    return CANGetFrame(id,len,buf);
+  }
+#endif
+};
+
+//*****************************************************************************
+TEST_CASE("Multi device address claim", "[addressclaim]") {
+  tNMEA2000_Test NMEA2000;
+
+  NMEA2000.SetDeviceCount(3);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+
+  REQUIRE(NMEA2000.FindSourceDeviceIndex(22)==0);
+  REQUIRE(NMEA2000.FindSourceDeviceIndex(23)==1);
+  REQUIRE(NMEA2000.FindSourceDeviceIndex(24)==2);
+  REQUIRE(NMEA2000.FindSourceDeviceIndex(25)==-1);
+  REQUIRE(NMEA2000.FindSourceDeviceIndex(254)==-1);
+
+  SECTION("Lost claim skips known addresses") {
+    NMEA2000.AddRxAddressClaim(25,0x1000);
+    NMEA2000.AddRxAddressClaim(26,0x1001);
+    NMEA2000.AddRxAddressClaim(23,0); // Lowest name always wins
+    NMEA2000.ParseMessages();
+
+    REQUIRE(NMEA2000.GetN2kSource(1)==27);
+    REQUIRE(NMEA2000.FindSourceDeviceIndex(27)==1);
+    REQUIRE(NMEA2000.FindSourceDeviceIndex(23)==-1);
+    REQUIRE(NMEA2000.ReadResetAddressChanged());
+  }
+
+  SECTION("Won claim keeps address") {
+    NMEA2000.AddRxAddressClaim(23,0xffffffffffffffffULL);
+    NMEA2000.ParseMessages();
+
+    REQUIRE(NMEA2000.GetN2kSource(1)==23);
+    REQUIRE(NMEA2000.FindSourceDeviceIndex(23)==1);
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Concurrent TP sessions", "[tp]") {
+  tNMEA2000_Test NMEA2000;
+
+  NMEA2000.SetN2kTPSessionCount(2);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Wait address claim to finish
+  NMEA2000.TxFrames.clear();
+
+  REQUIRE(NMEA2000.SendProductInformation(30,0,true));
+  REQUIRE(NMEA2000.SendProductInformation(31,0,true));
+  REQUIRE_FALSE(NMEA2000.SendProductInformation(31,0,true)); // Only one session per destination
+  REQUIRE_FALSE(NMEA2000.SendProductInformation(32,0,true)); // All sessions in use
+  NMEA2000.ParseMessages();
+  REQUIRE(NMEA2000.CountTxFrames(0xec00,16)==2); // RTS for both
+
+  // Both receivers accept in parallel
+  NMEA2000.AddRxTPCTS(30,22,126996L,5,1);
+  NMEA2000.AddRxTPCTS(31,22,126996L,5,1);
+  NMEA2000.ParseMessages();
+  REQUIRE(NMEA2000.CountTxFrames(0xeb00)==10);
+}
+
+//*****************************************************************************
+static int LargeMsgDataLen=0;
+static int LargeMsgLastByte=0;
+static int LargeMsgCount=0;
+
+static void HandleLargeMsg(const tN2kMsg &N2kMsg) {
+  if ( N2kMsg.PGN!=126464L || !N2kMsg.IsLargeMsg() ) return;
+  const tN2kLargeMsg &LargeMsg=(const tN2kLargeMsg &)N2kMsg;
+  LargeMsgCount++;
+  LargeMsgDataLen=LargeMsg.LargeDataLen;
+  LargeMsgLastByte=LargeMsg.LargeData[LargeMsg.LargeDataLen-1];
+}
+
+TEST_CASE("Large TP message reception", "[tp]") {
+  tNMEA2000_Test NMEA2000;
+  const int nBytes=400;
+  const int nPackets=(nBytes+6)/7;
+  unsigned char buf[8]={32,nBytes & 0xff,nBytes>>8,nPackets,0xff,0x00,0xee,0x01}; // BAM for 126464
+
+  NMEA2000.SetN2kLargeMsgBufSize(1);
+  NMEA2000.SetMsgHandler(HandleLargeMsg);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  REQUIRE(NMEA2000.OpenAndWait());
+
+  NMEA2000.AddRxFrame((7UL<<26) | (0xecffUL<<8) | 40,8,buf);
+  for (int i=0; i<nPackets; i++) {
+    buf[0]=i+1;
+    for (int j=1; j<8; j++) buf[j]=(i*7+j-1) & 0xff;
+    NMEA2000.AddRxFrame((7UL<<26) | (0xebffUL<<8) | 40,8,buf);
+  }
+  LargeMsgDataLen=0;
+  while ( !NMEA2000.RxFrames.empty() ) NMEA2000.ParseMessages();
+
+  REQUIRE(LargeMsgDataLen==nBytes);
+  REQUIRE(LargeMsgLastByte==((nBytes-1) & 0xff));
+}
+
+//*****************************************************************************
+// Adds BAM for 126464 with nBytes and data packets FirstPacket..LastPacket
+static void AddRxLargeBAM(tNMEA2000_Test &NMEA2000, unsigned char Source, int nBytes, int FirstPacket, int LastPacket) {
+  const int nPackets=(nBytes+6)/7;
+  unsigned char buf[8]={32,(unsigned char)(nBytes & 0xff),(unsigned char)(nBytes>>8),(unsigned char)nPackets,0xff,0x00,0xee,0x01};
+
+  if ( FirstPacket==0 ) NMEA2000.AddRxFrame((7UL<<26) | (0xecffUL<<8) | Source,8,buf);
+  for (int i=( FirstPacket>0 ? FirstPacket-1 : 0 ); i<LastPacket && i<nPackets; i++) {
+    buf[0]=i+1;
+    for (int j=1; j<8; j++) buf[j]=(i*7+j-1) & 0xff;
+    NMEA2000.AddRxFrame((7UL<<26) | (0xebffUL<<8) | Source,8,buf);
+  }
+}
+
+TEST_CASE("Large TP message restart", "[tp]") {
+  tNMEA2000_Test NMEA2000;
+  const int nBytes=400;
+  const int nPackets=(nBytes+6)/7;
+
+  NMEA2000.SetN2kLargeMsgBufSize(2);
+  NMEA2000.SetMsgHandler(HandleLargeMsg);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  REQUIRE(NMEA2000.OpenAndWait());
+  LargeMsgCount=0;
+
+  // Sender restarts transfer after few packets
+  AddRxLargeBAM(NMEA2000,40,nBytes,0,5);
+  AddRxLargeBAM(NMEA2000,40,nBytes,0,nPackets);
+  while ( !NMEA2000.RxFrames.empty() ) NMEA2000.ParseMessages();
+  REQUIRE(LargeMsgCount==1);
+  REQUIRE(LargeMsgDataLen==nBytes);
+
+  // Whole pool must be available again
+  AddRxLargeBAM(NMEA2000,41,nBytes,0,0);
+  AddRxLargeBAM(NMEA2000,42,nBytes,0,0);
+  AddRxLargeBAM(NMEA2000,41,nBytes,1,nPackets);
+  AddRxLargeBAM(NMEA2000,42,nBytes,1,nPackets);
+  while ( !NMEA2000.RxFrames.empty() ) NMEA2000.ParseMessages();
+  REQUIRE(LargeMsgCount==3);
+}
+
+//*****************************************************************************
+TEST_CASE("Next protocol event time", "[timers]") {
+  tNMEA2000_Test NMEA2000;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Wait address claim to finish
+
+  uint64_t Now=N2kMillis64();
+  uint64_t Next=NMEA2000.GetNextProtocolEventTime();
+  REQUIRE(Next>Now); // Nothing to do before heartbeat
+  REQUIRE(Next<=Now+60000);
+
+  NMEA2000.SetHeartbeatIntervalAndOffset(1000,0);
+  REQUIRE(NMEA2000.GetNextProtocolEventTime()==0);
+  NMEA2000.ParseMessages();
+  REQUIRE(NMEA2000.GetNextProtocolEventTime()<=N2kMillis64()+1000);
+}
+
+//*****************************************************************************
+class tDumpStream : public N2kStream {
+public:
+  std::vector<unsigned char> Data;
+  int read() { return -1; }
+  int peek() { return -1; }
+  size_t write(const uint8_t* data, size_t size) { Data.insert(Data.end(),data,data+size); return size; }
+};
+
+TEST_CASE("Runtime statistics", "[stats]") {
+  tNMEA2000_Test NMEA2000;
+  unsigned char buf[8]={0x20,20,1,2,3,4,5,6}; // Fast packet GNSS position data, 20 bytes = 3 frames
+  unsigned long GNSSId=(3UL<<26) | (129029UL<<8);
+  unsigned long RudderId=(2UL<<26) | (127245UL<<8) | 40;
+
+  NMEA2000.SetN2kCANSendFrameBufSize(5);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Wait address claim to finish
+  NMEA2000.ResetStats();
+  NMEA2000.SetPGNStatsSize(2);
+
+  SECTION("Receive errors") {
+    buf[0]=0x21; NMEA2000.AddRxFrame(GNSSId | 40,8,buf); // Orphan
+    buf[0]=0x20; NMEA2000.AddRxFrame(GNSSId | 40,8,buf);
+    buf[0]=0x22; NMEA2000.AddRxFrame(GNSSId | 40,8,buf); // Lost
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame((2UL<<26) | (127250UL<<8) | 40,8,buf); // PGN table full
+    NMEA2000.ParseMessages();
+
+    const tNMEA2000::tStats &Stats=NMEA2000.GetStats();
+    REQUIRE(Stats.FramesReceived==5);
+    REQUIRE(Stats.OrphanFrames==1);
+    REQUIRE(Stats.LostFrames==1);
+    REQUIRE(Stats.MessagesReceived==2);
+    REQUIRE(Stats.PGNStatsFull==1);
+
+    uint16_t Count;
+    const tNMEA2000::tPGNStats *PGNStats=NMEA2000.GetPGNStats(Count);
+    REQUIRE(Count==2);
+    REQUIRE(PGNStats[0].PGN==129029L);
+    REQUIRE(PGNStats[0].Errors==2);
+    REQUIRE(PGNStats[1].PGN==127245L);
+    REQUIRE(PGNStats[1].Received==1);
+
+    NMEA2000.ResetStats();
+    REQUIRE(NMEA2000.GetStats().FramesReceived==0);
+    NMEA2000.GetPGNStats(Count);
+    REQUIRE(Count==0);
+  }
+
+  SECTION("Message slots and parse limit") {
+    for (unsigned char Source=40; Source<46; Source++) NMEA2000.AddRxFrame(GNSSId | Source,8,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetStats().MsgSlotExhausted==1);
+    REQUIRE(NMEA2000.GetStats().ParseTruncated==0);
+
+    for (int i=0; i<20; i++) NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetStats().ParseTruncated==1);
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetStats().ParseTruncated==1);
+  }
+
+  SECTION("Send buffer full") {
+    tN2kMsg N2kMsg;
+    N2kMsg.SetPGN(127245L);
+    N2kMsg.Priority=2;
+    for (int i=0; i<6; i++) N2kMsg.AddByte(i);
+
+    NMEA2000.TxFrames.clear();
+    NMEA2000.TxBlocked=true;
+    for (int i=0; i<5; i++) NMEA2000.SendMsg(N2kMsg);
+
+    const tNMEA2000::tStats &Stats=NMEA2000.GetStats();
+    REQUIRE(Stats.FramesBuffered==4);
+    REQUIRE(Stats.SendBufferFull==1);
+    REQUIRE(Stats.SendFailed==1);
+    REQUIRE(Stats.MessagesSent==4);
+
+    NMEA2000.TxBlocked=false;
+    NMEA2000.SendMsg(N2kMsg);
+    REQUIRE(Stats.FramesSent==5);
+    REQUIRE(NMEA2000.TxFrames.size()==5);
+  }
+
+  SECTION("Binary dump") {
+    tDumpStream Stream;
+    unsigned char Dump[200];
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.ParseMessages();
+
+    size_t Len=NMEA2000.GetStatsDump(Dump,sizeof(Dump));
+    REQUIRE(Len==4+sizeof(tNMEA2000::tStats)+2+15);
+    REQUIRE(Dump[0]=='N');
+    REQUIRE(Dump[1]=='S');
+    REQUIRE(Dump[3]==sizeof(tNMEA2000::tStats)/4);
+    REQUIRE(Dump[4]==1); // FramesReceived
+    REQUIRE(Dump[Len-15]==(127245L & 0xff));
+    REQUIRE(NMEA2000.GetStatsDump(Dump,Len-1)==0);
+
+    NMEA2000.SetStatsDump(&Stream,10);
+    NMEA2000.ParseFor(15);
+    REQUIRE(Stream.Data.size()==Len);
+    REQUIRE(memcmp(Stream.Data.data(),Dump,Len)==0);
+  }
+}
+
+//*****************************************************************************
+class tSlowHandler : public tNMEA2000::tMsgHandler {
+public:
+  uint32_t Delay;
+  tSlowHandler(unsigned long _PGN, tNMEA2000 *_pNMEA2000, uint32_t _Delay) : tMsgHandler(_PGN,_pNMEA2000), Delay(_Delay) {}
+protected:
+  void HandleMsg(const tN2kMsg &/*N2kMsg*/) {
+    uint64_t End=N2kMicros64()+Delay;
+    while ( N2kMicros64()<End );
+  }
+};
+
+static const tNMEA2000::tMsgHandler *SlowHandler=0;
+static size_t SlowHandlerCalls=0;
+
+static void HandleSlowHandler(tNMEA2000::tMsgHandler *Handler, const tN2kMsg &N2kMsg, uint32_t Time) {
+  if ( N2kMsg.PGN!=127245L || Time<2000 ) return;
+  SlowHandler=Handler;
+  SlowHandlerCalls++;
+}
+
+static tNMEA2000 *DetachFrom=0;
+
+static void DetachSlowHandler(tNMEA2000::tMsgHandler *Handler, const tN2kMsg &N2kMsg, uint32_t Time) {
+  HandleSlowHandler(Handler,N2kMsg,Time);
+  if ( Handler!=0 && DetachFrom!=0 ) DetachFrom->DetachMsgHandler(Handler);
+}
+
+static void HandleNothing(const tN2kMsg &/*N2kMsg*/) {
+}
+
+TEST_CASE("Message handler timing", "[handlers]") {
+  tNMEA2000_Test NMEA2000;
+  tSlowHandler Slow(127245L,&NMEA2000,2000);
+  tSlowHandler Fast(127245L,&NMEA2000,0);
+  unsigned char buf[8]={0,1,2,3,4,5,6,7};
+  unsigned long RudderId=(2UL<<26) | (127245UL<<8) | 40;
+
+  NMEA2000.SetMsgHandler(HandleNothing);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  REQUIRE(NMEA2000.OpenAndWait());
+  SlowHandler=0;
+  SlowHandlerCalls=0;
+
+  SECTION("Disabled by default") {
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(Slow.GetHandlerStats().Calls==0);
+    REQUIRE(NMEA2000.GetMsgHandlerStats().Calls==0);
+  }
+
+  SECTION("Budget") {
+    NMEA2000.EnableHandlerTiming(true,1000);
+    NMEA2000.SetSlowHandlerCallback(HandleSlowHandler);
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.ParseMessages();
+
+    REQUIRE(Slow.GetHandlerStats().Calls==2);
+    REQUIRE(Slow.GetHandlerStats().MaxTime>=2000);
+    REQUIRE(Slow.GetHandlerStats().TotalTime>=4000);
+    REQUIRE(Slow.GetHandlerStats().OverBudget==2);
+    REQUIRE(Fast.GetHandlerStats().Calls==2);
+    REQUIRE(Fast.GetHandlerStats().OverBudget==0);
+    REQUIRE(NMEA2000.GetMsgHandlerStats().Calls==2);
+    REQUIRE(NMEA2000.GetStats().HandlersOverBudget==2);
+    REQUIRE(SlowHandler==&Slow);
+    REQUIRE(SlowHandlerCalls==2);
+
+    NMEA2000.ResetHandlerStats();
+    REQUIRE(Slow.GetHandlerStats().Calls==0);
+    REQUIRE(NMEA2000.GetMsgHandlerStats().Calls==0);
+  }
+
+  SECTION("Detach from callback") {
+    // Slow is before Fast on handler list, so Fast must still get message after Slow has been detached.
+    DetachFrom=&NMEA2000;
+    NMEA2000.EnableHandlerTiming(true,1000);
+    NMEA2000.SetSlowHandlerCallback(DetachSlowHandler);
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.ParseMessages();
+    DetachFrom=0;
+
+    REQUIRE(SlowHandlerCalls==1);
+    REQUIRE(Slow.GetHandlerStats().Calls==1);
+    REQUIRE(Fast.GetHandlerStats().Calls==2);
+  }
+}
+
+//*****************************************************************************
+static size_t SubscribedMsgCount=0;
+
+static void HandleSubscribedMsg(const tN2kMsg &) {
+  SubscribedMsgCount++;
+}
+
+TEST_CASE("Subscriptions", "[subscriptions]") {
+  tNMEA2000_Test NMEA2000;
+  unsigned char buf[8]={0,1,2,3,4,5,6,7};
+  unsigned long RudderId=(2UL<<26) | (127245UL<<8) | 40;
+  unsigned long HeadingId=(2UL<<26) | (127250UL<<8) | 41;
+  unsigned long WindId=(2UL<<26) | (130306UL<<8) | 40;
+  unsigned long RequestId=(6UL<<26) | (0xea00UL<<8) | (0x33UL<<8) | 40; // 59904 to 0x33
+  unsigned long ProprietaryId=(6UL<<26) | (0xef00UL<<8) | (0x22UL<<8) | 40; // 61184 to 0x22
+
+  NMEA2000.SetMsgHandler(HandleSubscribedMsg);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  NMEA2000.MaxFilters=4;
+  SubscribedMsgCount=0;
+
+  SECTION("Accept all by default") {
+    REQUIRE(NMEA2000.OpenAndWait());
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame(WindId,6,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(SubscribedMsgCount==2);
+    REQUIRE(NMEA2000.GetStats().FramesFiltered==0);
+    REQUIRE(NMEA2000.HWFilters.empty());
+  }
+
+  SECTION("Software and hardware filters") {
+    REQUIRE_FALSE(NMEA2000.Subscribe(130000L,129000L));
+    REQUIRE(NMEA2000.Subscribe(127245L));
+    REQUIRE(NMEA2000.Subscribe(127250L,127251L,41));
+    REQUIRE(NMEA2000.Subscribe(61184L));
+    REQUIRE(NMEA2000.OpenAndWait());
+
+    uint16_t Count;
+    const tNMEA2000::tCANFilter *Filters=NMEA2000.GetCANFilters(Count);
+    REQUIRE(Count>0);
+    REQUIRE(Filters!=0);
+    REQUIRE(NMEA2000.HWFilters.size()>0);
+    REQUIRE(NMEA2000.HWFilters.size()<=4);
+
+    unsigned long Accepted[]={ RudderId, HeadingId, RequestId, ProprietaryId,
+                               (6UL<<26) | (0xeeffUL<<8) | 40, // Address claim
+                               (3UL<<26) | (126208UL<<8) | (0x44UL<<8) | 40 }; // Group function
+    for (size_t i=0; i<sizeof(Accepted)/sizeof(Accepted[0]); i++) {
+      REQUIRE(NMEA2000.IsSubscribedFrame(Accepted[i]));
+      REQUIRE(NMEA2000.HWAccepts(Accepted[i])); // Hardware set must be superset
+    }
+    REQUIRE_FALSE(NMEA2000.IsSubscribedFrame(WindId));
+    REQUIRE_FALSE(NMEA2000.IsSubscribedFrame((2UL<<26) | (127250UL<<8) | 40)); // Heading from other source
+    REQUIRE_FALSE(NMEA2000.IsSubscribedFrame((2UL<<26) | (127252UL<<8) | 41));
+
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame(WindId,6,buf);
+    NMEA2000.AddRxFrame(HeadingId,8,buf);
+    NMEA2000.AddRxFrame((2UL<<26) | (127250UL<<8) | 40,8,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(SubscribedMsgCount==2);
+    REQUIRE(NMEA2000.GetStats().FramesFiltered==2);
+
+    NMEA2000.ClearSubscriptions();
+    REQUIRE(NMEA2000.HWFilters.empty());
+    NMEA2000.AddRxFrame(WindId,6,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(SubscribedMsgCount==3);
+  }
+
+  SECTION("Software only") {
+    NMEA2000.MaxFilters=0;
+    REQUIRE(NMEA2000.Subscribe(127245L));
+    REQUIRE(NMEA2000.OpenAndWait());
+    REQUIRE(NMEA2000.HWFilters.empty());
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame(WindId,6,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(SubscribedMsgCount==1);
+    REQUIRE(NMEA2000.GetStats().FramesFiltered==1);
+  }
+}
+
+//*****************************************************************************
+static const unsigned long TestSingleFrameMessages[] PROGMEM={ 65300L, 0 };
+static const unsigned long TestFastPacketMessages[] PROGMEM={ 130900L, 0 };
+
+TEST_CASE("Known message cache", "[known]") {
+  tNMEA2000_Test NMEA2000;
+  unsigned char buf[8]={0,1,2,3,4,5,6,7};
+  unsigned long RudderId=(2UL<<26) | (127245UL<<8) | 40;
+  unsigned long PropId=(6UL<<26) | (65300UL<<8) | 40;
+  unsigned long PropFPId=(6UL<<26) | (130900UL<<8) | 40;
+
+  NMEA2000.SetMsgHandler(HandleSubscribedMsg);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  NMEA2000.SetHandleOnlyKnownMessages(true);
+  REQUIRE(NMEA2000.OpenAndWait());
+  SubscribedMsgCount=0;
+
+  for (int i=0; i<3; i++) {
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+    NMEA2000.AddRxFrame(PropId,8,buf);
+  }
+  NMEA2000.ParseMessages();
+  REQUIRE(SubscribedMsgCount==3); // Only rudder is known
+
+  NMEA2000.ExtendSingleFrameMessages(TestSingleFrameMessages);
+  NMEA2000.AddRxFrame(PropId,8,buf);
+  NMEA2000.ParseMessages();
+  REQUIRE(SubscribedMsgCount==4);
+
+  // Unknown proprietary fast packet first frame is dropped.
+  unsigned char First[8]={0x20,9,1,2,3,4,5,6};
+  unsigned char Second[8]={0x21,7,8,9,0xff,0xff,0xff,0xff};
+  NMEA2000.AddRxFrame(PropFPId,8,First);
+  NMEA2000.AddRxFrame(PropFPId,8,Second);
+  NMEA2000.ParseMessages();
+  REQUIRE(SubscribedMsgCount==4);
+
+  NMEA2000.ExtendFastPacketMessages(TestFastPacketMessages);
+  NMEA2000.AddRxFrame(PropFPId,8,First);
+  NMEA2000.AddRxFrame(PropFPId,8,Second);
+  NMEA2000.ParseMessages();
+  REQUIRE(SubscribedMsgCount==5);
+}
+
+//*****************************************************************************
+static size_t CountLines(const tDumpStream &Stream) {
+  size_t Count=0;
+  for (size_t i=0; i<Stream.Data.size(); i++) if ( Stream.Data[i]=='\n' ) Count++;
+  return Count;
+}
+
+TEST_CASE("Forward rules", "[forward]") {
+  tNMEA2000_Test NMEA2000;
+  tDumpStream Stream;
+  unsigned char buf[8]={0,1,2,3,4,5,6,7};
+  unsigned long HeadingId=(2UL<<26) | (127250UL<<8);
+  unsigned long FluidId=(6UL<<26) | (127505UL<<8) | 40;
+  unsigned long SwitchId=(3UL<<26) | (127501UL<<8) | 40;
+  unsigned long RudderId=(2UL<<26) | (127245UL<<8) | 40;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  NMEA2000.SetForwardStream(&Stream);
+  NMEA2000.SetForwardType(tNMEA2000::fwdt_Text);
+  REQUIRE(NMEA2000.AddForwardRule(127250L,100));
+  REQUIRE(NMEA2000.AddForwardRule(127505L,0,tNMEA2000::fwdr_SuppressUnchanged));
+  REQUIRE(NMEA2000.AddForwardRule(127501L,10000,tNMEA2000::fwdr_SuppressUnchanged | tNMEA2000::fwdr_PassChanges));
+  REQUIRE(NMEA2000.OpenAndWait());
+  Stream.Data.clear();
+
+  for (int i=0; i<5; i++) {
+    buf[1]=i;
+    NMEA2000.AddRxFrame(HeadingId | 40,8,buf);
+    NMEA2000.AddRxFrame(HeadingId | 41,8,buf);
+    NMEA2000.AddRxFrame(RudderId,6,buf);
+  }
+  NMEA2000.ParseMessages();
+
+  uint8_t Count;
+  const tNMEA2000::tForwardRule *Rules=NMEA2000.GetForwardRules(Count);
+  REQUIRE(Count==3);
+  REQUIRE(Rules[0].Forwarded==2); // One per source
+  REQUIRE(Rules[0].Decimated==8);
+  REQUIRE(CountLines(Stream)==2+5);
+
+  SECTION("Interval") {
+    NMEA2000.ParseFor(110);
+    NMEA2000.AddRxFrame(HeadingId | 40,8,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(Rules[0].Forwarded==3);
+  }
+
+  SECTION("Unchanged") {
+    NMEA2000.AddRxFrame(FluidId,8,buf);
+    NMEA2000.AddRxFrame(FluidId,8,buf);
+    NMEA2000.AddRxFrame(SwitchId,8,buf);
+    NMEA2000.AddRxFrame(SwitchId,8,buf);
+    buf[2]=0xaa;
+    NMEA2000.AddRxFrame(FluidId,8,buf);
+    NMEA2000.AddRxFrame(SwitchId,8,buf);
+    NMEA2000.AddRxFrame(SwitchId,8,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(Rules[1].Forwarded==2);
+    REQUIRE(Rules[1].Suppressed==1);
+    REQUIRE(Rules[2].Forwarded==2); // Change passes interval
+    REQUIRE(Rules[2].Suppressed==2);
+    REQUIRE(Rules[2].Decimated==0);
+  }
+
+  SECTION("Clear") {
+    NMEA2000.ClearForwardRules();
+    NMEA2000.GetForwardRules(Count);
+    REQUIRE(Count==0);
+    NMEA2000.AddRxFrame(HeadingId | 40,8,buf);
+    NMEA2000.AddRxFrame(HeadingId | 40,8,buf);
+    NMEA2000.ParseMessages();
+    REQUIRE(CountLines(Stream)==2+5+2);
+  }
+}
+
+//*****************************************************************************
+static size_t PeriodicProducerCalls=0;
+
+static bool ProduceHeading(tN2kMsg &N2kMsg, int) {
+  PeriodicProducerCalls++;
+  SetN2kTrueHeading(N2kMsg,1,0.5);
+  return true;
+}
+
+static size_t CountTxPGN(const tNMEA2000_Test &NMEA2000, unsigned long PGN) {
+  size_t Count=0;
+  for (size_t i=0; i<NMEA2000.TxFrames.size(); i++) {
+    unsigned long FramePGN=(NMEA2000.TxFrames[i].id>>8) & 0x3ffff;
+    if ( ((FramePGN>>8) & 0xff)<240 ) FramePGN&=0x3ff00; // PDU1
+    if ( FramePGN==PGN ) Count++;
+  }
+  return Count;
+}
+
+// Sends 126208 request group function to NMEA2000 as fast packet
+static void AddRxIntervalRequest(tNMEA2000_Test &NMEA2000, unsigned long PGN, uint32_t Interval, uint16_t Offset, unsigned char Destination=0xfe) {
+  unsigned char First[8]={0x40,11,0,(unsigned char)PGN,(unsigned char)(PGN>>8),(unsigned char)(PGN>>16),
+                          (unsigned char)Interval,(unsigned char)(Interval>>8)};
+  unsigned char Second[8]={0x41,(unsigned char)(Interval>>16),(unsigned char)(Interval>>24),
+                           (unsigned char)Offset,(unsigned char)(Offset>>8),0,0xff,0xff};
+  if ( Destination==0xfe ) Destination=NMEA2000.GetN2kSource();
+  unsigned long id=(3UL<<26) | (126208UL<<8) | ((unsigned long)Destination<<8) | 40;
+  NMEA2000.AddRxFrame(id,8,First);
+  NMEA2000.AddRxFrame(id,8,Second);
+}
+
+TEST_CASE("Periodic messages", "[periodic]") {
+  tNMEA2000_Test NMEA2000;
+  tN2kMsg N2kMsg;
+  uint32_t Period, Offset;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  SetN2kRudder(N2kMsg,0.1);
+  REQUIRE(NMEA2000.AddPeriodicMsg(N2kMsg,50));
+  REQUIRE(NMEA2000.AddPeriodicMsg(127250L,100,ProduceHeading));
+  REQUIRE_FALSE(NMEA2000.AddPeriodicMsg(127251L,0,ProduceHeading));
+  REQUIRE(NMEA2000.IsPeriodicMsg(127250L));
+  REQUIRE_FALSE(NMEA2000.IsPeriodicMsg(127250L,1));
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+  PeriodicProducerCalls=0;
+  NMEA2000.TxFrames.clear();
+
+  // Offsets spread messages
+  REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+  REQUIRE(Period==50);
+  REQUIRE(NMEA2000.GetPeriodicMsgInterval(127250L,Period,Offset));
+  REQUIRE(Period==100);
+  REQUIRE(Offset>20);
+  REQUIRE(Offset<80);
+
+  NMEA2000.ParseFor(500);
+  REQUIRE(CountTxPGN(NMEA2000,127245L)>=9);
+  REQUIRE(CountTxPGN(NMEA2000,127245L)<=11);
+  REQUIRE(CountTxPGN(NMEA2000,127250L)>=4);
+  REQUIRE(CountTxPGN(NMEA2000,127250L)<=6);
+  REQUIRE(PeriodicProducerCalls==CountTxPGN(NMEA2000,127250L));
+
+  SECTION("Template update") {
+    SetN2kRudder(N2kMsg,0.2);
+    REQUIRE(NMEA2000.UpdatePeriodicMsg(N2kMsg));
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseFor(60);
+    REQUIRE(CountTxPGN(NMEA2000,127245L)>=1);
+    REQUIRE(NMEA2000.TxFrames.back().len==N2kMsg.DataLen);
+    REQUIRE(memcmp(NMEA2000.TxFrames.back().buf,N2kMsg.Data,N2kMsg.DataLen)==0);
+  }
+
+  SECTION("Group function interval change") {
+    AddRxIntervalRequest(NMEA2000,127245L,200,0xffff);
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseMessages();
+    REQUIRE(CountTxPGN(NMEA2000,127245L)==1); // Sent immediately
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+    REQUIRE(Period==200);
+
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseFor(500);
+    REQUIRE(CountTxPGN(NMEA2000,127245L)>=2);
+    REQUIRE(CountTxPGN(NMEA2000,127245L)<=3);
+
+    AddRxIntervalRequest(NMEA2000,127245L,0,0xffff); // Turn off
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseMessages();
+    REQUIRE(CountTxPGN(NMEA2000,127245L)==0); // Nothing sent on turn off
+    NMEA2000.ParseFor(250);
+    REQUIRE(CountTxPGN(NMEA2000,127245L)==0);
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+    REQUIRE(Period==0);
+
+    AddRxIntervalRequest(NMEA2000,127245L,0xfffffffe,0xffff); // Restore default
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+    REQUIRE(Period==50);
+
+    AddRxIntervalRequest(NMEA2000,127245L,10,0xffff); // Too short
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+    REQUIRE(Period==50);
+    REQUIRE(CountTxPGN(NMEA2000,126208L)>=1); // Acknowledge with error
+  }
+
+  SECTION("Group function offset change") {
+    uint32_t DefaultOffset;
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,DefaultOffset));
+
+    AddRxIntervalRequest(NMEA2000,127245L,0xffffffff,3); // Offset 30 ms
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+    REQUIRE(Period==50);
+    REQUIRE(Offset==30);
+
+    AddRxIntervalRequest(NMEA2000,127245L,0xffffffff,0xfffe); // Restore default offset
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.GetPeriodicMsgInterval(127245L,Period,Offset));
+    REQUIRE(Period==50);
+    REQUIRE(Offset==DefaultOffset);
+    REQUIRE(CountTxPGN(NMEA2000,126208L)==0); // No error acknowledge
+    REQUIRE(CountTxPGN(NMEA2000,127245L)==1);
+  }
+
+  SECTION("Remove") {
+    NMEA2000.RemovePeriodicMsg(127245L);
+    REQUIRE_FALSE(NMEA2000.IsPeriodicMsg(127245L));
+    NMEA2000.TxFrames.clear();
+    NMEA2000.ParseFor(250);
+    REQUIRE(CountTxPGN(NMEA2000,127245L)==0);
+    REQUIRE(CountTxPGN(NMEA2000,127250L)>=2);
+  }
+}
+
+//*****************************************************************************
+class tCountingGroupFunctionHandler : public tN2kGroupFunctionHandler {
+public:
+  size_t Requests[2];
+  bool Accept;
+
+  tCountingGroupFunctionHandler(tNMEA2000 *_pNMEA2000, unsigned long _PGN, bool _Accept=true)
+    : tN2kGroupFunctionHandler(_pNMEA2000,_PGN), Accept(_Accept) { Requests[0]=0; Requests[1]=0; }
+
+protected:
+  bool HandleRequest(const tN2kMsg &N2kMsg, uint32_t, uint16_t, uint8_t, int iDev) {
+    if ( PGN==0 && GetPGNForGroupFunction(N2kMsg)!=65300L ) return false;
+    if ( iDev>=0 && iDev<2 ) Requests[iDev]++;
+    return Accept;
+  }
+};
+
+TEST_CASE("Group function handler lookup", "[groupfunction]") {
+  tNMEA2000_Test NMEA2000;
+  tCountingGroupFunctionHandler Rudder(&NMEA2000,127245L);
+  tCountingGroupFunctionHandler Other(&NMEA2000,130310L);
+  tCountingGroupFunctionHandler Proprietary(&NMEA2000,0);
+
+  NMEA2000.SetDeviceCount(2);
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  NMEA2000.AddGroupFunctionHandler(&Proprietary);
+  NMEA2000.AddGroupFunctionHandler(&Other);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+  NMEA2000.AddGroupFunctionHandler(&Rudder); // Added after default handlers
+
+  AddRxIntervalRequest(NMEA2000,127245L,0xffffffff,0xffff,0xff);
+  NMEA2000.ParseMessages();
+  REQUIRE(Rudder.Requests[0]==1);
+  REQUIRE(Rudder.Requests[1]==1);
+  REQUIRE(Other.Requests[0]==0);
+
+  AddRxIntervalRequest(NMEA2000,65300L,0xffffffff,0xffff,NMEA2000.GetN2kSource(1));
+  NMEA2000.ParseMessages();
+  REQUIRE(Proprietary.Requests[0]==0);
+  REQUIRE(Proprietary.Requests[1]==1);
+
+  NMEA2000.RemoveGroupFunctionHandler(&Rudder);
+  AddRxIntervalRequest(NMEA2000,127245L,0xffffffff,0xffff,0xff);
+  NMEA2000.ParseMessages();
+  REQUIRE(Rudder.Requests[0]==1);
+}
+
+//*****************************************************************************
+static const tN2kGroupFunctionField RudderFields[] PROGMEM={
+  { 1,0,8,N2kgff_ReadOnly },
+  { 2,8,3,N2kgff_Writable },
+  { 4,16,16,N2kgff_Writable },
+  { 5,32,16,N2kgff_ReadOnly }
+};
+
+class tRudderFieldHandler : public tN2kGroupFunctionFieldHandler {
+public:
+  double Position;
+  double AngleOrder;
+  tN2kRudderDirectionOrder DirectionOrder;
+
+  tRudderFieldHandler(tNMEA2000 *_pNMEA2000)
+    : tN2kGroupFunctionFieldHandler(_pNMEA2000,127245L,RudderFields,sizeof(RudderFields)/sizeof(RudderFields[0])),
+      Position(0.05), AngleOrder(0.1), DirectionOrder(N2kRDO_NoDirectionOrder) {}
+
+protected:
+  bool GetFieldMsg(tN2kMsg &N2kMsg, int) {
+    SetN2kRudder(N2kMsg,Position,2,DirectionOrder,AngleOrder);
+    return true;
+  }
+  bool SetFieldMsg(const tN2kMsg &N2kMsg, int) {
+    double NewPosition;
+    unsigned char Instance;
+    return ParseN2kRudder(N2kMsg,NewPosition,Instance,DirectionOrder,AngleOrder);
+  }
+};
+
+// Sends message to NMEA2000 as fast packet from source 40
+static void AddRxFastPacket(tNMEA2000_Test &NMEA2000, const tN2kMsg &N2kMsg) {
+  unsigned char buf[8];
+  unsigned long id=((unsigned long)N2kMsg.Priority<<26) | (N2kMsg.PGN<<8) | ((unsigned long)N2kMsg.Destination<<8) | 40;
+  int Index=0;
+  for (unsigned char Frame=0; Index<N2kMsg.DataLen; Frame++) {
+    int Start=0;
+    buf[Start++]=0x60 | Frame;
+    if ( Frame==0 ) buf[Start++]=N2kMsg.DataLen;
+    for (int i=Start; i<8; i++) buf[i]=( Index<N2kMsg.DataLen ? N2kMsg.Data[Index++] : 0xff );
+    NMEA2000.AddRxFrame(id,8,buf);
+  }
+}
+
+// Returns data of fast packet PGN sent by NMEA2000. Skip 0 returns last one.
+static std::vector<unsigned char> GetTxFastPacket(const tNMEA2000_Test &NMEA2000, unsigned long PGN=126208L, size_t Skip=0) {
+  std::vector<std::vector<unsigned char> > Msgs;
+  size_t Len=0;
+  for (size_t i=0; i<NMEA2000.TxFrames.size(); i++) {
+    const tNMEA2000_Test::tFrame &Frame=NMEA2000.TxFrames[i];
+    unsigned long FramePGN=(Frame.id>>8) & 0x3ffff;
+    if ( ((FramePGN>>8) & 0xff)<240 ) FramePGN&=0x3ff00; // PDU1
+    if ( FramePGN!=PGN ) continue;
+    if ( (Frame.buf[0] & 0x1f)==0 ) {
+      Len=Frame.buf[1];
+      Msgs.push_back(std::vector<unsigned char>(Frame.buf+2,Frame.buf+8));
+    } else if ( !Msgs.empty() ) {
+      Msgs.back().insert(Msgs.back().end(),Frame.buf+1,Frame.buf+8);
+    }
+    if ( !Msgs.empty() && Msgs.back().size()>Len ) Msgs.back().resize(Len);
+  }
+  if ( Skip>=Msgs.size() ) return std::vector<unsigned char>();
+  return Msgs[Msgs.size()-1-Skip];
+}
+
+static void StartFieldGroupFunction(tN2kMsg &N2kMsg, tN2kGroupFunctionCode Code, unsigned char Destination,
+                                    uint8_t NumberOfSelectionPairs, uint8_t NumberOfParameterPairs) {
+  N2kMsg.SetPGN(126208L);
+  N2kMsg.Priority=3;
+  N2kMsg.Destination=Destination;
+  N2kMsg.AddByte(Code);
+  N2kMsg.Add3ByteInt(127245L);
+  N2kMsg.AddByte(0xff); // Unique ID
+  N2kMsg.AddByte(NumberOfSelectionPairs);
+  N2kMsg.AddByte(NumberOfParameterPairs);
+}
+
+TEST_CASE("Group function field map", "[groupfunction]") {
+  tNMEA2000_Test NMEA2000;
+  tRudderFieldHandler Rudder(&NMEA2000);
+  tN2kMsg N2kMsg;
+  std::vector<unsigned char> Reply;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  NMEA2000.AddGroupFunctionHandler(&Rudder);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+  NMEA2000.TxFrames.clear();
+
+  SECTION("Read fields") {
+    StartFieldGroupFunction(N2kMsg,N2kgfc_Read,NMEA2000.GetN2kSource(),1,2);
+    N2kMsg.AddByte(1); N2kMsg.AddByte(2); // Instance 2
+    N2kMsg.AddByte(4);
+    N2kMsg.AddByte(5);
+    AddRxFastPacket(NMEA2000,N2kMsg);
+    NMEA2000.ParseMessages();
+
+    const unsigned char Expected[]={ N2kgfc_ReadReply,0x0d,0xf1,0x01,0xff,1,2, 1,2, 4,0xe8,0x03, 5,0xf4,0x01 };
+    Reply=GetTxFastPacket(NMEA2000);
+    REQUIRE(Reply==std::vector<unsigned char>(Expected,Expected+sizeof(Expected)));
+  }
+
+  SECTION("Read fields selection does not match") {
+    StartFieldGroupFunction(N2kMsg,N2kgfc_Read,NMEA2000.GetN2kSource(),1,1);
+    N2kMsg.AddByte(1); N2kMsg.AddByte(3);
+    N2kMsg.AddByte(9); // Unknown field
+    AddRxFastPacket(NMEA2000,N2kMsg);
+    NMEA2000.ParseMessages();
+
+    Reply=GetTxFastPacket(NMEA2000);
+    REQUIRE(Reply.size()==7);
+    REQUIRE(Reply[0]==N2kgfc_Acknowledge);
+    REQUIRE(Reply[5]==2);
+    REQUIRE(Reply[6]==(N2kgfpec_RequestOrCommandParameterOutOfRange | N2kgfpec_InvalidRequestOrCommandParameterField<<4));
+  }
+
+  SECTION("Write fields") {
+    StartFieldGroupFunction(N2kMsg,N2kgfc_Write,NMEA2000.GetN2kSource(),1,2);
+    N2kMsg.AddByte(1); N2kMsg.AddByte(2);
+    N2kMsg.AddByte(2); N2kMsg.AddByte(N2kRDO_MoveToPort);
+    N2kMsg.AddByte(4); N2kMsg.AddByte(0xd0); N2kMsg.AddByte(0x07); // 0.2 rad
+    AddRxFastPacket(NMEA2000,N2kMsg);
+    NMEA2000.ParseMessages();
+
+    REQUIRE(Rudder.AngleOrder==Approx(0.2));
+    REQUIRE(Rudder.DirectionOrder==N2kRDO_MoveToPort);
+    const unsigned char Expected[]={ N2kgfc_WriteReply,0x0d,0xf1,0x01,0xff,1,2, 1,2, 2,N2kRDO_MoveToPort, 4,0xd0,0x07 };
+    Reply=GetTxFastPacket(NMEA2000);
+    REQUIRE(Reply==std::vector<unsigned char>(Expected,Expected+sizeof(Expected)));
+  }
+
+  SECTION("Write read only field") {
+    StartFieldGroupFunction(N2kMsg,N2kgfc_Write,NMEA2000.GetN2kSource(),0,2);
+    N2kMsg.AddByte(4); N2kMsg.AddByte(0xd0); N2kMsg.AddByte(0x07);
+    N2kMsg.AddByte(5); N2kMsg.AddByte(0); N2kMsg.AddByte(0);
+    AddRxFastPacket(NMEA2000,N2kMsg);
+    NMEA2000.ParseMessages();
+
+    REQUIRE(Rudder.AngleOrder==Approx(0.1)); // Nothing written
+    Reply=GetTxFastPacket(NMEA2000);
+    REQUIRE(Reply.size()==7);
+    REQUIRE(Reply[0]==N2kgfc_Acknowledge);
+    REQUIRE(Reply[6]==(N2kgfpec_Acknowledge | N2kgfpec_ReadOrWriteIsNotSupported<<4));
+  }
+}
+
+//*****************************************************************************
+static void AddRxISORequest(tNMEA2000_Test &NMEA2000, unsigned long PGN, unsigned char Destination, unsigned char Source=40) {
+  unsigned char buf[3]={(unsigned char)PGN,(unsigned char)(PGN>>8),(unsigned char)(PGN>>16)};
+  NMEA2000.AddRxFrame((6UL<<26) | (0xea00UL<<8) | ((unsigned long)Destination<<8) | Source,3,buf);
+}
+
+static bool ContainsString(const std::vector<unsigned char> &Data, const char *str) {
+  return std::search(Data.begin(),Data.end(),str,str+strlen(str))!=Data.end();
+}
+
+TEST_CASE("Cached information responses", "[responsecache]") {
+  tNMEA2000_Test NMEA2000;
+  std::vector<unsigned char> First;
+
+  NMEA2000.SetDeviceCount(2);
+  NMEA2000.SetProductInformation("SERIAL-A",100,"Model",NULL,NULL,1,2100,1,0);
+  NMEA2000.SetConfigurationInformation("Manufacturer","Install-A");
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+
+  SECTION("Product information") {
+    AddRxISORequest(NMEA2000,126996L,NMEA2000.GetN2kSource(1));
+    NMEA2000.ParseFor(100); // Coalesce time
+    First=GetTxFastPacket(NMEA2000,126996L);
+    REQUIRE(First.size()==134);
+    REQUIRE(ContainsString(First,"SERIAL-A")); // Device 1 uses device 0 information
+
+    NMEA2000.TxFrames.clear();
+    AddRxISORequest(NMEA2000,126996L,NMEA2000.GetN2kSource(1));
+    NMEA2000.ParseFor(100); // Coalesce time
+    REQUIRE(GetTxFastPacket(NMEA2000,126996L)==First);
+
+    NMEA2000.SetProductInformation("SERIAL-B",100,"Model",NULL,NULL,1,2100,1,0);
+    NMEA2000.TxFrames.clear();
+    AddRxISORequest(NMEA2000,126996L,NMEA2000.GetN2kSource(1));
+    NMEA2000.ParseFor(100); // Coalesce time
+    REQUIRE(ContainsString(GetTxFastPacket(NMEA2000,126996L),"SERIAL-B"));
+  }
+
+  SECTION("Configuration information") {
+    AddRxISORequest(NMEA2000,126998L,NMEA2000.GetN2kSource());
+    NMEA2000.ParseFor(100); // Coalesce time
+    First=GetTxFastPacket(NMEA2000,126998L);
+    REQUIRE(ContainsString(First,"Install-A"));
+
+    NMEA2000.TxFrames.clear();
+    AddRxISORequest(NMEA2000,126998L,NMEA2000.GetN2kSource());
+    NMEA2000.ParseFor(100); // Coalesce time
+    REQUIRE(GetTxFastPacket(NMEA2000,126998L)==First);
+
+    NMEA2000.SetInstallationDescription1("Install-B");
+    NMEA2000.TxFrames.clear();
+    AddRxISORequest(NMEA2000,126998L,NMEA2000.GetN2kSource());
+    NMEA2000.ParseFor(100); // Coalesce time
+    REQUIRE(ContainsString(GetTxFastPacket(NMEA2000,126998L),"Install-B"));
+  }
+
+  SECTION("PGN list") {
+    static const unsigned long TransmitMessages[]={ 127245L, 0 };
+    AddRxISORequest(NMEA2000,126464L,NMEA2000.GetN2kSource());
+    NMEA2000.ParseMessages();
+    First=GetTxFastPacket(NMEA2000,126464L); // Last one is receive list
+    REQUIRE(First[0]==N2kpgnl_receive);
+
+    NMEA2000.ExtendTransmitMessages(TransmitMessages);
+    NMEA2000.TxFrames.clear();
+    AddRxISORequest(NMEA2000,126464L,NMEA2000.GetN2kSource());
+    NMEA2000.ParseMessages();
+    REQUIRE(GetTxFastPacket(NMEA2000,126464L)==First);
+    std::vector<unsigned char> Transmit=GetTxFastPacket(NMEA2000,126464L,1);
+    REQUIRE(Transmit[0]==N2kpgnl_transmit);
+    const unsigned char Rudder[]={ 0x0d,0xf1,0x01 };
+    REQUIRE(std::search(Transmit.begin(),Transmit.end(),Rudder,Rudder+3)!=Transmit.end());
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("ISO request coalescing", "[isorequest]") {
+  tNMEA2000_Test NMEA2000;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+  NMEA2000.TxFrames.clear();
+  NMEA2000.ResetStats();
+
+  SECTION("Power up storm") {
+    for (unsigned char Source=30; Source<35; Source++) {
+      AddRxISORequest(NMEA2000,126996L,0xff,Source);
+      AddRxISORequest(NMEA2000,126996L,NMEA2000.GetN2kSource(),Source);
+      AddRxISORequest(NMEA2000,60928L,0xff,Source);
+    }
+    NMEA2000.ParseMessages();
+    REQUIRE(NMEA2000.TxFrames.empty()); // Held for coalescing
+    NMEA2000.ParseFor(100);
+    REQUIRE(CountTxPGN(NMEA2000,126996L)==20); // One fast packet message
+    REQUIRE(CountTxPGN(NMEA2000,60928L)==1);
+    REQUIRE(NMEA2000.GetStats().ISORequestsCoalesced==13);
+
+    // Next request after response will be responded again
+    AddRxISORequest(NMEA2000,126996L,0xff,30);
+    NMEA2000.ParseFor(100);
+    REQUIRE(CountTxPGN(NMEA2000,126996L)==40);
+  }
+
+  SECTION("Disabled") {
+    NMEA2000.SetISORequestCoalesceTime(0);
+    AddRxISORequest(NMEA2000,60928L,0xff,30);
+    AddRxISORequest(NMEA2000,60928L,0xff,31);
+    NMEA2000.ParseMessages();
+    REQUIRE(CountTxPGN(NMEA2000,60928L)==2);
+    REQUIRE(NMEA2000.GetStats().ISORequestsCoalesced==0);
+  }
+}
+
+//*****************************************************************************
+static const unsigned long UnsortedTransmitMessages[] PROGMEM={ 129029L, 127245L, 126996L, 129029L, 127250L, 0 };
+
+static unsigned char FirstFrameSequence(const tNMEA2000_Test &NMEA2000, unsigned long PGN, size_t Skip=0) {
+  for (size_t i=NMEA2000.TxFrames.size(); i>0; i--) {
+    const tNMEA2000_Test::tFrame &Frame=NMEA2000.TxFrames[i-1];
+    if ( ((Frame.id>>8) & 0x3ffff)!=PGN || (Frame.buf[0] & 0x1f)!=0 ) continue;
+    if ( Skip--==0 ) return Frame.buf[0]>>5;
+  }
+  return 0xff;
+}
+
+TEST_CASE("Transmit PGN table", "[pgntable]") {
+  tNMEA2000_Test NMEA2000;
+  tN2kMsg N2kMsg;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  NMEA2000.ExtendTransmitMessages(UnsortedTransmitMessages);
+  NMEA2000.SetISORequestCoalesceTime(0);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+  NMEA2000.TxFrames.clear();
+
+  REQUIRE(NMEA2000.IsTxPGN(129029L));
+  REQUIRE(NMEA2000.IsTxPGN(127250L));
+  REQUIRE(NMEA2000.IsTxPGN(59392L)); // Default list
+  REQUIRE_FALSE(NMEA2000.IsTxPGN(129025L));
+
+  AddRxISORequest(NMEA2000,126464L,NMEA2000.GetN2kSource());
+  NMEA2000.ParseMessages();
+  std::vector<unsigned char> List=GetTxFastPacket(NMEA2000,126464L,1);
+  REQUIRE(List.size()>1);
+  REQUIRE(List[0]==N2kpgnl_transmit);
+  REQUIRE((List.size()-1)%3==0);
+  unsigned long LastPGN=0;
+  for (size_t i=1; i<List.size(); i+=3) { // Sorted without duplicates
+    unsigned long PGN=List[i] | (List[i+1]<<8) | ((unsigned long)List[i+2]<<16);
+    REQUIRE(PGN>LastPGN);
+    LastPGN=PGN;
+  }
+
+  // Each listed fast packet PGN has own sequence counter
+  SetN2kGNSS(N2kMsg,1,19000,43200,60.1,22.5,10.0,N2kGNSSt_GPS,N2kGNSSm_GNSSfix,12,0.8);
+  NMEA2000.SendMsg(N2kMsg);
+  NMEA2000.SendMsg(N2kMsg);
+  REQUIRE(FirstFrameSequence(NMEA2000,129029L,1)==0);
+  REQUIRE(FirstFrameSequence(NMEA2000,129029L)==1);
+  SetN2kPGN129540(N2kMsg); // Not on list, uses common counter
+  NMEA2000.SendMsg(N2kMsg);
+  REQUIRE(FirstFrameSequence(NMEA2000,129540L)==0);
+  SetN2kGNSS(N2kMsg,1,19000,43200,60.1,22.5,10.0,N2kGNSSt_GPS,N2kGNSSm_GNSSfix,12,0.8);
+  NMEA2000.SendMsg(N2kMsg);
+  REQUIRE(FirstFrameSequence(NMEA2000,129029L)==2);
+}
+
+TEST_CASE("Default PGN table", "[pgntable]") {
+  tNMEA2000_Test NMEA2000;
+  tN2kMsg N2kMsg;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_NodeOnly,22);
+  NMEA2000.SetISORequestCoalesceTime(0);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Address claim
+  NMEA2000.TxFrames.clear();
+
+  // Default list is used directly
+  REQUIRE(NMEA2000.IsTxPGN(59392L));
+  REQUIRE(NMEA2000.IsTxPGN(126998L));
+  REQUIRE_FALSE(NMEA2000.IsTxPGN(129029L));
+
+  AddRxISORequest(NMEA2000,126464L,NMEA2000.GetN2kSource());
+  NMEA2000.ParseMessages();
+  std::vector<unsigned char> List=GetTxFastPacket(NMEA2000,126464L,1);
+  REQUIRE(List.size()>1);
+  REQUIRE(List[0]==N2kpgnl_transmit);
+  unsigned long LastPGN=0;
+  for (size_t i=1; i+2<List.size(); i+=3) {
+    unsigned long PGN=List[i] | (List[i+1]<<8) | ((unsigned long)List[i+2]<<16);
+    REQUIRE(PGN>LastPGN);
+    REQUIRE(NMEA2000.IsTxPGN(PGN));
+    LastPGN=PGN;
+  }
+
+  // PGNs not on list share common counter
+  SetN2kGNSS(N2kMsg,1,19000,43200,60.1,22.5,10.0,N2kGNSSt_GPS,N2kGNSSm_GNSSfix,12,0.8);
+  NMEA2000.SendMsg(N2kMsg);
+  SetN2kPGN129540(N2kMsg);
+  NMEA2000.SendMsg(N2kMsg);
+  REQUIRE(FirstFrameSequence(NMEA2000,129029L)==0);
+  REQUIRE(FirstFrameSequence(NMEA2000,129540L)==1);
+
+  // List set at runtime will be merged to default list
+  NMEA2000.ExtendTransmitMessages(UnsortedTransmitMessages);
+  REQUIRE(NMEA2000.IsTxPGN(129029L));
+  REQUIRE(NMEA2000.IsTxPGN(126998L));
+}
+
+//*****************************************************************************
+class tTxCounter : public tNMEA2000::tFrameMonitor {
+public:
+  size_t TxCount;
+  tTxCounter() : TxCount(0) {}
+  void HandleFrame(unsigned long /*id*/, unsigned char /*len*/, const unsigned char * /*buf*/, bool Tx, uint64_t /*FrameTime*/) {
+    if ( Tx ) TxCount++;
+  }
+};
+
+TEST_CASE("Frame monitor", "[monitor]") {
+  tNMEA2000_Test NMEA2000;
+  tTxCounter Monitor;
+  tN2kMsg N2kMsg;
+
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode,22);
+  REQUIRE(NMEA2000.OpenAndWait());
+  NMEA2000.ParseFor(300); // Wait address claim to finish
+  NMEA2000.SetFrameMonitor(&Monitor);
+  SetN2kRudder(N2kMsg,0.1);
+
+  // Buffered frames will be reported, when they are handed to driver
+  NMEA2000.TxBlocked=true;
+  REQUIRE(NMEA2000.SendMsg(N2kMsg));
+  REQUIRE(NMEA2000.SendMsg(N2kMsg));
+  REQUIRE(Monitor.TxCount==0);
+  NMEA2000.TxBlocked=false;
+  NMEA2000.ParseMessages();
+  REQUIRE(Monitor.TxCount==2);
+  REQUIRE(NMEA2000.SendMsg(N2kMsg));
+  REQUIRE(Monitor.TxCount==3);
+}
+
+#if defined(N2K_FRAME_TIMESTAMP)
+//*****************************************************************************
+static uint64_t RxFirstFrameTime=0;
+static uint64_t RxLastFrameTime=0;
+
+static void HandleTimestampedMsg(const tN2kMsg &N2kMsg) {
+  if ( N2kMsg.PGN!=129029L ) return;
+  RxFirstFrameTime=N2kMsg.FirstFrameTime;
+  RxLastFrameTime=N2kMsg.LastFrameTime;
+}
+
+TEST_CASE("Frame timestamps", "[timestamp]") {
+  tNMEA2000_Test NMEA2000;
+  unsigned char buf[8]={0x20,20,1,2,3,4,5,6}; // Fast packet GNSS position data, 20 bytes = 3 frames
+
+  NMEA2000.SetMsgHandler(HandleTimestampedMsg);
+  NMEA2000.SetMode(tNMEA2000::N2km_ListenOnly);
+  REQUIRE(NMEA2000.OpenAndWait());
+
+  unsigned long id=(3UL<<26) | (129029UL<<8) | 40;
+  NMEA2000.AddRxFrame(id,8,buf,1000000);
+  buf[0]=0x21; NMEA2000.AddRxFrame(id,8,buf,1000500);
+  buf[0]=0x22; NMEA2000.AddRxFrame(id,8,buf,1001250);
+  NMEA2000.ParseMessages();
+
+  REQUIRE(RxFirstFrameTime==1000000);
+  REQUIRE(RxLastFrameTime==1001250);
+}
+#endif
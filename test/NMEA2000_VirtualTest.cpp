@@ -0,0 +1,208 @@
+#include <catch.hpp>
+#include <NMEA2000_Virtual.h>
+#include <N2kMessages.h>
+#include <N2kTimer.h>
+#include <vector>
+#include <algorithm>
+
+static std::vector<unsigned long> ReceivedPGNs;
+
+static void HandleMsg(const tN2kMsg &N2kMsg) {
+  ReceivedPGNs.push_back(N2kMsg.PGN);
+}
+
+//*****************************************************************************
+static void SetupNode(tNMEA2000_Virtual &Node, unsigned long UniqueNumber, unsigned char Source) {
+  Node.SetDeviceInformation(UniqueNumber,130,25,2046);
+  Node.SetMode(tNMEA2000::N2km_ListenAndNode,Source);
+  Node.EnableForward(false);
+}
+
+//*****************************************************************************
+// Runs nodes for ms simulated milliseconds in 100 us steps.
+static void ParseAll(tN2kVirtualClock &Clock, tNMEA2000_Virtual *Nodes, size_t Count, uint32_t ms) {
+  for (uint32_t Step=0; Step<ms*10; Step++) {
+    Clock.Advance(100);
+    for (size_t i=0; i<Count; i++) Nodes[i].ParseMessages();
+  }
+}
+
+//*****************************************************************************
+TEST_CASE("Virtual bus frame length", "[virtualbus]") {
+  unsigned char Zero[8]={0,0,0,0,0,0,0,0};
+  unsigned char Alternating[8]={0x55,0x55,0x55,0x55,0x55,0x55,0x55,0x55};
+
+  // Without stuffing extended frame is 67 bits + data
+  REQUIRE(tN2kVirtualBus::FrameBitCount(0x15555555,8,Alternating)>=131);
+  REQUIRE(tN2kVirtualBus::FrameBitCount(0x15555555,8,Alternating)<tN2kVirtualBus::FrameBitCount(0,8,Zero));
+  // Worst case stuffing adds one bit per four
+  REQUIRE(tN2kVirtualBus::FrameBitCount(0,8,Zero)<=131+(54+64)/4);
+}
+
+//*****************************************************************************
+TEST_CASE("Virtual bus address claim", "[virtualbus]") {
+  tN2kVirtualClock Clock;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[3];
+
+  for (size_t i=0; i<3; i++) {
+    Nodes[i].SetBus(&Bus);
+    SetupNode(Nodes[i],1000+i,22); // All try to claim same address
+    Nodes[i].Open();
+  }
+  ParseAll(Clock,Nodes,3,1000);
+
+  REQUIRE(Nodes[0].GetN2kSource()!=Nodes[1].GetN2kSource());
+  REQUIRE(Nodes[0].GetN2kSource()!=Nodes[2].GetN2kSource());
+  REQUIRE(Nodes[1].GetN2kSource()!=Nodes[2].GetN2kSource());
+  REQUIRE(Bus.GetFrameCount()>=6);
+  REQUIRE(Bus.GetBusyTime()>=Bus.GetFrameCount()*131*4);
+}
+
+//*****************************************************************************
+TEST_CASE("Virtual bus arbitration and injection", "[virtualbus]") {
+  tN2kVirtualClock Clock;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[3];
+  tN2kMsg N2kMsg;
+
+  for (size_t i=0; i<3; i++) {
+    Nodes[i].SetBus(&Bus);
+    SetupNode(Nodes[i],2000+i,30+i);
+    Nodes[i].Open();
+  }
+  Nodes[2].SetMsgHandler(HandleMsg);
+  ParseAll(Clock,Nodes,3,500);
+  ReceivedPGNs.clear();
+
+  SECTION("Lowest id wins") {
+    SetN2kSystemTime(N2kMsg,1,19000,0); // Priority 3, occupies the bus
+    Nodes[0].SendMsg(N2kMsg);
+    Clock.Advance(10);
+    SetN2kTemperature(N2kMsg,1,1,N2kts_MainCabinTemperature,293.0); // Priority 6
+    Nodes[0].SendMsg(N2kMsg);
+    SetN2kRudder(N2kMsg,0.1); // Priority 2
+    Nodes[1].SendMsg(N2kMsg);
+    ParseAll(Clock,Nodes,3,50);
+
+    REQUIRE(ReceivedPGNs.size()==3);
+    REQUIRE(ReceivedPGNs[0]==126992L);
+    REQUIRE(ReceivedPGNs[1]==127245L);
+    REQUIRE(ReceivedPGNs[2]==130312L);
+  }
+
+  SECTION("Errors are retransmitted") {
+    Bus.SetRandomSeed(1);
+    Bus.SetErrorRate(0.5);
+    for (int i=0; i<10; i++) {
+      SetN2kRudder(N2kMsg,0.01*i);
+      Nodes[0].SendMsg(N2kMsg);
+      ParseAll(Clock,Nodes,3,5);
+    }
+    ParseAll(Clock,Nodes,3,50);
+
+    REQUIRE(ReceivedPGNs.size()==10);
+    REQUIRE(Bus.GetErrorCount()>0);
+  }
+
+  SECTION("Drops are lost") {
+    Bus.SetRandomSeed(1);
+    Bus.SetDropRate(1.0);
+    SetN2kRudder(N2kMsg,0.1);
+    Nodes[0].SendMsg(N2kMsg);
+    ParseAll(Clock,Nodes,3,50);
+
+    REQUIRE(ReceivedPGNs.empty());
+    REQUIRE(Bus.GetDropCount()==2);
+  }
+}
+
+//*****************************************************************************
+static std::vector<uint64_t> RudderTimes;
+static size_t ClaimCount;
+
+static void HandleRestartMsg(const tN2kMsg &N2kMsg) {
+  if ( N2kMsg.PGN==127245L ) RudderTimes.push_back(N2kMillis64());
+  if ( N2kMsg.PGN==60928L && N2kMsg.Source==30 ) ClaimCount++;
+}
+
+//*****************************************************************************
+// Node 0 sends rudder every 10 ms and restarts in middle. Returns longest
+// gap between rudder messages received by node 1.
+static uint64_t MeasureRestartGap(tN2kVirtualClock &Clock, tNMEA2000_Virtual *Nodes, tNMEA2000::tRestartMode Mode) {
+  tN2kMsg N2kMsg;
+
+  RudderTimes.clear();
+  ClaimCount=0;
+  for (int i=0; i<60; i++) {
+    if ( i==20 ) Nodes[0].Restart(Mode);
+    SetN2kRudder(N2kMsg,0.01*i);
+    Nodes[0].SendMsg(N2kMsg);
+    ParseAll(Clock,Nodes,2,10);
+  }
+
+  uint64_t Gap=0;
+  for (size_t i=1; i<RudderTimes.size(); i++) {
+    if ( RudderTimes[i]-RudderTimes[i-1]>Gap ) Gap=RudderTimes[i]-RudderTimes[i-1];
+  }
+  return Gap;
+}
+
+//*****************************************************************************
+// Node 1 restarts between second and last frame of fast packet.
+static void RestartDuringFastPacket(tN2kVirtualClock &Clock, tNMEA2000_Virtual *Nodes, tNMEA2000::tRestartMode Mode) {
+  unsigned char First[8]={0x40,18,0x01,0x02,0x03,0x04,0x05,0x06};
+  unsigned char Next[8]={0x41,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d};
+  unsigned char Last[8]={0x42,0x0e,0x0f,0x10,0x11,0x12,0xff,0xff};
+  unsigned long Id=(3UL<<26) | (129029UL<<8) | 50; // GNSS from 50
+
+  Nodes[1].SetMsgHandler(HandleMsg);
+  ReceivedPGNs.clear();
+  Nodes[1].InjectFrame(Id,8,First);
+  Nodes[1].InjectFrame(Id,8,Next);
+  ParseAll(Clock,Nodes,2,1);
+  Nodes[1].Restart(Mode);
+  ParseAll(Clock,Nodes,2,10);
+  Nodes[1].InjectFrame(Id,8,Last);
+  ParseAll(Clock,Nodes,2,1);
+}
+
+//*****************************************************************************
+TEST_CASE("Virtual bus warm restart", "[virtualbus]") {
+  tN2kVirtualClock Clock;
+  tN2kVirtualBus Bus;
+  tNMEA2000_Virtual Nodes[2];
+
+  for (size_t i=0; i<2; i++) {
+    Nodes[i].SetBus(&Bus);
+    SetupNode(Nodes[i],3000+i,30+i);
+    Nodes[i].Open();
+  }
+  Nodes[1].SetMsgHandler(HandleRestartMsg);
+  ParseAll(Clock,Nodes,2,500);
+  REQUIRE(Nodes[0].GetN2kSource()==30);
+
+  SECTION("Cold restart blocks sending during address claim") {
+    uint64_t Gap=MeasureRestartGap(Clock,Nodes,tNMEA2000::rm_Cold);
+    REQUIRE(Gap>=200);
+    REQUIRE(ClaimCount==1);
+  }
+
+  SECTION("Warm restart continues immediately") {
+    uint64_t Gap=MeasureRestartGap(Clock,Nodes,tNMEA2000::rm_Warm);
+    REQUIRE(Gap<=20);
+    REQUIRE(RudderTimes.size()==60);
+    REQUIRE(ClaimCount==1);
+    REQUIRE(Nodes[0].GetN2kSource()==30);
+  }
+
+  SECTION("Warm restart keeps partially received fast packet") {
+    RestartDuringFastPacket(Clock,Nodes,tNMEA2000::rm_Warm);
+    REQUIRE(std::count(ReceivedPGNs.begin(),ReceivedPGNs.end(),129029UL)==1);
+  }
+
+  SECTION("Cold restart drops partially received fast packet") {
+    RestartDuringFastPacket(Clock,Nodes,tNMEA2000::rm_Cold);
+    REQUIRE(std::count(ReceivedPGNs.begin(),ReceivedPGNs.end(),129029UL)==0);
+  }
+}